@@ -49,6 +49,9 @@
 
 #include "app_simple_server.h"
 #include "simple_server.h"
+#include "app_link.h"
+#include "app_bcast.h"
+#include "app_coc.h"
 
 #if (BLE_APP_DIS)
 #include "app_dis.h"                 // Device Information Service Application Definitions
@@ -269,6 +272,19 @@ void appm_init(void)
     app_simple_server_init();
     #endif //(BLE_APP_SIMPLE_SERVER)
 
+    // Link setup Module
+    app_link_init();
+
+    #if (BLE_APP_BCAST)
+    // Summary broadcast Module
+    app_bcast_init();
+    #endif //(BLE_APP_BCAST)
+
+    #if (BLE_APP_COC)
+    // CoC transport Module
+    app_coc_init();
+    #endif //(BLE_APP_COC)
+
     // Reset the stack
     appm_send_gapm_reset_cmd();
 
@@ -334,7 +350,7 @@ bool appm_add_svc(void)
 void appm_disconnect(uint8_t conidx)
 {
     struct gapc_disconnect_cmd *cmd = KE_MSG_ALLOC(GAPC_DISCONNECT_CMD,
-                                                   KE_BUILD_ID(TASK_GAPC, app_env.conidx), TASK_APP,
+                                                   KE_BUILD_ID(TASK_GAPC, conidx), TASK_APP,
                                                    gapc_disconnect_cmd);
 
     cmd->operation = GAPC_DISCONNECT;
@@ -344,11 +360,11 @@ void appm_disconnect(uint8_t conidx)
     ke_msg_send(cmd);
 }
 
-void appm_update_param(struct gapc_conn_param *conn_param)
+void appm_update_param(uint8_t conidx, struct gapc_conn_param *conn_param)
 {
     // Prepare the GAPC_PARAM_UPDATE_CMD message
     struct gapc_param_update_cmd *cmd = KE_MSG_ALLOC(GAPC_PARAM_UPDATE_CMD,
-                                                     KE_BUILD_ID(TASK_GAPC, app_env.conidx), TASK_APP,
+                                                     KE_BUILD_ID(TASK_GAPC, conidx), TASK_APP,
                                                      gapc_param_update_cmd);
 
     cmd->operation  = GAPC_UPDATE_PARAMS;
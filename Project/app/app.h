@@ -102,10 +102,12 @@ struct app_subtask_handlers
 ///Application environment structure
 struct app_env_tag
 {
-    /// Connection handle
+    /// Connection handle of the latest connection
     uint16_t conhdl;
-    /// Connection Index
+    /// Connection Index of the latest connection
     uint8_t  conidx;
+    /// Number of established connections
+    uint8_t  con_nb;
 
     /// Last initialized profile
     uint8_t next_svc;
@@ -153,11 +155,12 @@ bool appm_add_svc(void);
 /**
  ****************************************************************************************
  * @brief Send to request to update the connection parameters
+ * @param[in] conidx: the connect index.
  * @param[in] conn_param: the connect param. see struct gapc_conn_param
  * @return void.
  ****************************************************************************************
  */
-void appm_update_param(struct gapc_conn_param *conn_param);
+void appm_update_param(uint8_t conidx, struct gapc_conn_param *conn_param);
 
 /**
  ****************************************************************************************
@@ -0,0 +1,589 @@
+/**
+ ****************************************************************************************
+ *
+ * @file app_bcast.c
+ *
+ * @brief Connectionless telemetry: EMG, stimulation and battery summaries broadcast in
+ *        a non-connectable extended (or periodic) advertising set
+ *
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP_BCAST_C app_bcast.c
+ * @ingroup APP_COMMON
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h"     // SW configuration
+
+#if (BLE_APP_BCAST)
+
+#include "app_bcast.h"               // Broadcast Definitions
+#include "app_adv.h"                 // Connectable advertising state
+#include "app.h"                     // Application Definitions
+#include "app_task.h"                // application task definitions
+#include "gapm_task.h"               // GAP Manager Task API
+#include "gap.h"
+#include "co_debug.h"
+#include "co.h"
+#include "handler.h"                 // bcast_summary_fill
+#include <string.h>
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// Manufacturer specific data header: length, AD type, company identifier
+#define APP_BCAST_AD_HDR_LEN        4
+
+/// Summary set state, the pending operation is kept apart in op
+enum app_bcast_state
+{
+    /// No activity
+    APP_BCAST_STATE_IDLE,
+    /// Activity created, not advertising
+    APP_BCAST_STATE_CREATED,
+    /// Advertising
+    APP_BCAST_STATE_STARTED,
+};
+
+/// Broadcast environment
+struct app_bcast_env_tag
+{
+    /// @see enum app_bcast_mode
+    uint8_t mode;
+    /// @see enum app_bcast_state
+    uint8_t state;
+    /// Pending GAPM operation, 0 if none
+    uint8_t op;
+    /// Activity index of the summary set, valid out of APP_BCAST_STATE_IDLE
+    uint8_t actv_idx;
+    /// Advertising data of the summary set is set
+    bool data_set;
+    /// Summary changed since the data was set
+    bool dirty;
+    /// Updates left before a failed create is tried again
+    uint8_t retry;
+    /// Summary sequence number, incremented on every change
+    uint8_t seq;
+    /// Update interval (unit 100ms)
+    uint8_t update_intv;
+    /// Connectable advertising to restart once the summary set is gone
+    bool adv_restart;
+    /// Broadcast only: connectable window, the summary set gives its activity back
+    bool conn_window;
+    /// Broadcast only: time in the current summary or connectable window (unit ms)
+    uint32_t window_time;
+    /// Update timer
+    bool timer_on;
+    co_timer_t timer;
+    /// Manufacturer specific data: header + summary frame
+    uint8_t data_len;
+    uint8_t data[APP_BCAST_AD_HDR_LEN + APP_BCAST_FRAME_MAX];
+    /// Last summary built with sequence number 0, to detect a change
+    uint8_t last_len;
+    uint8_t last[APP_BCAST_FRAME_MAX];
+};
+
+/*
+ * LOCAL VARIABLE DEFINITIONS
+ ****************************************************************************************
+ */
+
+static struct app_bcast_env_tag app_bcast_env;
+
+/*
+ * LOCAL FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+
+static void app_bcast_next(void);
+
+/**
+ ****************************************************************************************
+ * @brief Connectable set with a GAPM operation in progress
+ ****************************************************************************************
+ */
+static bool app_bcast_adv_busy(void)
+{
+    switch (appm_adv_get_state())
+    {
+        case (APP_ADV_STATE_IDLE):
+        case (APP_ADV_STATE_CREATED):
+        case (APP_ADV_STATE_STARTED):
+            return false;
+        default:
+            return true;
+    }
+}
+
+/**
+ ****************************************************************************************
+ * @brief An activity is free for the summary set
+ *
+ * Counts the links, the connectable set and, while connectable advertising goes on, the
+ * activity the next link will take.
+ ****************************************************************************************
+ */
+static bool app_bcast_actv_free(void)
+{
+    uint8_t used = app_env.con_nb;
+
+    if (appm_adv_get_state() != APP_ADV_STATE_IDLE)
+    {
+        used++;
+    }
+    if (app_bcast_env.mode != APP_BCAST_MODE_ONLY && app_env.con_nb < BLE_CONNECTION_MAX)
+    {
+        used++;
+    }
+
+    return (used < BLE_ACTIVITY_MAX);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Rebuild the summary, the sequence number only moves when it changed
+ ****************************************************************************************
+ */
+static void app_bcast_build(void)
+{
+    uint8_t frame[APP_BCAST_FRAME_MAX];
+    uint8_t len = bcast_summary_fill(frame, 0);
+
+    if (app_bcast_env.data_len != 0 && len == app_bcast_env.last_len
+        && memcmp(frame, app_bcast_env.last, len) == 0)
+    {
+        return;
+    }
+    memcpy(app_bcast_env.last, frame, len);
+    app_bcast_env.last_len = len;
+
+    app_bcast_env.data[0] = APP_BCAST_AD_HDR_LEN - 1 + len;
+    app_bcast_env.data[1] = GAP_AD_TYPE_MANU_SPECIFIC_DATA;
+    app_bcast_env.data[2] = APP_BCAST_COMPANY_ID & 0xFF;
+    app_bcast_env.data[3] = APP_BCAST_COMPANY_ID >> 8;
+    app_bcast_env.data_len = APP_BCAST_AD_HDR_LEN + bcast_summary_fill(&app_bcast_env.data[APP_BCAST_AD_HDR_LEN], ++app_bcast_env.seq);
+    app_bcast_env.dirty = true;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Broadcast only without a link: switch between the summary set and a connectable
+ *        window, so the device never stays unreachable until reset
+ ****************************************************************************************
+ */
+static void app_bcast_window_update(void)
+{
+    if (app_bcast_env.mode != APP_BCAST_MODE_ONLY || app_env.con_nb != 0)
+    {
+        app_bcast_env.conn_window = false;
+        app_bcast_env.window_time = 0;
+        return;
+    }
+
+    app_bcast_env.window_time += app_bcast_env.update_intv * 100;
+    if (app_bcast_env.window_time >= (app_bcast_env.conn_window ? APP_BCAST_ONLY_CONN_TIME : APP_BCAST_ONLY_BCAST_TIME))
+    {
+        app_bcast_env.conn_window = !app_bcast_env.conn_window;
+        app_bcast_env.window_time = 0;
+        log_debug("bcast conn window %d\n", app_bcast_env.conn_window);
+    }
+}
+
+static void app_bcast_create(void)
+{
+    struct gapm_activity_create_adv_cmd *p_cmd = KE_MSG_ALLOC(GAPM_ACTIVITY_CREATE_CMD,
+                                                              TASK_GAPM, TASK_APP,
+                                                              gapm_activity_create_adv_cmd);
+
+    p_cmd->operation = GAPM_CREATE_ADV_ACTIVITY;
+    p_cmd->own_addr_type = GAPM_STATIC_ADDR;
+#if (APP_BCAST_PERIODIC)
+    p_cmd->adv_param.type = GAPM_ADV_TYPE_PERIODIC;
+    p_cmd->adv_param.period_cfg.adv_intv_min = APP_BCAST_PER_ADV_INTV;
+    p_cmd->adv_param.period_cfg.adv_intv_max = APP_BCAST_PER_ADV_INTV;
+#else
+    p_cmd->adv_param.type = GAPM_ADV_TYPE_EXTENDED;
+#endif
+    p_cmd->adv_param.prop = GAPM_EXT_ADV_PROP_NON_CONN_NON_SCAN_MASK;
+    p_cmd->adv_param.disc_mode = GAPM_ADV_MODE_BEACON;
+    p_cmd->adv_param.filter_pol = ADV_ALLOW_SCAN_ANY_CON_ANY;
+    p_cmd->adv_param.max_tx_pwr = 0;
+    p_cmd->adv_param.prim_cfg.chnl_map = 0x07;
+    p_cmd->adv_param.prim_cfg.phy = GAP_PHY_LE_1MBPS;
+    p_cmd->adv_param.prim_cfg.adv_intv_min = APP_BCAST_ADV_INTV;
+    p_cmd->adv_param.prim_cfg.adv_intv_max = APP_BCAST_ADV_INTV;
+    p_cmd->adv_param.second_cfg.max_skip = 0;
+    p_cmd->adv_param.second_cfg.phy = GAP_PHY_LE_1MBPS;
+    p_cmd->adv_param.second_cfg.adv_sid = APP_BCAST_ADV_SID;
+
+    ke_msg_send(p_cmd);
+    app_bcast_env.op = GAPM_CREATE_ADV_ACTIVITY;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Set the summary as advertising data, also while the set is advertising
+ *
+ * A periodic set gets the manufacturer header alone as extended data once, so scanners
+ * can find it, then the summary in every periodic train.
+ ****************************************************************************************
+ */
+static void app_bcast_set_data(void)
+{
+    uint8_t operation = GAPM_SET_ADV_DATA;
+    uint8_t len = app_bcast_env.data_len;
+
+#if (APP_BCAST_PERIODIC)
+    if (app_bcast_env.data_set)
+    {
+        operation = GAPM_SET_PERIOD_ADV_DATA;
+    }
+    else
+    {
+        len = APP_BCAST_AD_HDR_LEN;
+    }
+#endif
+
+    struct gapm_set_adv_data_cmd *p_cmd = KE_MSG_ALLOC_DYN(GAPM_SET_ADV_DATA_CMD,
+                                                           TASK_GAPM, TASK_APP,
+                                                           gapm_set_adv_data_cmd,
+                                                           len);
+
+    p_cmd->operation = operation;
+    p_cmd->actv_idx = app_bcast_env.actv_idx;
+    p_cmd->length = len;
+    memcpy(p_cmd->data, app_bcast_env.data, len);
+#if (APP_BCAST_PERIODIC)
+    if (!app_bcast_env.data_set)
+    {
+        p_cmd->data[0] = APP_BCAST_AD_HDR_LEN - 1;
+    }
+#endif
+
+    ke_msg_send(p_cmd);
+    app_bcast_env.op = operation;
+    if (operation == GAPM_SET_ADV_DATA)
+    {
+        app_bcast_env.dirty = false;
+    }
+}
+
+static void app_bcast_start(void)
+{
+    struct gapm_activity_start_cmd *p_cmd = KE_MSG_ALLOC(GAPM_ACTIVITY_START_CMD,
+                                                         TASK_GAPM, TASK_APP,
+                                                         gapm_activity_start_cmd);
+
+    p_cmd->operation = GAPM_START_ACTIVITY;
+    p_cmd->actv_idx = app_bcast_env.actv_idx;
+    p_cmd->u_param.adv_add_param.duration = 0;
+    p_cmd->u_param.adv_add_param.max_adv_evt = 0;
+
+    ke_msg_send(p_cmd);
+    app_bcast_env.op = GAPM_START_ACTIVITY;
+}
+
+static void app_bcast_stop(void)
+{
+    struct gapm_activity_stop_cmd *p_cmd = KE_MSG_ALLOC(GAPM_ACTIVITY_STOP_CMD,
+                                                        TASK_GAPM, TASK_APP,
+                                                        gapm_activity_stop_cmd);
+
+    p_cmd->operation = GAPM_STOP_ACTIVITY;
+    p_cmd->actv_idx = app_bcast_env.actv_idx;
+
+    ke_msg_send(p_cmd);
+    app_bcast_env.op = GAPM_STOP_ACTIVITY;
+}
+
+static void app_bcast_delete(void)
+{
+    struct gapm_activity_delete_cmd *p_cmd = KE_MSG_ALLOC(GAPM_ACTIVITY_DELETE_CMD,
+                                                          TASK_GAPM, TASK_APP,
+                                                          gapm_activity_delete_cmd);
+
+    p_cmd->operation = GAPM_DELETE_ACTIVITY;
+    p_cmd->actv_idx = app_bcast_env.actv_idx;
+
+    ke_msg_send(p_cmd);
+    app_bcast_env.op = GAPM_DELETE_ACTIVITY;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Send the next operation towards the wanted state, one at a time
+ ****************************************************************************************
+ */
+static void app_bcast_next(void)
+{
+    bool want = (app_bcast_env.mode != APP_BCAST_MODE_OFF) && !app_bcast_env.adv_restart
+                && !app_bcast_env.conn_window;
+
+    if (app_bcast_env.op != 0 || app_bcast_adv_busy())
+    {
+        return;
+    }
+
+    switch (app_bcast_env.state)
+    {
+        case (APP_BCAST_STATE_IDLE):
+        {
+            // Broadcast only left: the connectable set first, the summary set follows if
+            // an activity is still free
+            if (app_bcast_env.adv_restart)
+            {
+                app_bcast_env.adv_restart = false;
+                if (app_env.con_nb < BLE_CONNECTION_MAX)
+                {
+                    appm_adv_start();
+                }
+                break;
+            }
+            // Broadcast only, connectable window: started again should it time out
+            if (app_bcast_env.conn_window)
+            {
+                if (appm_adv_get_state() == APP_ADV_STATE_IDLE || appm_adv_get_state() == APP_ADV_STATE_CREATED)
+                {
+                    appm_adv_start();
+                }
+                break;
+            }
+            if (!want)
+            {
+                break;
+            }
+            // Broadcast only: the connectable set gives its activity back
+            if (app_bcast_env.mode == APP_BCAST_MODE_ONLY && app_env.con_nb == 0)
+            {
+                if (appm_adv_get_state() == APP_ADV_STATE_STARTED)
+                {
+                    appm_adv_stop(1);
+                    break;
+                }
+                if (appm_adv_get_state() == APP_ADV_STATE_CREATED)
+                {
+                    appm_adv_delete_advertising();
+                    break;
+                }
+            }
+            if (app_bcast_env.retry == 0 && app_bcast_actv_free())
+            {
+                app_bcast_env.data_set = false;
+                app_bcast_create();
+            }
+        } break;
+
+        case (APP_BCAST_STATE_CREATED):
+        {
+            if (!want)
+            {
+                app_bcast_delete();
+            }
+            else if (!app_bcast_env.data_set)
+            {
+                app_bcast_set_data();
+            }
+#if (APP_BCAST_PERIODIC)
+            else if (app_bcast_env.dirty)
+            {
+                app_bcast_set_data();
+            }
+#endif
+            else
+            {
+                app_bcast_start();
+            }
+        } break;
+
+        case (APP_BCAST_STATE_STARTED):
+        {
+            if (!want)
+            {
+                app_bcast_stop();
+            }
+            else if (app_bcast_env.dirty)
+            {
+                // Replaced in place, the set keeps advertising
+                app_bcast_set_data();
+            }
+        } break;
+
+        default:
+            break;
+    }
+}
+
+static void app_bcast_timer_handler(co_timer_t *timer, void *param)
+{
+    if (app_bcast_env.retry)
+    {
+        app_bcast_env.retry--;
+    }
+
+    app_bcast_window_update();
+    app_bcast_build();
+    app_bcast_next();
+}
+
+/*
+ * GLOBAL FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+
+void app_bcast_init(void)
+{
+    memset(&app_bcast_env, 0, sizeof(app_bcast_env));
+    app_bcast_env.update_intv = APP_BCAST_DFLT_UPDATE_INTV;
+}
+
+bool app_bcast_set_mode(uint8_t mode, uint8_t update_intv)
+{
+    if (mode >= APP_BCAST_MODE_NB || (mode == APP_BCAST_MODE_ON && !APP_BCAST_ON_SUPPORTED))
+    {
+        return false;
+    }
+
+    app_bcast_env.update_intv = update_intv ? update_intv : APP_BCAST_DFLT_UPDATE_INTV;
+    if (app_bcast_env.timer_on)
+    {
+        co_timer_del(&app_bcast_env.timer);
+        app_bcast_env.timer_on = false;
+    }
+    if (mode != APP_BCAST_MODE_OFF)
+    {
+        co_timer_set(&app_bcast_env.timer, app_bcast_env.update_intv * 100, TIMER_REPEAT,
+                     app_bcast_timer_handler, NULL);
+        app_bcast_env.timer_on = true;
+        app_bcast_build();
+    }
+
+    // The summary set may hold the activity connectable advertising needs
+    if (app_bcast_env.mode == APP_BCAST_MODE_ONLY && mode != APP_BCAST_MODE_ONLY)
+    {
+        app_bcast_env.adv_restart = true;
+    }
+
+    log_debug("bcast mode %d, %d00ms\n", mode, app_bcast_env.update_intv);
+    app_bcast_env.mode = mode;
+    app_bcast_env.retry = 0;
+    app_bcast_env.conn_window = false;
+    app_bcast_env.window_time = 0;
+    app_bcast_next();
+
+    return true;
+}
+
+uint8_t app_bcast_get_mode(void)
+{
+    return app_bcast_env.mode;
+}
+
+bool app_bcast_adv_allowed(void)
+{
+    return (app_bcast_env.mode != APP_BCAST_MODE_ONLY || app_bcast_env.conn_window);
+}
+
+void app_bcast_link_changed(void)
+{
+    app_bcast_env.retry = 0;
+    app_bcast_next();
+}
+
+bool app_bcast_create_ind_handler(void *p_param)
+{
+    struct gapm_activity_created_ind *param = (struct gapm_activity_created_ind *)p_param;
+
+    if (app_bcast_env.op != GAPM_CREATE_ADV_ACTIVITY || app_bcast_env.state != APP_BCAST_STATE_IDLE)
+    {
+        return false;
+    }
+
+    app_bcast_env.actv_idx = param->actv_idx;
+    app_bcast_env.state = APP_BCAST_STATE_CREATED;
+    return true;
+}
+
+bool app_bcast_stopped_ind_handler(void *p_param)
+{
+    struct gapm_activity_stopped_ind *param = (struct gapm_activity_stopped_ind *)p_param;
+
+    if (app_bcast_env.state == APP_BCAST_STATE_IDLE || param->actv_idx != app_bcast_env.actv_idx)
+    {
+        return false;
+    }
+
+    // Stopped by the stack, started again from the next update
+    app_bcast_env.state = APP_BCAST_STATE_CREATED;
+    return true;
+}
+
+bool app_bcast_cmp_evt_handler(void *param)
+{
+    struct gapm_cmp_evt *p_param = (struct gapm_cmp_evt *)param;
+
+    if (app_bcast_env.op == 0 || app_bcast_env.op != p_param->operation)
+    {
+        return false;
+    }
+    app_bcast_env.op = 0;
+
+    if (p_param->status != GAP_ERR_NO_ERROR)
+    {
+        log_debug("bcast op %x err %x\n", p_param->operation, p_param->status);
+        if (p_param->operation == GAPM_CREATE_ADV_ACTIVITY)
+        {
+            // No activity left, e.g. a link came up meanwhile
+            app_bcast_env.state = APP_BCAST_STATE_IDLE;
+            app_bcast_env.retry = APP_BCAST_RETRY_UPDATES;
+        }
+        else if (app_bcast_env.data_set)
+        {
+            // Data sent again from the next update
+            app_bcast_env.dirty = true;
+        }
+        return true;
+    }
+
+    switch (p_param->operation)
+    {
+        case (GAPM_SET_ADV_DATA):
+#if (APP_BCAST_PERIODIC)
+            app_bcast_env.data_set = true;
+            break;
+        case (GAPM_SET_PERIOD_ADV_DATA):
+            app_bcast_env.dirty = false;
+#endif
+            app_bcast_env.data_set = true;
+            break;
+        case (GAPM_START_ACTIVITY):
+            app_bcast_env.state = APP_BCAST_STATE_STARTED;
+            break;
+        case (GAPM_STOP_ACTIVITY):
+            app_bcast_env.state = APP_BCAST_STATE_CREATED;
+            break;
+        case (GAPM_DELETE_ACTIVITY):
+            app_bcast_env.state = APP_BCAST_STATE_IDLE;
+            break;
+        default:
+            break;
+    }
+
+    app_bcast_next();
+    return true;
+}
+
+#endif //(BLE_APP_BCAST)
+
+/// @} APP_BCAST_C
@@ -0,0 +1,175 @@
+/**
+ ****************************************************************************************
+ *
+ * @file app_bcast.h
+ *
+ * @brief Connectionless telemetry: EMG, stimulation and battery summaries broadcast in
+ *        a non-connectable extended (or periodic) advertising set
+ *
+ *
+ ****************************************************************************************
+ */
+
+#ifndef APP_BCAST_H_
+#define APP_BCAST_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP_BCAST_H app_bcast.h
+ * @ingroup APP_COMMON
+ *
+ * @brief Connectionless telemetry for group sessions, one tablet scanning many devices
+ *
+ * The summary set is a second advertising activity next to the connectable one. It is
+ * created once and its data is replaced in place (GAPM_SET_ADV_DATA or
+ * GAPM_SET_PERIOD_ADV_DATA on the running activity) at every update.
+ *
+ * Activities are shared with the connectable set and the links (BLE_ACTIVITY_MAX).
+ * APP_BCAST_MODE_ON only creates the set while one activity stays free for the next
+ * link, so it needs three activities (APP_BCAST_ON_SUPPORTED). APP_BCAST_MODE_ONLY gives
+ * up connectable advertising once the last link is gone, so it also fits a stack built
+ * with one connection and two activities; the two sets then take turns, the summary set
+ * for APP_BCAST_ONLY_BCAST_TIME and connectable advertising for APP_BCAST_ONLY_CONN_TIME,
+ * so a phone can still connect and switch the mode back.
+ *
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h"     // SW configuration
+#include <stdint.h>          // Standard Integer Definition
+#include <stdbool.h>
+
+#if (BLE_APP_BCAST)
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// Summary data in periodic advertising (scanner syncs once), else in the extended set
+#ifndef APP_BCAST_PERIODIC
+#define APP_BCAST_PERIODIC          0
+#endif
+
+/// Default summary update interval (unit 100ms)
+#define APP_BCAST_DFLT_UPDATE_INTV  5
+/// Advertising interval of the summary set (unit 0.625ms), several events per update
+#define APP_BCAST_ADV_INTV          160
+/// Periodic advertising interval (unit 1.25ms)
+#define APP_BCAST_PER_ADV_INTV      80
+/// Advertising SID of the summary set, the connectable set is legacy and has none
+#define APP_BCAST_ADV_SID           1
+/// Manufacturer specific data company identifier (0xFFFF: none assigned, test use)
+#define APP_BCAST_COMPANY_ID        0xFFFF
+/// Longest summary frame, see bcast_summary_fill()
+#define APP_BCAST_FRAME_MAX         32
+/// Updates skipped after a failed create before trying again
+#define APP_BCAST_RETRY_UPDATES     20
+/// Broadcast only: summary set time between connectable windows (unit ms)
+#define APP_BCAST_ONLY_BCAST_TIME   30000
+/// Broadcast only: connectable advertising window (unit ms)
+#define APP_BCAST_ONLY_CONN_TIME    10000
+/// APP_BCAST_MODE_ON needs the connectable set, the summary set and a free activity for the next link
+#define APP_BCAST_ON_SUPPORTED      (BLE_ACTIVITY_MAX >= 3)
+
+/// Broadcast modes
+enum app_bcast_mode
+{
+    /// No summary set
+    APP_BCAST_MODE_OFF,
+    /// Summary set next to connectable advertising, while an activity is free
+    APP_BCAST_MODE_ON,
+    /// Summary set alternating with connectable windows while no link is up
+    APP_BCAST_MODE_ONLY,
+
+    APP_BCAST_MODE_NB,
+};
+
+/*
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Initialize the broadcast module, mode off
+ ****************************************************************************************
+ */
+void app_bcast_init(void);
+
+/**
+ ****************************************************************************************
+ * @brief Select the broadcast mode
+ *
+ * @param[in] mode          @see enum app_bcast_mode
+ * @param[in] update_intv   Summary update interval (unit 100ms), 0 for the default
+ *
+ * @return false if the mode is unknown, or APP_BCAST_MODE_ON without APP_BCAST_ON_SUPPORTED
+ ****************************************************************************************
+ */
+bool app_bcast_set_mode(uint8_t mode, uint8_t update_intv);
+
+/**
+ ****************************************************************************************
+ * @brief Current broadcast mode, @see enum app_bcast_mode
+ ****************************************************************************************
+ */
+uint8_t app_bcast_get_mode(void);
+
+/**
+ ****************************************************************************************
+ * @brief Whether connectable advertising may be restarted (in APP_BCAST_MODE_ONLY only
+ *        during a connectable window)
+ ****************************************************************************************
+ */
+bool app_bcast_adv_allowed(void);
+
+/**
+ ****************************************************************************************
+ * @brief A link was established or lost, the free activities changed
+ ****************************************************************************************
+ */
+void app_bcast_link_changed(void);
+
+/**
+ ****************************************************************************************
+ * @brief GAPM_ACTIVITY_CREATED_IND for an advertising activity
+ *
+ * @return true if the activity is the summary set
+ ****************************************************************************************
+ */
+bool app_bcast_create_ind_handler(void *p_param);
+
+/**
+ ****************************************************************************************
+ * @brief GAPM_ACTIVITY_STOPPED_IND for an advertising activity
+ *
+ * @return true if the activity is the summary set
+ ****************************************************************************************
+ */
+bool app_bcast_stopped_ind_handler(void *p_param);
+
+/**
+ ****************************************************************************************
+ * @brief GAPM_CMP_EVT of an advertising operation
+ *
+ * GAPM completes the operations in the order they were sent and the summary set only
+ * sends one while the connectable set has none pending, so the first completion of
+ * the pending operation is ours.
+ *
+ * @return true if the completion belongs to the summary set
+ ****************************************************************************************
+ */
+bool app_bcast_cmp_evt_handler(void *param);
+
+#endif //(BLE_APP_BCAST)
+
+/// @} APP_BCAST_H
+
+#endif // APP_BCAST_H_
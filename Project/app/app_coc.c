@@ -0,0 +1,337 @@
+/**
+ ****************************************************************************************
+ *
+ * @file app_coc.c
+ *
+ * @brief LE credit based L2CAP channel (CoC) transport for the AM300 protocol
+ *
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP_COC_C app_coc.c
+ * @ingroup APP_COMMON
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h"     // SW configuration
+
+#if (BLE_APP_COC)
+
+#include "app_coc.h"                 // CoC transport Definitions
+#include "app.h"                     // Application Definitions
+#include "app_task.h"                // application task definitions
+#include "gapm_task.h"               // GAP Manager Task API
+#include "l2cc_task.h"               // L2CAP Controller Task API
+#include "gap.h"
+#include "co_bt.h"
+#include "co_utils.h"
+#include "co_debug.h"
+#include "co.h"
+#include "protocol.h"                // protocol_rx_write
+#include "app_simple_server.h"
+#include <string.h>
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// The peer must take the longest protocol frame in one SDU
+#define APP_COC_PEER_MTU_MIN        APP_SIMPLE_SERVER_FRAME_MAX
+/// Most credits a channel can hold
+#define APP_COC_CREDIT_MAX          0xFFFF
+
+/*
+ * GLOBAL VARIABLE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Channel Environment Structure, one per connection
+struct app_coc_env_tag app_coc_env[BLE_CONNECTION_MAX];
+
+/*
+ * LOCAL FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+
+static struct app_coc_env_tag *app_coc_get(uint8_t conidx, uint16_t cid)
+{
+    if (conidx >= BLE_CONNECTION_MAX || !app_coc_env[conidx].open)
+        return NULL;
+
+    if (app_coc_env[conidx].local_cid != cid)
+        return NULL;
+
+    return &app_coc_env[conidx];
+}
+
+/// K-frames (peer credits) of one SDU, the first one carries the SDU length
+static uint16_t app_coc_sdu_credits(struct app_coc_env_tag *coc, uint16_t length)
+{
+    return (length + APP_COC_SDU_LEN_HDR + coc->peer_mps - 1) / coc->peer_mps;
+}
+
+static void app_coc_credit_add(uint8_t conidx, uint16_t cid, uint16_t credit)
+{
+    struct l2cc_lecb_add_cmd *cmd = KE_MSG_ALLOC(L2CC_LECB_ADD_CMD,
+                                                 KE_BUILD_ID(TASK_L2CC, conidx), TASK_APP,
+                                                 l2cc_lecb_add_cmd);
+
+    cmd->operation = L2CC_LECB_CREDIT_ADD;
+    cmd->local_cid = cid;
+    cmd->credit    = credit;
+
+    // Send the message
+    ke_msg_send(cmd);
+}
+
+/*
+ * MESSAGE HANDLERS
+ ****************************************************************************************
+ */
+
+static int app_coc_connect_req_ind_handler(ke_msg_id_t const msgid,
+                                           struct l2cc_lecb_connect_req_ind const *param,
+                                           ke_task_id_t const dest_id,
+                                           ke_task_id_t const src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+    struct l2cc_lecb_connect_cfm *cfm = KE_MSG_ALLOC(L2CC_LECB_CONNECT_CFM,
+                                                     src_id, TASK_APP,
+                                                     l2cc_lecb_connect_cfm);
+
+    cfm->peer_cid     = param->peer_cid;
+    cfm->local_cid    = 0;
+    cfm->local_credit = APP_COC_RX_CREDITS;
+    cfm->local_mtu    = APP_COC_RX_MTU;
+    cfm->local_mps    = APP_COC_MPS;
+    // One channel per link; a peer that cannot take a whole frame stays on GATT
+    cfm->accept       = (param->le_psm == APP_COC_LE_PSM)
+                     && (conidx < BLE_CONNECTION_MAX) && !app_coc_env[conidx].open
+                     && (param->peer_mtu >= APP_COC_PEER_MTU_MIN) && (param->peer_mps != 0);
+
+    log_debug("COC req psm=%x mtu=%d mps=%d accept=%d\n", param->le_psm, param->peer_mtu,
+              param->peer_mps, cfm->accept);
+
+    // Send the message
+    ke_msg_send(cfm);
+
+    return (KE_MSG_CONSUMED);
+}
+
+static int app_coc_connect_ind_handler(ke_msg_id_t const msgid,
+                                       struct l2cc_lecb_connect_ind const *param,
+                                       ke_task_id_t const dest_id,
+                                       ke_task_id_t const src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+    struct app_coc_env_tag *coc;
+
+    if (conidx >= BLE_CONNECTION_MAX || param->status != GAP_ERR_NO_ERROR)
+        return (KE_MSG_CONSUMED);
+
+    coc = &app_coc_env[conidx];
+    coc->open        = true;
+    coc->local_cid   = param->local_cid;
+    coc->peer_mtu    = param->peer_mtu;
+    coc->peer_mps    = param->peer_mps;
+    coc->peer_credit = param->peer_credit;
+
+    log_debug("COC open cid=%x mtu=%d mps=%d credit=%d\n", param->local_cid, param->peer_mtu,
+              param->peer_mps, param->peer_credit);
+
+    // The frames of this link move to the channel
+    app_simple_server_coc_update(conidx);
+
+    return (KE_MSG_CONSUMED);
+}
+
+static int app_coc_disconnect_ind_handler(ke_msg_id_t const msgid,
+                                          struct l2cc_lecb_disconnect_ind const *param,
+                                          ke_task_id_t const dest_id,
+                                          ke_task_id_t const src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+    struct app_coc_env_tag *coc = app_coc_get(conidx, param->local_cid);
+
+    if (coc == NULL)
+        return (KE_MSG_CONSUMED);
+
+    memset(coc, 0, sizeof(*coc));
+    log_debug("COC closed reason=%x\n", param->reason);
+
+    // Back to notifications, if the peer enabled them
+    app_simple_server_coc_update(conidx);
+
+    return (KE_MSG_CONSUMED);
+}
+
+static int app_coc_add_ind_handler(ke_msg_id_t const msgid,
+                                   struct l2cc_lecb_add_ind const *param,
+                                   ke_task_id_t const dest_id,
+                                   ke_task_id_t const src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+    struct app_coc_env_tag *coc = app_coc_get(conidx, param->local_cid);
+
+    if (coc == NULL)
+        return (KE_MSG_CONSUMED);
+
+    coc->peer_credit = (param->peer_added_credit > APP_COC_CREDIT_MAX - coc->peer_credit)
+                     ? APP_COC_CREDIT_MAX : (coc->peer_credit + param->peer_added_credit);
+
+    // Frames waiting for credits
+    app_simple_server_coc_update(conidx);
+
+    return (KE_MSG_CONSUMED);
+}
+
+static int app_coc_sdu_recv_ind_handler(ke_msg_id_t const msgid,
+                                        struct l2cc_lecb_sdu_recv_ind const *param,
+                                        ke_task_id_t const dest_id,
+                                        ke_task_id_t const src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+    struct app_coc_env_tag *coc = app_coc_get(conidx, param->sdu.cid);
+
+    if (coc == NULL)
+        return (KE_MSG_CONSUMED);
+
+    // Parse and execute in place like a GATT write, replies go back to conidx
+    if (param->status == GAP_ERR_NO_ERROR)
+        protocol_rx_write(conidx, param->sdu.data, param->sdu.length);
+
+    // The SDU is consumed, the peer may send the next one
+    if (param->sdu.credit)
+        app_coc_credit_add(conidx, coc->local_cid, param->sdu.credit);
+
+    return (KE_MSG_CONSUMED);
+}
+
+static int app_coc_cmp_evt_handler(ke_msg_id_t const msgid,
+                                   struct l2cc_cmp_evt const *param,
+                                   ke_task_id_t const dest_id,
+                                   ke_task_id_t const src_id)
+{
+    // An SDU left (or was dropped with the channel), its TX slot is free again
+    if (param->operation == L2CC_LECB_SDU_SEND)
+        app_simple_server_tx_cmp(KE_IDX_GET(src_id));
+
+    return (KE_MSG_CONSUMED);
+}
+
+/*
+ * GLOBAL FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+
+void app_coc_init(void)
+{
+    memset(app_coc_env, 0, sizeof(app_coc_env));
+}
+
+void app_coc_register(void)
+{
+    struct gapm_lepsm_register_cmd *cmd = KE_MSG_ALLOC(GAPM_LEPSM_REGISTER_CMD,
+                                                       TASK_GAPM, TASK_APP,
+                                                       gapm_lepsm_register_cmd);
+
+    cmd->operation = GAPM_LEPSM_REG;
+    cmd->le_psm    = APP_COC_LE_PSM;
+    cmd->app_task  = TASK_APP;
+    cmd->sec_lvl   = APP_COC_SEC_LVL;
+
+    // Send the message
+    ke_msg_send(cmd);
+}
+
+void app_coc_register_cmp(uint8_t status)
+{
+    // Without the PSM no channel opens, every link stays on GATT
+    log_debug("COC psm=%x status=%x\n", APP_COC_LE_PSM, status);
+}
+
+void app_coc_stop(uint8_t conidx)
+{
+    if (conidx < BLE_CONNECTION_MAX)
+        memset(&app_coc_env[conidx], 0, sizeof(app_coc_env[conidx]));
+}
+
+bool app_coc_is_open(uint8_t conidx)
+{
+    return (conidx < BLE_CONNECTION_MAX) && app_coc_env[conidx].open;
+}
+
+uint16_t app_coc_tx_max(uint8_t conidx)
+{
+    struct app_coc_env_tag *coc;
+    uint32_t max;
+
+    if (!app_coc_is_open(conidx))
+        return 0;
+    coc = &app_coc_env[conidx];
+
+    if (coc->peer_credit == 0)
+        return 0;
+
+    // Every credit is one K-frame of peer_mps, the SDU length takes the first 2 octets
+    max = (uint32_t)coc->peer_credit * coc->peer_mps - APP_COC_SDU_LEN_HDR;
+    max = MIN(max, coc->peer_mtu);
+
+    return MIN(max, APP_COC_SDU_MAX);
+}
+
+struct l2cc_lecb_sdu_send_cmd *app_coc_sdu_alloc(uint8_t conidx, uint16_t max)
+{
+    return KE_MSG_ALLOC_DYN(L2CC_LECB_SDU_SEND_CMD,
+                            KE_BUILD_ID(TASK_L2CC, conidx), TASK_APP,
+                            l2cc_lecb_sdu_send_cmd, max);
+}
+
+void app_coc_sdu_send(uint8_t conidx, struct l2cc_lecb_sdu_send_cmd *cmd, uint16_t length)
+{
+    struct app_coc_env_tag *coc = &app_coc_env[conidx];
+    uint16_t credit = app_coc_sdu_credits(coc, length);
+
+    cmd->operation   = L2CC_LECB_SDU_SEND;
+    cmd->sdu.cid     = coc->local_cid;
+    cmd->sdu.length  = length;
+
+    // L2CC segments the SDU, the credits are spent as soon as it is queued
+    coc->peer_credit = (coc->peer_credit > credit) ? (coc->peer_credit - credit) : 0;
+
+    // Send the message
+    ke_msg_send(cmd);
+}
+
+/*
+ * LOCAL VARIABLE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Default State handlers definition
+const struct ke_msg_handler app_coc_msg_handler_list[] =
+{
+    {L2CC_LECB_CONNECT_REQ_IND, (ke_msg_func_t)app_coc_connect_req_ind_handler},
+    {L2CC_LECB_CONNECT_IND,     (ke_msg_func_t)app_coc_connect_ind_handler},
+    {L2CC_LECB_DISCONNECT_IND,  (ke_msg_func_t)app_coc_disconnect_ind_handler},
+    {L2CC_LECB_ADD_IND,         (ke_msg_func_t)app_coc_add_ind_handler},
+    {L2CC_LECB_SDU_RECV_IND,    (ke_msg_func_t)app_coc_sdu_recv_ind_handler},
+    {L2CC_CMP_EVT,              (ke_msg_func_t)app_coc_cmp_evt_handler},
+};
+
+/// CoC transport handler
+const struct app_subtask_handlers app_coc_handlers = APP_HANDLERS(app_coc);
+
+#endif //(BLE_APP_COC)
+
+/// @} APP
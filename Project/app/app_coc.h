@@ -0,0 +1,177 @@
+/**
+ ****************************************************************************************
+ *
+ * @file app_coc.h
+ *
+ * @brief LE credit based L2CAP channel (CoC) transport for the AM300 protocol
+ *
+ *
+ ****************************************************************************************
+ */
+
+#ifndef APP_COC_H_
+#define APP_COC_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP_COC_H app_coc.h
+ * @ingroup APP_COMMON
+ *
+ * @brief LE credit based L2CAP channel (CoC) transport for the AM300 protocol
+ *
+ * A central that supports it opens a channel on APP_COC_LE_PSM. From then on the frames
+ * of its link go out in SDUs of up to APP_COC_SDU_MAX octets instead of notifications;
+ * L2CC segments them into K-frames of the peer MPS, each K-frame takes one peer credit.
+ * Frames written to the channel are parsed like GATT writes. Without a channel, or
+ * once it is closed, the link stays on (or falls back to) the GATT service.
+ *
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h"     // SW configuration
+#include <stdint.h>          // Standard Integer Definition
+#include <stdbool.h>
+#include "ke_task.h"         // Kernel Task Definition
+#include "l2cc_task.h"       // L2CAP Controller Task API
+#include "co_bt.h"
+#include "app_link.h"        // APP_LINK_MAX_MTU
+
+#if (BLE_APP_COC)
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// Dynamic LE PSM of the AM300 protocol channel (0x0080~0x00FF)
+#define APP_COC_LE_PSM              0x0081
+/// Security level of the channel, same as the GATT service (no security)
+#define APP_COC_SEC_LVL             0
+/// Largest SDU sent, several protocol frames in one SDU
+#define APP_COC_SDU_MAX             512
+/// Largest SDU received, commands are short
+#define APP_COC_RX_MTU              APP_LINK_MAX_MTU
+/// Payload of one K-frame, fills a 251 octet LE data PDU (L2CAP header 4)
+#define APP_COC_MPS                 (LE_MAX_OCTETS - 4)
+/// SDU length field in the first K-frame of an SDU
+#define APP_COC_SDU_LEN_HDR         2
+/// Credits given to the peer, one full SDU can always be received
+#define APP_COC_RX_CREDITS          ((APP_COC_RX_MTU + APP_COC_SDU_LEN_HDR + APP_COC_MPS - 1) / APP_COC_MPS + 1)
+
+/*
+ * STRUCTURES DEFINITION
+ ****************************************************************************************
+ */
+
+/// Channel of one connection
+struct app_coc_env_tag
+{
+    /// Channel established
+    bool open;
+    /// Local channel identifier
+    uint16_t local_cid;
+    /// Largest SDU the peer receives
+    uint16_t peer_mtu;
+    /// Largest K-frame payload the peer receives
+    uint16_t peer_mps;
+    /// K-frames the peer still accepts
+    uint16_t peer_credit;
+};
+
+/*
+ * GLOBAL VARIABLES DECLARATIONS
+ ****************************************************************************************
+ */
+
+extern struct app_coc_env_tag app_coc_env[BLE_CONNECTION_MAX]; /// Channel environment, index conidx
+
+extern const struct app_subtask_handlers app_coc_handlers; /// Table of message handlers
+
+/*
+ * FUNCTIONS DECLARATION
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Close the channel of every connection
+ * @return void.
+ ****************************************************************************************
+ */
+void app_coc_init(void);
+
+/**
+ ****************************************************************************************
+ * @brief Register APP_COC_LE_PSM, completes with GAPM_LEPSM_REG
+ * @return void.
+ ****************************************************************************************
+ */
+void app_coc_register(void);
+
+/**
+ ****************************************************************************************
+ * @brief GAPM_CMP_EVT of GAPM_LEPSM_REG
+ * @param[in] status: completion status.
+ * @return void.
+ ****************************************************************************************
+ */
+void app_coc_register_cmp(uint8_t status);
+
+/**
+ ****************************************************************************************
+ * @brief Connection closed, its channel is gone
+ * @param[in] conidx: connect index.
+ * @return void.
+ ****************************************************************************************
+ */
+void app_coc_stop(uint8_t conidx);
+
+/**
+ ****************************************************************************************
+ * @brief Whether the frames of a link go over its channel
+ * @param[in] conidx: connect index.
+ ****************************************************************************************
+ */
+bool app_coc_is_open(uint8_t conidx);
+
+/**
+ ****************************************************************************************
+ * @brief Longest SDU that can be sent now, limited by the peer MTU and its credits
+ * @param[in] conidx: connect index.
+ * @return SDU length, 0 while the peer has no credit left.
+ ****************************************************************************************
+ */
+uint16_t app_coc_tx_max(uint8_t conidx);
+
+/**
+ ****************************************************************************************
+ * @brief Allocate an SDU for the channel of a link, the frames are packed in sdu.data
+ * @param[in] conidx: connect index.
+ * @param[in] max: room for the SDU data.
+ * @return L2CC_LECB_SDU_SEND_CMD message.
+ ****************************************************************************************
+ */
+struct l2cc_lecb_sdu_send_cmd *app_coc_sdu_alloc(uint8_t conidx, uint16_t max);
+
+/**
+ ****************************************************************************************
+ * @brief Hand one SDU to L2CC, completes with app_simple_server_tx_cmp()
+ * @param[in] conidx: connect index.
+ * @param[in] cmd: SDU from app_coc_sdu_alloc().
+ * @param[in] length: SDU length, at most app_coc_tx_max().
+ * @return void.
+ ****************************************************************************************
+ */
+void app_coc_sdu_send(uint8_t conidx, struct l2cc_lecb_sdu_send_cmd *cmd, uint16_t length);
+
+#endif //(BLE_APP_COC)
+
+/// @} APP_COC_H
+
+#endif // APP_COC_H_
@@ -0,0 +1,368 @@
+/**
+ ****************************************************************************************
+ *
+ * @file app_link.c
+ *
+ * @brief Link setup (MTU, data length, PHY) for the AM300 service
+ *
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP_LINK_C app_link.c
+ * @ingroup APP_COMMON
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h"     // SW configuration
+
+#include "app_link.h"                // Link setup Definitions
+#include "app.h"                     // Application Definitions
+#include "app_task.h"                // application task definitions
+#include "gapc_task.h"               // GAP Controller Task API
+#include "gattc_task.h"              // GATT Controller Task API
+#include "gap.h"
+#include "co_bt.h"
+#include "co_utils.h"
+#include "co_debug.h"
+#include "co.h"
+#include "handler.h"
+#include "app_simple_server.h"
+#include <string.h>
+
+/*
+ * GLOBAL VARIABLE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Link Environment Structure, one per connection
+struct app_link_env_tag app_link_env[BLE_CONNECTION_MAX];
+
+/// Connection parameters of each profile, supervision timeout covers the slave latency
+static const struct gapc_conn_param app_link_param[APP_LINK_PROFILE_NB] =
+{
+    [APP_LINK_PROFILE_RAW]      = {6,  8,   0, 200},    // 7.5~10ms
+    [APP_LINK_PROFILE_STREAM]   = {24, 40,  0, 300},    // 30~50ms
+    [APP_LINK_PROFILE_IDLE]     = {80, 100, 4, 600},    // 100~125ms, latency 4
+};
+
+/*
+ * LOCAL FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+
+static void app_link_mtu_exchange(uint8_t conidx)
+{
+    struct gattc_exc_mtu_cmd *cmd = KE_MSG_ALLOC(GATTC_EXC_MTU_CMD,
+                                                 KE_BUILD_ID(TASK_GATTC, conidx), TASK_APP,
+                                                 gattc_exc_mtu_cmd);
+
+    cmd->operation = GATTC_MTU_EXCH;
+
+    // Send the message
+    ke_msg_send(cmd);
+}
+
+static void app_link_length_exchange(uint8_t conidx)
+{
+    struct gapc_set_le_pkt_size_cmd *cmd = KE_MSG_ALLOC(GAPC_SET_LE_PKT_SIZE_CMD,
+                                                        KE_BUILD_ID(TASK_GAPC, conidx), TASK_APP,
+                                                        gapc_set_le_pkt_size_cmd);
+
+    cmd->operation = GAPC_SET_LE_PKT_SIZE;
+    cmd->tx_octets = LE_MAX_OCTETS;
+    cmd->tx_time   = LE_MAX_TIME;
+
+    // Send the message
+    ke_msg_send(cmd);
+}
+
+static void app_link_phy_update(uint8_t conidx)
+{
+    struct gapc_set_phy_cmd *cmd = KE_MSG_ALLOC(GAPC_SET_PHY_CMD,
+                                                KE_BUILD_ID(TASK_GAPC, conidx), TASK_APP,
+                                                gapc_set_phy_cmd);
+
+    // 1M stays allowed, the peer falls back to it when it has no 2M
+    cmd->operation = GAPC_SET_PHY;
+    cmd->tx_phy    = GAP_PHY_LE_1MBPS | GAP_PHY_LE_2MBPS;
+    cmd->rx_phy    = GAP_PHY_LE_1MBPS | GAP_PHY_LE_2MBPS;
+    cmd->phy_opt   = 0;
+
+    // Send the message
+    ke_msg_send(cmd);
+}
+
+/// Link of an event from GAPC/GATTC, NULL if the index is out of range
+static struct app_link_env_tag *app_link_get(uint8_t conidx)
+{
+    return (conidx < BLE_CONNECTION_MAX) ? &app_link_env[conidx] : NULL;
+}
+
+static bool app_link_param_match(struct app_link_env_tag *link, uint8_t profile)
+{
+    const struct gapc_conn_param *p = &app_link_param[profile];
+
+    return (link->con_interval >= p->intv_min) &&
+           (link->con_interval <= p->intv_max) &&
+           (link->con_latency == p->latency);
+}
+
+static void app_link_backoff(struct app_link_env_tag *link)
+{
+    uint32_t wait = (uint32_t)APP_LINK_BACKOFF_MIN << MIN(link->reject_cnt, 4);
+
+    link->wait = MIN(wait, APP_LINK_BACKOFF_MAX);
+    if (link->reject_cnt < 0xFF)
+        link->reject_cnt++;
+}
+
+static void app_link_reset(struct app_link_env_tag *link)
+{
+    memset(link, 0, sizeof(struct app_link_env_tag));
+    link->conidx    = GAP_INVALID_CONIDX;
+    link->mtu       = ATT_DEFAULT_MTU;
+    link->tx_octets = LE_MIN_OCTETS;
+    link->rx_octets = LE_MIN_OCTETS;
+    link->tx_phy    = GAP_PHY_LE_1MBPS;
+    link->rx_phy    = GAP_PHY_LE_1MBPS;
+    link->want      = APP_LINK_PROFILE_IDLE;
+    link->req       = APP_LINK_PROFILE_NB;
+}
+
+static void app_link_policy(struct app_link_env_tag *link, uint8_t want)
+{
+    const struct gapc_conn_param *p;
+
+    if (link->wait)
+        link->wait--;
+
+    if (want != link->want)
+    {
+        link->want       = want;
+        link->want_cnt   = 0;
+        link->reject_cnt = 0;
+    }
+    else if (link->want_cnt < 0xFFFF)
+    {
+        link->want_cnt++;
+    }
+
+    if (link->req != APP_LINK_PROFILE_NB || link->wait || app_link_param_match(link, want))
+        return;
+
+    // Faster link right away, slower one only once the state has settled
+    p = &app_link_param[want];
+    if (link->con_interval < p->intv_min && link->want_cnt < APP_LINK_SLOWER_DELAY)
+        return;
+
+    link->req = want;
+    appm_update_param(link->conidx, (struct gapc_conn_param *)p);
+}
+
+static int app_link_param_updated_ind_handler(ke_msg_id_t const msgid,
+                                              struct gapc_param_updated_ind const *param,
+                                              ke_task_id_t const dest_id,
+                                              ke_task_id_t const src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+    struct app_link_env_tag *link = app_link_get(conidx);
+
+    if (link == NULL)
+        return (KE_MSG_CONSUMED);
+
+    link->con_interval = param->con_interval;
+    link->con_latency  = param->con_latency;
+    app_simple_server_set_con_interval(conidx, param->con_interval);
+    log_debug("CON intv=%d latency=%d to=%d\n", param->con_interval, param->con_latency, param->sup_to);
+
+    return (KE_MSG_CONSUMED);
+}
+
+static int app_link_mtu_changed_ind_handler(ke_msg_id_t const msgid,
+                                            struct gattc_mtu_changed_ind const *param,
+                                            ke_task_id_t const dest_id,
+                                            ke_task_id_t const src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+    struct app_link_env_tag *link = app_link_get(conidx);
+
+    if (link == NULL)
+        return (KE_MSG_CONSUMED);
+
+    link->mtu = param->mtu;
+    log_debug("MTU=%d\n", param->mtu);
+    link_param_packet_send(conidx);
+
+    return (KE_MSG_CONSUMED);
+}
+
+static int app_link_pkt_size_ind_handler(ke_msg_id_t const msgid,
+                                         struct gapc_le_pkt_size_ind const *param,
+                                         ke_task_id_t const dest_id,
+                                         ke_task_id_t const src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+    struct app_link_env_tag *link = app_link_get(conidx);
+
+    if (link == NULL)
+        return (KE_MSG_CONSUMED);
+
+    link->tx_octets = param->max_tx_octets;
+    link->rx_octets = param->max_rx_octets;
+    log_debug("MTO=%d MRO=%d\n", param->max_tx_octets, param->max_rx_octets);
+    link_param_packet_send(conidx);
+
+    return (KE_MSG_CONSUMED);
+}
+
+static int app_link_phy_ind_handler(ke_msg_id_t const msgid,
+                                    struct gapc_le_phy_ind const *param,
+                                    ke_task_id_t const dest_id,
+                                    ke_task_id_t const src_id)
+{
+    uint8_t conidx = KE_IDX_GET(src_id);
+    struct app_link_env_tag *link = app_link_get(conidx);
+
+    if (link == NULL)
+        return (KE_MSG_CONSUMED);
+
+    link->tx_phy = param->tx_phy;
+    link->rx_phy = param->rx_phy;
+    log_debug("PHY tx=%d rx=%d\n", param->tx_phy, param->rx_phy);
+    link_param_packet_send(conidx);
+
+    return (KE_MSG_CONSUMED);
+}
+
+/*
+ * GLOBAL FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+
+void app_link_init(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < BLE_CONNECTION_MAX; i++)
+        app_link_reset(&app_link_env[i]);
+}
+
+void app_link_start(uint8_t conidx, uint16_t con_interval, uint16_t con_latency)
+{
+    struct app_link_env_tag *link = app_link_get(conidx);
+
+    if (link == NULL)
+        return;
+
+    app_link_reset(link);
+    link->conidx       = conidx;
+    link->con_interval = con_interval;
+    link->con_latency  = con_latency;
+    // Let the central finish its own setup first
+    link->wait         = APP_LINK_BACKOFF_MIN;
+
+    // GAPC runs its operations one after the other, GATTC in parallel
+    app_link_mtu_exchange(conidx);
+    app_link_length_exchange(conidx);
+    app_link_phy_update(conidx);
+}
+
+void app_link_stop(uint8_t conidx)
+{
+    struct app_link_env_tag *link = app_link_get(conidx);
+
+    if (link != NULL)
+        app_link_reset(link);
+}
+
+uint16_t app_link_tx_length(uint8_t conidx, uint16_t max)
+{
+    struct app_link_env_tag *link = app_link_get(conidx);
+    uint16_t mtu  = link ? link->mtu : ATT_DEFAULT_MTU;
+    uint16_t mto  = link ? link->tx_octets : LE_MIN_OCTETS;
+    uint16_t mtux = MIN(mtu - 3, max);
+    uint16_t mtox = mto - APP_LINK_PDU_HDR_LEN;
+
+    // First PDU carries the headers, the following ones are payload only
+    return (mtux > mtox) ? (mtox + mto * ((mtux - mtox) / mto)) : (mtux);
+}
+
+const struct gapc_conn_param *app_link_profile_param(uint8_t profile)
+{
+    return &app_link_param[(profile < APP_LINK_PROFILE_NB) ? profile : APP_LINK_PROFILE_IDLE];
+}
+
+void app_link_policy_handler(uint8_t want)
+{
+    uint8_t i;
+
+    if (want >= APP_LINK_PROFILE_NB)
+        return;
+
+    // Every central streams the same data, each link is tuned on its own
+    for (i = 0; i < BLE_CONNECTION_MAX; i++)
+    {
+        if (app_link_env[i].conidx != GAP_INVALID_CONIDX)
+            app_link_policy(&app_link_env[i], want);
+    }
+}
+
+void app_link_param_update_cmp(uint8_t conidx, uint8_t status)
+{
+    struct app_link_env_tag *link = app_link_get(conidx);
+    uint8_t req;
+
+    if (link == NULL || link->req == APP_LINK_PROFILE_NB)
+        return;
+    req = link->req;
+    link->req = APP_LINK_PROFILE_NB;
+
+    // Rejected, or accepted with values outside the asked range
+    if (status != GAP_ERR_NO_ERROR || !app_link_param_match(link, req))
+    {
+        log_debug("CON param reject(%d) cnt=%d\n", status, link->reject_cnt);
+        app_link_backoff(link);
+    }
+    else
+    {
+        link->reject_cnt = 0;
+        link->wait = APP_LINK_REQ_GAP;
+    }
+}
+
+void app_link_param_update_req(uint8_t conidx)
+{
+    struct app_link_env_tag *link = app_link_get(conidx);
+
+    // Do not fight the central
+    if (link != NULL && link->wait < APP_LINK_BACKOFF_MIN)
+        link->wait = APP_LINK_BACKOFF_MIN;
+}
+
+/*
+ * LOCAL VARIABLE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Default State handlers definition
+const struct ke_msg_handler app_link_msg_handler_list[] =
+{
+    {GATTC_MTU_CHANGED_IND,     (ke_msg_func_t)app_link_mtu_changed_ind_handler},
+    {GAPC_LE_PKT_SIZE_IND,      (ke_msg_func_t)app_link_pkt_size_ind_handler},
+    {GAPC_LE_PHY_IND,           (ke_msg_func_t)app_link_phy_ind_handler},
+    {GAPC_PARAM_UPDATED_IND,    (ke_msg_func_t)app_link_param_updated_ind_handler},
+};
+
+/// link setup handler
+const struct app_subtask_handlers app_link_handlers = APP_HANDLERS(app_link);
+
+/// @} APP
@@ -0,0 +1,195 @@
+/**
+ ****************************************************************************************
+ *
+ * @file app_link.h
+ *
+ * @brief Link setup (MTU, data length, PHY) for the AM300 service
+ *
+ *
+ ****************************************************************************************
+ */
+
+#ifndef APP_LINK_H_
+#define APP_LINK_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP_LINK_H app_link.h
+ * @ingroup APP_COMMON
+ *
+ * @brief Link setup (MTU, data length, PHY) for the AM300 service
+ *
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h"     // SW configuration
+#include <stdint.h>          // Standard Integer Definition
+#include "ke_task.h"         // Kernel Task Definition
+#include "gapc_task.h"       // GAP Controller Task API
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// MTU requested at connection, one full characteristic value plus the ATT header
+#define APP_LINK_MAX_MTU            (244 + 3)
+/// L2CAP (4) + ATT notification (3) header in the first LE data PDU
+#define APP_LINK_PDU_HDR_LEN        7
+
+/// A slower profile is only requested after it was wanted this long (unit 100ms)
+#define APP_LINK_SLOWER_DELAY       50
+/// Pause after a central initiated update or an accepted request (unit 100ms)
+#define APP_LINK_REQ_GAP            20
+/// Back-off after the first rejection, doubled up to APP_LINK_BACKOFF_MAX (unit 100ms)
+#define APP_LINK_BACKOFF_MIN        50
+#define APP_LINK_BACKOFF_MAX        600
+
+/// Connection parameter profiles, fastest first
+enum app_link_profile
+{
+    /// Raw EMG waveform streaming
+    APP_LINK_PROFILE_RAW,
+    /// 10Hz EMG envelope upload
+    APP_LINK_PROFILE_STREAM,
+    /// Idle or stimulation program running on its own
+    APP_LINK_PROFILE_IDLE,
+
+    APP_LINK_PROFILE_NB,
+};
+
+/*
+ * STRUCTURES DEFINITION
+ ****************************************************************************************
+ */
+
+/// Negotiated link parameters of one connection
+struct app_link_env_tag
+{
+    /// Connection index, GAP_INVALID_CONIDX if not connected
+    uint8_t conidx;
+    /// ATT MTU
+    uint16_t mtu;
+    /// Maximum TX octets of one LE data PDU
+    uint16_t tx_octets;
+    /// Maximum RX octets of one LE data PDU
+    uint16_t rx_octets;
+    /// TX PHY (@see enum gap_phy)
+    uint8_t tx_phy;
+    /// RX PHY (@see enum gap_phy)
+    uint8_t rx_phy;
+
+    /// Connection interval (unit 1.25ms)
+    uint16_t con_interval;
+    /// Slave latency
+    uint16_t con_latency;
+    /// Profile the device state asks for (@see enum app_link_profile)
+    uint8_t want;
+    /// How long want has not changed (unit 100ms)
+    uint16_t want_cnt;
+    /// Profile of the pending request, APP_LINK_PROFILE_NB if none
+    uint8_t req;
+    /// Rejections in a row
+    uint8_t reject_cnt;
+    /// No request before this runs out (unit 100ms)
+    uint16_t wait;
+};
+
+/*
+ * GLOBAL VARIABLES DECLARATIONS
+ ****************************************************************************************
+ */
+
+extern struct app_link_env_tag app_link_env[BLE_CONNECTION_MAX]; /// Link environment, index conidx
+
+extern const struct app_subtask_handlers app_link_handlers; /// Table of message handlers
+
+/*
+ * FUNCTIONS DECLARATION
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Reset the link parameters of every connection to the BLE defaults
+ * @return void.
+ ****************************************************************************************
+ */
+void app_link_init(void);
+
+/**
+ ****************************************************************************************
+ * @brief Request the maximum MTU, 251 octets data length and the 2M PHY
+ * @param[in] conidx: connect index.
+ * @param[in] con_interval: connection interval (unit 1.25ms).
+ * @param[in] con_latency: slave latency.
+ * @return void.
+ ****************************************************************************************
+ */
+void app_link_start(uint8_t conidx, uint16_t con_interval, uint16_t con_latency);
+
+/**
+ ****************************************************************************************
+ * @brief Connection closed, its link parameters go back to the BLE defaults
+ * @param[in] conidx: connect index.
+ * @return void.
+ ****************************************************************************************
+ */
+void app_link_stop(uint8_t conidx);
+
+/**
+ ****************************************************************************************
+ * @brief Notification payload filling whole LE data PDUs for a link
+ * @param[in] conidx: connect index.
+ * @param[in] max: characteristic length limit.
+ * @return Payload length.
+ ****************************************************************************************
+ */
+uint16_t app_link_tx_length(uint8_t conidx, uint16_t max);
+
+/**
+ ****************************************************************************************
+ * @brief Connection parameters of a profile
+ * @param[in] profile: @see enum app_link_profile.
+ * @return Connection parameters.
+ ****************************************************************************************
+ */
+const struct gapc_conn_param *app_link_profile_param(uint8_t profile);
+
+/**
+ ****************************************************************************************
+ * @brief Connection parameter policy of every link, call every 100ms
+ * @param[in] want: profile matching the device state (@see enum app_link_profile).
+ * @return void.
+ ****************************************************************************************
+ */
+void app_link_policy_handler(uint8_t want);
+
+/**
+ ****************************************************************************************
+ * @brief Result of the connection parameter update request
+ * @param[in] conidx: connect index.
+ * @param[in] status: GAP_ERR_NO_ERROR or the rejection reason.
+ * @return void.
+ ****************************************************************************************
+ */
+void app_link_param_update_cmp(uint8_t conidx, uint8_t status);
+
+/**
+ ****************************************************************************************
+ * @brief The central asked for new connection parameters
+ * @param[in] conidx: connect index.
+ * @return void.
+ ****************************************************************************************
+ */
+void app_link_param_update_req(uint8_t conidx);
+
+/// @} APP
+
+#endif // APP_LINK_H_
@@ -36,13 +36,26 @@
 #include "prf_types.h"               // Profile common types definition
 #include "arch.h"                    // Platform Definitions
 #include "prf.h"
+#include "app_link.h"
+#include "app_coc.h"
+#include "co_timer.h"
+#include "crc8.h"
+#include "protocol.h"                // HEAD_1 HEAD_2 protocol_link
+#include "bulk.h"                    // bulk_link_reset
 #include <string.h>
+#ifdef CONFIG_LOG_OUTPUT
+#include "peripheral.h"              // uart_send_block
+#endif
 
 /*
  * DEFINES
  ****************************************************************************************
  */
 
+#if (BLE_CONNECTION_MAX > PROTOCOL_LINK_MAX)
+#error "PROTOCOL_LINK_MAX must cover BLE_CONNECTION_MAX"
+#endif
+
 /*
  * GLOBAL VARIABLE DEFINITIONS
  ****************************************************************************************
@@ -51,6 +64,17 @@
 /// Application Module Environment Structure
 struct app_simple_server_env_tag app_simple_server_env;
 
+/// Response queue of each link
+static uint8_t tx_ctrl_queue[BLE_CONNECTION_MAX][APP_TX_CTRL_QUEUE_LEN];
+/// Shared TX class queues, every frame is written once for all links
+static uint8_t tx_alarm_queue[APP_TX_ALARM_QUEUE_LEN];
+static uint8_t tx_emg_queue[APP_TX_EMG_QUEUE_LEN];
+static uint8_t tx_raw_queue[APP_TX_RAW_QUEUE_LEN];
+
+static void app_simple_server_tx_schedule(uint8_t conidx);
+static void app_simple_server_tx_reset(uint8_t conidx);
+static void app_simple_server_tx_subscribe(uint8_t conidx, bool enable);
+
 /*
  * GLOBAL FUNCTION DEFINITIONS
  ****************************************************************************************
@@ -58,10 +82,20 @@ struct app_simple_server_env_tag app_simple_server_env;
 
 void app_simple_server_init(void)
 {
+    uint8_t i;
+
     // Reset the environment
     memset(&app_simple_server_env, 0, sizeof(struct app_simple_server_env_tag));
-
-    // TODO: Initial something
+    app_simple_server_env.tx_dest = GAP_INVALID_CONIDX;
+
+    co_fifo_init(&app_simple_server_env.tx_fifo[APP_TX_ALARM], tx_alarm_queue, sizeof(tx_alarm_queue));
+    co_fifo_init(&app_simple_server_env.tx_fifo[APP_TX_EMG], tx_emg_queue, sizeof(tx_emg_queue));
+    co_fifo_init(&app_simple_server_env.tx_fifo[APP_TX_RAW], tx_raw_queue, sizeof(tx_raw_queue));
+    for(i = 0; i < BLE_CONNECTION_MAX; i++)
+    {
+        co_fifo_init(&app_simple_server_env.con[i].tx_ctrl, tx_ctrl_queue[i], sizeof(tx_ctrl_queue[i]));
+        app_simple_server_tx_reset(i);
+    }
 }
 
 const struct prf_task_cbs* simple_server_prf_itf_get(void);
@@ -94,7 +128,13 @@ void app_simple_server_add_service(void)
 
 void app_simple_server_enable_prf(uint8_t conidx)
 {
-    app_simple_server_env.conidx = conidx;
+    if(conidx >= BLE_CONNECTION_MAX)
+        return;
+
+    // Frames queued before the link came up are not for it
+    app_simple_server_tx_reset(conidx);
+    app_simple_server_env.con[conidx].connected = true;
+
     // Allocate the message
     struct simple_server_enable_req * req = KE_MSG_ALLOC(SIMPLE_SERVER_ENABLE_REQ,
                                                 prf_get_task_from_id(TASK_ID_SIMPLE_SERVER),
@@ -110,8 +150,51 @@ void app_simple_server_enable_prf(uint8_t conidx)
 
 void app_simple_server_disable_prf(uint8_t conidx)
 {
-    app_simple_server_env.conidx = GAP_INVALID_CONIDX;
+    if(conidx >= BLE_CONNECTION_MAX)
+        return;
+
     ke_timer_clear(SIMPLE_SERVER_TIMEOUT_TIMER, TASK_APP);
+
+    // Frames of the old link are dropped, it no longer holds shared frames back
+    app_simple_server_tx_subscribe(conidx, false);
+    app_simple_server_env.con[conidx].connected = false;
+    app_simple_server_tx_reset(conidx);
+    if(app_simple_server_env.tx_dest == conidx)
+        app_simple_server_env.tx_dest = GAP_INVALID_CONIDX;
+    protocol_link_reset(conidx);
+    bulk_link_reset(conidx);
+}
+
+void app_simple_server_set_con_interval(uint8_t conidx, uint16_t con_interval)
+{
+    if(conidx < BLE_CONNECTION_MAX)
+        app_simple_server_env.con[conidx].con_interval = con_interval;
+}
+
+void app_simple_server_set_tx_dest(uint8_t conidx)
+{
+    app_simple_server_env.tx_dest = conidx;
+}
+
+bool app_simple_server_claim_control(uint8_t conidx)
+{
+    struct app_simple_server_con_tag *con = app_simple_server_env.con;
+    uint8_t i;
+
+    if(conidx >= BLE_CONNECTION_MAX || !con[conidx].connected)
+        return false;
+    if(con[conidx].role == APP_ROLE_CONTROLLER)
+        return true;
+
+    for(i = 0; i < BLE_CONNECTION_MAX; i++)
+    {
+        if(con[i].connected && con[i].role == APP_ROLE_CONTROLLER)
+            return false;
+    }
+
+    con[conidx].role = APP_ROLE_CONTROLLER;
+    log_debug("conidx(%d) controller\n", conidx);
+    return true;
 }
 
 static int simple_server_enable_rsp_handler(ke_msg_id_t const msgid,
@@ -130,10 +213,12 @@ static int simple_server_demo_ntf_cfg_ind_handler(ke_msg_id_t const msgid,
     if(param->ntf_cfg == PRF_CLI_START_NTF || param->ntf_cfg == PRF_CLI_START_IND)
 		{
 // Remove 20210610    ke_timer_set(SIMPLE_SERVER_TIMEOUT_TIMER, TASK_APP, 100);
+        app_simple_server_tx_subscribe(param->conidx, true);
     }
 		else if(param->ntf_cfg == PRF_CLI_STOP_NTFIND)
 		{
 // Remove 20210610       ke_timer_clear(SIMPLE_SERVER_TIMEOUT_TIMER, TASK_APP);
+        app_simple_server_tx_subscribe(param->conidx, false);
     }
     return (KE_MSG_CONSUMED);
 }
@@ -156,7 +241,7 @@ static int simple_server_timeout_timer_handler(ke_msg_id_t const msgid,
 																							sizeof(ntf_data));
 	
 	
-	cmd->conidx = app_simple_server_env.conidx;
+	cmd->conidx = app_env.conidx;
 	cmd->length = sizeof(ntf_data);
 	memcpy(cmd->value, ntf_data, sizeof(ntf_data));
 	// Send the message
@@ -208,32 +293,666 @@ const struct ke_msg_handler app_simple_server_msg_handler_list[] =
 /// simple server handler
 const struct app_subtask_handlers app_simple_server_handlers = APP_HANDLERS(app_simple_server);
 
-#include "crc8.h"
-void ble_send_data(uint8_t *buff, uint32_t length)
+/**
+ ****************************************************************************************
+ * @brief Notification payload for the negotiated MTU and data length of a link, or the
+ *        SDU its L2CAP channel takes with the peer credits left
+ ****************************************************************************************
+ */
+static uint16_t app_simple_server_tx_max(uint8_t conidx)
 {
-	uint8_t i,crc = 0;
-	
-//	uint32_t length = 0;
-	
-//	length = QUEUE_STOCK(BLE_Tx);
-	
-	struct simple_server_send_ntf_cmd * cmd = KE_MSG_ALLOC_DYN(SIMPLE_SERVER_SEND_NTF_CMD,
-																						prf_get_task_from_id(TASK_ID_SIMPLE_SERVER),
-																						TASK_APP,
-																						simple_server_send_ntf_cmd,
-																						length + 1);
-		for(i = 0; i < length; i++)
-		{
-			cmd->value[i] = buff[i];//QUEUE_READ(BLE_Tx);;
-			crc = CRC8(crc, buff[i]);
-		}
-		cmd->value[i] = crc;
-		
-		cmd->conidx = app_simple_server_env.conidx;
-		cmd->length = (length + 1);
-
-		// Send the message
-		ke_msg_send(cmd);
+    #if (BLE_APP_COC)
+    if(app_simple_server_env.con[conidx].coc_en)
+        return app_coc_tx_max(conidx);
+    #endif //(BLE_APP_COC)
+
+    return app_link_tx_length(conidx, APP_SIMPLE_SERVER_TX_BUF_LEN);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Length of the oldest frame in a queue, Len byte + head1 head2 token len crc
+ ****************************************************************************************
+ */
+static uint16_t app_simple_server_tx_frame_len(co_fifo_t *fifo)
+{
+    uint8_t head[4];
+
+    if(co_fifo_peek(fifo, head, sizeof(head)) < sizeof(head))
+        return 0;
+
+    return head[3] + 4;
+}
+
+static bool app_simple_server_tx_subscribed(struct app_simple_server_con_tag *con)
+{
+    return con->connected && (con->ntf_en || con->coc_en);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Queue of a class as a link reads it: its own control queue, or a copy of the
+ *        shared queue starting at the read position of the link
+ ****************************************************************************************
+ */
+static co_fifo_t *app_simple_server_tx_queue(struct app_simple_server_con_tag *con, uint8_t tx_class, co_fifo_t *view)
+{
+    co_fifo_t *fifo = &app_simple_server_env.tx_fifo[tx_class];
+
+    if(tx_class == APP_TX_CTRL)
+        return &con->tx_ctrl;
+
+    *view = *fifo;
+    // Nothing for a link without notifications, a stale position starts at the oldest frame
+    if(!app_simple_server_tx_subscribed(con))
+        view->out = fifo->in;
+    else if(fifo->in - con->tx_out[tx_class] <= co_fifo_len(fifo))
+        view->out = con->tx_out[tx_class];
+
+    return view;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Frames every subscribed link has sent leave the shared queue
+ ****************************************************************************************
+ */
+static void app_simple_server_tx_release(uint8_t tx_class)
+{
+    struct app_simple_server_con_tag *con = app_simple_server_env.con;
+    co_fifo_t *fifo = &app_simple_server_env.tx_fifo[tx_class];
+    unsigned lag, lag_max = 0;
+    uint8_t i;
+
+    for(i = 0; i < BLE_CONNECTION_MAX; i++)
+    {
+        if(!app_simple_server_tx_subscribed(&con[i]))
+            continue;
+        lag = fifo->in - con[i].tx_out[tx_class];
+        if(lag > lag_max && lag <= co_fifo_len(fifo))
+            lag_max = lag;
+    }
+
+    fifo->out = fifo->in - lag_max;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Drop the oldest frame of a shared queue, links still on it skip to the next one
+ ****************************************************************************************
+ */
+static void app_simple_server_tx_frame_drop(uint8_t tx_class)
+{
+    struct app_simple_server_con_tag *con = app_simple_server_env.con;
+    co_fifo_t *fifo = &app_simple_server_env.tx_fifo[tx_class];
+    unsigned out = fifo->out;
+    uint8_t i;
+
+    __co_fifo_add_out(fifo, app_simple_server_tx_frame_len(fifo));
+
+    for(i = 0; i < BLE_CONNECTION_MAX; i++)
+    {
+        if(con[i].tx_out[tx_class] == out)
+            con[i].tx_out[tx_class] = fifo->out;
+    }
+}
+
+static void app_simple_server_tx_timer_handler(co_timer_t *timer, void *param)
+{
+    struct app_simple_server_con_tag *con = param;
+
+    con->tx_timer_on = false;
+    con->tx_deadline = true;
+    app_simple_server_tx_schedule(con - app_simple_server_env.con);
+}
+
+static void app_simple_server_tx_timer_stop(struct app_simple_server_con_tag *con)
+{
+    if(con->tx_timer_on)
+        co_timer_del(&con->tx_flush_timer);
+    con->tx_timer_on = false;
+}
+
+static void app_simple_server_tx_reset(uint8_t conidx)
+{
+    struct app_simple_server_con_tag *con = &app_simple_server_env.con[conidx];
+    uint8_t i;
+
+    app_simple_server_tx_timer_stop(con);
+    co_fifo_reset(&con->tx_ctrl);
+    // Shared frames queued from now on
+    for(i = APP_TX_ALARM; i < APP_TX_CLASS_NB; i++)
+        con->tx_out[i] = app_simple_server_env.tx_fifo[i].in;
+    con->role         = APP_ROLE_VIEWER;
+    con->con_interval = APP_SIMPLE_SERVER_DFLT_CON_INTV;
+    con->tx_credit    = APP_SIMPLE_SERVER_TX_CREDITS;
+    con->tx_deadline  = false;
+    con->coc_en       = false;
+}
+
+/**
+ ****************************************************************************************
+ * @brief A link subscribed or unsubscribed, through notifications or its channel
+ ****************************************************************************************
+ */
+static void app_simple_server_tx_rejoin(uint8_t conidx, bool was_subscribed)
+{
+    struct app_simple_server_con_tag *con = &app_simple_server_env.con[conidx];
+    uint8_t i;
+
+    // A new subscriber starts with the next shared frame
+    if(!was_subscribed && app_simple_server_tx_subscribed(con))
+    {
+        for(i = APP_TX_ALARM; i < APP_TX_CLASS_NB; i++)
+            con->tx_out[i] = app_simple_server_env.tx_fifo[i].in;
+    }
+
+    for(i = APP_TX_ALARM; i < APP_TX_CLASS_NB; i++)
+        app_simple_server_tx_release(i);
+
+    app_simple_server_tx_schedule(conidx);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Notifications of a link enabled or disabled by the peer
+ ****************************************************************************************
+ */
+static void app_simple_server_tx_subscribe(uint8_t conidx, bool enable)
+{
+    struct app_simple_server_con_tag *con;
+    bool was_subscribed;
+
+    if(conidx >= BLE_CONNECTION_MAX)
+        return;
+    con = &app_simple_server_env.con[conidx];
+
+    was_subscribed = app_simple_server_tx_subscribed(con);
+    con->ntf_en = enable;
+    app_simple_server_tx_rejoin(conidx, was_subscribed);
+}
+
+void app_simple_server_coc_update(uint8_t conidx)
+{
+    #if (BLE_APP_COC)
+    struct app_simple_server_con_tag *con;
+    bool was_subscribed;
+
+    if(conidx >= BLE_CONNECTION_MAX || !app_simple_server_env.con[conidx].connected)
+        return;
+    con = &app_simple_server_env.con[conidx];
+
+    // The channel takes over from notifications while it is open, new credits resume it
+    was_subscribed = app_simple_server_tx_subscribed(con);
+    con->coc_en = app_coc_is_open(conidx);
+    app_simple_server_tx_rejoin(conidx, was_subscribed);
+    #endif //(BLE_APP_COC)
+}
+
+/**
+ ****************************************************************************************
+ * @brief Pack the queued frames of a link, highest class first, into notifications
+ *        (or SDUs of its L2CAP channel) while its credits last
+ ****************************************************************************************
+ */
+static void app_simple_server_tx_schedule(uint8_t conidx)
+{
+    struct app_simple_server_con_tag *con;
+    co_fifo_t view[APP_TX_CLASS_NB];
+    co_fifo_t *fifo[APP_TX_CLASS_NB];
+    uint8_t i;
+
+    if(conidx >= BLE_CONNECTION_MAX || !app_simple_server_env.con[conidx].connected)
+        return;
+    con = &app_simple_server_env.con[conidx];
+
+    for(i = 0; i < APP_TX_CLASS_NB; i++)
+        fifo[i] = app_simple_server_tx_queue(con, i, &view[i]);
+
+    while(con->tx_credit)
+    {
+        uint16_t max = app_simple_server_tx_max(conidx);
+        uint16_t pending = 0;
+        uint16_t length = 0;
+        uint16_t first = 0;
+        uint16_t frame_len;
+        struct simple_server_send_ntf_cmd *cmd = NULL;
+        #if (BLE_APP_COC)
+        struct l2cc_lecb_sdu_send_cmd *sdu = NULL;
+        #endif //(BLE_APP_COC)
+        uint8_t *value;
+
+        for(i = 0; i < APP_TX_CLASS_NB; i++)
+        {
+            pending += co_fifo_len(fifo[i]);
+            if(first == 0)
+                first = app_simple_server_tx_frame_len(fifo[i]);
+        }
+
+        if(pending == 0)
+        {
+            con->tx_deadline = false;
+            app_simple_server_tx_timer_stop(con);
+            break;
+        }
+
+        // Only EMG/raw frames queued: wait for a full notification or the deadline
+        if(co_fifo_is_empty(fifo[APP_TX_CTRL]) && co_fifo_is_empty(fifo[APP_TX_ALARM])
+            && pending < max && !con->tx_deadline)
+        {
+            if(!con->tx_timer_on)
+            {
+                // 1.25ms per interval unit
+                uint32_t delay = (uint32_t)con->con_interval * APP_SIMPLE_SERVER_TX_FLUSH_INTV * 5 / 4;
+
+                co_timer_set(&con->tx_flush_timer, delay ? delay : 1, TIMER_ONE_SHOT, app_simple_server_tx_timer_handler, con);
+                con->tx_timer_on = true;
+            }
+            break;
+        }
+
+        #if (BLE_APP_COC)
+        if(con->coc_en)
+        {
+            // Out of peer credits, the oldest frame waits for L2CC_LECB_ADD_IND
+            if(first > max)
+                break;
+            sdu = app_coc_sdu_alloc(conidx, max);
+            value = sdu->sdu.data;
+        }
+        else
+        #endif //(BLE_APP_COC)
+        {
+            cmd = KE_MSG_ALLOC_DYN(SIMPLE_SERVER_SEND_NTF_CMD,
+                                   prf_get_task_from_id(TASK_ID_SIMPLE_SERVER),
+                                   TASK_APP,
+                                   simple_server_send_ntf_cmd,
+                                   MAX(max, first));
+            value = cmd->value;
+        }
+
+        // Strict priority, a frame that does not fit ends the notification
+        for(i = 0; i < APP_TX_CLASS_NB; i++)
+        {
+            while((frame_len = app_simple_server_tx_frame_len(fifo[i])) != 0)
+            {
+                // Longer than one packet (MTU not negotiated yet), goes out alone as before
+                if(length + frame_len > max && length != 0)
+                    break;
+                length += co_fifo_out(fifo[i], value + length, frame_len);
+                if(length >= max)
+                    break;
+            }
+            if(frame_len != 0)
+                break;
+        }
+
+        con->tx_credit--;
+        con->tx_deadline = false;
+
+        #if (BLE_APP_COC)
+        if(sdu != NULL)
+        {
+            app_coc_sdu_send(conidx, sdu, length);
+            continue;
+        }
+        #endif //(BLE_APP_COC)
+
+        cmd->conidx = conidx;
+        cmd->length = length;
+
+        // Send the message
+        ke_msg_send(cmd);
+    }
+
+    // Keep the read positions, shared frames all links have sent are freed
+    if(app_simple_server_tx_subscribed(con))
+    {
+        for(i = APP_TX_ALARM; i < APP_TX_CLASS_NB; i++)
+        {
+            con->tx_out[i] = view[i].out;
+            app_simple_server_tx_release(i);
+        }
+    }
+}
+
+void app_simple_server_tx_cmp(uint8_t conidx)
+{
+    struct app_simple_server_con_tag *con;
+
+    if(conidx >= BLE_CONNECTION_MAX)
+        return;
+    con = &app_simple_server_env.con[conidx];
+
+    if(con->tx_credit < APP_SIMPLE_SERVER_TX_CREDITS)
+        con->tx_credit++;
+
+    app_simple_server_tx_schedule(conidx);
+}
+
+uint16_t app_simple_server_tx_depth(uint8_t conidx, uint8_t tx_class)
+{
+    co_fifo_t view;
+
+    if(tx_class >= APP_TX_CLASS_NB)
+        return 0;
+    if(conidx >= BLE_CONNECTION_MAX)
+        return (tx_class == APP_TX_CTRL) ? 0 : co_fifo_len(&app_simple_server_env.tx_fifo[tx_class]);
+
+    return co_fifo_len(app_simple_server_tx_queue(&app_simple_server_env.con[conidx], tx_class, &view));
+}
+
+/**
+ ****************************************************************************************
+ * @brief Link of a control frame: the one set with app_simple_server_set_tx_dest(), else
+ *        the one whose command is running, else GAP_INVALID_CONIDX for every link
+ ****************************************************************************************
+ */
+static uint8_t app_simple_server_tx_ctrl_dest(void)
+{
+    int16_t link = protocol_link();
+
+    if(app_simple_server_env.tx_dest != GAP_INVALID_CONIDX)
+        return app_simple_server_env.tx_dest;
+
+    return (link >= 0) ? (uint8_t)link : GAP_INVALID_CONIDX;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Control queue a frame is written to, for every link the first connected one
+ *        (link 0 while none is, e.g. CONFIG_LOG_OUTPUT), the others get a copy on commit
+ ****************************************************************************************
+ */
+static co_fifo_t *app_simple_server_tx_ctrl_fifo(uint8_t conidx)
+{
+    struct app_simple_server_con_tag *con = app_simple_server_env.con;
+    uint8_t i;
+
+    if(conidx < BLE_CONNECTION_MAX)
+        return con[conidx].connected ? &con[conidx].tx_ctrl : NULL;
+
+    for(i = 0; i < BLE_CONNECTION_MAX; i++)
+    {
+        if(con[i].connected)
+            return &con[i].tx_ctrl;
+    }
+
+    return &con[0].tx_ctrl;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Copy a committed control frame to the other connected links
+ ****************************************************************************************
+ */
+static void app_simple_server_tx_ctrl_copy(co_fifo_t *from, uint16_t length)
+{
+    struct app_simple_server_con_tag *con = app_simple_server_env.con;
+    uint8_t buff[APP_SIMPLE_SERVER_FRAME_MAX];
+    co_fifo_t frame = *from;
+    uint8_t i;
+
+    frame.out = from->in - length;
+    co_fifo_peek(&frame, buff, length);
+
+    for(i = 0; i < BLE_CONNECTION_MAX; i++)
+    {
+        if(!con[i].connected || &con[i].tx_ctrl == from)
+            continue;
+        if(co_fifo_avail(&con[i].tx_ctrl) < length)
+            app_simple_server_env.tx_drop[APP_TX_CTRL]++;
+        else
+            co_fifo_in(&con[i].tx_ctrl, buff, length);
+    }
+}
+
+uint16_t app_simple_server_tx_free(uint8_t tx_class)
+{
+    co_fifo_t *fifo;
+
+    if(tx_class >= APP_TX_CLASS_NB)
+        return 0;
+
+    if(tx_class == APP_TX_CTRL)
+        fifo = app_simple_server_tx_ctrl_fifo(app_simple_server_tx_ctrl_dest());
+    else
+        fifo = &app_simple_server_env.tx_fifo[tx_class];
+
+    return (fifo != NULL) ? co_fifo_avail(fifo) : 0;
+}
+
+bool app_simple_server_tx_full(uint8_t tx_class, uint16_t data_len)
+{
+    return app_simple_server_tx_free(tx_class) < APP_TX_FRAME_LEN(data_len);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Reserve room for a frame of up to max bytes (CRC excluded) at the queue tail
+ *
+ * The frame is written behind fifo->in and only becomes visible to the scheduler on
+ * commit, so nothing may be queued on the same class between reserve and commit.
+ ****************************************************************************************
+ */
+static bool app_tx_frame_reserve(struct app_tx_frame *frame, uint8_t tx_class, uint16_t max)
+{
+    co_fifo_t *fifo;
+
+    frame->fifo = NULL;
+    frame->conidx = GAP_INVALID_CONIDX;
+    frame->len = 0;
+    frame->max = 0;
+    frame->tx_class = tx_class;
+
+    if(max + 1 > APP_SIMPLE_SERVER_FRAME_MAX || tx_class >= APP_TX_CLASS_NB)
+        return false;
+
+    if(tx_class == APP_TX_CTRL)
+    {
+        // Response to one link, or written once and copied on commit
+        frame->conidx = app_simple_server_tx_ctrl_dest();
+        fifo = app_simple_server_tx_ctrl_fifo(frame->conidx);
+        if(fifo == NULL)
+            return false;
+    }
+    else
+    {
+        fifo = &app_simple_server_env.tx_fifo[tx_class];
+    }
+    if(max + 1 > co_fifo_size(fifo))
+        return false;
+
+    while(co_fifo_avail(fifo) < max + 1)
+    {
+        app_simple_server_env.tx_drop[tx_class]++;
+
+        // A response is never thrown away to make room
+        if(tx_class < APP_TX_EMG)
+            return false;
+
+        // Waveform and values: the oldest frame is the stale one
+        app_simple_server_tx_frame_drop(tx_class);
+    }
+
+    frame->fifo = fifo;
+    frame->max = max;
+    return true;
+}
+
+/// Frame byte at pos, the reserved room may wrap around the queue end
+static uint8_t *app_tx_frame_at(struct app_tx_frame *frame, uint16_t pos)
+{
+    co_fifo_t *fifo = frame->fifo;
+
+    return fifo->buffer + __co_fifo_off(fifo, fifo->in + pos);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Start a protocol frame in the queue of a TX class
+ *
+ * @param[out] frame     Frame to fill with app_tx_frame_put_*() and app_tx_frame_commit()
+ * @param[in]  tx_class  TX class (@see enum app_tx_class)
+ * @param[in]  token     Protocol token
+ * @param[in]  type      Protocol type
+ * @param[in]  data_max  Longest payload that will be written
+ *
+ * @return false if no room could be reserved, the put/commit calls are then no-ops
+ ****************************************************************************************
+ */
+bool app_tx_frame_begin(struct app_tx_frame *frame, uint8_t tx_class, uint8_t token, uint8_t type, uint16_t data_max)
+{
+    if(!app_tx_frame_reserve(frame, tx_class, APP_TX_FRAME_HEAD_LEN + 1 + data_max))
+        return false;
+
+    app_tx_frame_put_u8(frame, HEAD_1);
+    app_tx_frame_put_u8(frame, HEAD_2);
+    app_tx_frame_put_u8(frame, token);
+    app_tx_frame_put_u8(frame, 0);      // length, set on commit
+    app_tx_frame_put_u8(frame, type);
+
+    return true;
+}
+
+void app_tx_frame_put_u8(struct app_tx_frame *frame, uint8_t value)
+{
+    if(frame->fifo == NULL)
+        return;
+
+    // Overflow: the frame would be truncated, drop it on commit
+    if(frame->len >= frame->max)
+    {
+        frame->fifo = NULL;
+        return;
+    }
+
+    *app_tx_frame_at(frame, frame->len++) = value;
+}
+
+/// Big-endian, as every multi-byte protocol field
+void app_tx_frame_put_u16(struct app_tx_frame *frame, uint16_t value)
+{
+    app_tx_frame_put_u8(frame, value >> 8);
+    app_tx_frame_put_u8(frame, value);
+}
+
+/// Big-endian, as every multi-byte protocol field
+void app_tx_frame_put_u32(struct app_tx_frame *frame, uint32_t value)
+{
+    app_tx_frame_put_u16(frame, value >> 16);
+    app_tx_frame_put_u16(frame, value);
+}
+
+void app_tx_frame_put(struct app_tx_frame *frame, const uint8_t *data, uint16_t length)
+{
+    co_fifo_t *fifo = frame->fifo;
+    unsigned off, l;
+
+    if(fifo == NULL)
+        return;
+
+    if(frame->len + length > frame->max)
+    {
+        frame->fifo = NULL;
+        return;
+    }
+
+    off = __co_fifo_off(fifo, fifo->in + frame->len);
+    l = MIN(length, fifo->size - off);
+    memcpy(fifo->buffer + off, data, l);
+    memcpy(fifo->buffer, data + l, length - l);
+    frame->len += length;
+}
+
+void app_tx_frame_fill(struct app_tx_frame *frame, uint8_t value, uint16_t length)
+{
+    while(length--)
+        app_tx_frame_put_u8(frame, value);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Set the length and CRC of a frame and hand it to the scheduler
+ ****************************************************************************************
+ */
+void app_tx_frame_commit(struct app_tx_frame *frame)
+{
+    co_fifo_t *fifo = frame->fifo;
+    unsigned off, l;
+    uint8_t crc;
+    uint16_t depth;
+
+    if(fifo == NULL)
+    {
+        // Reserved but overflowed
+        if(frame->max)
+            app_simple_server_env.tx_drop[frame->tx_class]++;
+        return;
+    }
+    frame->fifo = NULL;
+    frame->max = 0;
+
+    // Length counts type, data and CRC
+    *app_tx_frame_at(frame, 3) = frame->len + 1 - APP_TX_FRAME_HEAD_LEN;
+
+    off = __co_fifo_off(fifo, fifo->in);
+    l = MIN(frame->len, fifo->size - off);
+    crc = CRC8_Update(0, fifo->buffer + off, l);
+    crc = CRC8_Update(crc, fifo->buffer, frame->len - l);
+    *app_tx_frame_at(frame, frame->len) = crc;
+
+    __co_fifo_add_in(fifo, frame->len + 1);
+
+    depth = co_fifo_len(fifo);
+    if(depth > app_simple_server_env.tx_depth_max[frame->tx_class])
+        app_simple_server_env.tx_depth_max[frame->tx_class] = depth;
+
+#ifdef CONFIG_LOG_OUTPUT
+    // Debug build: the protocol goes out on UART0 instead of notifications
+    {
+        uint8_t buff[APP_SIMPLE_SERVER_FRAME_MAX];
+
+        while((l = app_simple_server_tx_frame_len(fifo)) != 0)
+        {
+            co_fifo_out(fifo, buff, l);
+            uart_send_block(HS_UART0, buff, l);
+        }
+    }
+#else
+    if(frame->tx_class == APP_TX_CTRL)
+    {
+        if(frame->conidx == GAP_INVALID_CONIDX)
+            app_simple_server_tx_ctrl_copy(fifo, frame->len + 1);
+        else
+        {
+            app_simple_server_tx_schedule(frame->conidx);
+            return;
+        }
+    }
+
+    // Built once, every link sends it from the shared queue
+    for(l = 0; l < BLE_CONNECTION_MAX; l++)
+        app_simple_server_tx_schedule(l);
+    if(frame->tx_class != APP_TX_CTRL)
+        app_simple_server_tx_release(frame->tx_class);
+#endif
+}
+
+/**
+ ****************************************************************************************
+ * @brief Queue a frame built elsewhere (head1 head2 token length type data), CRC appended
+ ****************************************************************************************
+ */
+void ble_send_data(uint8_t *buff, uint32_t length, uint8_t tx_class)
+{
+    struct app_tx_frame frame;
+
+    if(!app_tx_frame_reserve(&frame, tx_class, length))
+        return;
+
+    app_tx_frame_put(&frame, buff, length);
+    app_tx_frame_commit(&frame);
 }
 
 
@@ -34,19 +34,122 @@
 #include <stdint.h>          // Standard Integer Definition
 #include "ke_task.h"         // Kernel Task Definition
 #include "co_debug.h"         // Kernel Task Definition
+#include "simple_server_task.h"  // SIMPLE_SERVER_MAX_CHAC_LEN
+#include "co.h"                    // co_fifo
+#include <stdbool.h>
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// Notification aggregation buffer, one full characteristic value
+#define APP_SIMPLE_SERVER_TX_BUF_LEN        SIMPLE_SERVER_MAX_CHAC_LEN
+/// Aggregated frames are flushed at the latest after this many connection intervals
+#define APP_SIMPLE_SERVER_TX_FLUSH_INTV     1
+/// Connection interval assumed before the link reports one (unit 1.25ms)
+#define APP_SIMPLE_SERVER_DFLT_CON_INTV     8
+/// Notifications handed to GATTC and not completed yet
+#define APP_SIMPLE_SERVER_TX_CREDITS        4
+/// Longest protocol frame, CRC included: one full notification
+#define APP_SIMPLE_SERVER_FRAME_MAX         APP_SIMPLE_SERVER_TX_BUF_LEN
+/// Frame head: head1 head2 token length
+#define APP_TX_FRAME_HEAD_LEN               4
+/// Queue bytes of a frame with data_len data bytes: head, type, data, CRC
+#define APP_TX_FRAME_LEN(data_len)          (APP_TX_FRAME_HEAD_LEN + 1 + (data_len) + 1)
+
+/// TX queue of each class in bytes, power of 2 (co_fifo). Control queues are per
+/// connection, the others are shared: a frame is written once and every link reads it
+#define APP_TX_CTRL_QUEUE_LEN               256
+#define APP_TX_ALARM_QUEUE_LEN              128
+#define APP_TX_EMG_QUEUE_LEN                256
+#define APP_TX_RAW_QUEUE_LEN                512
+
+/// Notification TX classes, highest priority first
+enum app_tx_class
+{
+    /// Command responses, to the link that sent the command
+    APP_TX_CTRL,
+    /// Alarms and events, e.g. ACK_BAT_LOW
+    APP_TX_ALARM,
+    /// Periodic values: EMG envelope, probe status, battery, monitor
+    APP_TX_EMG,
+    /// Raw EMG waveform
+    APP_TX_RAW,
+
+    APP_TX_CLASS_NB,
+};
 
 /*
  * STRUCTURES DEFINITION
  ****************************************************************************************
  */
 
+/// Command roles of a connection
+enum app_con_role
+{
+    /// Queries only, e.g. a clinician tablet watching the EMG
+    APP_ROLE_VIEWER,
+    /// May change the device state (stimulation, intensity), one link at a time
+    APP_ROLE_CONTROLLER,
+};
+
+/// Protocol frame being written in place into a TX class queue
+struct app_tx_frame
+{
+    /// Queue holding the frame, NULL if no room was reserved or the frame overflowed
+    co_fifo_t *fifo;
+    /// Control frame receiver, GAP_INVALID_CONIDX for every link
+    uint8_t conidx;
+    /// Bytes written so far, head included, CRC excluded
+    uint16_t len;
+    /// Bytes reserved, CRC excluded
+    uint16_t max;
+    /// TX class (@see enum app_tx_class)
+    uint8_t tx_class;
+};
+
+/// State of one connection
+struct app_simple_server_con_tag
+{
+    /// Profile enabled on this link
+    bool connected;
+    /// Peer enabled notifications, shared frames are only kept for subscribed links
+    bool ntf_en;
+    /// Frames go over the L2CAP channel of the link instead (app_coc), also subscribed
+    bool coc_en;
+    /// Command role (@see enum app_con_role)
+    uint8_t role;
+    /// Connection interval (unit 1.25ms)
+    uint16_t con_interval;
+    /// Responses to this link (APP_TX_CTRL)
+    co_fifo_t tx_ctrl;
+    /// Read position of this link in each shared queue, APP_TX_CTRL unused
+    unsigned tx_out[APP_TX_CLASS_NB];
+    /// Notifications that may still be handed to GATTC
+    uint8_t tx_credit;
+    /// Flush deadline timer running
+    bool tx_timer_on;
+    /// Flush deadline passed, send a partly filled notification
+    bool tx_deadline;
+    /// Notification flush deadline
+    co_timer_t tx_flush_timer;
+};
+
 ///struct app_simple_server_env_tag
 /// Application Module Environment Structure
 struct app_simple_server_env_tag
 {
-    /// Connection handle
-    uint8_t conidx;
-    /// Some other parameters
+    /// Connections, index conidx
+    struct app_simple_server_con_tag con[BLE_CONNECTION_MAX];
+    /// Shared queues of the ALARM/EMG/RAW classes, out is the slowest subscribed link
+    co_fifo_t tx_fifo[APP_TX_CLASS_NB];
+    /// Control frames outside a command go to this link, GAP_INVALID_CONIDX for every link
+    uint8_t tx_dest;
+    /// Frames dropped because the class queue was full
+    uint16_t tx_drop[APP_TX_CLASS_NB];
+    /// Highest queue depth seen (bytes)
+    uint16_t tx_depth_max[APP_TX_CLASS_NB];
 };
 
 /*
@@ -105,6 +208,113 @@ void app_simple_server_enable_prf(uint8_t conidx);
  */
 void app_simple_server_disable_prf(uint8_t conidx);
 
+/**
+ ****************************************************************************************
+ * @brief Record the connection interval, used for the notification flush deadline
+ * @param[in] conidx: connect index.
+ * @param[in] con_interval: connection interval (unit 1.25ms).
+ * @return void.
+ ****************************************************************************************
+ */
+void app_simple_server_set_con_interval(uint8_t conidx, uint16_t con_interval);
+
+/**
+ ****************************************************************************************
+ * @brief Send the following control frames to one link only, for frames that are not
+ *        a command response (those go to the link of the command, @see protocol_link)
+ * @param[in] conidx: connect index, GAP_INVALID_CONIDX to go back to the default.
+ * @return void.
+ ****************************************************************************************
+ */
+void app_simple_server_set_tx_dest(uint8_t conidx);
+
+/**
+ ****************************************************************************************
+ * @brief Controller role check for a command that changes the device state. The first
+ *        link asking while no link is controller takes the role, until it disconnects.
+ * @param[in] conidx: connect index.
+ * @return true if the link is (now) the controller.
+ ****************************************************************************************
+ */
+bool app_simple_server_claim_control(uint8_t conidx);
+
+/**
+ ****************************************************************************************
+ * @brief Queue one protocol frame for notification, the CRC8 byte is appended here
+ * @param[in] buff: frame without CRC.
+ * @param[in] length: frame length.
+ * @param[in] tx_class: @see enum app_tx_class. Control and alarm frames go out at once,
+ *                      EMG and raw frames wait until a notification is full or the
+ *                      deadline passes. A full EMG/raw queue drops its oldest frame.
+ *                      Control frames go to one link, the other classes to all links.
+ * @return void.
+ ****************************************************************************************
+ */
+void ble_send_data(uint8_t *buff, uint32_t length, uint8_t tx_class);
+
+bool app_tx_frame_begin(struct app_tx_frame *frame, uint8_t tx_class, uint8_t token, uint8_t type, uint16_t data_max);
+
+void app_tx_frame_put_u8(struct app_tx_frame *frame, uint8_t value);
+
+void app_tx_frame_put_u16(struct app_tx_frame *frame, uint16_t value);
+
+void app_tx_frame_put_u32(struct app_tx_frame *frame, uint32_t value);
+
+void app_tx_frame_put(struct app_tx_frame *frame, const uint8_t *data, uint16_t length);
+
+void app_tx_frame_fill(struct app_tx_frame *frame, uint8_t value, uint16_t length);
+
+void app_tx_frame_commit(struct app_tx_frame *frame);
+
+/**
+ ****************************************************************************************
+ * @brief GATTC finished (or skipped) one notification, or L2CC one SDU, its credit
+ *        comes back
+ * @param[in] conidx: connect index.
+ * @return void.
+ ****************************************************************************************
+ */
+void app_simple_server_tx_cmp(uint8_t conidx);
+
+/**
+ ****************************************************************************************
+ * @brief Bytes a link still has to send in a TX class
+ * @param[in] conidx: connect index.
+ * @param[in] tx_class: @see enum app_tx_class.
+ * @return Queue depth.
+ ****************************************************************************************
+ */
+uint16_t app_simple_server_tx_depth(uint8_t conidx, uint8_t tx_class);
+
+/**
+ ****************************************************************************************
+ * @brief The L2CAP channel of a link opened, closed or got peer credits
+ * @param[in] conidx: connect index.
+ * @return void.
+ ****************************************************************************************
+ */
+void app_simple_server_coc_update(uint8_t conidx);
+
+/**
+ ****************************************************************************************
+ * @brief Bytes a new frame of a TX class may take without dropping a queued one
+ * @param[in] tx_class: @see enum app_tx_class. APP_TX_CTRL: queue of the current
+ *                      control destination.
+ * @return Free queue bytes.
+ ****************************************************************************************
+ */
+uint16_t app_simple_server_tx_free(uint8_t tx_class);
+
+/**
+ ****************************************************************************************
+ * @brief Backpressure check before producing a frame
+ * @param[in] tx_class: @see enum app_tx_class.
+ * @param[in] data_len: data bytes of the frame.
+ * @return true if app_tx_frame_begin() would have to drop (or refuse) to make room.
+ ****************************************************************************************
+ */
+bool app_simple_server_tx_full(uint8_t tx_class, uint16_t data_len);
+
 // Some other functions
 
 
@@ -37,6 +37,9 @@
 #include "co_utils.h"
 #include "ke_timer.h"             // Kernel timer
 #include "co_debug.h"
+#include "app_link.h"             // Link setup Definitions
+#include "app_bcast.h"            // Summary broadcast Definitions
+#include "app_coc.h"              // CoC transport Definitions
 
 #if (BLE_APP_SEC)
 #include "app_sec.h"              // Security Module Definition
@@ -47,6 +50,13 @@
 #include "diss_task.h"
 #endif //(BLE_APP_DIS)
 
+#if (BLE_APP_BCAST)
+/// Connectable advertising is given up in broadcast only mode
+#define APP_ADV_ALLOWED()         app_bcast_adv_allowed()
+#else
+#define APP_ADV_ALLOWED()         (true)
+#endif //(BLE_APP_BCAST)
+
 extern void appm_reg_svc_itf(void);
 /*
  * LOCAL FUNCTION DEFINITIONS
@@ -104,6 +114,12 @@ static int gapm_activity_created_ind_handler(ke_msg_id_t const msgid,
                                              ke_task_id_t const src_id)
 {
     if (p_param->actv_type == GAPM_ACTV_TYPE_ADV) {
+        #if (BLE_APP_BCAST)
+        if (app_bcast_create_ind_handler((void*)p_param))
+        {
+            return (KE_MSG_CONSUMED);
+        }
+        #endif //(BLE_APP_BCAST)
         appm_adv_create_ind_handler((void*)p_param);
     }
 
@@ -128,6 +144,12 @@ static int gapm_activity_stopped_ind_handler(ke_msg_id_t const msgid,
                                              ke_task_id_t const src_id)
 {
     if (p_param->actv_type == GAPM_ACTV_TYPE_ADV) {
+        #if (BLE_APP_BCAST)
+        if (app_bcast_stopped_ind_handler((void*)p_param))
+        {
+            return (KE_MSG_CONSUMED);
+        }
+        #endif //(BLE_APP_BCAST)
         appm_adv_stopped_ind_handler((void*)p_param);
     }
 
@@ -218,16 +240,24 @@ static int gapm_cmp_evt_handler(ke_msg_id_t const msgid,
                 // The Max MTU is increased to support the Public Key exchange
                 // HOWEVER, with secure connections enabled you cannot sniff the
                 // LEAP and LEAS protocols
-                cmd->max_mtu = 160;
                 cmd->pairing_mode = GAPM_PAIRING_SEC_CON | GAPM_PAIRING_LEGACY;
                 #else // !(BLE_APP_SEC_CON)
                 // Do not support secure connections
                 cmd->pairing_mode = GAPM_PAIRING_LEGACY;
                 #endif //(BLE_APP_SEC_CON)
 
+                // Largest MTU, also covers the Public Key exchange (160)
+                cmd->max_mtu = APP_LINK_MAX_MTU;
+
+                #if (BLE_APP_COC)
+                // One LE credit based channel per link, K-frames fill a data PDU
+                cmd->max_mps     = APP_COC_MPS;
+                cmd->max_nb_lecb = BLE_CONNECTION_MAX;
+                #endif //(BLE_APP_COC)
+
                 // Set Data length parameters
-                cmd->sugg_max_tx_octets = BLE_MIN_OCTETS;
-                cmd->sugg_max_tx_time   = BLE_MIN_TIME;
+                cmd->sugg_max_tx_octets = LE_MAX_OCTETS;
+                cmd->sugg_max_tx_time   = LE_MAX_TIME;
 
                 #if (BLE_APP_HID)
                 // Enable Slave Preferred Connection Parameters present
@@ -286,6 +316,11 @@ static int gapm_cmp_evt_handler(ke_msg_id_t const msgid,
                 // Go to the ready state
                 ke_state_set(TASK_APP, APPM_READY);
 
+                #if (BLE_APP_COC)
+                // Channel of the AM300 protocol, next to the GATT service
+                app_coc_register();
+                #endif //(BLE_APP_COC)
+
                 // No more service to add, start advertising
                 //appm_adv_update_state(true);
                 appm_adv_start();
@@ -330,14 +365,28 @@ static int gapm_cmp_evt_handler(ke_msg_id_t const msgid,
             break;
         #endif
 
+        #if (BLE_APP_COC)
+        case (GAPM_LEPSM_REG):
+        {
+            app_coc_register_cmp(param->status);
+        } break;
+        #endif //(BLE_APP_COC)
+
         case (GAPM_CREATE_ADV_ACTIVITY):
         case (GAPM_STOP_ACTIVITY):
         case (GAPM_START_ACTIVITY):
         case (GAPM_DELETE_ACTIVITY):
         case (GAPM_SET_ADV_DATA):
         case (GAPM_SET_SCAN_RSP_DATA):
+        case (GAPM_SET_PERIOD_ADV_DATA):
         case (GAPM_DELETE_ALL_ACTIVITIES) :
         {
+            #if (BLE_APP_BCAST)
+            if (app_bcast_cmp_evt_handler((void*)param))
+            {
+                break;
+            }
+            #endif //(BLE_APP_BCAST)
             appm_adv_cmp_evt_handler((void*)param);
         } break;
 
@@ -386,19 +435,21 @@ static int gapc_get_dev_info_req_ind_handler(ke_msg_id_t const msgid,
 
         case GAPC_DEV_SLV_PREF_PARAMS:
         {
+            // Profile used until the policy asks for another one
+            const struct gapc_conn_param *pref = app_link_profile_param(APP_LINK_PROFILE_STREAM);
             // Allocate message
             struct gapc_get_dev_info_cfm *cfm = KE_MSG_ALLOC(GAPC_GET_DEV_INFO_CFM,
                     src_id, dest_id,
                                                             gapc_get_dev_info_cfm);
             cfm->req = param->req;
             // Slave preferred Connection interval Min
-            cfm->info.slv_pref_params.con_intv_min = 8;
+            cfm->info.slv_pref_params.con_intv_min = pref->intv_min;
             // Slave preferred Connection interval Max
-            cfm->info.slv_pref_params.con_intv_max = 10;
+            cfm->info.slv_pref_params.con_intv_max = pref->intv_max;
             // Slave preferred Connection latency
-            cfm->info.slv_pref_params.slave_latency  = 0;
+            cfm->info.slv_pref_params.slave_latency  = pref->latency;
             // Slave preferred Link supervision timeout
-            cfm->info.slv_pref_params.conn_timeout    = 200;  // 2s (500*10ms)
+            cfm->info.slv_pref_params.conn_timeout    = pref->time_out;
 
             // Send message
             ke_msg_send(cfm);
@@ -456,24 +507,26 @@ static int gapc_connection_req_ind_handler(ke_msg_id_t const msgid,
                                            ke_task_id_t const dest_id,
                                            ke_task_id_t const src_id)
 {
-    app_env.conidx = KE_IDX_GET(src_id);
+    uint8_t conidx = KE_IDX_GET(src_id);
     #if(BLE_APP_SEC)
     bool is_bond = app_sec_get_bond_status_by_addr(param->peer_addr);
     #endif
 	
-		enable_notification(1); // Add 20210610
-	
-	log_debug("Device type(%d) conidx(%d) connected, ", param->peer_addr_type, app_env.conidx);
+	log_debug("Device type(%d) conidx(%d) connected, ", param->peer_addr_type, conidx);
 	log_debug_array_ex("ADDR", &param->peer_addr, 6);
     // Check if the received Connection Handle was valid
-    if (app_env.conidx != GAP_INVALID_CONIDX)
+    if (conidx < BLE_CONNECTION_MAX)
     {
         // Retrieve the connection info from the parameters
+        app_env.conidx = conidx;
         app_env.conhdl = param->conhdl;
+        app_env.con_nb++;
+
+		enable_notification(conidx, 1); // Add 20210610
 
         // Send connection confirmation
         struct gapc_connection_cfm *cfm = KE_MSG_ALLOC(GAPC_CONNECTION_CFM,
-                KE_BUILD_ID(TASK_GAPC, app_env.conidx), TASK_APP,
+                KE_BUILD_ID(TASK_GAPC, conidx), TASK_APP,
                 gapc_connection_cfm);
 
         #if(BLE_APP_SEC)
@@ -495,18 +548,32 @@ static int gapc_connection_req_ind_handler(ke_msg_id_t const msgid,
 
         #if (BLE_APP_SIMPLE_SERVER)
         // Enable SIMPLE_SERVER Service
-        app_simple_server_enable_prf(app_env.conhdl);
+        app_simple_server_enable_prf(conidx);
+        app_simple_server_set_con_interval(conidx, param->con_interval);
         #endif //(BLE_APP_SIMPLE_SERVER)
 
+        // Ask for MTU, data length and 2M PHY
+        app_link_start(conidx, param->con_interval, param->con_latency);
+
         // We are now in connected State
         ke_state_set(dest_id, APPM_CONNECTED);
 
+        // Keep advertising while a link is free, e.g. for the clinician tablet next to the patient phone
+        if (app_env.con_nb < BLE_CONNECTION_MAX && APP_ADV_ALLOWED())
+        {
+            appm_adv_start();
+        }
+
+        #if (BLE_APP_BCAST)
+        app_bcast_link_changed();
+        #endif //(BLE_APP_BCAST)
+
 
         #if (BLE_APP_SEC)
         if (is_bond)
         {
             // Ask for the peer device to either start encryption
-            app_sec_send_security_req(app_env.conidx);
+            app_sec_send_security_req(conidx);
         }
         #endif // (BLE_APP_SEC)
 				
@@ -515,7 +582,10 @@ static int gapc_connection_req_ind_handler(ke_msg_id_t const msgid,
     {
         // No connection has been established, restart advertising
         //appm_adv_update_state(true);
-        appm_adv_start();
+        if (APP_ADV_ALLOWED())
+        {
+            appm_adv_start();
+        }
     }
 
     return (KE_MSG_CONSUMED);
@@ -546,6 +616,8 @@ static int gapc_cmp_evt_handler(ke_msg_id_t const msgid,
             {
 //                appm_disconnect();
             }
+            // Back off on rejection
+            app_link_param_update_cmp(KE_IDX_GET(src_id), param->status);
         } break;
 
         default:
@@ -573,16 +645,36 @@ static int gapc_disconnect_ind_handler(ke_msg_id_t const msgid,
                                       ke_task_id_t const dest_id,
                                       ke_task_id_t const src_id)
 {
-	enable_notification(0); // Add 20210610
+    uint8_t conidx = KE_IDX_GET(src_id);
+
+	enable_notification(conidx, 0); // Add 20210610
 	
-    log_debug("Disconnected.\n");
-	app_simple_server_disable_prf(KE_IDX_GET(src_id));
-    // Go to the ready state
-    ke_state_set(TASK_APP, APPM_READY);
+    log_debug("conidx(%d) disconnected.\n", conidx);
+	app_simple_server_disable_prf(conidx);
+	app_link_stop(conidx);
+    #if (BLE_APP_COC)
+    app_coc_stop(conidx);
+    #endif //(BLE_APP_COC)
+    if (app_env.con_nb)
+    {
+        app_env.con_nb--;
+    }
+    // Go to the ready state once the last link is gone
+    if (app_env.con_nb == 0)
+    {
+        ke_state_set(TASK_APP, APPM_READY);
+    }
 
-    // Restart Advertising
+    // Restart Advertising, not in broadcast only mode
     //appm_adv_update_state(true);
-    appm_adv_start();
+    if (APP_ADV_ALLOWED())
+    {
+        appm_adv_start();
+    }
+
+    #if (BLE_APP_BCAST)
+    app_bcast_link_changed();
+    #endif //(BLE_APP_BCAST)
 
     return (KE_MSG_CONSUMED);
 }
@@ -605,11 +697,12 @@ static int gapc_disconnect_ind_handler(ke_msg_id_t const msgid,
  {
 	 // Prepare the GAPC_PARAM_UPDATE_CMD message
 	 struct gapc_param_update_cfm *cfm = KE_MSG_ALLOC(GAPC_PARAM_UPDATE_CFM,
-													  KE_BUILD_ID(TASK_GAPC, app_env.conidx), TASK_APP,
+													  src_id, TASK_APP,
 													  gapc_param_update_cfm);
 
 	 /// True to accept slave connection parameters, False else.
 	 cfm->accept = true;
+	 app_link_param_update_req(KE_IDX_GET(src_id));
 	 /// Minimum Connection Event Duration
 	 cfm->ce_len_min = 0x0;
 	 /// Maximum Connection Event Duration
@@ -654,13 +747,29 @@ static int appm_msg_handler(ke_msg_id_t const msgid,
                 msg_pol = app_get_handler(&app_sec_handlers, msgid, param, src_id);
             }
             #endif //(BLE_APP_SEC)
+            if ((msgid == GAPC_LE_PKT_SIZE_IND) ||
+                (msgid == GAPC_LE_PHY_IND) ||
+                (msgid == GAPC_PARAM_UPDATED_IND))
+            {
+                // Call the Link setup Module
+                msg_pol = app_get_handler(&app_link_handlers, msgid, param, src_id);
+            }
             // else drop the message
         } break;
 
         case (TASK_ID_GATTC):
         {
-            // Service Changed - Drop
+            // MTU changed, Service Changed - Drop
+            msg_pol = app_get_handler(&app_link_handlers, msgid, param, src_id);
+        } break;
+
+        #if (BLE_APP_COC)
+        case (TASK_ID_L2CC):
+        {
+            // LE credit based channel of the AM300 protocol
+            msg_pol = app_get_handler(&app_coc_handlers, msgid, param, src_id);
         } break;
+        #endif //(BLE_APP_COC)
 
         #if (BLE_APP_DIS)
         case (TASK_ID_DISS):
@@ -0,0 +1,356 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: bulk.c
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20211018
+		1. 20211018		First editon
+		2.
+*/
+#include <string.h>
+#include "bulk.h"
+#include "handler.h"
+#include "protocol.h"
+#include "bsp_systick.h"
+
+static Bulk_sink_Typedef bulk_sink[BULK_SINK_NUM];
+static Bulk_source_Typedef bulk_source[BULK_SOURCE_NUM];
+static Bulk_link_Typedef bulk_link[PROTOCOL_LINK_MAX];
+
+/************************************************
+	@Function			: bulk_init
+	@Description	:	ʼ
+	@parameter		: None
+	@Return				: None
+	@Remark				: нշȡ͸ӵĴ
+*/
+void bulk_init(void)
+{
+	memset(bulk_sink, 0, sizeof(bulk_sink));
+	memset(bulk_source, 0, sizeof(bulk_source));
+	memset(bulk_link, 0, sizeof(bulk_link));
+}
+
+/************************************************
+	@Function			: bulk_sink_find
+	@Description	:	ҽշ
+	@parameter		: id , Id
+	@Return				: շδעʱΪ NULL
+	@Remark				: None
+*/
+static Bulk_sink_Typedef *bulk_sink_find(uint8_t id)
+{
+	uint8_t i;
+	
+	for(i = 0; i < BULK_SINK_NUM; i++)
+	{
+		if(id && (bulk_sink[i].id == id)) return &bulk_sink[i];
+	}
+	
+	return NULL;
+}
+
+/************************************************
+	@Function			: bulk_sink_find_free
+	@Description	:	δʹõĽշ
+	@parameter		: None
+	@Return				: շʱΪ NULL
+	@Remark				: None
+*/
+static Bulk_sink_Typedef *bulk_sink_find_free(void)
+{
+	uint8_t i;
+	
+	for(i = 0; i < BULK_SINK_NUM; i++)
+	{
+		if(bulk_sink[i].id == 0) return &bulk_sink[i];
+	}
+	
+	return NULL;
+}
+
+/************************************************
+	@Function			: bulk_sink_register
+	@Description	:	עݽշ
+	@parameter		: id , Id0
+									buf , ջ
+									size , ջС
+									done , ɻصΪνյݣֵΪ ACK_BULK  Status
+	@Return				: 1 , ɹ; 0 , 
+	@Remark				: ͬһ Id ظעʱ»棻done ǰ buf ᱻһδд
+*/
+uint8_t bulk_sink_register(uint8_t id, uint8_t *buf, uint16_t size, BULK_DONE_TYPE done)
+{
+	Bulk_sink_Typedef *sink = bulk_sink_find(id);
+	uint8_t i;
+	
+	if(!id || !buf) return 0;
+	
+	if(sink == NULL) sink = bulk_sink_find_free();
+	if(sink == NULL) return 0;
+	
+	// ˣڽеĴ
+	for(i = 0; i < PROTOCOL_LINK_MAX; i++)
+	{
+		if(bulk_link[i].sink == sink) bulk_link[i].sink = NULL;
+	}
+	
+	sink->id = id;
+	sink->buf = buf;
+	sink->size = size;
+	sink->done = done;
+	
+	return 1;
+}
+
+/************************************************
+	@Function			: bulk_source_register
+	@Description	:	עȡ
+	@parameter		: id , ȡId0
+									size , ѯ󳤶
+									read , ȡһ
+	@Return				: 1 , ɹ; 0 , 
+	@Remark				: ͬһ Id ظעʱ»ص
+*/
+uint8_t bulk_source_register(uint8_t id, BULK_SIZE_TYPE size, BULK_READ_TYPE read)
+{
+	Bulk_source_Typedef *source = NULL;
+	uint8_t i;
+	
+	if(!id || !size || !read) return 0;
+	
+	for(i = 0; i < BULK_SOURCE_NUM; i++)
+	{
+		if(bulk_source[i].id == id)
+		{
+			source = &bulk_source[i];
+			break;
+		}
+		if((bulk_source[i].id == 0) && (source == NULL)) source = &bulk_source[i];
+	}
+	if(source == NULL) return 0;
+	
+	source->id = id;
+	source->size = size;
+	source->read = read;
+	
+	return 1;
+}
+
+/************************************************
+	@Function			: bulk_sink_busy
+	@Description	:	շǷӴ
+	@parameter		: sink , շ
+									link , ǰ
+	@Return				: 1 , ; 0 , 
+	@Remark				: ʱĴΪжϣͷŽշ
+*/
+static uint8_t bulk_sink_busy(Bulk_sink_Typedef *sink, uint8_t link)
+{
+	Bulk_link_Typedef *l;
+	uint8_t i;
+	
+	for(i = 0; i < PROTOCOL_LINK_MAX; i++)
+	{
+		l = &bulk_link[i];
+		if((i == link) || (l->sink != sink) || (l->recv >= l->total)) continue;
+		
+		if(TICK_PASSED(TICK_NOW, l->tick) < BULK_RX_TIMEOUT) return 1;
+		l->sink = NULL;
+	}
+	
+	return 0;
+}
+
+/************************************************
+	@Function			: bulk_segment_handler
+	@Description	:	һֶ
+	@parameter		: link , 
+									data , չ֡ Id Total Offset ֶ...
+									len , 
+	@Return				: None
+	@Remark				: չ֡ͨCRCУ飬ֱָBLEдݻ黺
+									ʱֻظһƫƴֱAPPӸƫط
+*/
+void bulk_segment_handler(uint8_t link, const uint8_t *data, uint16_t len)
+{
+	Bulk_sink_Typedef *sink;
+	Bulk_link_Typedef *l;
+	uint16_t total, offset;
+	uint8_t status;
+	
+	if(link >= PROTOCOL_LINK_MAX) return;
+	l = &bulk_link[link];
+	
+	if(len < BULK_SEG_HEAD_LEN)
+	{
+		bulk_ack_packet_send(link, len ? data[0] : 0, BULK_ERR_FORMAT, 0);
+		return;
+	}
+	
+	sink = bulk_sink_find(data[0]);
+	if(sink == NULL)
+	{
+		bulk_ack_packet_send(link, data[0], BULK_ERR_ID, 0);
+		return;
+	}
+	
+	total = (uint16_t)data[1] << 8 | data[2];
+	offset = (uint16_t)data[3] << 8 | data[4];
+	data += BULK_SEG_HEAD_LEN;
+	len -= BULK_SEG_HEAD_LEN;
+	
+	if(offset == 0)  // µĴ
+	{
+		if(bulk_sink_busy(sink, link))
+		{
+			bulk_ack_packet_send(link, sink->id, BULK_ERR_BUSY, 0);
+			return;
+		}
+		l->sink = sink;
+		l->total = total;
+		l->recv = 0;
+		l->nak = 0;
+		if(total > sink->size)
+		{
+			l->total = 0;
+			bulk_ack_packet_send(link, sink->id, BULK_ERR_SIZE, 0);
+			return;
+		}
+	}
+	else if(l->sink != sink)  // ûпʼô䣬ͷط
+	{
+		l->sink = sink;
+		l->total = 0;
+		l->recv = 0;
+		l->nak = 0;
+	}
+	
+	if((offset != l->recv) || (total != l->total))
+	{
+		if(!l->nak) bulk_ack_packet_send(link, sink->id, BULK_ERR_OFFSET, l->recv);
+		l->nak = 1;
+		return;
+	}
+	
+	if(len > total - offset)
+	{
+		bulk_ack_packet_send(link, sink->id, BULK_ERR_SIZE, l->recv);
+		return;
+	}
+	
+	memcpy(sink->buf + offset, data, len);
+	l->recv += len;
+	l->nak = 0;
+	l->tick = TICK_NOW;
+	
+	if(l->recv == l->total)
+	{
+		l->total = 0;  // ɺظķֶΰƫƴ
+		status = sink->done ? sink->done(sink->id, sink->buf, l->recv) : BULK_OK;
+		bulk_ack_packet_send(link, sink->id, status, status == BULK_OK ? l->recv : 0);
+		l->recv = 0;
+	}
+}
+
+/************************************************
+	@Function			: bulk_read_handler
+	@Description	:	ʼһζȡ
+	@parameter		: link , 
+									data , CMD_BULK_READ  Id Sel Offset
+									len , 
+	@Return				: None
+	@Remark				: ֻ bulk_handler Ͷϴ
+*/
+void bulk_read_handler(uint8_t link, const uint8_t *data, uint16_t len)
+{
+	Bulk_source_Typedef *source = NULL;
+	Bulk_link_Typedef *l;
+	uint16_t total, offset;
+	uint8_t i;
+	
+	if(link >= PROTOCOL_LINK_MAX) return;
+	l = &bulk_link[link];
+	l->source = NULL;
+	
+	if(len < BULK_READ_LEN)
+	{
+		bulk_ack_packet_send(link, len ? data[0] : 0, BULK_ERR_FORMAT, 0);
+		return;
+	}
+	
+	for(i = 0; i < BULK_SOURCE_NUM; i++)
+	{
+		if(data[0] && (bulk_source[i].id == data[0])) source = &bulk_source[i];
+	}
+	total = source ? source->size(data[1]) : 0;
+	if(total == 0)
+	{
+		bulk_ack_packet_send(link, data[0], BULK_ERR_ID, 0);
+		return;
+	}
+	
+	offset = (uint16_t)data[2] << 8 | data[3];
+	if(offset >= total)
+	{
+		bulk_ack_packet_send(link, data[0], BULK_ERR_OFFSET, 0);
+		return;
+	}
+	
+	l->source = source;
+	l->sel = data[1];
+	l->tx_total = total;
+	l->tx_offset = offset;
+}
+
+/************************************************
+	@Function			: bulk_link_reset
+	@Description	:	ӶϿϸӵĴ
+	@parameter		: link , 
+	@Return				: None
+	@Remark				: շ漴ɱʹ
+*/
+void bulk_link_reset(uint8_t link)
+{
+	if(link < PROTOCOL_LINK_MAX) memset(&bulk_link[link], 0, sizeof(Bulk_link_Typedef));
+}
+
+/************************************************
+	@Function			: bulk_handler
+	@Description	:	ϴȡݣʱ
+	@parameter		: None
+	@Return				: None
+	@Remark				: ÿӷŵƶΪֹʱ´εãӦ
+									Ƽ¼ѱʱظ BULK_ERR_ID 
+*/
+void bulk_handler(void)
+{
+	uint8_t buf[BULK_TX_SEG_MAX];
+	Bulk_link_Typedef *l;
+	uint16_t len;
+	uint8_t i;
+	
+	for(i = 0; i < PROTOCOL_LINK_MAX; i++)
+	{
+		l = &bulk_link[i];
+		while(l->source != NULL)
+		{
+			len = l->tx_total - l->tx_offset;
+			if(len > BULK_TX_SEG_MAX) len = BULK_TX_SEG_MAX;
+			if(!bulk_data_ready(i, len)) break;
+			
+			if(l->source->read(l->sel, l->tx_offset, buf, len) != len)
+			{
+				bulk_ack_packet_send(i, l->source->id, BULK_ERR_ID, l->tx_offset);
+				l->source = NULL;
+				break;
+			}
+			bulk_data_packet_send(i, l->source->id, l->tx_total, l->tx_offset, buf, len);
+			
+			l->tx_offset += len;
+			if(l->tx_offset >= l->tx_total) l->source = NULL;
+		}
+	}
+}
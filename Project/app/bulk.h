@@ -0,0 +1,90 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: bulk.h
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20211018
+		1. 20211018		First editon
+		2.
+*/
+
+#ifndef __BULK_H__
+#define __BULK_H__
+
+#include <stdint.h>
+
+/*
+	ݷֶδ䣨APP -> λʹչ֡ CMD_BULK_DATA :
+		Data : Id(1) Total(2) Offset(2) ֶ...
+	ÿչ֡CRCУ飬ֱӿշעĻ
+	ֶα밴˳Offset Ϊ 0 ʱʼµĴ䣻ֻɻʱظ ACK_BULK :
+		Data : Id(1) Status(1) Offset(2) Offset ΪһƫƣʱAPPӴ˴ط
+	ÿӸһ䣻շһӴʱظ BULK_ERR_BUSY 
+	ô䳬 BULK_RX_TIMEOUT û·ֶλӶϿ
+	
+	ȡλ -> APP׼֡ CMD_BULK_READ :
+		Data : Id(1) Sel(1) Offset(2) Sel ѡڼƼ¼
+	 Offset ϴ ACK_BULK_DATA ÿ֡CRC8У :
+		Data : Id(1) Total(2) Offset(2) ֶ...
+	ӿƶеֲͣӦ𣻳ظ ACK_BULK
+	APP Offset ʱȱʧͬһµȡδɵĶȡ
+*/
+#define BULK_SINK_NUM				4				// עĽշ
+#define BULK_SOURCE_NUM			4				// עĶȡ
+#define BULK_SEG_HEAD_LEN		5				// Id Total Offset
+#define BULK_READ_LEN				4				// Id Sel Offset
+#define BULK_TX_SEG_MAX			112			// ϴֶݳȣһ֡ƶеһ
+#define BULK_RX_TIMEOUT			TICK_X10MS(200)		// жϳ2sӿռýշ
+
+#define BULK_OK							0x00		// 
+#define BULK_ERR_ID					0x01		// Id δעᣬȡ󲻴
+#define BULK_ERR_SIZE				0x02		// ܳȳջ
+#define BULK_ERR_OFFSET			0x03		// ֶβ Offset ط
+#define BULK_ERR_FORMAT			0x04		// ֶθʽ󣬻շݲͨ
+#define BULK_ERR_BUSY				0x05		// շʹãǰִУ̼У
+
+// Id
+#define BULK_ID_MON_CAL			0x01		// 迹У׼д stim_monitor_cal_set
+#define BULK_ID_SESSION_LOG	0x10		// Ƽ¼Sel 0 Ϊµļ¼ʽ session_log.h
+
+typedef uint8_t (* BULK_DONE_TYPE)(uint8_t id, uint8_t *buf, uint16_t len);		//  BULK_OK / BULK_ERR_xxx
+typedef uint16_t (* BULK_SIZE_TYPE)(uint8_t sel);																// ض󳤶ȣ0:
+typedef uint16_t (* BULK_READ_TYPE)(uint8_t sel, uint16_t offset, uint8_t *buf, uint16_t len);
+
+typedef struct{
+	uint8_t id;						// Id0 Ϊδʹ
+	uint8_t *buf;					// ջ棬ɽշṩ
+	uint16_t size;				// ջС
+	BULK_DONE_TYPE done;	// ɻص
+}Bulk_sink_Typedef;
+
+typedef struct{
+	uint8_t id;						// ȡId0 Ϊδʹ
+	BULK_SIZE_TYPE size;
+	BULK_READ_TYPE read;
+}Bulk_source_Typedef;
+
+typedef struct{
+	Bulk_sink_Typedef *sink;			// ڽյĽշNULL:
+	uint16_t total;								// ǰܳ
+	uint16_t recv;								// Ѱ˳յĳ
+	uint8_t nak;									// ѻظƫƴ󣬵ȴط
+	uint32_t tick;								// һֶεʱ
+	
+	Bulk_source_Typedef *source;	// ϴĶȡNULL:
+	uint8_t sel;
+	uint16_t tx_total;
+	uint16_t tx_offset;						// һϴƫ
+}Bulk_link_Typedef;
+
+void bulk_init(void);
+uint8_t bulk_sink_register(uint8_t id, uint8_t *buf, uint16_t size, BULK_DONE_TYPE done);
+uint8_t bulk_source_register(uint8_t id, BULK_SIZE_TYPE size, BULK_READ_TYPE read);
+void bulk_segment_handler(uint8_t link, const uint8_t *data, uint16_t len);
+void bulk_read_handler(uint8_t link, const uint8_t *data, uint16_t len);
+void bulk_link_reset(uint8_t link);
+void bulk_handler(void);
+
+#endif
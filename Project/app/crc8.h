@@ -19,6 +19,7 @@
 
 uint8_t CRC8(uint8_t crc, uint8_t data);
 uint8_t CRC_8( uint8_t *pData, uint8_t Len);
+uint8_t CRC8_Update(uint8_t crc, const uint8_t *pData, uint32_t Len);
 
 #endif
 
@@ -17,6 +17,8 @@
 #include "bsp_spi.h"
 #include "handler.h"
 #include "stim_control.h"
+#include "stim_loop.h"
+#include "session_log.h"
 
 #define EMG_OFF_AD_CH		ADC_CHANNEL_EXTERN_CH5
 
@@ -123,7 +125,8 @@ static void emg_lead_off_check(void)
 void get_emg_lead_off_adc_value(void)
 {
 	gpio_write(BITMASK(PIN_OFF_EN_OR_RELEASE), GPIO_LOW);
-	adc_sample_one_channel_irq(EMG_OFF_AD_CH, (adc_callback_t)emg_lead_off_adc_sample_handler);
+	if(!adc_sample_one_channel_irq(EMG_OFF_AD_CH, (adc_callback_t)emg_lead_off_adc_sample_handler))
+		gpio_write(BITMASK(PIN_OFF_EN_OR_RELEASE), GPIO_HIGH);  // GPADCæ´ٲ
 }
 
 
@@ -138,11 +141,16 @@ void get_emg_raw_adc_value(void)
 {
 	static EMG_CH channel = EMG_CH_A;
 	static uint16_t data = 0;
+	static uint16_t hold[EMG_CH_NUM] = {0};
 	
 	if(++channel >= EMG_CH_NUM) channel = EMG_CH_A;
 	
 	data = spi_read();
 	
+	// ̼ʱ̼弰αڼ䱣һֵ
+	if(stim_loop_blanking()) data = hold[channel];
+	else hold[channel] = data;
+	
 	switch(channel)
 	{
 		case EMG_CH_A: 
@@ -200,6 +208,9 @@ static void emg_algorithm_handler(EMG_CH channel, QUEUE_U16 *fifo)
 		
 		if(dat_tmp == 0xFFFF) return;
 		
+		stim_loop_envelope_update(channel, dat_tmp);  // ¼ִбջ
+		session_log_emg(channel, dat_tmp);  // Ƽ¼ͳ
+		
 //		printf("%d - %d\r\n", channel, dat_tmp);
 		
 		if(EMG_CH_A == channel) emg_wave.emg_a = dat_tmp;
@@ -207,7 +218,7 @@ static void emg_algorithm_handler(EMG_CH channel, QUEUE_U16 *fifo)
 		{
 			emg_wave.emg_b = dat_tmp;
 			
-//			if(stim_a_control.stim_section || stim_b_control.stim_section)
+//			if(stim_active_mask())
 //			{
 //				emg_wave_packet_send(0x9999, 0x9999);
 //			}
@@ -226,7 +237,8 @@ static void emg_algorithm_handler(EMG_CH channel, QUEUE_U16 *fifo)
 	@Description	:	ϴԭʼ
 	@parameter		: None
 	@Return				: None
-	@Remark				: None
+	@Remark				: Ͷʱֹͣȡڲɼе´ηͣѹ
+									ѹɼкٵȴɷͶмɵİɼ
 */
 void debug_emg_send_raw_data(EMG_CH channel, QUEUE_U16 *fifo)
 {
@@ -238,6 +250,8 @@ void debug_emg_send_raw_data(EMG_CH channel, QUEUE_U16 *fifo)
 	
 	for(uint16_t i = 0; i < (uint8_t)(len / 10); i++)	
 	{
+		if(!emg_org_wave_data_ready() && QUEUE_STOCK_P(fifo) < fifo->len / 2) break;
+		
 		for(uint8_t j = 0; j < 5; j++)
 		{
 			data = QUEUE_READ_P(fifo);
@@ -258,7 +272,7 @@ void debug_emg_send_raw_data(EMG_CH channel, QUEUE_U16 *fifo)
 */
 void emg_calculate_handler(void)
 {
-	if(stim_a_control.stim_section || stim_b_control.stim_section)
+	if(stim_active_mask() && !stim_loop_active())
 		return;
 	
 	if(!emg_wave.emg_wave_org_en)
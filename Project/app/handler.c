@@ -18,7 +18,15 @@
 #include "bsp_battery.h"
 #include "emg_wave.h"
 #include "stim_control.h"
+#include "stim_monitor.h"
+#include "stim_loop.h"
 #include "bsp_gpio.h"
+#include "app_simple_server.h"
+#include "app_link.h"
+#include "protocol.h"
+#include "bulk.h"
+#include "session_log.h"
+#include "app_bcast.h"
 
 //#include "protocol.h"
 
@@ -28,6 +36,9 @@
 #define TOKEN_NUM			2
 #define TYPE_NUM			50
 
+#define ORG_WAVE_DATA_LEN	21		// ԭʼΰݳȣ(1) (10) (10)
+#define ACK_SEQ_LEN			1		// Ӧ𸽼ӵдţapp_tx_frame_begin ʱ
+
 CMD_HANDLER_TYPE cmd_handler_tab[TOKEN_NUM][TYPE_NUM] = {NULL};
 
 uint8_t old_protocol_en = 0;
@@ -50,39 +61,56 @@ void ble_send_buff(uint8_t *buff, uint32_t len)
 }
 
 /************************************************
-	@Function			: ble_send_packet
+	@Function			: ble_send_packet_ex
 	@Description	:	ͨBLEЭݰ
 	@parameter		: packet , Эָ
+									tx_class , ȼ APP_TX_CTRL > APP_TX_ALARM > APP_TX_EMG > APP_TX_RAW
 	@Return				: None
-	@Remark				: None
+	@Remark				: Ӧͱ; EMG/ԭʼݺϲһ֪ͨУʱɵݰ
 */
-extern void ble_send_data(uint8_t *buff, uint32_t length);
-static void ble_send_packet(PACKET_Typedef * packet)
+static void ble_send_packet_ex(PACKET_Typedef * packet, uint8_t tx_class)
 {
+	// add head1 head2 token length  sub crc ; CONFIG_LOG_OUTPUT ʱ app_tx_frame_commit Ӵ
+	ble_send_data(packet->buf, packet->para.Length + 3, tx_class);
+}
 
-#ifdef CONFIG_LOG_OUTPUT
-	
-	uint8_t i;
-	uint8_t crc = 0;
-	static uint8_t buff[64] = {0};
+/************************************************
+	@Function			: ble_send_packet
+	@Description	:	ָӦݰ
+	@parameter		: packet , Эָ
+	@Return				: None
+	@Remark				: ȼڲݺ
+*/
+static void ble_send_packet(PACKET_Typedef * packet)
+{
+	int16_t seq = protocol_seq();
 	
-	for(i = 0; i < (packet->para.Length + 3); i++)  // add head1 head2 token length  sub crc
+	// Write Without Response ָӦ𸽼д
+	if((seq >= 0) && (packet->para.Length < sizeof(PACKET_Typedef) - 4))
 	{
-		crc = CRC8(crc, packet->buf[i]);
-		buff[i] = packet->buf[i];
-//		QUEUE_WRITE(BLE_Tx, packet->buf[i]);
+		packet->para.Data[packet->para.Length - 2] = (uint8_t)seq;
+		packet->para.Length++;
 	}
-	buff[i] = crc;
-//	QUEUE_WRITE(BLE_Tx, crc); // add crc byte
-	uart_send_block(HS_UART0, buff, packet->para.Length + 4);
-//	printf("\r\naaaa 0x%2x aaaa\r\n", crc);
-#else
 	
-	ble_send_data(packet->buf, packet->para.Length + 3);
-#endif
+	ble_send_packet_ex(packet, APP_TX_CTRL);
+}
 
+/************************************************
+	@Function			: ack_frame_commit
+	@Description	:	ύֱд뷢ͶеӦ֡
+	@parameter		: frame , app_tx_frame_begin ʱ data_max Ѷ ACK_SEQ_LEN
+	@Return				: None
+	@Remark				:  ble_send_packet ͬWrite Without Response ָӦCRCǰд
+*/
+static void ack_frame_commit(struct app_tx_frame *frame)
+{
+	int16_t seq = protocol_seq();
 	
-//	ble_send_data(packet->buf, packet->para.Length + 3);
+	if(seq >= 0)
+	{
+		app_tx_frame_put_u8(frame, (uint8_t)seq);
+	}
+	app_tx_frame_commit(frame);
 }
 
 /************************************************
@@ -91,26 +119,19 @@ static void ble_send_packet(PACKET_Typedef * packet)
 	@parameter		: None
 	@Return				: None
 	@Remark				: ϴ 1Hz
+									ϴݰֱд뷢ͶУapp_tx_frame_* PACKET_Typedef
 */
 void battery_voltage_packet_send()
 {
-	PACKET_Typedef battery_packet;
+	struct app_tx_frame frame;
 	
 	battery.vol_level = 3;
 	battery.voltage_bat_mv = 4200;
 	
-	battery_packet.para.Head1 = HEAD1;
-	battery_packet.para.Head2 = HEAD2;
-	battery_packet.para.Token = GERNARL_TOKEN;   
-	battery_packet.para.Length = 0x05;
-	battery_packet.para.Type = ACK_BATVOL;  
-	
-	battery_packet.para.Data[0] = battery.vol_level;
-	battery_packet.para.Data[1] = (uint8_t)(battery.voltage_bat_mv >> 8);
-	battery_packet.para.Data[2] = (uint8_t)battery.voltage_bat_mv;
-	
-	ble_send_packet(&battery_packet);
-	
+	app_tx_frame_begin(&frame, APP_TX_EMG, GERNARL_TOKEN, ACK_BATVOL, 3);
+	app_tx_frame_put_u8(&frame, battery.vol_level);
+	app_tx_frame_put_u16(&frame, battery.voltage_bat_mv);
+	app_tx_frame_commit(&frame);
 }
 
 /************************************************
@@ -123,33 +144,21 @@ void battery_voltage_packet_send()
 */
 void emg_wave_packet_send(uint16_t emg_a, uint16_t emg_b)
 {	
-	PACKET_Typedef emg_wave_packet;
+	struct app_tx_frame frame;
 	
-	emg_wave_packet.para.Head1 = HEAD1;
-	emg_wave_packet.para.Head2 = HEAD2;
-	emg_wave_packet.para.Token = AM300_TOKEN;  
-
 	if(!old_protocol_en) // new protocol
 	{
-		emg_wave_packet.para.Length = 0x06;
-		emg_wave_packet.para.Type = PACK_EMG_WAVE + 0x02;  
-		
-		emg_wave_packet.para.Data[0] = (uint8_t)(emg_a >> 8);
-		emg_wave_packet.para.Data[1] = (uint8_t)emg_a;
-		
-		emg_wave_packet.para.Data[2] = (uint8_t)(emg_b >> 8);
-		emg_wave_packet.para.Data[3] = (uint8_t)emg_b;
+		app_tx_frame_begin(&frame, APP_TX_EMG, AM300_TOKEN, PACK_EMG_WAVE + 0x02, 4);
+		app_tx_frame_put_u16(&frame, emg_a);
+		app_tx_frame_put_u16(&frame, emg_b);
 	}
 	else // old protocol
 	{
-		emg_wave_packet.para.Length = 0x04;
-		emg_wave_packet.para.Type = PACK_EMG_WAVE;  // ˴Э飨Type = 0x03ϴ1ͨEMGݣ
-		
-		emg_wave_packet.para.Data[0] = (uint8_t)(emg_a >> 8);
-		emg_wave_packet.para.Data[1] = (uint8_t)emg_a;
+		app_tx_frame_begin(&frame, APP_TX_EMG, AM300_TOKEN, PACK_EMG_WAVE, 2);  // ˴Э飨Type = 0x03ϴ1ͨEMGݣ
+		app_tx_frame_put_u16(&frame, emg_a);
 	}
 	
-	ble_send_packet(&emg_wave_packet);
+	app_tx_frame_commit(&frame);
 }
 
 /************************************************
@@ -162,21 +171,20 @@ void emg_wave_packet_send(uint16_t emg_a, uint16_t emg_b)
 */
 void probe_status_packet_send(uint8_t emg_pro_status, uint8_t stim_pro_status)
 {	
-	PACKET_Typedef probe_status_packet;
-	
-	probe_status_packet.para.Head1 = HEAD1;
-	probe_status_packet.para.Head2 = HEAD2;
-	probe_status_packet.para.Token = AM300_TOKEN;   
-	probe_status_packet.para.Length = 0x04;
-	probe_status_packet.para.Type = ACK_LEAD_STA;  
+	struct app_tx_frame frame;
+	uint8_t ch, status = 0;
 	
-//	if(stim_a_control.probe_status )
+//	if(stim_control[CH_A].probe_status )
 	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		if(stim_control[ch].probe_status) status |= 1 << ch;
+	}
 	
-	probe_status_packet.para.Data[0] = stim_a_control.probe_status + (stim_b_control.probe_status << 1);
-	probe_status_packet.para.Data[1] = stim_pro_status;
-	
-	ble_send_packet(&probe_status_packet);
+	app_tx_frame_begin(&frame, APP_TX_EMG, AM300_TOKEN, ACK_LEAD_STA, 2);
+	app_tx_frame_put_u8(&frame, status);
+	app_tx_frame_put_u8(&frame, stim_pro_status);
+	app_tx_frame_commit(&frame);
 }
 
 /************************************************
@@ -188,17 +196,35 @@ void probe_status_packet_send(uint8_t emg_pro_status, uint8_t stim_pro_status)
 */
 void stim_status_packet_send(uint8_t status)
 {	
-	PACKET_Typedef probe_status_packet;
+	struct app_tx_frame frame;
 	
-	probe_status_packet.para.Head1 = HEAD1;
-	probe_status_packet.para.Head2 = HEAD2;
-	probe_status_packet.para.Token = AM300_TOKEN;   
-	probe_status_packet.para.Length = 0x03;
-	probe_status_packet.para.Type = PACK_STIM_STA;  
-	
-	probe_status_packet.para.Data[0] = status;
+	app_tx_frame_begin(&frame, APP_TX_ALARM, AM300_TOKEN, PACK_STIM_STA, 1);
+	app_tx_frame_put_u8(&frame, status);
+	app_tx_frame_commit(&frame);
+}
+
+/************************************************
+	@Function			: stim_monitor_packet_send
+	@Description	:	ʹ̼迹/˳
+	@parameter		: None
+	@Return				: None
+	@Remark				: ̼ϴ 1Hz
+									ÿͨ: жϽ(1) 迹(2) ˳mV(2) ǿmA(1)
+*/
+void stim_monitor_packet_send(void)
+{
+	struct app_tx_frame frame;
+	uint8_t ch;
 	
-	ble_send_packet(&probe_status_packet);
+	app_tx_frame_begin(&frame, APP_TX_EMG, AM300_TOKEN, PACK_STIM_MON, 6 * CH_NUM);
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		app_tx_frame_put_u8(&frame, stim_monitor[ch].result);
+		app_tx_frame_put_u16(&frame, stim_monitor_impedance(ch));
+		app_tx_frame_put_u16(&frame, (uint16_t)stim_monitor_margin(ch));
+		app_tx_frame_put_u8(&frame, stim_monitor_max_intensity(ch));
+	}
+	app_tx_frame_commit(&frame);
 }
 
 /************************************************
@@ -210,15 +236,10 @@ void stim_status_packet_send(uint8_t status)
 */
 void battery_alarm_stop_cure_packet_send(void)
 {
-	PACKET_Typedef probe_status_packet;
+	struct app_tx_frame frame;
 	
-	probe_status_packet.para.Head1 = HEAD1;
-	probe_status_packet.para.Head2 = HEAD2;
-	probe_status_packet.para.Token = AM300_TOKEN;   
-	probe_status_packet.para.Length = 0x02;
-	probe_status_packet.para.Type = ACK_BAT_LOW;  
-	
-	ble_send_packet(&probe_status_packet);
+	app_tx_frame_begin(&frame, APP_TX_ALARM, AM300_TOKEN, ACK_BAT_LOW, 0);
+	app_tx_frame_commit(&frame);
 }
 
 /************************************************
@@ -227,27 +248,193 @@ void battery_alarm_stop_cure_packet_send(void)
 	@parameter		: channel , ͨ
 									fifo , ԭʼݻ
 	@Return				: None
-	@Remark				: None
+	@Remark				: Length ̶ 0x17 (1) (10) (10)ֽڲ0
+									Ͷʱɵİǰ emg_org_wave_data_ready 
 */
 void emg_org_wave_data_packet_send(uint8_t *buff)
 {
 	static uint8_t index = 0;
-	PACKET_Typedef emg_raw_wave_packet;
+	struct app_tx_frame frame;
 	
-	emg_raw_wave_packet.para.Head1 = HEAD1;
-	emg_raw_wave_packet.para.Head2 = HEAD2;
-	emg_raw_wave_packet.para.Token = AM300_TOKEN;  
+	app_tx_frame_begin(&frame, APP_TX_RAW, AM300_TOKEN, PACK_ORG_DATA, ORG_WAVE_DATA_LEN);
+	app_tx_frame_put_u8(&frame, index);
+	if(++index >= 256) index = 0;
+	
+	app_tx_frame_put(&frame, buff, 10);
+	app_tx_frame_fill(&frame, 0, 10);
+	app_tx_frame_commit(&frame);
+}
 
-	emg_raw_wave_packet.para.Length = 0x17;
-	emg_raw_wave_packet.para.Type = PACK_ORG_DATA;  
+/************************************************
+	@Function			: emg_org_wave_data_ready
+	@Description	:	ԭʼηͶǷܷһ
+	@parameter		: None
+	@Return				: 1 , Է; 0 , ѹڲɼеȷɺٷ
+	@Remark				: ÿ֪ͨ/SDUʱMTUųſ
+*/
+uint8_t emg_org_wave_data_ready(void)
+{
+	return !app_simple_server_tx_full(APP_TX_RAW, ORG_WAVE_DATA_LEN);
+}
+
+/************************************************
+	@Function			: link_param_packet_fill
+	@Description	:	BLE·
+	@parameter		: conidx , 
+									packet , Эָ
+	@Return				: None
+	@Remark				: Data : MTU(2) TX octets(2) RX octets(2) TX PHY(1) RX PHY(1) ֪ͨ(2)
+*/
+static void link_param_packet_fill(uint8_t conidx, PACKET_Typedef *packet)
+{
+	struct app_link_env_tag *link = &app_link_env[conidx < BLE_CONNECTION_MAX ? conidx : 0];
+	uint16_t tx_len = app_link_tx_length(conidx, APP_SIMPLE_SERVER_TX_BUF_LEN);
+	
+	packet->para.Length = 12;
+	packet->para.Type = PACK_LINK_PARAM;
+	
+	packet->para.Data[0] = link->mtu >> 8;
+	packet->para.Data[1] = link->mtu & 0xFF;
+	packet->para.Data[2] = link->tx_octets >> 8;
+	packet->para.Data[3] = link->tx_octets & 0xFF;
+	packet->para.Data[4] = link->rx_octets >> 8;
+	packet->para.Data[5] = link->rx_octets & 0xFF;
+	packet->para.Data[6] = link->tx_phy;
+	packet->para.Data[7] = link->rx_phy;
+	packet->para.Data[8] = tx_len >> 8;
+	packet->para.Data[9] = tx_len & 0xFF;
+}
+
+/************************************************
+	@Function			: link_param_packet_send
+	@Description	:	ϴBLE·
+	@parameter		: conidx , 
+	@Return				: None
+	@Remark				: MTU/ݳ/PHY Э̽ʱֻͣ
+*/
+void link_param_packet_send(uint8_t conidx)
+{
+	PACKET_Typedef link_packet;
 	
-	emg_raw_wave_packet.para.Data[0] = index;
-	if(++index >= 256) index = 0;
+	link_packet.para.Head1 = HEAD1;
+	link_packet.para.Head2 = HEAD2;
+	link_packet.para.Token = AM300_TOKEN;
+	link_param_packet_fill(conidx, &link_packet);
 	
-	for(uint8_t i = 0; i < 10; i++)
-		emg_raw_wave_packet.para.Data[i + 1] = buff[i];
+	app_simple_server_set_tx_dest(conidx);
+	ble_send_packet(&link_packet);
+	app_simple_server_set_tx_dest(GAP_INVALID_CONIDX);
+}
 
-	ble_send_packet(&emg_raw_wave_packet);
+/************************************************
+	@Function			: bcast_summary_fill
+	@Description	:	㲥ժҪ
+	@parameter		: buf , 棬 10 + CH_NUM ֽ
+									seq , ժҪţݱ仯ʱ1
+	@Return				: ȣ֡ͷCRC
+	@Remark				: ֪ͨͬ֡ʽƽɨʱͬһЭ
+									Data : (1) ̼ͨ(1) ͨǿ(CH_NUM) EMG A(2) EMG B(2) EMG缫״̬(1) ̼缫״̬(1) ȼ(1)
+*/
+uint8_t bcast_summary_fill(uint8_t *buf, uint8_t seq)
+{
+	uint8_t ch, stim_probe = 0;
+	uint8_t *p = buf;
+	
+	*p++ = HEAD1;
+	*p++ = HEAD2;
+	*p++ = AM300_TOKEN;
+	*p++ = 0;		// Length
+	*p++ = PACK_BCAST_SUM;
+	
+	*p++ = seq;
+	*p++ = stim_active_mask();
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		*p++ = stim_control[ch].intensity;
+		if(stim_control[ch].probe_status) stim_probe |= 1 << ch;
+	}
+	*p++ = emg_wave.emg_a >> 8;
+	*p++ = emg_wave.emg_a & 0xFF;
+	*p++ = emg_wave.emg_b >> 8;
+	*p++ = emg_wave.emg_b & 0xFF;
+	*p++ = emg_wave.probe_status;
+	*p++ = stim_probe;
+	*p++ = battery.vol_level;
+	
+	// Length  Type Data  CRC
+	buf[3] = (p - buf) - 4 + 1;
+	*p = CRC8_Update(0, buf, p - buf);
+	
+	return (p - buf) + 1;
+}
+
+/************************************************
+	@Function			: bulk_ack_packet_send
+	@Description	:	/ظ
+	@parameter		: link , 
+									id , Id
+									status , BULK_OK / BULK_ERR_xxx
+									offset , һƫ
+	@Return				: None
+	@Remark				: Data : Id(1) Status(1) Offset(2) ֻ
+									ִָУֶΡȡĻظдţʱظû
+*/
+void bulk_ack_packet_send(uint8_t link, uint8_t id, uint8_t status, uint16_t offset)
+{
+	struct app_tx_frame frame;
+	
+	app_simple_server_set_tx_dest(link);
+	app_tx_frame_begin(&frame, APP_TX_CTRL, AM300_TOKEN, ACK_BULK, 4 + ACK_SEQ_LEN);
+	app_tx_frame_put_u8(&frame, id);
+	app_tx_frame_put_u8(&frame, status);
+	app_tx_frame_put_u16(&frame, offset);
+	ack_frame_commit(&frame);
+	app_simple_server_set_tx_dest(GAP_INVALID_CONIDX);
+}
+
+/************************************************
+	@Function			: bulk_data_ready
+	@Description	:	ӵĿƶǷܷһȡֶ
+	@parameter		: link , 
+									len , ֶݳ
+	@Return				: 1 , Է; 0 , ȷɺٷ
+	@Remark				: None
+*/
+uint8_t bulk_data_ready(uint8_t link, uint16_t len)
+{
+	uint8_t ready;
+	
+	app_simple_server_set_tx_dest(link);
+	ready = !app_simple_server_tx_full(APP_TX_CTRL, BULK_SEG_HEAD_LEN + len);
+	app_simple_server_set_tx_dest(GAP_INVALID_CONIDX);
+	
+	return ready;
+}
+
+/************************************************
+	@Function			: bulk_data_packet_send
+	@Description	:	ϴһȡֶ
+	@parameter		: link , 
+									id , ȡId
+									total , ܳ
+									offset , ƫ
+									data , ֶ
+									len , ֶݳ
+	@Return				: None
+	@Remark				: Data : Id(1) Total(2) Offset(2) ֶ... ֻ
+*/
+void bulk_data_packet_send(uint8_t link, uint8_t id, uint16_t total, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+	struct app_tx_frame frame;
+	
+	app_simple_server_set_tx_dest(link);
+	app_tx_frame_begin(&frame, APP_TX_CTRL, AM300_TOKEN, ACK_BULK_DATA, BULK_SEG_HEAD_LEN + len);
+	app_tx_frame_put_u8(&frame, id);
+	app_tx_frame_put_u16(&frame, total);
+	app_tx_frame_put_u16(&frame, offset);
+	app_tx_frame_put(&frame, data, len);
+	app_tx_frame_commit(&frame);
+	app_simple_server_set_tx_dest(GAP_INVALID_CONIDX);
 }
 
 /************************************************
@@ -381,6 +568,7 @@ static void start_emg_wave_data_handler(PACKET_Typedef *packet)
 	emg_wave.emg_wave_en = 1;
 	emg_wave.emg_wave_org_en = 0;
 	gpio_write(BITMASK(PIN_EMG_OR_STIM_SW), GPIO_HIGH);  // ̵еEMG
+	pmu_lowpower_prevent(PMU_LP_SPI0);  // ɼڼSPI0˯
 	tim_start(HS_TIM1);
 	
 	packet->para.Length = 3;
@@ -404,6 +592,7 @@ static void stop_emg_wave_data_handler(PACKET_Typedef *packet)
 	emg_wave.emg_wave_en = 0;
 	gpio_write(BITMASK(PIN_EMG_OR_STIM_SW), GPIO_LOW);  // ̵еSTIM
 	tim_stop(HS_TIM1);
+	pmu_lowpower_allow(PMU_LP_SPI0);
 	
 	packet->para.Length = 3;
 	packet->para.Type = ACK_DIS_EMG;
@@ -528,16 +717,18 @@ static void inquire_stim_parameter_handler(PACKET_Typedef *packet)
 */
 static void set_stim_intensity_handler(PACKET_Typedef *packet)
 {
+	uint8_t ch;
+	
 /*
 	if(packet->para.Data[1] <= INTENSITY_MAX)
 	{
 		if(0x01 == (packet->para.Data[0] & 0x01))
 		{
-			set_stim_intensity_general(packet->para.Data[1], &stim_a_control);
+			set_stim_intensity_general(packet->para.Data[1], &stim_control[CH_A]);
 		}
 		if(0x02 == (packet->para.Data[0] & 0x02))
 		{
-			set_stim_intensity_general(packet->para.Data[1], &stim_b_control);
+			set_stim_intensity_general(packet->para.Data[1], &stim_control[CH_B]);
 		}
 		
 		packet->para.Data[0] = 0x00;
@@ -554,11 +745,11 @@ static void set_stim_intensity_handler(PACKET_Typedef *packet)
 //	printf("packet->para.Data[0] = %d\r\n",packet->para.Data[0]);
 	if(packet->para.Data[0] <= INTENSITY_MAX)
 	{
-		set_stim_intensity_general(packet->para.Data[0], &stim_a_control);
-		set_stim_intensity_general(packet->para.Data[0], &stim_b_control);
+		for(ch = 0; ch < CH_NUM; ch++)
+			set_stim_intensity_general(packet->para.Data[0], &stim_control[ch]);
 		
-//		printf("A = %d\r\n",stim_a_control.intensity);
-//		printf("B = %d\r\n",stim_b_control.intensity);
+//		printf("A = %d\r\n",stim_control[CH_A].intensity);
+//		printf("B = %d\r\n",stim_control[CH_B].intensity);
 	}
 	
 	ble_send_packet(packet);
@@ -573,11 +764,13 @@ static void set_stim_intensity_handler(PACKET_Typedef *packet)
 */
 static void inquire_stim_intensity_handler(PACKET_Typedef *packet)
 {
-	packet->para.Length = 4;
+	uint8_t ch;
+	
+	packet->para.Length = 2 + CH_NUM;
 	packet->para.Type = ACK_INTENSITY_INQ;
 	
-	packet->para.Data[0] = stim_a_control.intensity;  
-	packet->para.Data[1] = stim_b_control.intensity;  															
+	for(ch = 0; ch < CH_NUM; ch++)
+		packet->para.Data[ch] = stim_control[ch].intensity;  
 	
 	ble_send_packet(packet);
 }
@@ -595,8 +788,8 @@ static void start_stim_output_handler(PACKET_Typedef *packet)
 	
 	start_stim(1);
 	
-//	if(packet->para.Data[0] & 0x01) { res[CH_A] = startup_stim_operation(&stim_a_control); }
-//	if(packet->para.Data[0] & 0x02) { res[CH_B] = startup_stim_operation(&stim_b_control); }
+//	if(packet->para.Data[0] & 0x01) { res[CH_A] = startup_stim_operation(&stim_control[CH_A]); }
+//	if(packet->para.Data[0] & 0x02) { res[CH_B] = startup_stim_operation(&stim_control[CH_B]); }
 	
 //	gpio_write(BITMASK(PIN_EMG_OR_STIM_SW), GPIO_LOW); // ̵лStim
 	
@@ -616,8 +809,7 @@ static void start_stim_output_handler(PACKET_Typedef *packet)
 */
 static void pause_stim_output_handler(PACKET_Typedef *packet)
 {
-	stim_a_control.period_time = 0;
-	stim_b_control.period_time = 0;
+	start_stim(0);
 	
 	packet->para.Length = 0x03;
 	packet->para.Type = ACK_STIM_PAUSE;
@@ -636,8 +828,7 @@ static void pause_stim_output_handler(PACKET_Typedef *packet)
 static void stop_stim_output_handler(PACKET_Typedef *packet)
 {
 	
-	stim_a_control.period_time = 0;
-	stim_b_control.period_time = 0;
+	start_stim(0);
 	
 	packet->para.Length = 0x03;
 	packet->para.Type = ACK_STIM_STOP;
@@ -651,11 +842,27 @@ static void stop_stim_output_handler(PACKET_Typedef *packet)
 	@Description	:	紥̼ƿʼָ
 	@parameter		: packet , Эָ
 	@Return				: None
-	@Remark				: CMD Such as : AA 55 69 02 93 9E  
+	@Remark				: CMD Such as : AA 55 69 0B 97 01 00 01 00 00 64 00 32 1E xx  
+									AͨǿȸEMG Aͨ磬 256/256 100ÿ仯 0.5mA 30mA
+									Data[0] ̼ͨ  Data[1] EMGͨ  Data[2~3]   Data[4~5]   Data[6~7] 仯  Data[8] 
 */
 static void start_trigger_stim_output_handler(PACKET_Typedef *packet)
 {
+	uint8_t res = ERROR_ACK;
+	
+	if(packet->para.Length >= 2 + 9)
+	{
+		res = stim_loop_start(packet->para.Data[0], packet->para.Data[1],
+													(packet->para.Data[2] << 8) | packet->para.Data[3],
+													(packet->para.Data[4] << 8) | packet->para.Data[5],
+													(packet->para.Data[6] << 8) | packet->para.Data[7],
+													packet->para.Data[8]);
+	}
 	
+	packet->para.Length = 0x03;
+	packet->para.Type = ACK_STIM_START1;
+	packet->para.Data[0] = res;  
+	ble_send_packet(packet);
 }	
 
 /************************************************
@@ -667,7 +874,12 @@ static void start_trigger_stim_output_handler(PACKET_Typedef *packet)
 */
 static void pause_trigger_stim_output_handler(PACKET_Typedef *packet)
 {
+	stim_loop_stop();
 	
+	packet->para.Length = 0x03;
+	packet->para.Type = ACK_STIM_PAUSE1;
+	packet->para.Data[0] = 0;  
+	ble_send_packet(packet);
 }	
 
 /************************************************
@@ -679,7 +891,12 @@ static void pause_trigger_stim_output_handler(PACKET_Typedef *packet)
 */
 static void stop_trigger_stim_output_handler(PACKET_Typedef *packet)
 {
+	stim_loop_stop();
 	
+	packet->para.Length = 0x03;
+	packet->para.Type = ACK_STIM_STOP1;
+	packet->para.Data[0] = 0;  
+	ble_send_packet(packet);
 }	
 
 /************************************************
@@ -724,13 +941,24 @@ static void emg_debug_mode_en_handler(PACKET_Typedef *packet)
 	@parameter		: packet , Эָ
 	@Return				: None
 	@Remark				: CMD Such as : AA 55 69 03 A4 01 B8  // 0:disable  1:enable
+									ʱɼҲδͬ stop_emg_wave_data_handler ֹͣɼ˯
 */
 static void emg_org_wave_data_en_handler(PACKET_Typedef *packet)
 {
 	emg_wave.emg_wave_org_en = packet->para.Data[0];
-	if(emg_wave.emg_wave_org_en) emg_wave.emg_wave_en = 0;
-	gpio_write(BITMASK(PIN_EMG_OR_STIM_SW), GPIO_HIGH);  // ̵еEMG
-	tim_start(HS_TIM1);
+	if(emg_wave.emg_wave_org_en)
+	{
+		emg_wave.emg_wave_en = 0;
+		gpio_write(BITMASK(PIN_EMG_OR_STIM_SW), GPIO_HIGH);  // ̵еEMG
+		pmu_lowpower_prevent(PMU_LP_SPI0);  // ɼڼSPI0˯
+		tim_start(HS_TIM1);
+	}
+	else if(!emg_wave.emg_wave_en)
+	{
+		gpio_write(BITMASK(PIN_EMG_OR_STIM_SW), GPIO_LOW);  // ̵еSTIM
+		tim_stop(HS_TIM1);
+		pmu_lowpower_allow(PMU_LP_SPI0);
+	}
 	
 	packet->para.Length = 4;
 	packet->para.Type = ACK_ORG_DATA;
@@ -753,6 +981,119 @@ static void emg_org_probe_leadoff_data_en_handler(PACKET_Typedef *packet)
 	
 }
 
+/************************************************
+	@Function			: inquire_link_param_handler
+	@Description	:	ѯBLE·
+	@parameter		: packet , Эָ
+	@Return				: None
+	@Remark				: CMD Such as : AA 55 69 02 AD CRC
+*/
+static void inquire_link_param_handler(PACKET_Typedef *packet)
+{
+	link_param_packet_fill(protocol_link(), packet);
+	
+	ble_send_packet(packet);
+}
+
+/************************************************
+	@Function			: inquire_tx_stat_handler
+	@Description	:	ѯBLEͶ״̬
+	@parameter		: packet , Эָ
+	@Return				: None
+	@Remark				: CMD Such as : AA 55 69 02 AE CRC
+									Data : ÿ(CTRL/ALARM/EMG/RAW) ǰ(2) (2) (2), ʣ෢Ͷ(1)
+									ȺͶΪѯӵֵȺͶΪӺϼ
+*/
+static void inquire_tx_stat_handler(PACKET_Typedef *packet)
+{
+	uint8_t i;
+	uint8_t *p = packet->para.Data;
+	uint16_t depth;
+	int16_t link = protocol_link();
+	
+	packet->para.Length = 3 + APP_TX_CLASS_NB * 6;
+	packet->para.Type = ACK_TX_STAT;
+	
+	for(i = 0; i < APP_TX_CLASS_NB; i++)
+	{
+		depth = app_simple_server_tx_depth(link, i);
+		*p++ = depth >> 8;
+		*p++ = depth & 0xFF;
+		*p++ = app_simple_server_env.tx_depth_max[i] >> 8;
+		*p++ = app_simple_server_env.tx_depth_max[i] & 0xFF;
+		*p++ = app_simple_server_env.tx_drop[i] >> 8;
+		*p++ = app_simple_server_env.tx_drop[i] & 0xFF;
+	}
+	*p = (link >= 0 && link < BLE_CONNECTION_MAX) ? app_simple_server_env.con[link].tx_credit : 0;
+	
+	ble_send_packet(packet);
+}
+
+/************************************************
+	@Function			: set_bcast_mode_handler
+	@Description	:	ù㲥ժҪģʽ
+	@parameter		: packet , Эָ
+	@Return				: None
+	@Remark				: CMD Such as : AA 55 69 04 B0 01 05 CRC
+									Data[0] 0:ر  1:ӹ㲥ͬʱУ3  2:㲥ժҪʱÿ30s10sӹ㲥
+									Data[1] ժҪ¼λ100ms0ΪĬֵ
+									ظ Data[0] 0:ɹ  1:  2:㣬֧ģʽ1
+*/
+static void set_bcast_mode_handler(PACKET_Typedef *packet)
+{
+	uint8_t res = 1;
+	
+#if (BLE_APP_BCAST)
+	if(packet->para.Length >= 2 + 1)
+	{
+		if(packet->para.Data[0] == APP_BCAST_MODE_ON && !APP_BCAST_ON_SUPPORTED)
+		{
+			res = 2;
+		}
+		else
+		{
+			res = app_bcast_set_mode(packet->para.Data[0], (packet->para.Length >= 2 + 2) ? packet->para.Data[1] : 0) ? 0 : 1;
+		}
+	}
+#endif
+	
+	packet->para.Length = 0x03;
+	packet->para.Type = ACK_BCAST_SET;
+	packet->para.Data[0] = res;
+	ble_send_packet(packet);
+}
+
+/************************************************
+	@Function			: bulk_read_cmd_handler
+	@Description	:	ȡ
+	@parameter		: packet , Эָ
+	@Return				: None
+	@Remark				: CMD Such as : AA 55 69 06 B1 10 00 00 00 CRC
+									Data : Id(1) Sel(1) Offset(2)  bulk_handler  ACK_BULK_DATA ϴظ ACK_BULK
+*/
+static void bulk_read_cmd_handler(PACKET_Typedef *packet)
+{
+	int16_t link = protocol_link();
+	
+	bulk_read_handler(link < 0 ? 0 : link, packet->para.Data, packet->para.Length > 2 ? packet->para.Length - 2 : 0);
+}
+
+/************************************************
+	@Function			: mon_cal_done
+	@Description	:	迹У׼ݽ
+	@parameter		: id , BULK_ID_MON_CAL
+									buf , У׼ VH(4) VSAT(2) DIV(2)
+									len , ݳ
+	@Return				: BULK_OK ; BULK_ERR_BUSY , ̼; BULK_ERR_FORMAT , ݲ
+	@Remark				: У׼ֻRAMУָĬֵ
+*/
+static uint8_t mon_cal_done(uint8_t id, uint8_t *buf, uint16_t len)
+{
+	if(stim_active_mask()) return BULK_ERR_BUSY;
+	
+	return stim_monitor_cal_set(buf, len) ? BULK_OK : BULK_ERR_FORMAT;
+}
+
 /************************************************
 	@Function			: set_serial_number_handler
 	@Description	:	豸к
@@ -765,6 +1106,37 @@ static void set_serial_number_handler(PACKET_Typedef *packet)
 	
 }
 
+/************************************************
+	@Function			: control_permitted
+	@Description	:	жϵǰǷִиָ
+	@parameter		: token , ָ
+									type , ָ
+	@Return				: true ִ
+	@Remark				: ѯָӶִУı豸״ָֻ̬ӿִУ
+									һָӳΪأϿͷ
+*/
+static bool control_permitted(uint8_t token, uint8_t type)
+{
+	int16_t link = protocol_link();
+	
+	if(link < 0 || token != AM300_TOKEN)
+		return true;
+	
+	switch(type)
+	{
+		case CMD_PARA_INQ:
+		case CMD_INTENSITY_INQ:
+		case CMD_MODE_STA:
+		case CMD_GAIN_INQ:
+		case CMD_LINK_INQ:
+		case CMD_TX_STAT_INQ:
+		case CMD_BULK_READ:
+			return true;
+		default:
+			return app_simple_server_claim_control(link);
+	}
+}
+
 /************************************************
 	@Function			: add_protocol_handler_fun
 	@Description	:	ЭָָӺָ
@@ -796,6 +1168,12 @@ static void add_protocol_handler_fun(uint8_t Token, uint8_t Type, CMD_HANDLER_TY
 */
 void handler_init(void)
 {
+	static uint8_t mon_cal_buf[STIM_MON_CAL_LEN];
+	
+	bulk_init();
+	bulk_sink_register(BULK_ID_MON_CAL, mon_cal_buf, sizeof(mon_cal_buf), mon_cal_done);
+	bulk_source_register(BULK_ID_SESSION_LOG, session_log_size, session_log_read_part);
+	
 		// protocol cmd handler init
 	// Gernarl CMD
 	add_protocol_handler_fun(GERNARL_TOKEN, CMD_DEBUG_VERSION,	(CMD_HANDLER_TYPE)inquire_debug_version_handler);
@@ -825,19 +1203,97 @@ void handler_init(void)
 	add_protocol_handler_fun(AM300_TOKEN, CMD_OFF_DATA, 				(CMD_HANDLER_TYPE)emg_org_probe_leadoff_data_en_handler);
 
 	add_protocol_handler_fun(AM300_TOKEN, CMD_SN_SET, 					(CMD_HANDLER_TYPE)set_serial_number_handler);
+	add_protocol_handler_fun(AM300_TOKEN, CMD_LINK_INQ, 				(CMD_HANDLER_TYPE)inquire_link_param_handler);
+	add_protocol_handler_fun(AM300_TOKEN, CMD_TX_STAT_INQ, 			(CMD_HANDLER_TYPE)inquire_tx_stat_handler);
+	add_protocol_handler_fun(AM300_TOKEN, CMD_BCAST_SET, 				(CMD_HANDLER_TYPE)set_bcast_mode_handler);
+	add_protocol_handler_fun(AM300_TOKEN, CMD_BULK_READ, 				(CMD_HANDLER_TYPE)bulk_read_cmd_handler);
 //	add_protocol_handler_fun(AM300_TOKEN, CMD_GAIN_SET, 				(CMD_HANDLER_TYPE)inquire_stim_intensity_handler);
 //	add_protocol_handler_fun(AM300_TOKEN, CMD_GAIN_INQ, 				(CMD_HANDLER_TYPE)inquire_stim_intensity_handler);
 //	add_protocol_handler_fun(AM300_TOKEN, CMD_CAL_EN, 					(CMD_HANDLER_TYPE)inquire_stim_intensity_handler);
 }
 
 
+/************************************************
+	@Function			: execute_handler
+	@Description	:	ִָ
+	@parameter		: packet , Эָ
+	@Return				: None
+	@Remark				: δָظ ERROR_ACK Data[0] Ϊԭָ
+									ӵĿָظ ERROR_ACK Data[1] Ϊ ERROR_NOT_CONTROLLER
+*/
 void execute_handler(PACKET_Typedef *packet) 
 {
-	switch(packet->para.Token)
+	CMD_HANDLER_TYPE handler = NULL;
+	uint8_t index = packet->para.Type - TYPE_BASE_ADDR;
+	
+	if((packet->para.Type >= TYPE_BASE_ADDR) && (index < TYPE_NUM))
 	{
-		case AM300_TOKEN: cmd_handler_tab[0][packet->para.Type - TYPE_BASE_ADDR](packet); break;
-		case GERNARL_TOKEN: cmd_handler_tab[1][packet->para.Type - TYPE_BASE_ADDR](packet); break;
-		default: break;
+		switch(packet->para.Token)
+		{
+			case AM300_TOKEN: handler = cmd_handler_tab[0][index]; break;
+			case GERNARL_TOKEN: handler = cmd_handler_tab[1][index]; break;
+			default: break;
+		}
 	}
+	
+	if(handler != NULL && !control_permitted(packet->para.Token, packet->para.Type))
+	{
+		packet->para.Data[0] = packet->para.Type;
+		packet->para.Data[1] = ERROR_NOT_CONTROLLER;
+		packet->para.Length = 4;
+		packet->para.Type = ERROR_ACK;
+		ble_send_packet(packet);
+	}
+	else if(handler != NULL)
+	{
+		handler(packet);
+	}
+	else
+	{
+		packet->para.Data[0] = packet->para.Type;
+		packet->para.Length = 3;
+		packet->para.Type = ERROR_ACK;
+		ble_send_packet(packet);
+	}
+}
+
+/************************************************
+	@Function			: execute_ext_handler
+	@Description	:	ִչָ֡
+	@parameter		: token , ָ
+									type , ָ
+									data , ָBLEдݻ黺
+									len , 
+	@Return				: None
+	@Remark				: չ֡ Packet δָظ ERROR_ACK
+									ظ ble_send_packet ͬд
+*/
+void execute_ext_handler(uint8_t token, uint8_t type, const uint8_t *data, uint16_t len)
+{
+	struct app_tx_frame frame;
+	int16_t link = protocol_link();
+	
+	if(!control_permitted(token, type))
+	{
+		app_tx_frame_begin(&frame, APP_TX_CTRL, token, ERROR_ACK, 2 + ACK_SEQ_LEN);
+		app_tx_frame_put_u8(&frame, type);
+		app_tx_frame_put_u8(&frame, ERROR_NOT_CONTROLLER);
+		ack_frame_commit(&frame);
+		return;
+	}
+	
+	if((token == AM300_TOKEN) && (type == CMD_BULK_DATA))
+	{
+		// ֪ĸʱܼǵӵĴ
+		if(link >= 0)
+		{
+			bulk_segment_handler(link, data, len);
+		}
+		return;
+	}
+	
+	app_tx_frame_begin(&frame, APP_TX_CTRL, token, ERROR_ACK, 1 + ACK_SEQ_LEN);
+	app_tx_frame_put_u8(&frame, type);
+	ack_frame_commit(&frame);
 }
 
@@ -93,6 +93,11 @@
 #define CMD_GAIN_SET				0xA7		// 豸Ӳ
 #define CMD_GAIN_INQ				0xA8		// ѯ豸Ӳ
 #define CMD_CAL_EN					0xA9		// EMG꿪ʼ/ֹͣ
+#define CMD_LINK_INQ				0xAD		// ѯBLE·(MTU/ݳ/PHY)
+#define CMD_TX_STAT_INQ			0xAE		// ѯBLEͶ/
+#define CMD_BULK_DATA				0xAF		// ݷֶΣչ֡
+#define CMD_BCAST_SET				0xB0		// ù㲥ժҪģʽȺƣƽɨ̨豸
+#define CMD_BULK_READ				0xB1		// ȡλ -> APP ACK_BULK_DATA ϴ
 
 #define ACK_SN_SET					0x26
 #define ACK_GAIN_SET				0x27
@@ -100,8 +105,16 @@
 #define ACK_MODE_ERR				0x29		// 豸Ϣ
 #define ACK_CAL_EN					0x2A
 #define PACK_CAL_DATA				0x2B		// EMG겨ΰ
+#define PACK_STIM_MON				0x2C		// ̼迹/˳
+#define PACK_LINK_PARAM			0x2D		// BLE·Эɻѯʱϴ
+#define ACK_TX_STAT					0x2E
+#define ACK_BULK						0x2F		// /ظ
+#define ACK_BCAST_SET				0x30
+#define PACK_BCAST_SUM			0x31		// 㲥ժҪչ/ڹ㲥ĳУ֪ͨ
+#define ACK_BULK_DATA				0x32		// ȡݷֶ
 
 #define ERROR_ACK						0xF1
+#define ERROR_NOT_CONTROLLER		0x01		// ERROR_ACK Data[1]Ϊأָܾ
 
 typedef union{
 	struct  _packet{
@@ -122,12 +135,20 @@ extern uint8_t old_protocol_en;
 
 void handler_init(void);
 void execute_handler(PACKET_Typedef *packet); 
+void execute_ext_handler(uint8_t token, uint8_t type, const uint8_t *data, uint16_t len);
 void battery_voltage_packet_send(void);
 void ble_send_buff(uint8_t *buff, uint32_t len);
 void stim_status_packet_send(uint8_t status_a);
 void emg_wave_packet_send(uint16_t emg_a, uint16_t emg_b);
 void emg_org_wave_data_packet_send(uint8_t *buff);
+uint8_t emg_org_wave_data_ready(void);
 void probe_status_packet_send(uint8_t emg_pro_status, uint8_t stim_pro_status);
+void stim_monitor_packet_send(void);
+void link_param_packet_send(uint8_t conidx);
+void bulk_ack_packet_send(uint8_t link, uint8_t id, uint8_t status, uint16_t offset);
+uint8_t bulk_data_ready(uint8_t link, uint16_t len);
+void bulk_data_packet_send(uint8_t link, uint8_t id, uint16_t total, uint16_t offset, const uint8_t *data, uint16_t len);
+uint8_t bcast_summary_fill(uint8_t *buf, uint8_t seq);
 /*
 void inquire_debug_version_handler(PACKET_Typedef *packet);
 void inquire_soft_version_handler(PACKET_Typedef *packet);
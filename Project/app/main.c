@@ -31,14 +31,17 @@
 #include "bsp_iic.h"
 #include "bsp_spi.h"
 #include "bsp_timer.h"
-
-uint8_t BLE_RX_Buf[BLE_BUF_LEN] = {0};
-QUEUE_U8	BLE_Rx;
+#include "stim_loop.h"
+#include "app_link.h"
+#include "session_log.h"
+#include "bulk.h"
+#include "ke_event.h"
 
 //uint8_t BLE_TX_Buf[BLE_BUF_LEN] = {0};
 //QUEUE_U8	BLE_Tx;
 
 static co_timer_t adc_sample_timer;
+static uint32_t sleep_enter_time = 0;
 
 /************************************************
 	@Function			: queue_init
@@ -50,7 +53,6 @@ static co_timer_t adc_sample_timer;
 static void queue_init(void)
 {
 	// BlE FIFO Inint
-	QUEUE_INIT(BLE_Rx, BLE_RX_Buf, BLE_BUF_LEN);
 //	QUEUE_INIT(BLE_Tx, BLE_TX_Buf, BLE_BUF_LEN);
 	
 	emg_init();
@@ -81,6 +83,7 @@ static void hardware_init(void)
 	// Init UART
 #ifdef CONFIG_LOG_OUTPUT
 	usart_config();
+	pmu_lowpower_prevent(PMU_LP_UART0);  // ЭUART0˯
 #endif
 	
 	TIM1_config(250);   // 250us   2KHz * 2 = 4KHz
@@ -97,6 +100,24 @@ static void hardware_init(void)
 }
 
 
+/************************************************
+	@Function			: link_profile_select
+	@Description	:	ݹ״̬ѡBLEӲλ
+	@parameter		: None
+	@Return				: APP_LINK_PROFILE_xxx
+	@Remark				: ԭʼ -> ̼; 10Hz -> еȼ; л̼ -> +ӻӳ
+*/
+static uint8_t link_profile_select(void)
+{
+	if(emg_wave.emg_wave_org_en) 
+		return APP_LINK_PROFILE_RAW;
+	
+	if(emg_wave.emg_wave_en || stim_loop_active()) 
+		return APP_LINK_PROFILE_STREAM;
+	
+	return APP_LINK_PROFILE_IDLE;
+}
+
 /************************************************
 	@Function			: adc_sample_timer_handler
 	@Description	:	��ص�ѹadc�ɼ���������
@@ -111,17 +132,22 @@ static void adc_sample_timer_handler(co_timer_t *timer, void *param)
 //	static uint16_t test_cnt = 0;
 	
 	if(emg_wave.emg_wave_en && (!emg_wave.emg_wave_org_en)
-		&& (!stim_a_control.stim_section) && (!stim_a_control.stim_section)) 
+		&& (!stim_active_mask())) 
 		get_emg_lead_off_adc_value();   // EMG�缫����adc�ɼ�  200Hz * 5
 	
+	bulk_handler();  // ȡͶϴ
+	
 	if(++time_100ms_cnt >= 20)  // 100ms
 	{
 		time_100ms_cnt = 0;
+		protocol_handler();  // ʱķְ
+		app_link_policy_handler(link_profile_select());  // Ӳʵ
+		
 		if(emg_wave.emg_wave_en && (!emg_wave.emg_wave_org_en) 
-			&& (!stim_a_control.stim_section) && (!stim_a_control.stim_section)) 
+			&& (!stim_active_mask())) 
 			probe_status_packet_send(0x01, 0x01); 
 		
-		if(emg_wave.emg_wave_en && (stim_a_control.stim_section || stim_a_control.stim_section))
+		if(emg_wave.emg_wave_en && stim_active_mask())
 			emg_wave_packet_send(0x9999, 0x9999);
 	}
 	
@@ -130,9 +156,15 @@ static void adc_sample_timer_handler(co_timer_t *timer, void *param)
 		time_1s_cnt = 0;
 		
 		get_battery_adc_value();   // ��ص����ɼ�
-		if(!emg_wave.emg_wave_org_en && (!stim_a_control.stim_section) && (!stim_a_control.stim_section)) 
+		if(!emg_wave.emg_wave_org_en && (!stim_active_mask())) 
 			battery_voltage_packet_send();  // 1s ��1�ε�ص�����Ϣ
+		if(stim_active_mask())
+			stim_monitor_packet_send();  // ̼1sϴ1迹
+		
+		session_log_tick_1s();  // Ƽ¼ÿͳ
 	}
+	
+	session_log_handler();  // ֲֹ̼ͣдƼ¼
 }
 
 /************************************************
@@ -164,7 +196,7 @@ static void ble_stack_config(void)
 	co_power_ultra_sleep_mode_enable(false);  // 20210520  true -> false
 
 	// Enable sleep, SWD will be closed.
-	co_power_sleep_enable(false); // 20210520  true -> false
+	co_power_sleep_enable(true);  // ʱ˯ߣʱ/SPI0/UART0 ʱ pmu_lowpower_prevent ֹ
 	
 	// init pmu clock 64MHz    add 20210525
 	pmu_xtal32m_x2_startup();
@@ -172,6 +204,73 @@ static void ble_stack_config(void)
 	cpm_set_clock(CPM_CPU_CLK, 64000000);
 }
 
+/************************************************
+	@Function			: app_event_set
+	@Description	:	λӦ¼
+	@parameter		: event , APP_EVENT_xxx
+	@Return				: None
+	@Remark				: жеã¼ rwip_schedule() ִ
+*/
+void app_event_set(uint8_t event)
+{
+	ke_event_set(KE_EVENT_USR_FIRST + event);
+}
+
+/************************************************
+	@Function			: emg_event_handler
+	@Description	:	EMGݴ¼
+	@parameter		: None
+	@Return				: None
+	@Remark				: TIM1жλ
+*/
+static void emg_event_handler(void)
+{
+	ke_event_clear(KE_EVENT_USR_FIRST + APP_EVENT_EMG);  // ڼٴδ
+	emg_calculate_handler();
+}
+
+/************************************************
+	@Function			: stim_event_handler
+	@Description	:	̼¼
+	@parameter		: None
+	@Return				: None
+	@Remark				: TIM0 50msʱBLEָдλ
+*/
+static void stim_event_handler(void)
+{
+	ke_event_clear(KE_EVENT_USR_FIRST + APP_EVENT_STIM);
+	stim_control_handler();
+}
+
+/************************************************
+	@Function			: power_sleep_event_handler
+	@Description	:	˯߽/Ѵ
+	@parameter		: sleep_state , ˯״̬
+									power_status , POWER_SLEEP  POWER_DEEP_SLEEP
+	@Return				: None
+	@Remark				: ѺĴʧGPIO/PINMUXϵͳָ
+									SysTickʱSPI˯ڼsystick
+*/
+static void power_sleep_event_handler(co_power_sleep_state_t sleep_state, co_power_status_t power_status)
+{
+	switch(sleep_state)
+	{
+		case POWER_SLEEP_ENTRY:
+			sleep_enter_time = co_time();
+			break;
+		
+		case POWER_SLEEP_LEAVE_TOP_HALF:
+			SysTick_Config(64000);
+			TICK_ADD(CO_TIME_SYS2MS(co_time_diff(co_time(), sleep_enter_time)));
+			TIM1_config(250);
+			TIM0_config(50);
+			spi_config();
+			break;
+		
+		default: break;
+	}
+}
+
 /************************************************
 	@Function			: main
 	@Description	:	main function
@@ -200,10 +299,13 @@ int main(void)
   ble_stack_config();
 	
   hardware_init();
+  session_log_init();  // Ƽ¼ָFlashдλ
 
   rwip_init(RESET_NO_ERROR);
 	
-// Remove 20210520    co_power_register_sleep_event(power_sleep_event_handler);
+	co_power_register_sleep_event(power_sleep_event_handler);
+	ke_event_callback_set(KE_EVENT_USR_FIRST + APP_EVENT_EMG, emg_event_handler);
+	ke_event_callback_set(KE_EVENT_USR_FIRST + APP_EVENT_STIM, stim_event_handler);
 
 // Remove 20210520    log_debug("running %d\n", pmu_reboot_reason());
 	pmu_reboot_reason(); // Add 20210520
@@ -227,13 +329,7 @@ int main(void)
 //		if(gpio_read(BITMASK(PIN_LED0))) gpio_write(BITMASK(PIN_LED0), GPIO_LOW);
 //		else gpio_write(BITMASK(PIN_LED0), GPIO_HIGH);
 //		printf("123456\r\n");
-    rwip_schedule();		
-		
-		protocol_handler();
-		
-		emg_calculate_handler();
-		
-		stim_control_handler();
+    rwip_schedule();  // ִBLEӦ¼¼ʱ co_power WFI˯
   }
 }
 
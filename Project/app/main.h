@@ -27,9 +27,11 @@
 #define ENABLE 				1
 #define DISABLE				0
 
-#define BLE_BUF_LEN		256
-extern uint8_t BLE_RX_Buf[BLE_BUF_LEN];
-extern QUEUE_U8	BLE_Rx;
+// Ӧ¼жϻBLEдʱλ rwip_schedule() ִжӦ
+#define APP_EVENT_EMG		0		// EMGԭʼݵ -> emg_calculate_handler
+#define APP_EVENT_STIM	1		// ̼״̬Ҫ -> stim_control_handler
+
+void app_event_set(uint8_t event);
 
 //extern uint8_t BLE_TX_Buf[BLE_BUF_LEN];
 //extern QUEUE_U8	BLE_Tx;
@@ -12,102 +12,276 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include "protocol.h"
-#include "main.h"
 #include "bsp_systick.h"
 #include "crc8.h"
 #include "handler.h"
 
+#define FRAME_HEAD_LEN		4																				// Head1 Head2 Token Length
+#define FRAME_EXT_HEAD_LEN	5																				// Head1 Head2 Token LenH LenL
+#define FRAME_LEN_MAX			sizeof(PACKET_Typedef)
+#define FRAME_TIMEOUT			TICK_X10MS(20)													// дķְʱ
+
 PACKET_Typedef Packet;
 
+typedef struct
+{
+	uint8_t buf[PROTOCOL_EXT_FRAME_MAX];		// дְ黺棬ֻһ֡
+	uint16_t len;
+	uint8_t crc;							// buf ǰ crc_len ֽڵCRCд
+	uint16_t crc_len;
+	uint32_t tick;
+}PROTOCOL_RX_Typedef;
+
+static PROTOCOL_RX_Typedef rx_link[PROTOCOL_LINK_MAX];	// ÿһݣְ
+static int16_t rx_seq = -1;					// ִедţ-1 Ϊͨд
+static int16_t rx_cur = -1;					// ִеָԵӣ-1 Ϊִָ
+
 /************************************************
-	@Function			: protocol_upacket
-	@Description	:	Э
-	@parameter		: None
-	@Return				: None
+	@Function			: protocol_frame_head_len
+	@Description	:	֡ͷ
+	@parameter		: p , 
+									len , ݳ
+	@Return				: ͨ֡ 4 , չ֡ 5
+	@Remark				: 2ֽʱͨ֡
+*/
+static uint16_t protocol_frame_head_len(const uint8_t *p, uint16_t len)
+{
+	return ((len >= 2) && (p[1] == HEAD_2_EXT)) ? FRAME_EXT_HEAD_LEN : FRAME_HEAD_LEN;
+}
+
+/************************************************
+	@Function			: protocol_frame_len
+	@Description	:	֡ͷ֡
+	@parameter		: p , ֡ͷ
+	@Return				: ֡ȣ֡ͷCRC
+	@Remark				: Length  Type  CRC
+*/
+static uint16_t protocol_frame_len(const uint8_t *p)
+{
+	if(p[1] == HEAD_2_EXT) return FRAME_EXT_HEAD_LEN + ((uint16_t)p[3] << 8 | p[4]);
+	
+	return FRAME_HEAD_LEN + p[3];
+}
+
+/************************************************
+	@Function			: protocol_frame_check
+	@Description	:	黺ʼǷΪһ֡Ч
+	@parameter		: p , 
+									len , ݳ
+	@Return				: >0 , Ч֡ĳ
+									0 , ֡ͷЧݲ
+									-1 , ֡ͷCRC
+	@Remark				: ֡ʽAA 55 Token Length Type Data... CRC Length  Type  CRC
+									չ֡AA 5A Token LenH LenL Type Data... CRC
+									crc/crc_len Ϊǰ crc_len ֽڵCRCֻʣಿ
+									crc_len ֡ͬ󻺴лкݣʱͷ
+*/
+static int16_t protocol_frame_check(const uint8_t *p, uint16_t len, uint8_t crc, uint16_t crc_len)
+{
+	uint16_t frame_len, head_len;
+	
+	if(p[0] != HEAD_1) return -1;
+	if(len < 2) return 0;
+	if((p[1] != HEAD_2) && (p[1] != HEAD_2_EXT)) return -1;
+	if(len < 3) return 0;
+	if((p[2] != GERNARL_TOKEN) && (p[2] != AM300_TOKEN)) return -1;
+	head_len = protocol_frame_head_len(p, len);
+	if(len < head_len) return 0;
+	
+	frame_len = protocol_frame_len(p);
+	if(frame_len < head_len + 2) return -1;  // ٰ Type  CRC
+	if(frame_len > ((head_len == FRAME_HEAD_LEN) ? FRAME_LEN_MAX : PROTOCOL_EXT_FRAME_MAX)) return -1;
+	if(len < frame_len) return 0;
+	
+	if(crc_len > frame_len)
+	{
+		crc = 0;
+		crc_len = 0;
+	}
+	if(CRC8_Update(crc, p + crc_len, frame_len - crc_len) != 0) return -1;  // CRCֽڼΪ0
+	
+	return frame_len;
+}
+
+/************************************************
+	@Function			: protocol_frame_resync
+	@Description	:	ݣһ֡ͷ
+	@parameter		: p , 
+									len , ݳ
+	@Return				: ֽ
 	@Remark				: None
 */
-static uint8_t protocol_upacket(void)
-{	
-	static _unpacket_step step = Idle;
-	static uint8_t Token = 0;
-	static uint8_t data_len = 0;
-	static uint32_t timeout_tick = 0;
+static uint16_t protocol_frame_resync(const uint8_t *p, uint16_t len)
+{
+	const uint8_t *head = (len > 1) ? memchr(p + 1, HEAD_1, len - 1) : NULL;
 	
-	uint16_t index = 0;
-	uint16_t byte = 0;
+	return head ? (head - p) : len;
+}
+
+/************************************************
+	@Function			: protocol_frame_dispatch
+	@Description	:	ִһָ֡
+	@parameter		: p , Ч֡
+									len , ֡
+	@Return				: None
+	@Remark				: ָ Packet ԭдظֻ֡һ
+									չֱ֡ӽ execute_ext_handler
+*/
+static void protocol_frame_dispatch(const uint8_t *p, uint16_t len)
+{
+	if(p[1] == HEAD_2_EXT)
+	{
+		execute_ext_handler(p[2], p[FRAME_EXT_HEAD_LEN], p + FRAME_EXT_HEAD_LEN + 1, len - FRAME_EXT_HEAD_LEN - 2);
+		return;
+	}
 	
-	while(QUEUE_STOCK(BLE_Rx))
+	memcpy(Packet.buf, p, len);
+	execute_handler(&Packet); 
+}
+
+/************************************************
+	@Function			: protocol_rx_write
+	@Description	:	BLEдݲ
+	@parameter		: link , Ӻţconidx
+									buf , дݣGATTд
+									len , ݳ
+	@Return				: None
+	@Remark				: ֱдУ鲢ִУһдɰ֡
+									ֻпдķְſӵ黺
+*/
+void protocol_rx_write(uint8_t link, const uint8_t *buf, uint16_t len)
+{
+	PROTOCOL_RX_Typedef *rx;
+	uint16_t need, skip;
+	int16_t res;
+	
+	if(link >= PROTOCOL_LINK_MAX) return;
+	rx = &rx_link[link];
+	rx_cur = link;
+	
+	if(rx->len && (TICK_PASSED(TICK_NOW, rx->tick) > FRAME_TIMEOUT)) rx->len = 0;  // ְʱ
+	
+	// ȫϴдδɵ֡
+	while(rx->len)
 	{
-		if( step < Len_chk ) byte = QUEUE_READ(BLE_Rx);
-		
-		switch(step)
+		res = protocol_frame_check(rx->buf, rx->len, rx->crc, rx->crc_len);
+		if(res > 0)
 		{
-			case Idle: 
-				if(byte == HEAD_1) step = Hd1_match;
-			break;
-			
-			case Hd1_match:		
-				if(byte == HEAD_2) step = Hd2_match;
-				else if(byte != HEAD_1) step = Idle;
-			break;
-			
-			case Hd2_match: 
-				if((byte == GERNARL_TOKEN) || (byte == AM300_TOKEN)) 
-				{
-					Token = byte;
-					step = Tok_valid;
-				}
-				else if(byte ==HEAD_1) step = Hd1_match;
-				else step = Hd1_match;
-			break;
-			
-			case Tok_valid: 
-				data_len = byte;
-				timeout_tick = TICK_NOW;
-				step = Len_chk;
-			break;
-			
-			case Len_chk: 
-				if(QUEUE_STOCK(BLE_Rx) >= data_len ) step = CRC_chk;
-				if(TICK_PASSED(TICK_NOW, timeout_tick) > TICK_X10MS(20)) step = Idle;
-			break;
-			
-			case CRC_chk: 
-				index = BLE_Rx.read;
-				byte = CRC8(0, HEAD_1);
-				byte = CRC8(byte, HEAD_2);
-				byte = CRC8(byte, Token);
-				byte = CRC8(byte, data_len);
-				for(int i = 0; i < data_len; i++)
-				{
-					if(++index >= BLE_Rx.len) index = 0;
-					byte = CRC8(byte, BLE_Rx.pdat[index]);
-				}	
-				step = Idle;
-				if( byte == 0)
-				{
-					Packet.para.Head1 = HEAD_1;
-					Packet.para.Head2 = HEAD_2;
-					Packet.para.Token = Token;
-					Packet.para.Length = data_len;
-					Packet.para.Type = QUEUE_READ(BLE_Rx);
-					for(int i = 0; i < (data_len - 1); i++) Packet.para.Data[i] = QUEUE_READ(BLE_Rx);
-					
-					return (data_len + 4);
-				}
-//				else
-//				{
-//					printf("byte = 0x%x\r\n", byte);
-//				}
-				
+			// ͬ󻺴пܻһ֡Ŀͷ
+			protocol_frame_dispatch(rx->buf, res);
+			rx->len -= res;
+			memmove(rx->buf, rx->buf + res, rx->len);
+			rx->crc = CRC8_Update(0, rx->buf, rx->len);
+			rx->crc_len = rx->len;
+		}
+		else if(res < 0)
+		{
+			skip = protocol_frame_resync(rx->buf, rx->len);
+			rx->len -= skip;
+			memmove(rx->buf, rx->buf + skip, rx->len);
+			rx->crc = CRC8_Update(0, rx->buf, rx->len);
+			rx->crc_len = rx->len;
+		}
+		else
+		{
+			if(!len) break;
+			need = protocol_frame_head_len(rx->buf, rx->len);
+			need = (rx->len < need) ? (need - rx->len) : (protocol_frame_len(rx->buf) - rx->len);
+			if(need > len) need = len;
+			memcpy(rx->buf + rx->len, buf, need);
+			rx->crc = CRC8_Update(rx->crc, rx->buf + rx->crc_len, rx->len + need - rx->crc_len);
+			rx->len += need;
+			rx->crc_len = rx->len;
+			buf += need;
+			len -= need;
+		}
+	}
+	
+	// дԭز
+	while(len)
+	{
+		res = protocol_frame_check(buf, len, 0, 0);
+		if(res > 0)
+		{
+			protocol_frame_dispatch(buf, res);
+			buf += res;
+			len -= res;
+		}
+		else if(res < 0)
+		{
+			skip = protocol_frame_resync(buf, len);
+			buf += skip;
+			len -= skip;
+		}
+		else  // ֡һдм
+		{
+			memcpy(rx->buf, buf, len);
+			rx->crc = CRC8_Update(0, rx->buf, len);
+			rx->crc_len = len;
+			rx->len = len;
+			rx->tick = TICK_NOW;
 			break;
-			
-			default: step = Idle; break;
 		}
-		if(step == Len_chk) return 0;
 	}
-	return 0;
+	
+	rx_cur = -1;
+}
+
+/************************************************
+	@Function			: protocol_rx_write_seq
+	@Description	:	ŵBLEд루Write Without Response
+	@parameter		: link , Ӻţconidx
+									buf , д Seq Frame...
+									len , ݳ
+	@Return				: None
+	@Remark				: һֽΪţдӦݰĩβӸ
+									APPдָӦеŶӦŲΪʧ
+*/
+void protocol_rx_write_seq(uint8_t link, const uint8_t *buf, uint16_t len)
+{
+	if(!len) return;
+	
+	rx_seq = buf[0];
+	protocol_rx_write(link, buf + 1, len - 1);
+	rx_seq = -1;
+}
+
+/************************************************
+	@Function			: protocol_seq
+	@Description	:	ǰִָд
+	@parameter		: None
+	@Return				: 0~255 , ; -1 , ͨд
+	@Remark				: None
+*/
+int16_t protocol_seq(void)
+{
+	return rx_seq;
+}
+
+/************************************************
+	@Function			: protocol_link
+	@Description	:	ǰִָԵ
+	@parameter		: None
+	@Return				: 0~PROTOCOL_LINK_MAX-1 , Ӻ; -1 , ִָ
+	@Remark				: ӦֻӣȨ޼ҲӵĽɫ
+*/
+int16_t protocol_link(void)
+{
+	return rx_cur;
+}
+
+/************************************************
+	@Function			: protocol_link_reset
+	@Description	:	һδɵķְ
+	@parameter		: link , Ӻ
+	@Return				: None
+	@Remark				: ϿʱãӲƴϾӵİ֡
+*/
+void protocol_link_reset(uint8_t link)
+{
+	if(link < PROTOCOL_LINK_MAX) rx_link[link].len = 0;
 }
 
 /************************************************
@@ -115,27 +289,14 @@ static uint8_t protocol_upacket(void)
 	@Description	:	Э鴦
 	@parameter		: None
 	@Return				: None
-	@Remark				: None
+	@Remark				: ָBLEдʱִУֻʱķְ
 */
 void protocol_handler(void)
 {
-	if( protocol_upacket() ) 
+	uint8_t i;
+	
+	for(i = 0; i < PROTOCOL_LINK_MAX; i++)
 	{
-		execute_handler(&Packet); 
+		if(rx_link[i].len && (TICK_PASSED(TICK_NOW, rx_link[i].tick) > FRAME_TIMEOUT)) rx_link[i].len = 0;
 	}
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -20,19 +20,22 @@
 
 #define HEAD_1		0xAA
 #define HEAD_2		0x55
+#define HEAD_2_EXT	0x5A		// չ֡AA 5A Token LenH LenL Type Data... CRC 16λ
 
-typedef enum{
-	Idle = 0,				
-	Hd1_match,			
-	Hd2_match,			
-	Tok_valid,			
-	Len_chk,				
-	CRC_chk	
-}_unpacket_step;
+#define PROTOCOL_EXT_FRAME_MAX	256		// չ֡󳤶ȣ֡ͷCRCһGATTд244ֽ
+
+#ifndef PROTOCOL_LINK_MAX
+#define PROTOCOL_LINK_MAX		2			// ͬʱֻ + ʦƽ壩С BLE_CONNECTION_MAX
+#endif
 
 extern PACKET_Typedef	Packet;
 
 
+void protocol_rx_write(uint8_t link, const uint8_t *buf, uint16_t len);
+void protocol_rx_write_seq(uint8_t link, const uint8_t *buf, uint16_t len);
+int16_t protocol_seq(void);
+int16_t protocol_link(void);
+void protocol_link_reset(uint8_t link);
 void protocol_handler(void);
 
 
@@ -43,6 +43,12 @@ extern "C"
 /// enable/disable dis profile
 #define BLE_APP_DIS 0
 
+/// enable/disable EMG/stimulation summary broadcast (extended advertising)
+#define BLE_APP_BCAST        1
+
+/// enable/disable the LE credit based L2CAP channel transport (GATT fallback)
+#define BLE_APP_COC          1
+
 #if (BLE_APP_DIS)
 ///Device Information Service Server Role
 #define BLE_DIS_SERVER       1
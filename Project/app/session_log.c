@@ -0,0 +1,666 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: session_log.c
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20211108
+		1. 20211108		First editon
+		2.
+*/
+#include <string.h>
+#include "session_log.h"
+#include "bsp_flash.h"
+#include "co_crc.h"
+
+enum{
+	SESSION_IDLE = 0,				// ޴̼
+	SESSION_RUN,						// ̼Уͳ
+	SESSION_CLOSED,					// ֹ̼ͣȴд뻺
+};
+
+enum{
+	SESSION_WR_IDLE = 0,
+	SESSION_WR_ERASE,				// ֻһ
+	SESSION_WR_PROG,				// ҳд¼
+	SESSION_WR_COMMIT,			// дĿ¼
+};
+
+Session_Typedef session;
+Session_store_Typedef session_store;
+
+#define SESSION_SECTOR_ADDR(s)		(session_store.base + (uint32_t)(s) * FLASH_SECTOR_SIZE)
+#define SESSION_BLANK_CHECK				16			// дλúĿհֽ
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, (uint16_t)v);
+	put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+/************************************************
+	@Function			: session_sector_head
+	@Description	:	ͷ
+	@parameter		: sector , 
+									seq , 
+	@Return				: 1 , ͷЧ; 0 , δʹû
+	@Remark				: None
+*/
+static uint8_t session_sector_head(uint8_t sector, uint32_t *seq)
+{
+	uint8_t head[SESSION_HEAD_LEN];
+	
+	flash_read(SESSION_SECTOR_ADDR(sector), head, SESSION_HEAD_LEN);
+	if(get16(head) != SESSION_SECTOR_MAGIC) return 0;
+	if(get16(head + 2) != co_crc16(0xFFFF, head + 4, 4)) return 0;
+	*seq = get32(head + 4);
+	
+	return (*seq != 0) && (*seq != 0xFFFFFFFF);
+}
+
+/************************************************
+	@Function			: session_sector_dir
+	@Description	:	Ŀ¼дĿ¼
+	@parameter		: sector , 
+									dir , Ŀ¼ SESSION_DIR_NUM * SESSION_DIR_LEN
+									wr ,  һ¼֮ƫ
+	@Return				: Ч¼; Ŀ¼ʱֻ֮ǰļ¼ wr Ϊ 0
+	@Remark				: ¼Ŵţ i ƫƱǰһĽλ
+*/
+static uint8_t session_sector_dir(uint8_t sector, uint8_t *dir, uint16_t *wr)
+{
+	uint8_t i;
+	uint16_t offset, len;
+	
+	flash_read(SESSION_SECTOR_ADDR(sector) + SESSION_HEAD_LEN, dir, SESSION_DIR_NUM * SESSION_DIR_LEN);
+	
+	*wr = SESSION_DATA_START;
+	for(i = 0; i < SESSION_DIR_NUM; i++)
+	{
+		offset = get16(dir + i * SESSION_DIR_LEN);
+		len = get16(dir + i * SESSION_DIR_LEN + 2);
+		if((offset == 0xFFFF) && (len == 0xFFFF)) break;
+		
+		if((offset != *wr) || (len < SESSION_REC_HEAD_LEN + 2) || (len > SESSION_RECORD_MAX)
+			|| ((uint32_t)offset + len > FLASH_SECTOR_SIZE))
+		{
+			// Ŀ¼дʱ磬д
+			*wr = 0;
+			break;
+		}
+		*wr = offset + len;
+	}
+	
+	return i;
+}
+
+/************************************************
+	@Function			: session_index_push
+	@Description	:	µļ¼ڴ
+	@parameter		: addr , ¼ַ
+									len , ¼
+	@Return				: None
+	@Remark				: ʱɵ
+*/
+static void session_index_push(uint32_t addr, uint16_t len)
+{
+	session_store.index[session_store.index_head].addr = addr;
+	session_store.index[session_store.index_head].len = len;
+	session_store.index_head = (session_store.index_head + 1) % SESSION_INDEX_NUM;
+	if(session_store.index_num < SESSION_INDEX_NUM) session_store.index_num++;
+}
+
+/************************************************
+	@Function			: session_index_drop
+	@Description	:	ǰɾļ¼
+	@parameter		: sector , 
+	@Return				: None
+	@Remark				: ɵ¼һ
+*/
+static void session_index_drop(uint8_t sector)
+{
+	uint8_t oldest;
+	uint32_t addr = SESSION_SECTOR_ADDR(sector);
+	
+	while(session_store.index_num)
+	{
+		oldest = (session_store.index_head + SESSION_INDEX_NUM - session_store.index_num) % SESSION_INDEX_NUM;
+		if((session_store.index[oldest].addr < addr) || (session_store.index[oldest].addr >= addr + FLASH_SECTOR_SIZE)) break;
+		session_store.index_num--;
+	}
+}
+
+/************************************************
+	@Function			: session_store_recover
+	@Description	:	ϵָдλú¼¼
+	@parameter		: None
+	@Return				: None
+	@Remark				: ֻͷĿ¼Ϊǰд
+									ٴǰ
+*/
+static void session_store_recover(void)
+{
+	uint8_t dir[SESSION_DIR_NUM * SESSION_DIR_LEN];
+	uint8_t blank[SESSION_BLANK_CHECK];
+	uint8_t s, i, n, k, num, sector;
+	uint16_t wr, check;
+	uint32_t seq, rec[2];
+	
+	// մ洢ǰΪһһ¼ֻ01
+	session_store.head = session_store.sector_num - 1;
+	session_store.seq = 0;
+	session_store.dir_used = SESSION_DIR_NUM;
+	session_store.wr = FLASH_SECTOR_SIZE;
+	session_store.next_id = 1;
+	
+	for(s = 0; s < session_store.sector_num; s++)
+	{
+		if(session_sector_head(s, &seq) && (seq > session_store.seq))
+		{
+			session_store.seq = seq;
+			session_store.head = s;
+		}
+	}
+	if(session_store.seq == 0) return;
+	
+	// ǰдλãǿհ˵¼дʱ磬д
+	n = session_sector_dir(session_store.head, dir, &wr);
+	if(wr && (n < SESSION_DIR_NUM))
+	{
+		check = FLASH_SECTOR_SIZE - wr;
+		if(check > SESSION_BLANK_CHECK) check = SESSION_BLANK_CHECK;
+		flash_read(SESSION_SECTOR_ADDR(session_store.head) + wr, blank, check);
+		for(i = 0; (i < check) && (blank[i] == 0xFF); i++);
+		if(i == check)
+		{
+			session_store.dir_used = n;
+			session_store.wr = wr;
+		}
+	}
+	
+	// ӵǰǰµ index_head ǰһ
+	session_store.index_head = 0;
+	num = 0;
+	for(k = 0; (k < session_store.sector_num) && (num < SESSION_INDEX_NUM); k++)
+	{
+		sector = (session_store.head + session_store.sector_num - k) % session_store.sector_num;
+		if(k && (!session_sector_head(sector, &seq) || (seq != session_store.seq - k))) break;
+		
+		n = session_sector_dir(sector, dir, &wr);
+		while(n && (num < SESSION_INDEX_NUM))
+		{
+			n--;
+			num++;
+			i = SESSION_INDEX_NUM - num;
+			session_store.index[i].addr = SESSION_SECTOR_ADDR(sector) + get16(dir + n * SESSION_DIR_LEN);
+			session_store.index[i].len = get16(dir + n * SESSION_DIR_LEN + 2);
+		}
+	}
+	session_store.index_num = num;
+	
+	// һ¼Idµļ¼
+	if(num)
+	{
+		flash_read(session_store.index[SESSION_INDEX_NUM - 1].addr, rec, sizeof(rec));
+		if(get16((uint8_t *)rec) == SESSION_RECORD_MAGIC) session_store.next_id = get32((uint8_t *)rec + 4) + 1;
+	}
+}
+
+/************************************************
+	@Function			: session_log_init
+	@Description	:	Ƽ¼ʼ
+	@parameter		: None
+	@Return				: None
+	@Remark				: 洢ʱ¼
+*/
+void session_log_init(void)
+{
+	uint32_t addr, len;
+	
+	memset(&session, 0, sizeof(session));
+	memset(&session_store, 0, sizeof(session_store));
+	
+	if(!flash_store_region(&addr, &len)) return;
+	len /= FLASH_SECTOR_SIZE;
+	if(len < 2) return;
+	if(len > SESSION_SECTOR_MAX) len = SESSION_SECTOR_MAX;
+	
+	session_store.base = addr;
+	session_store.sector_num = len;
+	session_store_recover();
+	session_store.ready = 1;
+}
+
+/************************************************
+	@Function			: session_trace_push
+	@Description	:	ǿ߼һ
+	@parameter		: None
+	@Return				: None
+	@Remark				: ʱȡֵϲӱ
+*/
+static void session_trace_push(void)
+{
+	uint16_t i;
+	uint8_t ch;
+	
+	if(session.trace_num < SESSION_TRACE_NUM) memcpy(session.trace[session.trace_num++], session.trace_acc, CH_NUM);
+	memset(session.trace_acc, 0, CH_NUM);
+	
+	// ϲһ¼ͳ
+	if((session.trace_num >= SESSION_TRACE_NUM) && (session.trace_intv < SESSION_TRACE_INTV_MAX))
+	{
+		for(i = 0; i < SESSION_TRACE_NUM / 2; i++)
+		{
+			for(ch = 0; ch < CH_NUM; ch++)
+			{
+				session.trace[i][ch] = session.trace[2 * i][ch] > session.trace[2 * i + 1][ch] ? session.trace[2 * i][ch] : session.trace[2 * i + 1][ch];
+			}
+		}
+		session.trace_num = SESSION_TRACE_NUM / 2;
+		session.trace_intv *= 2;
+	}
+}
+
+/************************************************
+	@Function			: session_open
+	@Description	:	̼ʼ
+	@parameter		: None
+	@Return				: None
+	@Remark				: None
+*/
+static void session_open(void)
+{
+	uint8_t ch;
+	
+	memset(&session, 0, sizeof(session));
+	session.state = SESSION_RUN;
+	session.para = stim_parameter;
+	session.trace_intv = 1;
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		session.pulse_start[ch] = stim_control[ch].pulse_cnt;
+		session.probe_last[ch] = stim_control[ch].probe_status;
+	}
+	for(ch = 0; ch < SESSION_EMG_CH; ch++)
+	{
+		session.emg_min[ch] = 0xFFFF;
+	}
+}
+
+/************************************************
+	@Function			: session_sample
+	@Description	:	̼ÿͳһ
+	@parameter		: None
+	@Return				: None
+	@Remark				: ǿȰʵ¼ͨδʱΪ0
+*/
+static void session_sample(void)
+{
+	uint8_t ch, intensity, off;
+	
+	if(session.duration < 0xFFFF) session.duration++;
+	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		intensity = stim_control[ch].stim_section ? stim_control[ch].intensity : 0;
+		if(intensity > session.intensity_max[ch]) session.intensity_max[ch] = intensity;
+		if(intensity > session.trace_acc[ch]) session.trace_acc[ch] = intensity;
+		
+		// 缫˳ӦԱ
+		off = stim_control[ch].probe_status & (LEAD_OFF | COMPLIANCE_OFF);
+		if(off & ~session.probe_last[ch])
+		{
+			if(session.off_cnt[ch] < 0xFF) session.off_cnt[ch]++;
+			if(session.off_num < SESSION_OFF_EVT_NUM)
+			{
+				session.off[session.off_num].t = session.duration;
+				session.off[session.off_num].ch = ch;
+				session.off[session.off_num].status = off;
+				session.off_num++;
+			}
+		}
+		session.probe_last[ch] = off;
+	}
+	
+	if(++session.trace_sub >= session.trace_intv)
+	{
+		session.trace_sub = 0;
+		session_trace_push();
+	}
+}
+
+/************************************************
+	@Function			: session_serialize
+	@Description	:	ֹͣĴ̼ͳдд뻺
+	@parameter		: None
+	@Return				: None
+	@Remark				: ¼ʽ session_log.h
+*/
+static void session_serialize(void)
+{
+	uint8_t *p = session_store.buf;
+	uint8_t ch;
+	uint16_t i, len;
+	
+	p += SESSION_REC_HEAD_LEN;
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		put32(p, session.pulses[ch]);
+		p[4] = session.intensity_max[ch];
+		p[5] = session.off_cnt[ch];
+		p += SESSION_REC_CH_LEN;
+	}
+	for(ch = 0; ch < SESSION_EMG_CH; ch++)
+	{
+		put16(p, session.emg_num[ch] ? session.emg_min[ch] : 0);
+		put16(p + 2, session.emg_max[ch]);
+		put16(p + 4, session.emg_num[ch] ? session.emg_sum[ch] / session.emg_num[ch] : 0);
+		p += SESSION_REC_EMG_LEN;
+	}
+	for(i = 0; i < session.off_num; i++)
+	{
+		put16(p, session.off[i].t);
+		p[2] = session.off[i].ch;
+		p[3] = session.off[i].status;
+		p += SESSION_REC_OFF_LEN;
+	}
+	memcpy(p, session.trace, session.trace_num * CH_NUM);
+	p += session.trace_num * CH_NUM;
+	len = p - session_store.buf + 2;
+	
+	p = session_store.buf;
+	put16(p, SESSION_RECORD_MAGIC);
+	put16(p + 2, len);
+	put32(p + 4, session_store.next_id++);
+	put16(p + 8, session.duration);
+	put16(p + 10, session.para.frequency);
+	put16(p + 12, session.para.pulse_width);
+	p[14] = session.para.rasetime;
+	p[15] = session.para.stimtime;
+	p[16] = session.para.falltime;
+	p[17] = session.para.resttime;
+	p[18] = CH_NUM;
+	p[19] = SESSION_EMG_CH;
+	p[20] = session.trace_intv;
+	p[21] = session.off_num;
+	put16(p + 22, session.trace_num);
+	put16(p + len - 2, co_crc16(0xFFFF, p, len - 2));
+	
+	session_store.pend_len = len;
+	session_store.pend_done = 0;
+	session_store.wr_state = SESSION_WR_ERASE;
+	if((session_store.dir_used < SESSION_DIR_NUM) && ((uint32_t)session_store.wr + len <= FLASH_SECTOR_SIZE))
+	{
+		session_store.wr_state = SESSION_WR_PROG;
+	}
+	
+	session.state = SESSION_IDLE;
+}
+
+/************************************************
+	@Function			: session_close
+	@Description	:	ֹ̼ͣ
+	@parameter		: None
+	@Return				: None
+	@Remark				: һ¼δдʱͳƱдٷ뻺
+*/
+static void session_close(void)
+{
+	uint8_t ch;
+	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		session.pulses[ch] = stim_control[ch].pulse_cnt - session.pulse_start[ch];
+	}
+	if(session.trace_sub) session_trace_push();
+	
+	session.state = SESSION_CLOSED;
+	if(session_store.wr_state == SESSION_WR_IDLE) session_serialize();
+}
+
+/************************************************
+	@Function			: session_log_tick_1s
+	@Description	:	Ƽ¼ͳƣѭÿ
+	@parameter		: None
+	@Return				: None
+	@Remark				: һ̼ͨʼȫֹͨͣΪһ¼
+*/
+void session_log_tick_1s(void)
+{
+	uint8_t active;
+	
+	if(!session_store.ready) return;
+	active = stim_active_mask();
+	
+	switch(session.state)
+	{
+		case SESSION_IDLE:
+			if(!active)
+			{
+				session.skip = 0;
+			}
+			else if(!session.skip)
+			{
+				session_open();
+				session_sample();
+			}
+			break;
+		
+		case SESSION_RUN:
+			if(active) session_sample();
+			else session_close();
+			break;
+		
+		case SESSION_CLOSED:
+			// һδд룬δ̼¼
+			if(active && !session.skip)
+			{
+				session.skip = 1;
+				if(session_store.lost < 0xFFFF) session_store.lost++;
+			}
+			if(!active) session.skip = 0;
+			break;
+		
+		default:
+			session.state = SESSION_IDLE;
+			break;
+	}
+}
+
+/************************************************
+	@Function			: session_log_emg
+	@Description	:	EMGͳ
+	@parameter		: channel , EMGͨ
+									value , ֵ
+	@Return				: None
+	@Remark				: ֻͳƴ̼еİ磨ջ̼
+*/
+void session_log_emg(uint8_t channel, uint16_t value)
+{
+	if((session.state != SESSION_RUN) || (channel >= SESSION_EMG_CH)) return;
+	
+	if(value < session.emg_min[channel]) session.emg_min[channel] = value;
+	if(value > session.emg_max[channel]) session.emg_max[channel] = value;
+	session.emg_sum[channel] += value;
+	session.emg_num[channel]++;
+}
+
+/************************************************
+	@Function			: session_log_handler
+	@Description	:	Ƽ¼дFlashѭ
+	@parameter		: None
+	@Return				: None
+	@Remark				: ̼вFlashдʱжϣÿεֻһ
+									һдҳһΣдĿ¼
+*/
+void session_log_handler(void)
+{
+	uint8_t head[SESSION_HEAD_LEN];
+	uint8_t dir[SESSION_DIR_LEN];
+	uint32_t addr;
+	uint16_t len;
+	
+	if(!session_store.ready || stim_active_mask()) return;
+	
+	switch(session_store.wr_state)
+	{
+		case SESSION_WR_IDLE:
+			if(session.state == SESSION_CLOSED) session_serialize();
+			break;
+		
+		case SESSION_WR_ERASE:
+			session_store.head = (session_store.head + 1) % session_store.sector_num;
+			session_index_drop(session_store.head);
+			flash_erase_sector(SESSION_SECTOR_ADDR(session_store.head));
+			
+			session_store.seq++;
+			put16(head, SESSION_SECTOR_MAGIC);
+			put32(head + 4, session_store.seq);
+			put16(head + 2, co_crc16(0xFFFF, head + 4, 4));
+			flash_write(SESSION_SECTOR_ADDR(session_store.head), head, SESSION_HEAD_LEN);
+			
+			session_store.dir_used = 0;
+			session_store.wr = SESSION_DATA_START;
+			session_store.wr_state = SESSION_WR_PROG;
+			break;
+		
+		case SESSION_WR_PROG:
+			addr = SESSION_SECTOR_ADDR(session_store.head) + session_store.wr + session_store.pend_done;
+			len = FLASH_PAGE_SIZE - (addr & (FLASH_PAGE_SIZE - 1));
+			if(len > session_store.pend_len - session_store.pend_done) len = session_store.pend_len - session_store.pend_done;
+			flash_write(addr, session_store.buf + session_store.pend_done, len);
+			
+			session_store.pend_done += len;
+			if(session_store.pend_done >= session_store.pend_len) session_store.wr_state = SESSION_WR_COMMIT;
+			break;
+		
+		case SESSION_WR_COMMIT:
+			put16(dir, session_store.wr);
+			put16(dir + 2, session_store.pend_len);
+			flash_write(SESSION_SECTOR_ADDR(session_store.head) + SESSION_HEAD_LEN + session_store.dir_used * SESSION_DIR_LEN, dir, SESSION_DIR_LEN);
+			
+			session_index_push(SESSION_SECTOR_ADDR(session_store.head) + session_store.wr, session_store.pend_len);
+			session_store.dir_used++;
+			session_store.wr += session_store.pend_len;
+			session_store.wr_state = SESSION_WR_IDLE;
+			break;
+		
+		default:
+			session_store.wr_state = SESSION_WR_IDLE;
+			break;
+	}
+}
+
+/************************************************
+	@Function			: session_log_busy
+	@Description	:	Ƿм¼ȴд
+	@parameter		: None
+	@Return				: 1 , ; 0 , 
+	@Remark				: None
+*/
+uint8_t session_log_busy(void)
+{
+	return (session_store.wr_state != SESSION_WR_IDLE) || (session.state == SESSION_CLOSED);
+}
+
+/************************************************
+	@Function			: session_log_count
+	@Description	:	ֱӶȡ¼¼
+	@parameter		: None
+	@Return				: ¼ SESSION_INDEX_NUM
+	@Remark				: None
+*/
+uint8_t session_log_count(void)
+{
+	return session_store.index_num;
+}
+
+/************************************************
+	@Function			: session_index_get
+	@Description	:	µĵn¼
+	@parameter		: n , 0 Ϊµļ¼
+	@Return				: ʱΪ NULL
+	@Remark				: None
+*/
+static Session_index_Typedef *session_index_get(uint8_t n)
+{
+	if(n >= session_store.index_num) return NULL;
+	return &session_store.index[(session_store.index_head + SESSION_INDEX_NUM - 1 - n) % SESSION_INDEX_NUM];
+}
+
+/************************************************
+	@Function			: session_log_read
+	@Description	:	ȡµĵn¼
+	@parameter		: n , 0 Ϊµļ¼
+									buf , ¼
+									size , 泤
+	@Return				: ¼; 0 , ڡ治У
+	@Remark				: ڴֱӶλɨFlash
+*/
+uint16_t session_log_read(uint8_t n, uint8_t *buf, uint16_t size)
+{
+	Session_index_Typedef *e = session_index_get(n);
+	uint16_t len;
+	
+	if(e == NULL) return 0;
+	len = e->len;
+	if(len > size) return 0;
+	
+	flash_read(e->addr, buf, len);
+	if((get16(buf) != SESSION_RECORD_MAGIC) || (get16(buf + 2) != len)) return 0;
+	if(get16(buf + len - 2) != co_crc16(0xFFFF, buf, len - 2)) return 0;
+	
+	return len;
+}
+
+/************************************************
+	@Function			: session_log_size
+	@Description	:	µĵn¼ĳ
+	@parameter		: n , 0 Ϊµļ¼
+	@Return				: ¼; 0 , 
+	@Remark				: ȡBULK_ID_SESSION_LOGĶ󳤶
+*/
+uint16_t session_log_size(uint8_t n)
+{
+	Session_index_Typedef *e = session_index_get(n);
+	
+	return e ? e->len : 0;
+}
+
+/************************************************
+	@Function			: session_log_read_part
+	@Description	:	ȡµĵn¼һ
+	@parameter		: n , 0 Ϊµļ¼
+									offset , ¼ڵƫ
+									buf , 
+									len , ȡ
+	@Return				: ȡĳ; 0 , ڻ򳬳¼
+	@Remark				: ֶϴλУ飬APP¼ Magic  CRC16 
+									ϴڼд¼¼ʱ n ָļ¼䣬APPУʧܺ¶ȡ
+*/
+uint16_t session_log_read_part(uint8_t n, uint16_t offset, uint8_t *buf, uint16_t len)
+{
+	Session_index_Typedef *e = session_index_get(n);
+	
+	if((e == NULL) || (offset >= e->len) || (len > e->len - offset)) return 0;
+	
+	flash_read(e->addr + offset, buf, len);
+	return len;
+}
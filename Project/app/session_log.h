@@ -0,0 +1,122 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: session_log.h
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20211108
+		1. 20211108		First editon
+		2.
+*/
+
+#ifndef __SESSION_LOG_H__
+#define __SESSION_LOG_H__
+
+#include <stdint.h>
+#include "stim_control.h"
+
+/*
+	Ƽ¼ÿδ̼һ̼ͨʼȫֹͨͣ׷һ¼Flash洢
+	洢4Kѭʹãдɵֻĥ⣩¼ֻ׷Ӳ޸
+	 : ͷ Magic(2) CRC16(2) Seq(4) | Ŀ¼ Offset(2) Len(2) x SESSION_DIR_NUM | ¼...
+		Seq ÿֻһ1ΪǰдĿ¼ڼ¼ддδдĿ¼ļ¼Ч
+		ϵָֻͷĿ¼ɨ¼
+	¼ : Magic(2) Len(2) Id(4) ʱs(2) Ƶ(2) (2) (1) ̼(1) ½(1) Ϣ(1)
+				 ͨ(1) EMGͨ(1) ߼s(1) ¼(1) ߵ(2)
+				 ÿͨ : (4) ǿ(1) (1)
+				 ÿEMGͨ : С(2) (2) ƽ(2)
+				 ¼ : ʱs(2) ͨ(1) ״̬(1)
+				 ǿ : ÿͨǿ(1)ȡֵ
+				 CRC16(2)
+	ֽݵֽǰFlashֻڴֹ̼ͣʱѭֲд루ÿһҳһ
+*/
+#define SESSION_SECTOR_MAGIC		0x4C53		// "SL"
+#define SESSION_RECORD_MAGIC		0x5253		// "SR"
+#define SESSION_HEAD_LEN				8					// ͷ
+#define SESSION_DIR_NUM					32				// ÿ¼
+#define SESSION_DIR_LEN					4					// Ŀ¼ Offset Len
+#define SESSION_DATA_START			(SESSION_HEAD_LEN + SESSION_DIR_NUM * SESSION_DIR_LEN)
+#define SESSION_SECTOR_MAX			16				// 洢ʹõ
+#define SESSION_INDEX_NUM				32				// ڴµļ¼
+
+#define SESSION_EMG_CH					2					// EMGͨ
+#define SESSION_OFF_EVT_NUM			16				// ÿμ¼¼ֻƴ
+#define SESSION_TRACE_BYTES			1200			// ǿ߻棬1sһ㣬ϲӱ
+#define SESSION_TRACE_NUM				(SESSION_TRACE_BYTES / CH_NUM)
+#define SESSION_TRACE_INTV_MAX	128				// ߼sټ¼
+
+#define SESSION_REC_HEAD_LEN		24
+#define SESSION_REC_CH_LEN			6
+#define SESSION_REC_EMG_LEN			6
+#define SESSION_REC_OFF_LEN			4
+#define SESSION_RECORD_MAX			(SESSION_REC_HEAD_LEN + SESSION_REC_CH_LEN * CH_NUM + SESSION_REC_EMG_LEN * SESSION_EMG_CH \
+																	+ SESSION_REC_OFF_LEN * SESSION_OFF_EVT_NUM + SESSION_TRACE_BYTES + 2)
+
+typedef struct{
+	uint16_t t;				// Կʼʱs
+	uint8_t ch;				// ͨ
+	uint8_t status;		// probe_status
+}Session_off_Typedef;
+
+typedef struct{
+	uint8_t state;										// SESSION_xxx
+	uint8_t skip;											// һ¼δдFlashʱʼĴ̼¼
+	uint16_t duration;								// ʱs
+	Stim_parameter_Typedef para;			// ʼʱĴ̼
+	uint32_t pulse_start[CH_NUM];			// ʼʱ
+	uint32_t pulses[CH_NUM];
+	uint8_t intensity_max[CH_NUM];
+	uint8_t off_cnt[CH_NUM];
+	uint8_t probe_last[CH_NUM];
+	uint16_t emg_min[SESSION_EMG_CH];
+	uint16_t emg_max[SESSION_EMG_CH];
+	uint32_t emg_sum[SESSION_EMG_CH];
+	uint32_t emg_num[SESSION_EMG_CH];
+	uint8_t off_num;
+	Session_off_Typedef off[SESSION_OFF_EVT_NUM];
+	uint8_t trace_intv;								// ߼s
+	uint8_t trace_sub;								// ǰѹ
+	uint16_t trace_num;
+	uint8_t trace_acc[CH_NUM];				// ǰڵǿ
+	uint8_t trace[SESSION_TRACE_NUM][CH_NUM];
+}Session_Typedef;
+
+typedef struct{
+	uint32_t addr;		// ¼ַ
+	uint16_t len;			// ¼
+}Session_index_Typedef;
+
+typedef struct{
+	uint8_t ready;										// 洢
+	uint32_t base;										// 洢ַ
+	uint8_t sector_num;
+	uint8_t head;											// ǰд
+	uint32_t seq;											// ǰдţ0:洢Ϊ
+	uint8_t dir_used;									// ǰĿ¼SESSION_DIR_NUM:
+	uint16_t wr;											// ǰдƫ
+	uint32_t next_id;									// һ¼Id
+	Session_index_Typedef index[SESSION_INDEX_NUM];	// Σµ index_head ǰһ
+	uint8_t index_head;
+	uint8_t index_num;
+	uint8_t wr_state;									// SESSION_WR_xxx
+	uint16_t pend_len;								// д¼
+	uint16_t pend_done;								// д볤
+	uint16_t lost;										// δܼ¼Ĵ̼
+	uint8_t buf[SESSION_RECORD_MAX];	// д¼
+}Session_store_Typedef;
+
+extern Session_Typedef session;
+extern Session_store_Typedef session_store;
+
+void session_log_init(void);
+void session_log_tick_1s(void);
+void session_log_emg(uint8_t channel, uint16_t value);
+void session_log_handler(void);
+uint8_t session_log_busy(void);
+uint8_t session_log_count(void);
+uint16_t session_log_read(uint8_t n, uint8_t *buf, uint16_t size);
+uint16_t session_log_size(uint8_t n);
+uint16_t session_log_read_part(uint8_t n, uint16_t offset, uint8_t *buf, uint16_t len);
+
+#endif
@@ -17,11 +17,29 @@
 #include "bsp_timer.h"
 #include "bsp_systick.h"
 #include "emg_wave.h"
+#include "stim_monitor.h"
+#include "stim_loop.h"
+#include "main.h"
 
 //Stim_status_Typedef stim_status;
 
-Stim_control_Typedef stim_a_control;
-Stim_control_Typedef stim_b_control;
+Stim_control_Typedef stim_control[CH_NUM];
+
+// 4ͨӲC/Dͨ device/bsp_gpio.h ж壨Ŀǰֻз unittest/bsp_gpio.h 壩
+#if (STIM_CH_NUM > 2) && !(defined(PIN_STIM_OUT_C) && defined(PIN_STIM_OUT_D) && defined(PIN_STIM_DAC_SEL_C) && defined(PIN_STIM_DAC_SEL_D))
+#error "STIM_CH_NUM > 2: PIN_STIM_OUT_C/D, PIN_STIM_DAC_SEL_C/D not defined in bsp_gpio.h"
+#endif
+
+// ֻͨͨڴ
+static const Stim_channel_Typedef stim_channel[CH_NUM] =
+{
+	[CH_A] = { .out_pin_mask = BITMASK(PIN_STIM_OUT_A), .dac_route_mask = 0, },
+	[CH_B] = { .out_pin_mask = BITMASK(PIN_STIM_OUT_B), .dac_route_mask = 0, },
+#if (STIM_CH_NUM > 2)
+	[CH_C] = { .out_pin_mask = BITMASK(PIN_STIM_OUT_C), .dac_route_mask = BITMASK(PIN_STIM_DAC_SEL_C), },
+	[CH_D] = { .out_pin_mask = BITMASK(PIN_STIM_OUT_D), .dac_route_mask = BITMASK(PIN_STIM_DAC_SEL_D), },
+#endif
+};
 
 Stim_parameter_Typedef stim_parameter =
 {
@@ -42,13 +60,14 @@ Stim_parameter_Typedef stim_parameter =
 */
 void pulse_parameter_set(void)
 {
-	stim_a_control.pw_50us_cnt = stim_parameter.pulse_width / 50;
-	stim_a_control.pw_period_cnt = (1000000 / stim_parameter.frequency ) / 50;
-	stim_a_control.period_time = stim_parameter.stimtime + stim_parameter.rasetime/10;
+	uint8_t ch;
 	
-	stim_b_control.pw_50us_cnt = stim_parameter.pulse_width / 50;
-	stim_b_control.pw_period_cnt = (1000000 / stim_parameter.frequency) / 50;
-	stim_b_control.period_time = stim_parameter.stimtime + stim_parameter.rasetime/10;
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		stim_control[ch].pw_50us_cnt = stim_parameter.pulse_width / 50;
+		stim_control[ch].pw_period_cnt = (1000000 / stim_parameter.frequency ) / 50;
+		stim_control[ch].period_time = stim_parameter.stimtime + stim_parameter.rasetime/10;
+	}
 }
 
 /************************************************
@@ -85,7 +104,7 @@ uint8_t startup_stim_operation(Stim_control_Typedef *pc)
 {
 	uint8_t res = 0;
 	
-	if(pc->probe_status == LEAD_OFF) { return ERROR_ACK; } // 缫
+	if(pc->probe_status & LEAD_OFF) { return ERROR_ACK; } // 缫
 	
 	if(pc->intensity > 0)
 	{
@@ -116,16 +135,20 @@ void stim_lead_off_check(uint8_t channel, Stim_control_Typedef *pc)
 {
 	static uint8_t index[CH_NUM] = {0};
 	static uint16_t status_cnt[CH_NUM] = {0}; 
+	uint8_t ch, lead_off = 0;
 	
 	if(gpio_read(BITMASK(PIN_STIM_OFF))) status_cnt[channel]++;
 	
 	if(++index[channel] >= LEAD_OFF_CNT)
 	{
 		index[channel] = 0;
-		pc->probe_status = (status_cnt[channel] >= 5) ? LEAD_OFF : 0;
+		if(status_cnt[channel] >= 5) pc->probe_status |= LEAD_OFF;
+		else pc->probe_status &= ~LEAD_OFF;
 		status_cnt[channel] = 0;
 		
-		if(stim_a_control.probe_status) gpio_write(BITMASK(PIN_LED0), GPIO_HIGH);
+		for(ch = 0; ch < CH_NUM; ch++) lead_off |= stim_control[ch].probe_status;  // һͨ
+		
+		if(lead_off) gpio_write(BITMASK(PIN_LED0), GPIO_HIGH);
 		else gpio_write(BIT_MASK(PIN_LED0), GPIO_LOW);
 		
 	}
@@ -141,12 +164,14 @@ void stim_lead_off_check(uint8_t channel, Stim_control_Typedef *pc)
 void stim_period_output_control(void)
 {
 //	uint8_t status = 0;
+	uint8_t ch;
 	
 	// ̼ʱ½ʱ
-	if(!stim_a_control.period_time && stim_a_control.stim_section) 
-		stim_a_control.stim_section =  FALLTIME;
-	if(!stim_b_control.period_time && stim_b_control.stim_section) 
-		stim_b_control.stim_section = FALLTIME;
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		if(!stim_control[ch].period_time && stim_control[ch].stim_section) 
+			stim_control[ch].stim_section = FALLTIME;
+	}
 
 /*	
 	// Ǵ̼״̬ȡ ̼缫䱨
@@ -200,6 +225,8 @@ void stim_intensity_value_control( uint8_t channel, Stim_parameter_Typedef *sp,
 	static uint8_t stim_start_last_value[CH_NUM] = {0};
 	uint8_t intensity_tmp;
 	
+	if( pc->closed_loop ) { return; }  // ̼ stim_loop ǿ
+	
 	if( pc->start_in_half ) { intensity_tmp = 1;}
 	else { intensity_tmp = (pc->intensity + 1)/ 2;}
 	
@@ -275,6 +302,8 @@ void stim_intensity_output_control( Stim_parameter_Typedef *sp, Stim_control_Typ
 {	
 	uint8_t intensity_tmp = 0;
 	
+	if( pc->closed_loop ) { return; }
+	
 	if( pc->intensity_changed_flag ) // ǿȷ仯½ʱΣ
 	{
 		if( pc->stim_section == RASETIME )  // start 
@@ -331,158 +360,154 @@ void stim_intensity_output_control( Stim_parameter_Typedef *sp, Stim_control_Typ
 	}
 }
 
+static uint16_t tick_lost_cnt = 0;		// DACдڼ䶪ʧ50usжϴ
+static uint16_t pulse_dac_value = 0;	// ǰдDACĵǿ
+
+/**************************************************************
+	@Function 		: pulse_dac_set
+	@Parameter		: value , ĵǿ
+	@Description	: DAC¼ʧĶʱж
+	@Return				: None
+	@Remark				: None
+*/
+static void pulse_dac_set(uint16_t value)
+{
+	dac_out_value_set(value);
+	pulse_dac_value = value;
+	tick_lost_cnt += STIM_DAC_WR_CNT - 1;
+}
+
+/**************************************************************
+	@Function 		: pulse_low_cnt
+	@Parameter		: period_cnt , ()ڼλ50us
+									pw_cnt , λ50us
+	@Description	: ͵ƽ׶εĽ
+	@Return				: ͵ƽ׶μ
+	@Remark				: һ: ׼(DACд) +  + ض(DACд) + ͵ƽ = period_cnt
+*/
+static uint16_t pulse_low_cnt(uint16_t period_cnt, uint16_t pw_cnt)
+{
+	uint16_t used = pw_cnt + 2 * STIM_DAC_WR_CNT;
+	
+	return (period_cnt > used) ? (period_cnt - used) : 1;
+}
+
+static uint8_t slot_ch[CH_NUM];		// ͨ
+static uint8_t slot_num = 0;				// ͨ
+static uint8_t slot_idx = 0;				// ǰͨ
+
+/**************************************************************
+	@Function 		: pulse_slot_cnt
+	@Parameter		: period_cnt , ڼλ50us
+									idx , ͨڱڵ
+									num , ͨ
+	@Description	: ͨռõʱƬ
+	@Return				: ʱƬλ50us
+	@Remark				: ͨƽڣηָͨ
+*/
+static uint16_t pulse_slot_cnt(uint16_t period_cnt, uint8_t idx, uint8_t num)
+{
+	return (uint32_t)period_cnt * (idx + 1) / num - (uint32_t)period_cnt * idx / num;
+}
+
+/**************************************************************
+	@Function 		: pulse_slot_schedule
+	@Parameter		: None
+	@Description	: µڿʼͳƴ̼еͨ
+	@Return				: ͨ
+	@Remark				: None
+*/
+static uint8_t pulse_slot_schedule(void)
+{
+	uint8_t ch;
+	
+	slot_num = 0;
+	slot_idx = 0;
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		if(stim_control[ch].stim_section) slot_ch[slot_num++] = ch;
+	}
+	
+	return slot_num;
+}
+
 /**************************************************************
 	@Function 		: single_pulse_control
 	@Parameter		: None						 
 	@Description	: 
-	@Return				: None
-	@Remark				: None
+	@Return				: 1 , ڽ
+	@Remark				: ̼еͨһ
 */
 uint8_t single_pulse_control(void)
 {
-	static pulse_step step = step_a_prepare;  // Ʋ
-	static uint16_t count_50us[CH_NUM]; 			// 
-//	uint8_t freq_comp = 0; // Ƶʲ
-
-//	// ֻBͨ
-	if(( !stim_a_control.stim_section ) && (step == step_a_prepare)) step = step_b_prepare;
-//	
-//	if(stim_a_control.pulse_low_time_cnt) stim_a_control.pulse_low_time_cnt++;
-//	if(stim_b_control.pulse_low_time_cnt) stim_b_control.pulse_low_time_cnt++;
+	static pulse_step step = step_prepare;  // Ʋ
+	static uint16_t count_50us = 0;
+	const Stim_channel_Typedef *pch;
+	Stim_control_Typedef *pc;
+	uint8_t channel;
+	
+	if((step == step_prepare) && (slot_idx >= slot_num))
+	{
+		if(!pulse_slot_schedule()) return 1; // ͨѽ
+	}
+	
+	channel = slot_ch[slot_idx];
+	pch = &stim_channel[channel];
+	pc = &stim_control[channel];
 	
 	switch( step )
 	{
-		case step_a_prepare:	 // ǰ׼	
-			if(stim_a_control.intensity < 40) { gpio_write(BITMASK(PIN_STIM_PWM_L), GPIO_HIGH); }
+		case step_prepare:	 // ǰ׼	
+			if(pc->intensity < 40) { gpio_write(BITMASK(PIN_STIM_PWM_L), GPIO_HIGH); }
 			else { gpio_write(BITMASK(PIN_STIM_PWM_H), GPIO_HIGH); }
-			gpio_write(BITMASK(PIN_STIM_OUT_A), GPIO_HIGH);  // Aͨʹܹ			
-//			if( ++count_50us[CH_A] >= 4 )  // 200us delay time
-//			{
-				count_50us[CH_A] = 0;
-				step = step_a_up; 
-//			}
-		
+			if(pch->dac_route_mask) gpio_write(pch->dac_route_mask, GPIO_HIGH);
+			pulse_dac_set(pc->intensity_dac);  // DACдڹǰ
+			stim_loop_blank_start(pc->pw_50us_cnt + 2 * STIM_DAC_WR_CNT + STIM_LOOP_BLANK_CNT);  // 弰αڼEMG
+			count_50us = 0;
+			step = step_up; 
 		break;
 		
-		case step_a_up:  // ʱ
-			if(!count_50us[CH_A])
+		case step_up:  // ʱ
+			if(!count_50us && pc->stim_section)  // ѽͨ
 			{
-				dac_out_value_set(stim_a_control.intensity_dac);    // test intensity set.			
-//				if(stim_a_control.intensity < 40) { gpio_write(BITMASK(PIN_STIM_PWM_L), GPIO_HIGH); }
-//				else { gpio_write(BITMASK(PIN_STIM_PWM_H), GPIO_HIGH); }
+				gpio_write(pch->out_pin_mask, GPIO_HIGH);  // ͨʹܹ
+				pc->pulse_cnt++;
 			}
+			if(count_50us == stim_monitor_sample_cnt(pc->pw_50us_cnt))
+				stim_monitor_trigger(channel, pc, pulse_dac_value);  // 迹
 			
-			if( ++count_50us[CH_A] >= stim_a_control.pw_50us_cnt )  // 
+			if( ++count_50us >= pc->pw_50us_cnt )  // 
 			{
-				count_50us[CH_A] = 0;
+				count_50us = 0;
 				tim_arr_set(HS_TIM0, 50); 
 
-				step = step_a_delay; 
+				step = step_delay; 
 			}
-			stim_lead_off_check(CH_A, &stim_a_control); // 
+			stim_lead_off_check(channel, pc); // 
 		break;
 
-		case step_a_delay:  // ͵ƽʱ1
-			if(!count_50us[CH_A])
+		case step_delay:  // ͵ƽʱ
+			if(!count_50us)
 			{				
 				tim_arr_set(HS_TIM0, 50);	
-				gpio_write(BITMASK(PIN_STIM_OUT_A), GPIO_LOW); // رչ  
+				gpio_write(pch->out_pin_mask, GPIO_LOW); // رչ  
 				gpio_write(BITMASK(PIN_STIM_PWM_L), GPIO_LOW);
 				gpio_write(BITMASK(PIN_STIM_PWM_H), GPIO_LOW);
+				if(pch->dac_route_mask) gpio_write(pch->dac_route_mask, GPIO_LOW);
 		
-				dac_out_value_set(0);
-			}
-//			else if(count_50us[CH_A]==1)
-//			{
-//				tim_arr_set(HS_TIM0, 50);
-//				stim_lead_off_check(CH_A, &stim_a_control); // 
-//			}
-			else
-			{
-				if(stim_b_control.stim_section)
-				{
-					if( count_50us[CH_A] >= stim_a_control.pw_period_cnt / 2 - 19)
-					{
-						count_50us[CH_A] = 0;
-						step = step_b_prepare;
-					}
-				}
-				else 
-				{
-					if( count_50us[CH_A] >= stim_a_control.pw_period_cnt - 21)
-					{
-						count_50us[CH_A] = 0;
-						step = step_a_prepare;
-						
-						return 1;
-					}
-				}			
-			}
-			count_50us[CH_A]++;
-		break;
-			
-		case step_b_prepare:		
-			if(stim_b_control.intensity < 40) { gpio_write(BITMASK(PIN_STIM_PWM_L), GPIO_HIGH); }
-			else { gpio_write(BITMASK(PIN_STIM_PWM_H), GPIO_HIGH); }
-			gpio_write(BITMASK(PIN_STIM_OUT_B), GPIO_HIGH);  // Aͨʹܹ			
-//			if( ++count_50us[CH_A] >= 4 )  // 200us delay time
-//			{
-				count_50us[CH_A] = 0;
-				step = step_b_up; 
-//			}
-		break;
-		
-		case step_b_up:	
-			if(!count_50us[CH_A])
-			{
-				dac_out_value_set(stim_b_control.intensity_dac);    // test intensity set.			
-//				if(stim_b_control.intensity < 40) { gpio_write(BITMASK(PIN_STIM_PWM_L), GPIO_HIGH); }
-//				else { gpio_write(BITMASK(PIN_STIM_PWM_H), GPIO_HIGH); }
+				pulse_dac_set(0);
 			}
-			
-			if( ++count_50us[CH_A] >= stim_b_control.pw_50us_cnt )  // 
+			else if( count_50us >= pulse_low_cnt(pulse_slot_cnt(pc->pw_period_cnt, slot_idx, slot_num), pc->pw_50us_cnt))
 			{
-				count_50us[CH_A] = 0;
-				tim_arr_set(HS_TIM0, 50); 
-
-				step = step_b_delay; 
+				count_50us = 0;
+				step = step_prepare;
+				
+				if(++slot_idx >= slot_num) return 1;  // ͨ
+				return 0;
 			}
-			stim_lead_off_check(CH_B, &stim_b_control); // 
+			count_50us++;
 		break;
 
-		case step_b_delay:
-			if(!count_50us[CH_A])
-			{				
-				tim_arr_set(HS_TIM0, 50);
-				gpio_write(BITMASK(PIN_STIM_OUT_B), GPIO_LOW); // رչ  
-				gpio_write(BITMASK(PIN_STIM_PWM_L), GPIO_LOW);
-				gpio_write(BITMASK(PIN_STIM_PWM_H), GPIO_LOW);
-				dac_out_value_set(0);
-			}
-//			else if(count_50us[CH_A]==1)
-//			{
-//				tim_arr_set(HS_TIM0, 50);
-//				stim_lead_off_check(CH_B, &stim_a_control); // 
-//			}
-			else
-			{
-					if( count_50us[CH_A] >= stim_b_control.pw_period_cnt / 2 - 19)
-					{
-						count_50us[CH_A] = 0;
-						step = step_a_prepare;
-//						if(!stim_a_control.stim_section && !stim_b_control.stim_section) 	
-//							tim_stop(HS_TIM0); 		
-
-//						gpio_write(BITMASK(PIN_OFF_EN_OR_RELEASE), GPIO_HIGH); // ŵ
-//				
-//						if(emg_wave.emg_wave_en) 
-//							gpio_write(BITMASK(PIN_EMG_OR_STIM_SW), GPIO_HIGH); // лEMG				
-						return 1;
-					}		
-			}
-			count_50us[CH_A]++;
-			break;
-
 		default: break;
 	}
 	return 0;
@@ -499,36 +524,45 @@ uint8_t single_pulse_control(void)
 */
 void intensity_up_or_down(uint8_t channel, uint8_t operation)
 {
-	if(operation)  // up
+	Stim_control_Typedef *pc;
+	uint8_t ch;
+	
+	for(ch = 0; ch < CH_NUM; ch++)
 	{
-		if(STIM_CH_A == (channel & STIM_CH_A)) 
+		if(!(channel & (1 << ch))) continue;
+		pc = &stim_control[ch];
+		
+		if(operation)  // up
 		{
-			if(++stim_a_control.intensity >= INTENSITY_MAX) stim_a_control.intensity = 0;
-			stim_a_control.stim_section = RASETIME;
+			if(++pc->intensity >= INTENSITY_MAX) pc->intensity = 0;
+			pc->stim_section = RASETIME;
 		}
-		if(STIM_CH_B == (channel & STIM_CH_B))
+		else  // down
 		{
-			if(++stim_b_control.intensity >= INTENSITY_MAX) stim_b_control.intensity = 0;
-			stim_b_control.stim_section = RASETIME;
+			if(pc->intensity > INTENSITY_MIN) pc->intensity--;
+			if(!pc->intensity) pc->stim_section = FALLTIME;
+			else pc->stim_section = RASETIME;
 		}
 	}
-	else  // down
+}
+
+/**************************************************************
+	@Function 		: stim_active_mask
+	@Parameter		: None
+	@Description	: ȡ̼еͨ
+	@Return				: ͨ룬bit n Ӧͨ n0:̼ͨ
+	@Remark				: None
+*/
+uint8_t stim_active_mask(void)
+{
+	uint8_t ch, mask = 0;
+	
+	for(ch = 0; ch < CH_NUM; ch++)
 	{
-		if(STIM_CH_A == (channel & STIM_CH_A)) 
-		{
-			if(stim_a_control.intensity > INTENSITY_MIN) stim_a_control.intensity--;
-			if(!stim_a_control.intensity) stim_a_control.stim_section = FALLTIME;
-			else stim_a_control.stim_section = RASETIME;
-		}
-		if(STIM_CH_B == (channel & STIM_CH_B))
-		{
-			if(stim_b_control.intensity > INTENSITY_MIN) stim_b_control.intensity--;
-			if(!stim_b_control.intensity)stim_b_control.stim_section = FALLTIME;
-			else stim_b_control.stim_section = RASETIME;
-		}
+		if(stim_control[ch].stim_section) mask |= 1 << ch;
 	}
 	
-//	printf("A = %d\r\n", stim_a_control.intensity);
+	return mask;
 }
 
 /**************************************************************
@@ -540,13 +574,20 @@ void intensity_up_or_down(uint8_t channel, uint8_t operation)
 */
 void stim_led_control(uint8_t sw)
 {
+	uint8_t ch, intensity = INTENSITY_MAX;
+	
+	for(ch = 0; ch < CH_NUM; ch++)  // Сͨǿָʾ
+	{
+		if(stim_control[ch].intensity < intensity) intensity = stim_control[ch].intensity;
+	}
+	
 	if(sw)
 	{
-		if((stim_a_control.intensity < 16)||(stim_b_control.intensity < 16))
+		if(intensity < 16)
 		{
 			gpio_write(BITMASK(PIN_LED3), GPIO_LOW);
 		}
-		else if((stim_a_control.intensity < 31)||(stim_b_control.intensity < 31)) 
+		else if(intensity < 31) 
 		{
 			gpio_write(BITMASK(PIN_LED3), GPIO_LOW);
 			gpio_write(BITMASK(PIN_LED1), GPIO_LOW);
@@ -575,11 +616,14 @@ void stim_led_control(uint8_t sw)
 */
 void stim_control_handler(void)
 {
+	uint8_t ch;
 	
 	stim_period_output_control();
 	
-	stim_intensity_value_control( CH_A, &stim_parameter, &stim_a_control );  // stim risetime & falltime control of A
-	stim_intensity_value_control( CH_B, &stim_parameter, &stim_b_control );	
+	for(ch = 0; ch < CH_NUM; ch++)  // stim risetime & falltime control
+		stim_intensity_value_control( ch, &stim_parameter, &stim_control[ch] );
+	
+	stim_loop_handler();  // ̼ʱֹͣ
 	
 	// ˴Ӧڷ͵缫״̬
 	/*----------?????------------*/
@@ -622,20 +666,21 @@ void stim_control_handler(void)
 */
 void stim_init(void)
 {
+	uint8_t ch;
+	
 	// control data init
-	memset(&stim_a_control, 0, sizeof(stim_a_control));
-	memset(&stim_b_control, 0, sizeof(stim_b_control));
+	memset(stim_control, 0, sizeof(stim_control));
 
-	stim_a_control.pw_50us_cnt = 4;
-	stim_a_control.pw_period_cnt = 200;
-	stim_a_control.period_time = 5;
-	
-	stim_b_control.pw_50us_cnt = 4;
-	stim_b_control.pw_period_cnt = 200;
-	stim_b_control.period_time = 5;
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		stim_control[ch].pw_50us_cnt = 4;
+		stim_control[ch].pw_period_cnt = 200;
+		stim_control[ch].period_time = 5;
+		stim_control[ch].intensity = 10;
+	}
 	
-	stim_a_control.intensity = 10;
-	stim_b_control.intensity = 10;
+	stim_monitor_init();
+	stim_loop_init();
 //		stim_a_control.intensity_dac = 10;
 }
 
@@ -652,21 +697,31 @@ void stim_50us_server(void)
 	static uint16_t tim_50ms_cnt = 0;
 	static uint16_t tim_1s_cnt = 0;
 	static uint16_t tim_500us_cnt = 0;
+	uint16_t ticks = 1 + tick_lost_cnt;  // жϾ50usDACдʱʧжϣ
+	uint8_t ch;
+	
+	tick_lost_cnt = 0;
+	
+	stim_loop_blank_tick(ticks);
 	
-	if( ++tim_1s_cnt >= 20000 )   // 50us * 20000 = 1s
+	tim_1s_cnt += ticks;
+	if( tim_1s_cnt >= 20000 )   // 50us * 20000 = 1s
 	{
-		tim_1s_cnt = 0;
-		if(stim_a_control.period_time && stim_parameter.stimtime != 99) stim_a_control.period_time--;
-		if(stim_b_control.period_time && stim_parameter.stimtime != 99) stim_b_control.period_time--;
+		tim_1s_cnt -= 20000;
+		for(ch = 0; ch < CH_NUM; ch++)
+		{
+			if(stim_control[ch].period_time && stim_parameter.stimtime != 99) stim_control[ch].period_time--;
+		}
 	}
 	
 	if(single_pulse_control()) // 
 	{
-		if(!stim_a_control.stim_section && !stim_b_control.stim_section) 	// ̼
+		if(!stim_active_mask()) 	// ̼
 		{
 			tim_stop(HS_TIM0); 		
 		
 			gpio_write(BITMASK(PIN_OFF_EN_OR_RELEASE), GPIO_HIGH); // ŵ
+			app_event_set(APP_EVENT_STIM);
 
 			if(emg_wave.emg_wave_en) 
 			{
@@ -676,18 +731,23 @@ void stim_50us_server(void)
 		}
 	}
 	
-	if(++tim_50ms_cnt >= 975)  // 50ms   1000 -> 975
+	tim_50ms_cnt += ticks;
+	if(tim_50ms_cnt >= 1000)  // 50ms  Ѱʧж 975
 	{
-		tim_50ms_cnt = 0;
+		tim_50ms_cnt -= 1000;
 		
-		stim_intensity_output_control( &stim_parameter, &stim_a_control );
-		stim_intensity_output_control( &stim_parameter, &stim_b_control );
+		for(ch = 0; ch < CH_NUM; ch++)
+			stim_intensity_output_control( &stim_parameter, &stim_control[ch] );
+		
+		stim_loop_tick_50ms();
+		app_event_set(APP_EVENT_STIM);  // ̼ʱ䡢½׶ѭи
 	}
 	
-	if(++tim_500us_cnt >= 10)
+	tim_500us_cnt += ticks;
+	if(tim_500us_cnt >= 10)
 	{
-		tim_500us_cnt = 0;
-		if(emg_wave.emg_wave_en) 
+		tim_500us_cnt %= 10;
+		if(emg_wave.emg_wave_en && !stim_loop_active())  // ̼ʱEMGճɼ
 		{
 			QUEUE_WRITE(emg_a_raw_fifo, 0);	
 			QUEUE_WRITE(emg_b_raw_fifo, 0);	
@@ -695,6 +755,42 @@ void stim_50us_server(void)
 	}
 }
 
+/**************************************************************
+	@Function 		: start_stim_channels
+	@Parameter		: ch_mask , ͨ룬bit n Ӧͨ n
+	@Description	: ʼָͨĴ̼
+	@Return				: None
+	@Remark				: ̼ǿΪ0ͨ
+*/
+void start_stim_channels(uint8_t ch_mask)
+{
+	Stim_control_Typedef *pc;
+	uint8_t ch;
+	
+	stim_monitor_init();
+	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		if(!(ch_mask & (1 << ch))) continue;
+		
+		pc = &stim_control[ch];
+		pc->probe_status &= ~COMPLIANCE_OFF;  // ¿ʼ迹ж
+		
+		if(pc->intensity)
+		{
+			if(pc->stim_section != STIMTIME) 
+				pc->stim_section = RASETIME; 
+			pc->period_time = stim_parameter.stimtime + stim_parameter.rasetime/10;   // reset stim period time
+		}
+	}
+	
+	gpio_write(BITMASK(PIN_OFF_EN_OR_RELEASE), GPIO_LOW);
+	gpio_write(BITMASK(PIN_EMG_OR_STIM_SW), GPIO_LOW); // лStim
+//	emg_wave.emg_wave_en = 0; // ֹͣEMGĻ
+	if(!stim_loop_active()) tim_stop(HS_TIM1);  // ̼ҪEMGɼ
+	tim_start(HS_TIM0);
+}
+
 /**************************************************************
 	@Function 		: start_stim
 	@Parameter		: mode , 0: stop 1:start  pause: 2
@@ -704,34 +800,17 @@ void stim_50us_server(void)
 */
 void start_stim(uint8_t mode)
 {
+	uint8_t ch;
+	
 	switch(mode)
 	{
 		case 0x01: //START_OUTPUT:  
-			if(stim_a_control.intensity)
-			{
-				if(stim_a_control.stim_section != STIMTIME) 
-					stim_a_control.stim_section = RASETIME; 
-				stim_a_control.period_time = stim_parameter.stimtime + stim_parameter.rasetime/10;   // reset stim period time
-			}
-
-/* ʱBͨ			
-			if(stim_b_control.intensity)
-			{
-				if(stim_b_control.stim_section != STIMTIME) 
-					stim_b_control.stim_section = RASETIME; 
-				stim_b_control.period_time = stim_parameter.stimtime + stim_parameter.rasetime/10;   // reset stim period time
-			}
-*/		
-			gpio_write(BITMASK(PIN_OFF_EN_OR_RELEASE), GPIO_LOW);
-			gpio_write(BITMASK(PIN_EMG_OR_STIM_SW), GPIO_LOW); // лStim
-//			emg_wave.emg_wave_en = 0; // ֹͣEMGĻ
-			tim_stop(HS_TIM1);
-			tim_start(HS_TIM0);
+			start_stim_channels(STIM_CH_ALL);
 		break;
 		
 		case 0x00://STOP_OUTPUT:
-				stim_a_control.period_time = 0; // stim_A_control.stim_status = FALLTIME;
-				stim_b_control.period_time = 0; // stim_B_control.stim_status = FALLTIME;
+				for(ch = 0; ch < CH_NUM; ch++)
+					stim_control[ch].period_time = 0; // stim_status = FALLTIME;
 		break;
 	}
 }
@@ -46,38 +46,45 @@
 #define INTENSITY_MAX			90
 	
 #define LEAD_OFF				0x01
+#define COMPLIANCE_OFF	0x02		// 迹⣺˳ӵѹ޵ͨ·
 //#define B_LEAD_OFF				0x02
 //#define AB_LEAD_OFF				0x03
 
+// DACд(ģI2Cж)ռõ50usʱΪ1
+#ifndef STIM_DAC_WR_CNT
+#define STIM_DAC_WR_CNT		9
+#endif
+
+// ̼ͨ4ͨӲ汾ڹж STIM_CH_NUM=4 bsp_gpio.h жC/Dͨ
+#ifndef STIM_CH_NUM
+#define STIM_CH_NUM		2
+#endif
+
+// ͨ룬bit n Ӧͨ n
 #define STIM_CH_A		0x01
 #define STIM_CH_B		0x02
 #define STIM_CH_AB	0x03
+#define STIM_CH_ALL	((1 << CH_NUM) - 1)
 
 typedef enum {
 	CH_A = 0,
 	CH_B,
-	CH_NUM,
+	CH_C,
+	CH_D,
 }STIM_CH;
 
+#define CH_NUM			STIM_CH_NUM
+
 typedef enum {
-	step_a_prepare = 0,
-	step_a_up,
-	step_a_delay,
-	step_b_prepare,
-	step_b_up,
-	step_b_delay,
-	step_over
+	step_prepare = 0,		// ǰ׼DACд룩
+	step_up,						// ʱ
+	step_delay,					// ͵ƽʱ
 }pulse_step;
 
-typedef enum {
-	step_prepare_a = 0,
-	step_up_a,
-	step_delay_a,
-	step_prepare_b,
-	step_up_b,
-	step_delay_b,
-	step_stop
-}double_pulse_step;
+typedef struct{
+	uint32_t out_pin_mask;			// ʹܹ
+	uint32_t dac_route_mask;		// DACлͨѡţ0:һ·DACл
+}Stim_channel_Typedef;
 
 typedef struct{
 	
@@ -109,6 +116,10 @@ typedef struct{
 	
 	uint8_t probe_status;			// 0x00:  0x01:
 	
+	uint8_t closed_loop;			// ̼ǿEMG½ʱ
+	
+	uint32_t pulse_cnt;				// ֻ壨Ƽ¼ȡֵ
+	
 }Stim_control_Typedef;
 
 
@@ -124,8 +135,7 @@ typedef struct{
 
 //extern Stim_status_Typedef stim_status;
 
-extern Stim_control_Typedef stim_a_control;
-extern Stim_control_Typedef stim_b_control;
+extern Stim_control_Typedef stim_control[CH_NUM];
 
 extern Stim_parameter_Typedef stim_parameter;
 
@@ -136,6 +146,8 @@ uint8_t startup_stim_operation(Stim_control_Typedef *pc);
 
 void intensity_up_or_down(uint8_t channel, uint8_t operation);
 
+uint8_t stim_active_mask(void);
+
 void stim_control_handler(void);
 
 void stim_init(void);
@@ -143,4 +155,5 @@ void stim_init(void);
 void stim_50us_server(void);
 
 void start_stim(uint8_t mode);
+void start_stim_channels(uint8_t ch_mask);
 #endif
@@ -0,0 +1,269 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: stim_loop.c
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20210623
+		1. 20210623		First editon
+		2.
+*/
+#include <string.h>
+#include "stim_loop.h"
+#include "stim_monitor.h"
+#include "emg_wave.h"
+#include "handler.h"
+
+Stim_loop_Typedef stim_loop[CH_NUM];
+
+static volatile uint8_t tick_50ms = 0;					// 50usʱжۼ
+static uint8_t tick_50ms_done = 0;							// ѭѴļ
+static volatile uint16_t blank_cnt = 0;					// EMGλ50us
+
+/************************************************
+	@Function			: stim_loop_init
+	@Description	:	̼ʼ
+	@parameter		: None
+	@Return				: None
+	@Remark				: None
+*/
+void stim_loop_init(void)
+{
+	memset(stim_loop, 0, sizeof(stim_loop));
+	tick_50ms_done = tick_50ms;
+	blank_cnt = 0;
+}
+
+/************************************************
+	@Function			: stim_loop_step
+	@Description	:	 slew ưͨǿĿֵһ
+	@parameter		: channel , ̼ͨ
+									target , Ŀǿȣλ0.01mA
+	@Return				: None
+	@Remark				: intensity_dac һ׼׶дDAC
+*/
+static void stim_loop_step(uint8_t channel, uint16_t target)
+{
+	Stim_control_Typedef *pc = &stim_control[channel];
+	Stim_loop_Typedef *pl = &stim_loop[channel];
+	uint16_t cur = pc->intensity_temp_dac;
+	
+	if(pc->stim_section == STIMOVER)  // 迹ֹͣͨ
+	{
+		pc->closed_loop = FALSE;
+		return;
+	}
+	
+	if(pc->stim_section == FALLTIME) target = 0;
+	
+	if(target > cur) cur = ((target - cur) > pl->slew) ? (cur + pl->slew) : target;
+	else cur = ((cur - target) > pl->slew) ? (cur - pl->slew) : target;
+	
+	pc->intensity_temp_dac = cur;
+	pc->intensity_dac = cur / 100;
+	
+	if((pc->stim_section == FALLTIME) && !cur)  // ֹͣʱ slew  0 
+	{
+		pc->stim_section = STIMOVER;
+		pc->closed_loop = FALSE;
+	}
+}
+
+/************************************************
+	@Function			: stim_loop_start
+	@Description	:	ʼ̼
+	@parameter		: ch_mask , ̼ͨ
+									emg_channel , ԴEMGͨ
+									gain , 棬λmA/256 ÿ絥λ
+									deadband , 
+									slew , ÿθ仯λ0.01mA
+									ceiling , ǿޣλmA
+	@Return				: 0x00 , ʼ
+									ERROR_ACK , 缫
+	@Remark				: ջͨ/½ʱ䣬ǿȫEMG
+*/
+uint8_t stim_loop_start(uint8_t ch_mask, uint8_t emg_channel, uint16_t gain, uint16_t deadband, uint16_t slew, uint8_t ceiling)
+{
+	Stim_control_Typedef *pc;
+	uint8_t ch;
+	
+	ch_mask &= STIM_CH_ALL;
+	if(!ch_mask || (emg_channel >= EMG_CH_NUM) || !gain || !slew || !ceiling) return ERROR_ACK;
+	if(ceiling > STIM_LOOP_CEILING_MAX) ceiling = STIM_LOOP_CEILING_MAX;
+	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		if(!(ch_mask & (1 << ch))) continue;
+		if(stim_control[ch].probe_status & LEAD_OFF) return ERROR_ACK;  // 缫
+	}
+	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		if(!(ch_mask & (1 << ch))) continue;
+		
+		stim_loop[ch].emg_channel = emg_channel;
+		stim_loop[ch].gain = gain;
+		stim_loop[ch].deadband = deadband;
+		stim_loop[ch].slew = slew;
+		stim_loop[ch].ceiling = ceiling;
+		stim_loop[ch].age_50ms = 0;
+		
+		pc = &stim_control[ch];
+		pc->closed_loop = TRUE;
+		pc->intensity = ceiling;
+		pc->intensity_dac = 0;
+		pc->intensity_temp_dac = 0;
+		pc->intensity_changed_flag = FALSE;
+		pc->stim_section = STIMTIME;  // ʱ䣬 0 ʼ
+	}
+	
+	tick_50ms_done = tick_50ms;
+	start_stim_channels(ch_mask);
+	
+	return 0;
+}
+
+/************************************************
+	@Function			: stim_loop_stop
+	@Description	:	ֹ̼ͣ
+	@parameter		: None
+	@Return				: None
+	@Remark				: ½׶Σ slew  0 
+*/
+void stim_loop_stop(void)
+{
+	uint8_t ch;
+	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		if(stim_control[ch].closed_loop) stim_control[ch].period_time = 0;
+	}
+}
+
+/************************************************
+	@Function			: stim_loop_active
+	@Description	:	ȡջ̼еͨ
+	@parameter		: None
+	@Return				: ͨ룬0:ޱջͨ
+	@Remark				: None
+*/
+uint8_t stim_loop_active(void)
+{
+	uint8_t ch, mask = 0;
+	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		if(stim_control[ch].closed_loop) mask |= 1 << ch;
+	}
+	
+	return mask;
+}
+
+/************************************************
+	@Function			: stim_loop_envelope_update
+	@Description	:	EMG£ջͨǿ
+	@parameter		: emg_channel , EMGͨ
+									envelope , EMGֵ
+	@Return				: None
+	@Remark				: ÿִֵһΣѭ
+*/
+void stim_loop_envelope_update(uint8_t emg_channel, uint16_t envelope)
+{
+	Stim_loop_Typedef *pl;
+	uint32_t target;
+	uint8_t ch, ceiling;
+	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		pl = &stim_loop[ch];
+		if(!stim_control[ch].closed_loop || (pl->emg_channel != emg_channel)) continue;
+		
+		pl->age_50ms = 0;
+		
+		//  + λ㵽 0.01mA
+		target = (envelope > pl->deadband) ? ((uint32_t)(envelope - pl->deadband) * pl->gain * 100 >> 8) : 0;
+		
+		ceiling = stim_monitor_max_intensity(ch);  // ˳ӵѹ
+		if(ceiling > pl->ceiling) ceiling = pl->ceiling;
+		if(target > ceiling * 100) target = ceiling * 100;
+		
+		stim_loop_step(ch, target);
+	}
+}
+
+/************************************************
+	@Function			: stim_loop_handler
+	@Description	:	ջ̼ʱֹͣ
+	@parameter		: None
+	@Return				: None
+	@Remark				: ѭÿ50msһ
+									糬ʱEMGɼжϣֹͣʱ slew  0
+*/
+void stim_loop_handler(void)
+{
+	Stim_control_Typedef *pc;
+	uint8_t ch;
+	
+	if(tick_50ms_done == tick_50ms) return;
+	tick_50ms_done++;
+	
+	for(ch = 0; ch < CH_NUM; ch++)
+	{
+		pc = &stim_control[ch];
+		if(!pc->closed_loop) continue;
+		
+		if(stim_loop[ch].age_50ms < STIM_LOOP_TIMEOUT_50MS) stim_loop[ch].age_50ms++;
+		
+		if((pc->stim_section != STIMTIME) || (stim_loop[ch].age_50ms >= STIM_LOOP_TIMEOUT_50MS))
+			stim_loop_step(ch, 0);
+	}
+}
+
+/************************************************
+	@Function			: stim_loop_tick_50ms
+	@Description	:	ջ̼ʱ
+	@parameter		: None
+	@Return				: None
+	@Remark				: 50usʱжÿ50ms
+*/
+void stim_loop_tick_50ms(void)
+{
+	tick_50ms++;
+}
+
+/************************************************
+	@Function			: stim_loop_blank_start
+	@Description	:	ʼEMG
+	@parameter		: cnt , ʱ䣬λ50us
+	@Return				: None
+	@Remark				: ̼׼׶εã弰α
+*/
+void stim_loop_blank_start(uint16_t cnt)
+{
+	blank_cnt = cnt;
+}
+
+/************************************************
+	@Function			: stim_loop_blank_tick
+	@Description	:	EMGʱ
+	@parameter		: ticks , 50us
+	@Return				: None
+	@Remark				: 50usʱже
+*/
+void stim_loop_blank_tick(uint16_t ticks)
+{
+	blank_cnt = (blank_cnt > ticks) ? (blank_cnt - ticks) : 0;
+}
+
+/************************************************
+	@Function			: stim_loop_blanking
+	@Description	:	EMGǷʱ
+	@parameter		: None
+	@Return				: TRUE , УEMGһֵ
+	@Remark				: None
+*/
+uint8_t stim_loop_blanking(void)
+{
+	return blank_cnt ? TRUE : FALSE;
+}
@@ -0,0 +1,52 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: stim_loop.h
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20210623
+		1. 20210623		First editon
+		2.
+*/
+
+#ifndef __STIM_LOOP_H__
+#define __STIM_LOOP_H__
+
+#include <stdint.h>
+#include "stim_control.h"
+
+/*
+	̼ջ:
+	EMG env ÿһμһĿǿ
+		target = (env - deadband) * gain / 256 env <= deadband ʱΪ 0
+		target  ceiling 迹ǿ
+	ǿÿ仯 slewֱд intensity_dacһЧ
+*/
+#define STIM_LOOP_CEILING_MAX		(INTENSITY_MAX - 10)	// ջģʽȫޣλmA
+#define STIM_LOOP_TIMEOUT_50MS	4						// EMG糬 200ms δ£ slew  0
+#define STIM_LOOP_BLANK_CNT			10					// EMGʱ䣬λ50us
+
+typedef struct{
+	uint8_t emg_channel;		// ԴEMGͨ
+	uint16_t gain;					// 棬λmA/256 ÿ絥λ
+	uint16_t deadband;			// ڴֵ
+	uint16_t slew;					// ÿθ仯λ0.01mA
+	uint8_t ceiling;				// ǿޣλmA
+	uint8_t age_50ms;				// ϴΰµʱ䣬λ50ms
+}Stim_loop_Typedef;
+
+extern Stim_loop_Typedef stim_loop[CH_NUM];
+
+void stim_loop_init(void);
+uint8_t stim_loop_start(uint8_t ch_mask, uint8_t emg_channel, uint16_t gain, uint16_t deadband, uint16_t slew, uint8_t ceiling);
+void stim_loop_stop(void);
+uint8_t stim_loop_active(void);
+void stim_loop_envelope_update(uint8_t emg_channel, uint16_t envelope);
+void stim_loop_handler(void);
+void stim_loop_tick_50ms(void);
+void stim_loop_blank_start(uint16_t cnt);
+void stim_loop_blank_tick(uint16_t ticks);
+uint8_t stim_loop_blanking(void);
+
+#endif
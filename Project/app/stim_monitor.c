@@ -0,0 +1,241 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: stim_monitor.c
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20210621
+		1. 20210621		First editon
+		2.
+*/
+#include <string.h>
+#include "adc_ex.h"
+#include "bsp_adc.h"
+#include "stim_monitor.h"
+
+#define STIM_MON_ADC_CH		ADC_CHANNEL_EXTERN_CH4		// PIN_CURRENT_ACQ (pin10)
+#define STIM_MON_VOFF_MV	500												// ѹڴֵΪ޵ͨ·缫䣩
+
+Stim_monitor_Typedef stim_monitor[CH_NUM];
+Stim_monitor_cal_Typedef stim_monitor_cal = {STIM_MON_VH_MV, STIM_MON_VSAT_MV, STIM_MON_DIV};	// stim_monitor_init ָ
+
+static uint8_t sample_point = STIM_MON_SAMPLE_POINT;		// İٷֱ
+static Stim_control_Typedef *pending_pc = NULL;					// תͨNULL:
+static uint8_t pending_channel = CH_A;
+static uint16_t pending_ma = 0;													// ʱ趨λmA
+
+/************************************************
+	@Function			: stim_monitor_init
+	@Description	:	̼迹ʼ
+	@parameter		: None
+	@Return				: None
+	@Remark				: None
+*/
+void stim_monitor_init(void)
+{
+	memset(stim_monitor, 0, sizeof(stim_monitor));
+	pending_pc = NULL;
+}
+
+/************************************************
+	@Function			: stim_monitor_set_sample_point
+	@Description	:	ڵADC
+	@parameter		: percent , İٷֱ 0~100
+	@Return				: None
+	@Remark				: None
+*/
+void stim_monitor_set_sample_point(uint8_t percent)
+{
+	if(percent > 100) percent = 100;
+	sample_point = percent;
+}
+
+/************************************************
+	@Function			: stim_monitor_sample_cnt
+	@Description	:	ڴADC50us
+	@parameter		: pw_50us_cnt , λ50us
+	@Return				: ڼ50usADC
+	@Remark				: ֤
+*/
+uint8_t stim_monitor_sample_cnt(uint16_t pw_50us_cnt)
+{
+	uint16_t cnt = pw_50us_cnt * sample_point / 100;
+	
+	if(cnt >= pw_50us_cnt) cnt = pw_50us_cnt ? (pw_50us_cnt - 1) : 0;
+	
+	return (uint8_t)cnt;
+}
+
+/************************************************
+	@Function			: stim_monitor_update
+	@Description	:	迹/˳㼰ֹͣ/ж
+	@parameter		: channel , ͨ
+									pc , ƽṹָ
+									vnode_mv , ѹλmV
+									ma , 趨λmA
+	@Return				: None
+	@Remark				: ADCжִУǰж
+*/
+static void stim_monitor_update(uint8_t channel, Stim_control_Typedef *pc, uint32_t vnode_mv, uint16_t ma)
+{
+	Stim_monitor_Typedef *pm = &stim_monitor[channel];
+	uint32_t z;
+	int32_t margin;
+	
+	margin = (int32_t)vnode_mv - stim_monitor_cal.vsat_mv;
+	z = (vnode_mv < stim_monitor_cal.vh_mv) ? (stim_monitor_cal.vh_mv - vnode_mv) / ma : 0;  // mV / mA = 
+	if(z > 0xFFFF) z = 0xFFFF;
+	
+	pm->vnode_mv = (vnode_mv > 0xFFFF) ? 0xFFFF : vnode_mv;
+	pm->impedance = z;
+	pm->margin_mv = (margin < -32768) ? -32768 : ((margin > 32767) ? 32767 : margin);
+	
+	// һ˲
+	if(!pm->valid)
+	{
+		pm->impedance_filt = z << STIM_MON_FILTER_SHIFT;
+		pm->margin_filt = margin * (1 << STIM_MON_FILTER_SHIFT);
+		pm->valid = TRUE;
+	}
+	else
+	{
+		pm->impedance_filt = pm->impedance_filt + z - (pm->impedance_filt >> STIM_MON_FILTER_SHIFT);
+		pm->margin_filt = pm->margin_filt + margin - (pm->margin_filt >> STIM_MON_FILTER_SHIFT);
+	}
+	
+	if((vnode_mv < STIM_MON_VOFF_MV) || (z >= STIM_MON_Z_OFF))  // ޵ͨ·ֹͣͨ
+	{
+		pm->result = STIM_MON_STOP;
+		pc->probe_status |= COMPLIANCE_OFF;
+		pc->intensity_dac = 0;
+		pc->intensity_temp_dac = 0;
+		pc->intensity_changed_flag = FALSE;
+		pc->period_time = 0;
+		pc->stim_section = STIMOVER;
+	}
+	else if(margin < 0)  // ˳ӵѹ
+	{
+		pm->result = STIM_MON_ALARM;
+		pc->probe_status |= COMPLIANCE_OFF;
+	}
+	else
+	{
+		pm->result = STIM_MON_NORMAL;
+		pc->probe_status &= ~COMPLIANCE_OFF;
+	}
+}
+
+/************************************************
+	@Function			: stim_monitor_adc_handler
+	@Description	:	ADCɻص
+	@parameter		: ch , ADCͨ
+									adc_data , ADCֵ
+	@Return				: None
+	@Remark				: None
+*/
+static void stim_monitor_adc_handler(uint32_t ch, uint32_t adc_data)
+{
+	int32_t adc_mv;
+	
+	adc_del_channel(STIM_MON_ADC_CH);
+	
+	if(pending_pc == NULL) return;
+	
+	adc_mv = (int32_t)(int16_t)(adc_data & 0xFFFF) * 800 / 2048;  // ͬصѹ
+	if(adc_mv < 0) adc_mv = 0;
+	
+	stim_monitor_update(pending_channel, pending_pc, (uint32_t)adc_mv * stim_monitor_cal.div, pending_ma);
+	pending_pc = NULL;
+}
+
+/************************************************
+	@Function			: stim_monitor_trigger
+	@Description	:	һADCת
+	@parameter		: channel , ͨ
+									pc , ƽṹָ
+									ma , дDACĵǿȣλmA
+	@Return				: None
+	@Remark				: 50usʱжеãתɺADCжм
+									ѭ;޸intensity_dacDACʵֵ
+*/
+void stim_monitor_trigger(uint8_t channel, Stim_control_Typedef *pc, uint16_t ma)
+{
+	if(pending_pc != NULL) return;  // һתδ
+	if(!ma) return;
+	
+	pending_channel = channel;
+	pending_ma = ma;
+	pending_pc = pc;
+	
+	// GPADCڲɼصѹ岻
+	if(!adc_sample_one_channel_irq(STIM_MON_ADC_CH, (adc_callback_t)stim_monitor_adc_handler)) pending_pc = NULL;
+}
+
+/************************************************
+	@Function			: stim_monitor_impedance
+	@Description	:	ȡͨ˲ĸ迹
+	@parameter		: channel , ͨ
+	@Return				: 迹λ0ʾ
+	@Remark				: None
+*/
+uint16_t stim_monitor_impedance(uint8_t channel)
+{
+	uint32_t z = stim_monitor[channel].impedance_filt >> STIM_MON_FILTER_SHIFT;
+	
+	return (z > 0xFFFF) ? 0xFFFF : z;
+}
+
+/************************************************
+	@Function			: stim_monitor_margin
+	@Description	:	ȡͨ˲˳
+	@parameter		: channel , ͨ
+	@Return				: λmV
+	@Remark				: None
+*/
+int16_t stim_monitor_margin(uint8_t channel)
+{
+	return (int16_t)(stim_monitor[channel].margin_filt / (1 << STIM_MON_FILTER_SHIFT));
+}
+
+/************************************************
+	@Function			: stim_monitor_max_intensity
+	@Description	:	ǰ迹㲻˳ӵѹ̼ǿ
+	@parameter		: channel , ͨ
+	@Return				: ̼ǿȣλmA
+	@Remark				: Ӧʹ
+*/
+uint8_t stim_monitor_max_intensity(uint8_t channel)
+{
+	uint32_t z = stim_monitor_impedance(channel);
+	uint32_t ma;
+	
+	if(!stim_monitor[channel].valid || !z) return INTENSITY_MAX;
+	
+	ma = (stim_monitor_cal.vh_mv - stim_monitor_cal.vsat_mv) / z;
+	
+	return (ma > INTENSITY_MAX) ? INTENSITY_MAX : ma;
+}
+
+/************************************************
+	@Function			: stim_monitor_cal_set
+	@Description	:	迹У׼
+	@parameter		: buf , VH(4) VSAT(2) DIV(2)ֽǰ
+									len , ݳ
+	@Return				: 1 , ɹ; 0 , ȻֵΧԭУ׼
+	@Remark				: ̼вܵãжʹУ׼ݣ浽Flash
+*/
+uint8_t stim_monitor_cal_set(const uint8_t *buf, uint16_t len)
+{
+	Stim_monitor_cal_Typedef cal;
+	
+	if(len != STIM_MON_CAL_LEN) return 0;
+	
+	cal.vh_mv = (uint32_t)buf[0] << 24 | (uint32_t)buf[1] << 16 | (uint32_t)buf[2] << 8 | buf[3];
+	cal.vsat_mv = (uint16_t)buf[4] << 8 | buf[5];
+	cal.div = (uint16_t)buf[6] << 8 | buf[7];
+	if((cal.vh_mv > STIM_MON_VH_MAX_MV) || (cal.vsat_mv >= cal.vh_mv) || !cal.div || (cal.div > STIM_MON_DIV_MAX)) return 0;
+	
+	stim_monitor_cal = cal;
+	return 1;
+}
@@ -0,0 +1,72 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: stim_monitor.h
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20210621
+		1. 20210621		First editon
+		2.
+*/
+
+#ifndef __STIM_MONITOR_H__
+#define __STIM_MONITOR_H__
+
+#include <stdint.h>
+#include "stim_control.h"
+
+/*
+	: VH --- (缫) --- (PIN_CURRENT_ACQ) ---  --- GND
+	ѹ Vnode = VH - I * Z Vnode ںܱѹʱﲻ趨ֵ˳ӵѹ
+	迹	Z = (VH - Vnode) / I
+	˳	margin = Vnode - VSAT
+*/
+#define STIM_MON_VH_MV					100000	// ̼ѹλmV   ݶ
+#define STIM_MON_VSAT_MV				2000		// СѹλmV   ݶ
+#define STIM_MON_DIV						100			// 㵽ADCķѹ   ݶ
+// ΪĬֵʵʹ stim_monitor_cal APPд BULK_ID_MON_CAL У׼棬ָĬϣ
+#define STIM_MON_CAL_LEN				8				// У׼ VH(4) VSAT(2) DIV(2)ֽǰ
+#define STIM_MON_VH_MAX_MV			200000	// У׼ݼ鷶Χ
+#define STIM_MON_DIV_MAX				1000
+
+#define STIM_MON_SAMPLE_POINT		50			// Ĭϲ㣬İٷֱ
+#define STIM_MON_Z_OFF					20000		// 迹ֵΪ缫䣬ֹͣͨλ
+#define STIM_MON_FILTER_SHIFT		3				// 迹/һ˲ϵ 1/8
+
+// жϽ
+#define STIM_MON_NORMAL					0x00
+#define STIM_MON_ALARM					0x01		// ˳ӵѹ
+#define STIM_MON_STOP						0x02		// 迹ֹͣͨ
+
+typedef struct{
+	uint16_t vnode_mv;				// ѹλmV
+	uint16_t impedance;				// 帺迹λ
+	int16_t	margin_mv;				// ˳λmV
+	
+	uint32_t impedance_filt;	// 迹˲ֵx 2^STIM_MON_FILTER_SHIFT
+	int32_t margin_filt;			// ˲ֵx 2^STIM_MON_FILTER_SHIFT
+	
+	uint8_t result;						// жϽ
+	uint8_t valid;						// Ч
+}Stim_monitor_Typedef;
+
+typedef struct{
+	uint32_t vh_mv;						// ̼ѹλmV
+	uint16_t vsat_mv;					// СѹλmV
+	uint16_t div;							// 㵽ADCķѹ
+}Stim_monitor_cal_Typedef;
+
+extern Stim_monitor_Typedef stim_monitor[CH_NUM];
+extern Stim_monitor_cal_Typedef stim_monitor_cal;
+
+void stim_monitor_init(void);
+void stim_monitor_set_sample_point(uint8_t percent);
+uint8_t stim_monitor_sample_cnt(uint16_t pw_50us_cnt);
+void stim_monitor_trigger(uint8_t channel, Stim_control_Typedef *pc, uint16_t ma);
+uint16_t stim_monitor_impedance(uint8_t channel);
+int16_t stim_monitor_margin(uint8_t channel);
+uint8_t stim_monitor_max_intensity(uint8_t channel);
+uint8_t stim_monitor_cal_set(const uint8_t *buf, uint16_t len);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __ADC_EX_H__
+#define __ADC_EX_H__
+
+#include <stdint.h>
+
+// Channel ids used by the application (subset of device/adc_ex.h)
+typedef enum {
+    ADC_CHANNEL_CHIP_BATTERY = 8,
+    ADC_CHANNEL_EXTERN_CH4   = 4,
+    ADC_CHANNEL_EXTERN_CH5   = 5,
+} adc_channel_t;
+
+typedef void (*adc_callback_t)(uint32_t event, uint32_t adc_data);
+
+uint8_t adc_del_channel(adc_channel_t inp_gp);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef __BSP_ADC_H__
+#define __BSP_ADC_H__
+
+#include <stdint.h>
+#include "adc_ex.h"
+
+uint8_t adc_sample_one_channel_irq(adc_channel_t ch_p, adc_callback_t cb);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __BSP_FLASH_H__
+#define __BSP_FLASH_H__
+
+#include <stdint.h>
+
+#define FLASH_SECTOR_SIZE   4096
+#define FLASH_PAGE_SIZE     256
+
+// RAM backed flash, see session_log_test.c
+uint8_t flash_store_region(uint32_t *addr, uint32_t *len);
+void flash_read(uint32_t addr, void *buf, uint32_t len);
+void flash_write(uint32_t addr, const void *buf, uint32_t len);
+void flash_erase_sector(uint32_t addr);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __BSP_GPIO_H__
+#define __BSP_GPIO_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#define BITMASK(n)      (1u << (n))
+#define BIT_MASK(n)     (1u << (n))
+
+typedef enum {
+    GPIO_LOW  = 0,
+    GPIO_HIGH = 1,
+} gpio_level_t;
+
+// Same pin map as device/bsp_gpio.h (stim related pins only)
+#define PIN_STIM_OFF            9
+#define PIN_CURRENT_ACQ         10
+#define PIN_STIM_PWM_L          13
+#define PIN_STIM_PWM_H          14
+#define PIN_STIM_OUT_A          15
+#define PIN_STIM_OUT_B          17
+// 4 channel hardware variant (pins of the variant board)
+#define PIN_STIM_OUT_C          18
+#define PIN_STIM_OUT_D          19
+#define PIN_STIM_DAC_SEL_C      20
+#define PIN_STIM_DAC_SEL_D      21
+#define PIN_OFF_EN_OR_RELEASE   22
+#define PIN_EMG_OR_STIM_SW      30
+#define PIN_LED3                29
+#define PIN_LED2                28
+#define PIN_LED1                27
+#define PIN_LED0                7
+
+void gpio_write(uint32_t pin_mask, gpio_level_t level);
+uint32_t gpio_read(uint32_t pin_mask);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef __BSP_IIC_H__
+#define __BSP_IIC_H__
+
+#include <stdint.h>
+#include "bsp_gpio.h"
+
+void dac_out_value_set(uint16_t value);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __BSP_SYSTICK_H__
+#define __BSP_SYSTICK_H__
+
+#include <stdint.h>
+
+// Same tick macros as device/bsp_systick.h, systick_cnt is advanced by the tests
+extern volatile uint32_t systick_cnt;
+#define TICK_OUT            (1000* 60 * 30)
+#define TICK_NOW            (systick_cnt)
+#define TICK_X10MS(_x10ms)  (((uint32_t)_x10ms) * 100)
+#define TICK_PASSED(_now, _old)     ((((uint32_t)_now + TICK_OUT) - (uint32_t)_old)%TICK_OUT)
+
+#endif
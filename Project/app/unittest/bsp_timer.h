@@ -0,0 +1,19 @@
+#ifndef __BSP_TIMER_H__
+#define __BSP_TIMER_H__
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t ARR;
+    uint32_t running;
+} HS_TIM_Type;
+
+extern HS_TIM_Type sim_tim0, sim_tim1;
+#define HS_TIM0     (&sim_tim0)
+#define HS_TIM1     (&sim_tim1)
+
+void tim_start(HS_TIM_Type *TIMx);
+void tim_stop(HS_TIM_Type *TIMx);
+void tim_arr_set(HS_TIM_Type *TIMx, uint16_t value);
+
+#endif
@@ -0,0 +1,7 @@
+rm -rf a.out a.exe a_ideal.out a_4ch.out
+# DAC write blocks the 50us timer for STIM_DAC_WR_CNT ticks (bit-banged I2C)
+gcc *.c ../stim_control.c ../stim_monitor.c ../stim_loop.c ../protocol.c ../bulk.c ../session_log.c ../crc8.c ../../coroutine/co_crc.c -I. -I.. -I../../coroutine -DCO_CRC_ALL_IMPL=1 -Wall -O2 --std=gnu99 && ./a.out || exit 1
+# Ideal timer, ISR never overruns
+gcc *.c ../stim_control.c ../stim_monitor.c ../stim_loop.c ../protocol.c ../bulk.c ../session_log.c ../crc8.c ../../coroutine/co_crc.c -I. -I.. -I../../coroutine -DCO_CRC_ALL_IMPL=1 -Wall -O2 --std=gnu99 -DSTIM_DAC_WR_CNT=1 -o a_ideal.out && ./a_ideal.out || exit 1
+# 4 channel hardware variant
+gcc *.c ../stim_control.c ../stim_monitor.c ../stim_loop.c ../protocol.c ../bulk.c ../session_log.c ../crc8.c ../../coroutine/co_crc.c -I. -I.. -I../../coroutine -DCO_CRC_ALL_IMPL=1 -Wall -O2 --std=gnu99 -DSTIM_CH_NUM=4 -o a_4ch.out && ./a_4ch.out
@@ -0,0 +1,347 @@
+/*
+ * Segmented bulk transfer (app/bulk.c) fed through the frame parser with
+ * extended frames, the way a phone streams a table with Write Without Response,
+ * and the read direction paced by the room left in each link's control queue.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "protocol.h"
+#include "bsp_systick.h"
+#include "bulk.h"
+#include "unittest.h"
+
+#define MAX_ACKS    16
+#define MAX_SEGS    64
+
+struct bulk_ack {
+    uint8_t link;
+    uint8_t id;
+    uint8_t status;
+    uint16_t offset;
+    int16_t seq;        // protocol_seq() while sending, handler.c appends it to the ACK
+};
+
+struct bulk_seg {
+    uint8_t link;
+    uint16_t total;
+    uint16_t offset;
+    uint16_t len;
+};
+
+static struct bulk_ack ack[MAX_ACKS];
+static uint32_t ack_num;
+static uint8_t done_id;
+static uint16_t done_len;
+static uint32_t done_num;
+static uint8_t done_status;
+
+// read direction: frames the control queue of each link still takes, and what was sent
+static uint32_t tx_room[PROTOCOL_LINK_MAX];
+static struct bulk_seg seg[MAX_SEGS];
+static uint32_t seg_num;
+static uint8_t tx_buf[PROTOCOL_LINK_MAX][2048];
+
+uint16_t ext_frame_build(uint8_t *p, uint8_t token, uint8_t type, const uint8_t *data, uint16_t data_len);
+
+void bulk_ack_packet_send(uint8_t link, uint8_t id, uint8_t status, uint16_t offset)
+{
+    if (ack_num < MAX_ACKS) {
+        ack[ack_num].link = link;
+        ack[ack_num].id = id;
+        ack[ack_num].status = status;
+        ack[ack_num].offset = offset;
+        ack[ack_num].seq = protocol_seq();
+    }
+    ack_num++;
+}
+
+uint8_t bulk_data_ready(uint8_t link, uint16_t len)
+{
+    return tx_room[link] != 0;
+}
+
+void bulk_data_packet_send(uint8_t link, uint8_t id, uint16_t total, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+    tx_room[link]--;
+    if (seg_num < MAX_SEGS) {
+        seg[seg_num].link = link;
+        seg[seg_num].total = total;
+        seg[seg_num].offset = offset;
+        seg[seg_num].len = len;
+    }
+    seg_num++;
+    if (offset + len <= sizeof(tx_buf[0]))
+        memcpy(tx_buf[link] + offset, data, len);
+}
+
+static uint8_t bulk_done(uint8_t id, uint8_t *buf, uint16_t len)
+{
+    done_id = id;
+    done_len = len;
+    done_num++;
+    return done_status;
+}
+
+// one CMD_BULK_DATA extended frame: id total offset data
+static uint16_t segment_build(uint8_t *p, uint8_t id, uint16_t total, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+    uint8_t seg[PROTOCOL_EXT_FRAME_MAX];
+
+    seg[0] = id;
+    seg[1] = total >> 8;
+    seg[2] = total & 0xFF;
+    seg[3] = offset >> 8;
+    seg[4] = offset & 0xFF;
+    memcpy(seg + BULK_SEG_HEAD_LEN, data, len);
+    return ext_frame_build(p, AM300_TOKEN, CMD_BULK_DATA, seg, BULK_SEG_HEAD_LEN + len);
+}
+
+static void reset(void)
+{
+    ack_num = done_num = done_len = done_id = done_status = 0;
+    seg_num = 0;
+    memset(tx_room, 0, sizeof(tx_room));
+}
+
+static void src_fill(uint8_t *p, uint16_t len)
+{
+    uint16_t i;
+
+    for (i = 0; i < len; i++)
+        p[i] = i * 13 + (i >> 8);
+}
+
+// 2000 bytes in 200-byte segments, several segments per write, one ACK
+static void test_stream(void)
+{
+    static uint8_t src[2000], sink[2048], buf[1024];
+    uint16_t off, len, seg;
+
+    bulk_init();
+    src_fill(src, sizeof(src));
+    CHECK(bulk_sink_register(3, sink, sizeof(sink), bulk_done), "register");
+    reset();
+
+    for (off = 0; off < sizeof(src);) {
+        len = 0;
+        for (seg = 0; seg < 3 && off < sizeof(src); seg++) {
+            uint16_t n = sizeof(src) - off < 200 ? sizeof(src) - off : 200;
+            len += segment_build(buf + len, 3, sizeof(src), off, src + off, n);
+            off += n;
+        }
+        protocol_rx_write(0, buf, len);
+    }
+    CHECK(done_num == 1 && done_id == 3 && done_len == sizeof(src), "done %u id %u len %u", done_num, done_id, done_len);
+    CHECK(memcmp(sink, src, sizeof(src)) == 0, "content");
+    CHECK(ack_num == 1 && ack[0].status == BULK_OK && ack[0].offset == sizeof(src), "%u acks", ack_num);
+}
+
+// a lost segment is NAKed once with the offset to resend from
+static void test_lost_segment(void)
+{
+    static uint8_t src[1000], sink[1000], buf[PROTOCOL_EXT_FRAME_MAX];
+    uint16_t off;
+
+    bulk_init();
+    src_fill(src, sizeof(src));
+    bulk_sink_register(7, sink, sizeof(sink), bulk_done);
+    reset();
+
+    for (off = 0; off < sizeof(src); off += 200) {
+        if (off == 400)
+            continue;
+        protocol_rx_write(0, buf, segment_build(buf, 7, sizeof(src), off, src + off, 200));
+    }
+    CHECK(done_num == 0, "completed with a hole");
+    CHECK(ack_num == 1 && ack[0].status == BULK_ERR_OFFSET && ack[0].offset == 400, "%u acks, offset %u", ack_num, ack[0].offset);
+
+    for (off = 400; off < sizeof(src); off += 200)
+        protocol_rx_write(0, buf, segment_build(buf, 7, sizeof(src), off, src + off, 200));
+    CHECK(done_num == 1 && memcmp(sink, src, sizeof(src)) == 0, "resend");
+    CHECK(ack_num == 2 && ack[1].status == BULK_OK, "%u acks", ack_num);
+}
+
+// Write Without Response: the ACK of the completing or failing write carries its sequence number
+static void test_seq(void)
+{
+    static uint8_t src[400], sink[400], buf[PROTOCOL_EXT_FRAME_MAX];
+    uint16_t len;
+
+    bulk_init();
+    src_fill(src, sizeof(src));
+    bulk_sink_register(5, sink, sizeof(sink), bulk_done);
+    reset();
+
+    buf[0] = 0x21;
+    len = 1 + segment_build(buf + 1, 5, sizeof(src), 0, src, 200);
+    protocol_rx_write_seq(0, buf, len);
+    CHECK(ack_num == 0, "ack before the last segment");
+    buf[0] = 0x22;
+    len = 1 + segment_build(buf + 1, 5, sizeof(src), 200, src + 200, 200);
+    protocol_rx_write_seq(0, buf, len);
+    CHECK(ack_num == 1 && ack[0].status == BULK_OK && ack[0].seq == 0x22, "done ack seq %d", ack[0].seq);
+
+    buf[0] = 0x23;
+    len = 1 + segment_build(buf + 1, 5, sizeof(src), 200, src, 200);
+    protocol_rx_write_seq(0, buf, len);
+    CHECK(ack_num == 2 && ack[1].status == BULK_ERR_OFFSET && ack[1].seq == 0x23, "error ack seq %d", ack[1].seq);
+
+    protocol_rx_write(0, buf, segment_build(buf, 6, 10, 0, src, 10));
+    CHECK(ack_num == 3 && ack[2].status == BULK_ERR_ID && ack[2].seq == -1, "plain write ack seq %d", ack[2].seq);
+}
+
+static void test_errors(void)
+{
+    static uint8_t sink[100], data[120], buf[PROTOCOL_EXT_FRAME_MAX];
+
+    bulk_init();
+    bulk_sink_register(1, sink, sizeof(sink), bulk_done);
+    reset();
+
+    protocol_rx_write(0, buf, segment_build(buf, 2, 10, 0, data, 10));
+    CHECK(ack_num == 1 && ack[0].id == 2 && ack[0].status == BULK_ERR_ID, "unknown id");
+
+    protocol_rx_write(0, buf, segment_build(buf, 1, 120, 0, data, 100));
+    CHECK(ack_num == 2 && ack[1].status == BULK_ERR_SIZE && done_num == 0, "total over sink size");
+
+    protocol_rx_write(0, buf, segment_build(buf, 1, 50, 0, data, 60));
+    CHECK(ack_num == 3 && ack[2].status == BULK_ERR_SIZE && done_num == 0, "segment past total");
+
+    protocol_rx_write(0, buf, ext_frame_build(buf, AM300_TOKEN, CMD_BULK_DATA, data, 3));
+    CHECK(ack_num == 4 && ack[3].status == BULK_ERR_FORMAT, "short segment");
+
+    // restart at offset 0 replaces a transfer in progress
+    protocol_rx_write(0, buf, segment_build(buf, 1, 100, 0, data, 40));
+    protocol_rx_write(0, buf, segment_build(buf, 1, 30, 0, data, 30));
+    CHECK(done_num == 1 && done_len == 30 && ack[ack_num - 1].status == BULK_OK, "restart");
+
+    CHECK(!bulk_sink_register(0, sink, 1, NULL) && !bulk_sink_register(9, NULL, 1, NULL), "bad register");
+    bulk_sink_register(2, sink, 1, NULL);
+    bulk_sink_register(3, sink, 1, NULL);
+    bulk_sink_register(4, sink, 1, NULL);
+    CHECK(!bulk_sink_register(5, sink, 1, NULL), "table full");
+    CHECK(bulk_sink_register(4, sink, 2, NULL), "re-register");
+}
+
+// a sink belongs to the link that started the transfer until it completes, times out or disconnects
+static void test_two_links(void)
+{
+    static uint8_t src[600], sink[600], buf[PROTOCOL_EXT_FRAME_MAX];
+
+    bulk_init();
+    src_fill(src, sizeof(src));
+    bulk_sink_register(5, sink, sizeof(sink), bulk_done);
+    reset();
+
+    protocol_rx_write(0, buf, segment_build(buf, 5, sizeof(src), 0, src, 200));
+    protocol_rx_write(1, buf, segment_build(buf, 5, sizeof(src), 0, src, 200));
+    CHECK(ack_num == 1 && ack[0].link == 1 && ack[0].status == BULK_ERR_BUSY, "second link not refused");
+
+    // a segment of link 1 must not land in link 0's transfer
+    protocol_rx_write(1, buf, segment_build(buf, 5, sizeof(src), 200, src + 200, 200));
+    CHECK(ack_num == 2 && ack[1].link == 1 && ack[1].status == BULK_ERR_OFFSET && ack[1].offset == 0, "foreign segment");
+    protocol_rx_write(0, buf, segment_build(buf, 5, sizeof(src), 200, src + 200, 200));
+    protocol_rx_write(0, buf, segment_build(buf, 5, sizeof(src), 400, src + 400, 200));
+    CHECK(done_num == 1 && ack_num == 3 && ack[2].link == 0 && ack[2].status == BULK_OK, "owner completes");
+    CHECK(memcmp(sink, src, sizeof(src)) == 0, "content");
+
+    // released on completion, on disconnect and after the timeout
+    protocol_rx_write(1, buf, segment_build(buf, 5, sizeof(src), 0, src, 200));
+    CHECK(ack_num == 3, "link 1 refused after completion");
+    protocol_rx_write(0, buf, segment_build(buf, 5, sizeof(src), 0, src, 200));
+    CHECK(ack_num == 4 && ack[3].status == BULK_ERR_BUSY, "link 0 not refused");
+    bulk_link_reset(1);
+    protocol_rx_write(0, buf, segment_build(buf, 5, sizeof(src), 0, src, 200));
+    CHECK(ack_num == 4, "link 0 refused after disconnect");
+    systick_cnt += BULK_RX_TIMEOUT;
+    protocol_rx_write(1, buf, segment_build(buf, 5, sizeof(src), 0, src, 200));
+    CHECK(ack_num == 4, "link 1 refused after timeout");
+
+    // the sink refuses the content: status in the ACK, resend from 0
+    done_status = BULK_ERR_BUSY;
+    protocol_rx_write(1, buf, segment_build(buf, 5, sizeof(src), 200, src + 200, 200));
+    protocol_rx_write(1, buf, segment_build(buf, 5, sizeof(src), 400, src + 400, 200));
+    CHECK(done_num == 2 && ack_num == 5 && ack[4].status == BULK_ERR_BUSY && ack[4].offset == 0, "done status");
+}
+
+static const uint8_t *src_data;
+
+static uint16_t src_size(uint8_t sel)
+{
+    return sel == 0 ? 1000 : 0;
+}
+
+static uint16_t src_read(uint8_t sel, uint16_t offset, uint8_t *buf, uint16_t len)
+{
+    if (src_data == NULL)
+        return 0;
+    memcpy(buf, src_data + offset, len);
+    return len;
+}
+
+static void read_request(uint8_t link, uint8_t id, uint8_t sel, uint16_t offset)
+{
+    uint8_t req[BULK_READ_LEN] = {id, sel, offset >> 8, offset & 0xFF};
+
+    bulk_read_handler(link, req, sizeof(req));
+}
+
+// read is paced by queue room, both links at once, resumable from any offset
+static void test_read(void)
+{
+    static uint8_t src[1000];
+    uint32_t i, calls;
+
+    bulk_init();
+    src_fill(src, sizeof(src));
+    src_data = src;
+    CHECK(bulk_source_register(0x10, src_size, src_read), "register source");
+    reset();
+    memset(tx_buf, 0, sizeof(tx_buf));
+
+    read_request(0, 0x10, 0, 0);
+    read_request(1, 0x10, 0, 500);
+    CHECK(ack_num == 0, "%u acks", ack_num);
+    bulk_handler();
+    CHECK(seg_num == 0, "sent without room");
+
+    for (calls = 0; calls < 20; calls++) {
+        tx_room[0] = tx_room[1] = 2;
+        bulk_handler();
+    }
+    CHECK(seg_num == (1000 + BULK_TX_SEG_MAX - 1) / BULK_TX_SEG_MAX + (500 + BULK_TX_SEG_MAX - 1) / BULK_TX_SEG_MAX,
+          "%u segments", seg_num);
+    for (i = 0; i < seg_num && i < MAX_SEGS; i++)
+        CHECK(seg[i].total == 1000 && seg[i].len <= BULK_TX_SEG_MAX, "segment %u", i);
+    CHECK(memcmp(tx_buf[0], src, 1000) == 0 && memcmp(tx_buf[1] + 500, src + 500, 500) == 0, "content");
+
+    read_request(0, 0x11, 0, 0);
+    read_request(0, 0x10, 1, 0);
+    read_request(0, 0x10, 0, 1000);
+    read_request(0, 0x10, 0, 0);
+    CHECK(ack_num == 3 && ack[0].status == BULK_ERR_ID && ack[1].status == BULK_ERR_ID
+          && ack[2].status == BULK_ERR_OFFSET, "request errors");
+
+    // the object vanished (record erased) mid-read
+    src_data = NULL;
+    tx_room[0] = 1;
+    bulk_handler();
+    CHECK(ack_num == 4 && ack[3].status == BULK_ERR_ID && ack[3].link == 0, "read failure");
+    tx_room[0] = 1;
+    seg_num = 0;
+    bulk_handler();
+    CHECK(seg_num == 0, "read continued after failure");
+}
+
+uint32_t test_bulk(uint32_t *case_num)
+{
+    fail_num = 0;
+    test_stream();
+    test_lost_segment();
+    test_errors();
+    test_seq();
+    test_two_links();
+    test_read();
+    *case_num += 6;
+    return fail_num;
+}
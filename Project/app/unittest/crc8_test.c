@@ -0,0 +1,111 @@
+/*
+ * CRC8 (app/crc8.c): CRC8_Update (CO_CRC8_IMPL) against the bytewise table,
+ * plus a throughput comparison on notification-sized buffers.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "crc8.h"
+#include "unittest.h"
+
+#define BUF_LEN     300
+#define BENCH_LEN   244     // SIMPLE_SERVER_MAX_CHAC_LEN
+#define BENCH_LOOPS 200000
+
+static uint8_t crc_bytewise(uint8_t crc, const uint8_t *p, uint32_t len)
+{
+    while (len--)
+        crc = CRC8(crc, *p++);
+    return crc;
+}
+
+static void buf_fill(uint8_t *p, uint32_t len, uint32_t seed)
+{
+    while (len--) {
+        seed = seed * 1103515245 + 12345;
+        *p++ = seed >> 16;
+    }
+}
+
+// every length at every alignment
+static void test_lengths(void)
+{
+    uint8_t buf[BUF_LEN + 4];
+    uint32_t off, len;
+
+    buf_fill(buf, sizeof(buf), 1);
+    for (off = 0; off < 4; off++) {
+        for (len = 0; len <= BUF_LEN; len++) {
+            uint8_t ref = crc_bytewise(0, buf + off, len);
+            CHECK(CRC8_Update(0, buf + off, len) == ref, "off %u len %u", off, len);
+            if (len < 256)  // CRC_8 takes a uint8_t length
+                CHECK(CRC_8(buf + off, len) == ref, "CRC_8 off %u len %u", off, len);
+        }
+    }
+}
+
+// CRC carried across chunks equals the CRC of the whole buffer
+static void test_chained(void)
+{
+    uint8_t buf[BUF_LEN];
+    uint32_t split, split2;
+    uint8_t ref, crc;
+
+    buf_fill(buf, sizeof(buf), 2);
+    ref = crc_bytewise(0, buf, 70);
+    for (split = 0; split <= 70; split++) {
+        for (split2 = split; split2 <= 70; split2++) {
+            crc = CRC8_Update(0, buf, split);
+            crc = CRC8_Update(crc, buf + split, split2 - split);
+            crc = CRC8_Update(crc, buf + split2, 70 - split2);
+            CHECK(crc == ref, "split %u/%u", split, split2);
+        }
+    }
+}
+
+// frame with its CRC appended checks to 0, as protocol_frame_check expects
+static void test_residue(void)
+{
+    uint8_t buf[65];
+    uint32_t len;
+
+    for (len = 1; len < sizeof(buf); len++) {
+        buf_fill(buf, len, len);
+        buf[len] = CRC8_Update(0, buf, len);
+        CHECK(CRC8_Update(0, buf, len + 1) == 0, "len %u", len);
+    }
+}
+
+static void bench(void)
+{
+    static uint8_t buf[BENCH_LEN];
+    volatile uint8_t sink = 0;
+    clock_t t0, t1, t2;
+    uint32_t i;
+    double mb = (double)BENCH_LEN * BENCH_LOOPS / (1024 * 1024);
+
+    buf_fill(buf, sizeof(buf), 3);
+    t0 = clock();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        sink ^= crc_bytewise((uint8_t)i, buf, BENCH_LEN);
+    t1 = clock();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        sink ^= CRC8_Update((uint8_t)i, buf, BENCH_LEN);
+    t2 = clock();
+    (void)sink;
+
+    printf("crc8 %u bytes: bytewise %.0f MB/s, CRC8_Update %.0f MB/s\n", BENCH_LEN,
+           mb * CLOCKS_PER_SEC / (double)(t1 - t0 ? t1 - t0 : 1),
+           mb * CLOCKS_PER_SEC / (double)(t2 - t1 ? t2 - t1 : 1));
+}
+
+uint32_t test_crc8(uint32_t *case_num)
+{
+    fail_num = 0;
+    test_lengths();
+    test_chained();
+    test_residue();
+    bench();
+    *case_num += 3;
+    return fail_num;
+}
@@ -0,0 +1,141 @@
+/*
+ * Shared CRC module (coroutine/co_crc.c), built with CO_CRC_ALL_IMPL:
+ * every implementation against the bitwise one and the standard check
+ * values, plus bytes per cycle of each on DFU and notification sized buffers.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "co_crc.h"
+#include "unittest.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES()    __rdtsc()
+#define UNIT        "bytes/cycle"
+#else
+#define CYCLES()    ((uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC))
+#define UNIT        "bytes/ns"
+#endif
+
+#define BUF_LEN     300
+
+typedef uint32_t (*crc32_fn)(uint32_t crc, const void *buf, unsigned len);
+typedef uint16_t (*crc16_fn)(uint16_t crc, const void *buf, unsigned len);
+typedef uint8_t (*crc8_fn)(uint8_t crc, const void *buf, unsigned len);
+
+static const char *impl_name[] = { "bitwise", "table", "slice4", "slice8" };
+static const crc32_fn crc32_impl[] = { co_crc32_bitwise, co_crc32_table, co_crc32_slice4, co_crc32_slice8 };
+static const crc16_fn crc16_impl[] = { co_crc16_bitwise, co_crc16_table, co_crc16_slice4, co_crc16_slice8 };
+static const crc8_fn crc8_impl[] = { co_crc8_bitwise, co_crc8_table, co_crc8_slice4, co_crc8_slice8 };
+
+static void buf_fill(uint8_t *p, uint32_t len, uint32_t seed)
+{
+    while (len--) {
+        seed = seed * 1103515245 + 12345;
+        *p++ = seed >> 16;
+    }
+}
+
+// CRC-32, CRC-16/XMODEM and CRC-8/MAXIM of "123456789"
+static void test_check_values(void)
+{
+    const char *s = "123456789";
+    uint32_t i;
+
+    for (i = 0; i < 4; i++) {
+        CHECK(crc32_impl[i](0, s, 9) == 0xCBF43926, "crc32 %s", impl_name[i]);
+        CHECK(crc16_impl[i](0, s, 9) == 0x31C3, "crc16 %s", impl_name[i]);
+        CHECK(crc8_impl[i](0, s, 9) == 0xA1, "crc8 %s", impl_name[i]);
+    }
+    CHECK(co_crc32(0, s, 9) == 0xCBF43926 && co_crc16(0, s, 9) == 0x31C3 && co_crc8(0, s, 9) == 0xA1, "selected");
+}
+
+// every length at every alignment, with a non-zero running crc
+static void test_lengths(void)
+{
+    uint8_t buf[BUF_LEN + 8];
+    uint32_t i, off, len;
+
+    buf_fill(buf, sizeof(buf), 4);
+    for (off = 0; off < 8; off++) {
+        for (len = 0; len <= BUF_LEN; len++) {
+            uint32_t ref32 = co_crc32_bitwise(0x12345678, buf + off, len);
+            uint16_t ref16 = co_crc16_bitwise(0xBEEF, buf + off, len);
+            uint8_t ref8 = co_crc8_bitwise(0x5A, buf + off, len);
+            for (i = 1; i < 4; i++) {
+                CHECK(crc32_impl[i](0x12345678, buf + off, len) == ref32, "crc32 %s off %u len %u", impl_name[i], off, len);
+                CHECK(crc16_impl[i](0xBEEF, buf + off, len) == ref16, "crc16 %s off %u len %u", impl_name[i], off, len);
+                CHECK(crc8_impl[i](0x5A, buf + off, len) == ref8, "crc8 %s off %u len %u", impl_name[i], off, len);
+            }
+        }
+    }
+}
+
+// CRC carried across chunks equals the CRC of the whole buffer
+static void test_chained(void)
+{
+    uint8_t buf[BUF_LEN];
+    uint32_t i, split;
+
+    buf_fill(buf, sizeof(buf), 5);
+    for (i = 0; i < 4; i++) {
+        uint32_t ref32 = crc32_impl[i](0, buf, sizeof(buf));
+        uint16_t ref16 = crc16_impl[i](0, buf, sizeof(buf));
+        for (split = 0; split <= sizeof(buf); split += 7) {
+            uint32_t c32 = crc32_impl[i](crc32_impl[i](0, buf, split), buf + split, sizeof(buf) - split);
+            uint16_t c16 = crc16_impl[i](crc16_impl[i](0, buf, split), buf + split, sizeof(buf) - split);
+            CHECK(c32 == ref32 && c16 == ref16, "%s split %u", impl_name[i], split);
+        }
+    }
+}
+
+static void bench_len(uint32_t len, uint32_t loops)
+{
+    static uint8_t buf[4096];
+    volatile uint32_t sink = 0;
+    double bpc[3][4];
+    uint64_t t;
+    uint32_t i, n;
+
+    buf_fill(buf, len, 6);
+    for (i = 0; i < 4; i++) {
+        t = CYCLES();
+        for (n = 0; n < loops; n++)
+            sink ^= crc32_impl[i](n, buf, len);
+        t = CYCLES() - t;
+        bpc[0][i] = (double)len * loops / (t ? t : 1);
+        t = CYCLES();
+        for (n = 0; n < loops; n++)
+            sink ^= crc16_impl[i](n, buf, len);
+        t = CYCLES() - t;
+        bpc[1][i] = (double)len * loops / (t ? t : 1);
+        t = CYCLES();
+        for (n = 0; n < loops; n++)
+            sink ^= crc8_impl[i](n, buf, len);
+        t = CYCLES() - t;
+        bpc[2][i] = (double)len * loops / (t ? t : 1);
+    }
+    (void)sink;
+
+    for (i = 0; i < 3; i++)
+        printf("crc%-2u %4u bytes, " UNIT ": bitwise %.3f, table %.3f, slice4 %.3f, slice8 %.3f\n",
+               i == 0 ? 32 : i == 1 ? 16 : 8, len, bpc[i][0], bpc[i][1], bpc[i][2], bpc[i][3]);
+}
+
+static void bench(void)
+{
+    bench_len(244, 20000);  // SIMPLE_SERVER_MAX_CHAC_LEN
+    bench_len(4096, 1000);  // DFU flash sector
+}
+
+uint32_t test_crc(uint32_t *case_num)
+{
+    fail_num = 0;
+    test_check_values();
+    test_lengths();
+    test_chained();
+    bench();
+    *case_num += 3;
+    return fail_num;
+}
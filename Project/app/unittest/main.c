@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "stim_sim.h"
+#include "stim_control.h"
+#include "stim_monitor.h"
+#include "stim_loop.h"
+#include "emg_wave.h"
+#include "bsp_gpio.h"
+#include "bsp_timer.h"
+#include "unittest.h"
+
+#define TEST_INTENSITY      30
+#define TEST_RASETIME       5       // 0.5s
+#define TEST_STIMTIME       3
+#define TEST_FALLTIME       5
+#define TEST_RUN_MAX_MS     6000
+
+typedef struct {
+    uint64_t rise;
+    uint64_t width;         // gate open and DAC not 0
+    uint16_t ampl;
+} pulse_t;
+
+typedef struct {
+    pulse_t p[1024];
+    uint32_t num;
+} pulse_list_t;
+
+static pulse_list_t pulse[CH_NUM];
+
+static void stim_setup(uint16_t freq, uint16_t pw, uint8_t ch_mask)
+{
+    uint8_t ch;
+
+    sim_reset();
+    stim_init();
+    stim_parameter.frequency = freq;
+    stim_parameter.pulse_width = pw;
+    stim_parameter.rasetime = TEST_RASETIME;
+    stim_parameter.stimtime = TEST_STIMTIME;
+    stim_parameter.falltime = TEST_FALLTIME;
+    pulse_parameter_set();
+    for (ch = 0; ch < CH_NUM; ch++)
+        set_stim_intensity_general((ch_mask & (1 << ch)) ? TEST_INTENSITY : 0, &stim_control[ch]);
+    start_stim(1);
+}
+
+// main loop runs stim_control_handler() between the timer interrupts
+static void stim_run_ms(int run_ms)
+{
+    int ms;
+
+    for (ms = 0; ms < run_ms && sim_tim0.running; ms++) {
+        stim_control_handler();
+        sim_run_us(1000);
+    }
+}
+
+static void run_stim(uint16_t freq, uint16_t pw, uint8_t ch_mask)
+{
+    stim_setup(freq, pw, ch_mask);
+    stim_run_ms(TEST_RUN_MAX_MS);
+}
+
+static int gate_channel(uint8_t sig)
+{
+    int ch;
+
+    for (ch = 0; ch < CH_NUM; ch++)
+        if (sim_gate_pin[ch] == sig)
+            return ch;
+    return -1;
+}
+
+static void collect_pulses(void)
+{
+    uint32_t i;
+    int ch, gate[CH_NUM] = {0}, gate_num = 0;
+    uint16_t dac = 0;
+    uint64_t on = 0;
+    pulse_t *cur = NULL;
+
+    for (ch = 0; ch < CH_NUM; ch++)
+        pulse[ch].num = 0;
+    for (i = 0; i < sim_trace.num; i++) {
+        sim_event_t *e = &sim_trace.ev[i];
+        int open_before = gate_num && dac;
+
+        if ((ch = gate_channel(e->sig)) >= 0) {
+            pulse_list_t *l = &pulse[ch];
+            gate_num += (int)e->value - gate[ch];
+            gate[ch] = e->value;
+            if (e->value && l->num < sizeof(l->p) / sizeof(l->p[0])) {
+                cur = &l->p[l->num++];
+                cur->rise = e->t_us;
+                cur->width = 0;
+                cur->ampl = dac;
+            }
+        } else if (e->sig == SIM_SIG_DAC) {
+            dac = e->value;
+            if (cur && gate_num && dac > cur->ampl)
+                cur->ampl = dac;
+        } else {
+            continue;
+        }
+
+        int open_after = gate_num && dac;
+        if (!open_before && open_after)
+            on = e->t_us;
+        if (open_before && !open_after && cur)
+            cur->width += e->t_us - on;
+        if (gate_num > 1)
+            fail_num++, printf("FAIL %d gates open at %lluus\n", gate_num, (unsigned long long)e->t_us);
+    }
+}
+
+static void check_pulses(const char *name, pulse_list_t *l, uint16_t freq, uint16_t pw, uint64_t expect_period)
+{
+    uint32_t i, full = 0;
+    uint64_t ramp, ramp_tol;
+    uint64_t period_tol = 50;
+
+    CHECK(l->num >= 2, "%s f=%u pw=%u: %u pulses", name, freq, pw, l->num);
+
+    for (i = 0; i < l->num; i++) {
+        if (!l->p[i].ampl)
+            continue;
+        CHECK(l->p[i].width == pw, "%s f=%u pw=%u: pulse %u width %lluus",
+              name, freq, pw, i, (unsigned long long)l->p[i].width);
+    }
+
+    for (i = 1; i < l->num; i++) {
+        uint64_t period = l->p[i].rise - l->p[i - 1].rise;
+        CHECK(llabs((long long)period - (long long)expect_period) <= (long long)period_tol,
+              "%s f=%u pw=%u: period %lluus, expect %lluus", name, freq, pw,
+              (unsigned long long)period, (unsigned long long)expect_period);
+    }
+
+    // ramp: first pulse at full intensity, 50ms step resolution (975 tick correction)
+    while (full < l->num && l->p[full].ampl < TEST_INTENSITY)
+        full++;
+    CHECK(full < l->num, "%s f=%u pw=%u: intensity never reached", name, freq, pw);
+    ramp = l->p[full].rise - l->p[0].rise;
+    ramp_tol = TEST_RASETIME * 100000 / 10 + expect_period;
+    CHECK(llabs((long long)ramp - TEST_RASETIME * 100000LL) <= (long long)ramp_tol,
+          "%s f=%u pw=%u: ramp %lluus, expect %uus", name, freq, pw,
+          (unsigned long long)ramp, TEST_RASETIME * 100000);
+}
+
+static void test_channel_a(uint16_t freq, uint16_t pw)
+{
+    uint8_t ch;
+
+    run_stim(freq, pw, STIM_CH_A);
+    collect_pulses();
+
+    CHECK(!sim_tim0.running, "A f=%u pw=%u: stim never ended", freq, pw);
+    for (ch = CH_B; ch < CH_NUM; ch++)
+        CHECK(pulse[ch].num == 0, "A f=%u pw=%u: %u pulses on channel %u", freq, pw, pulse[ch].num, ch);
+    check_pulses("A", &pulse[CH_A], freq, pw, 1000000 / freq);
+}
+
+// all channels share the pulse period, channel n starts n/CH_NUM period after channel 0
+static void test_channel_all(uint16_t freq, uint16_t pw)
+{
+    uint32_t i;
+    uint8_t ch;
+    char name[8];
+    uint16_t period_cnt = (1000000 / freq) / 50;
+
+    run_stim(freq, pw, STIM_CH_ALL);
+    collect_pulses();
+
+    CHECK(!sim_tim0.running, "ALL f=%u pw=%u: stim never ended", freq, pw);
+    for (ch = 0; ch < CH_NUM; ch++) {
+        uint64_t offset = (uint64_t)period_cnt * ch / CH_NUM * 50;
+
+        snprintf(name, sizeof(name), "ALL.%c", 'A' + ch);
+        check_pulses(name, &pulse[ch], freq, pw, 1000000 / freq);
+        for (i = 0; i < pulse[CH_A].num && i < pulse[ch].num; i++) {
+            uint64_t spacing = pulse[ch].p[i].rise - pulse[CH_A].p[i].rise;
+            CHECK(llabs((long long)spacing - (long long)offset) <= 50,
+                  "%s f=%u pw=%u: spacing %lluus, expect %lluus", name, freq, pw,
+                  (unsigned long long)spacing, (unsigned long long)offset);
+        }
+    }
+}
+
+static uint32_t pulses_after(pulse_list_t *l, uint64_t t_us)
+{
+    uint32_t i, n = 0;
+
+    for (i = 0; i < l->num; i++)
+        if (l->p[i].rise >= t_us && l->p[i].width)
+            n++;
+    return n;
+}
+
+static void test_monitor_normal(uint16_t freq, uint16_t pw)
+{
+    uint16_t z;
+
+    stim_setup(freq, pw, STIM_CH_A);
+    stim_run_ms(1500);
+    z = stim_monitor_impedance(CH_A);
+    CHECK(stim_monitor[CH_A].valid, "MON f=%u pw=%u: no sample", freq, pw);
+    CHECK(stim_monitor[CH_A].result == STIM_MON_NORMAL, "MON f=%u pw=%u: result %u",
+          freq, pw, stim_monitor[CH_A].result);
+    CHECK(abs((int)z - SIM_LOAD_DEFAULT) <= SIM_LOAD_DEFAULT / 20,
+          "MON f=%u pw=%u: impedance %u, expect %u", freq, pw, z, SIM_LOAD_DEFAULT);
+    CHECK(!(stim_control[CH_A].probe_status & COMPLIANCE_OFF), "MON f=%u pw=%u: compliance flag", freq, pw);
+    stim_run_ms(TEST_RUN_MAX_MS);
+}
+
+// GPADC taken by the battery conversion: no pulse is sampled, nothing is stopped
+static void test_monitor_adc_busy(void)
+{
+    stim_setup(50, 200, STIM_CH_A);
+    sim_adc_busy = 1;
+    stim_run_ms(1500);
+    CHECK(!stim_monitor[CH_A].valid && stim_control[CH_A].stim_section == STIMTIME, "BUSY: sampled while GPADC taken");
+    sim_adc_busy = 0;
+    stim_run_ms(500);
+    CHECK(stim_monitor[CH_A].valid && stim_monitor[CH_A].result == STIM_MON_NORMAL, "BUSY: no sample after release");
+    stim_run_ms(TEST_RUN_MAX_MS);
+}
+
+// calibration written by the app: out-of-range data is refused, VH scales the intensity limit
+static void test_monitor_cal(void)
+{
+    static const uint8_t bad_div[STIM_MON_CAL_LEN] = {0x00, 0x01, 0x86, 0xA0, 0x07, 0xD0, 0x00, 0x00};
+    static const uint8_t bad_vsat[STIM_MON_CAL_LEN] = {0x00, 0x00, 0x07, 0xD0, 0x07, 0xD0, 0x00, 0x64};
+    static const uint8_t vh_50v[STIM_MON_CAL_LEN] = {0x00, 0x00, 0xC3, 0x50, 0x07, 0xD0, 0x00, 0x64};
+    static const uint8_t dflt[STIM_MON_CAL_LEN] = {0x00, 0x01, 0x86, 0xA0, 0x07, 0xD0, 0x00, 0x64};
+
+    stim_setup(50, 200, STIM_CH_A);
+    stim_run_ms(1500);
+    CHECK(stim_monitor_max_intensity(CH_A) == INTENSITY_MAX, "CAL: default limit %u", stim_monitor_max_intensity(CH_A));
+    CHECK(!stim_monitor_cal_set(bad_div, sizeof(bad_div)) && !stim_monitor_cal_set(bad_vsat, sizeof(bad_vsat))
+          && !stim_monitor_cal_set(vh_50v, sizeof(vh_50v) - 1), "CAL: bad data accepted");
+    CHECK(stim_monitor_cal.vh_mv == STIM_MON_VH_MV && stim_monitor_cal.div == STIM_MON_DIV, "CAL: changed by bad data");
+    CHECK(stim_monitor_cal_set(vh_50v, sizeof(vh_50v)), "CAL: refused");
+    CHECK(stim_monitor_max_intensity(CH_A) == (50000 - STIM_MON_VSAT_MV) / stim_monitor_impedance(CH_A),
+          "CAL: limit %u", stim_monitor_max_intensity(CH_A));
+    stim_monitor_cal_set(dflt, sizeof(dflt));
+    stim_run_ms(TEST_RUN_MAX_MS);
+}
+
+static void test_monitor_alarm(uint16_t freq, uint16_t pw)
+{
+    // 30mA into 3.3k needs 99V, leaves less than VSAT across the regulator
+    stim_setup(freq, pw, STIM_CH_A);
+    sim_load_ohm[CH_A] = 3300;
+    stim_run_ms(1500);
+    CHECK(stim_monitor[CH_A].result == STIM_MON_ALARM, "ALARM f=%u pw=%u: result %u",
+          freq, pw, stim_monitor[CH_A].result);
+    CHECK(stim_monitor[CH_A].margin_mv < 0, "ALARM f=%u pw=%u: margin %d", freq, pw, stim_monitor[CH_A].margin_mv);
+    CHECK(stim_monitor_max_intensity(CH_A) < TEST_INTENSITY, "ALARM f=%u pw=%u: max intensity %u",
+          freq, pw, stim_monitor_max_intensity(CH_A));
+    CHECK(stim_control[CH_A].probe_status & COMPLIANCE_OFF, "ALARM f=%u pw=%u: no compliance flag", freq, pw);
+    CHECK(stim_control[CH_A].stim_section == STIMTIME, "ALARM f=%u pw=%u: stim stopped", freq, pw);
+    stim_run_ms(TEST_RUN_MAX_MS);
+    CHECK(!sim_tim0.running, "ALARM f=%u pw=%u: stim never ended", freq, pw);
+}
+
+static void test_monitor_open(uint16_t freq, uint16_t pw)
+{
+    uint64_t t_open;
+    uint32_t n;
+
+    stim_setup(freq, pw, STIM_CH_A);
+    stim_run_ms(1500);
+    t_open = sim_now();
+    sim_load_ohm[CH_A] = 1000000;
+    stim_run_ms(TEST_RUN_MAX_MS);
+    collect_pulses();
+
+    n = pulses_after(&pulse[CH_A], t_open);
+    CHECK(n <= 1, "OPEN f=%u pw=%u: %u pulses after open", freq, pw, n);
+    CHECK(stim_monitor[CH_A].result == STIM_MON_STOP, "OPEN f=%u pw=%u: result %u",
+          freq, pw, stim_monitor[CH_A].result);
+    CHECK(stim_control[CH_A].probe_status & COMPLIANCE_OFF, "OPEN f=%u pw=%u: no compliance flag", freq, pw);
+    CHECK(stim_control[CH_A].stim_section == STIMOVER, "OPEN f=%u pw=%u: section %u",
+          freq, pw, stim_control[CH_A].stim_section);
+}
+
+#define LOOP_GAIN           256     // 1mA per envelope unit above the deadband
+#define LOOP_DEADBAND       100
+#define LOOP_SLEW           50      // 0.5mA per envelope update
+#define LOOP_CEILING        30
+
+// closed loop: main loop feeds one envelope value per ms, as emg_calculate_handler() does
+static int loop_run_ms(int run_ms, int envelope, uint16_t *dac_min, uint16_t *dac_max)
+{
+    int ms, max_step = 0;
+    uint16_t last = stim_control[CH_A].intensity_dac;
+
+    *dac_min = 0xFFFF;
+    *dac_max = 0;
+    for (ms = 0; ms < run_ms && sim_tim0.running; ms++) {
+        if (envelope >= 0)
+            stim_loop_envelope_update(EMG_CH_A, envelope);
+        stim_control_handler();
+        sim_run_us(1000);
+        uint16_t dac = stim_control[CH_A].intensity_dac;
+        if (abs((int)dac - (int)last) > max_step)
+            max_step = abs((int)dac - (int)last);
+        if (dac < *dac_min) *dac_min = dac;
+        if (dac > *dac_max) *dac_max = dac;
+        last = dac;
+    }
+    return max_step;
+}
+
+static void test_loop(uint16_t freq, uint16_t pw)
+{
+    uint16_t lo, hi;
+    uint64_t t_on;
+    uint32_t i;
+    int step;
+
+    sim_reset();
+    stim_init();
+    stim_parameter.frequency = freq;
+    stim_parameter.pulse_width = pw;
+    stim_parameter.stimtime = STIMTIME_UNLIMIT;
+    pulse_parameter_set();
+    CHECK(stim_loop_start(STIM_CH_A, EMG_CH_A, LOOP_GAIN, LOOP_DEADBAND, LOOP_SLEW, 200) == 0,
+          "LOOP f=%u pw=%u: start", freq, pw);
+    CHECK(stim_control[CH_A].intensity == STIM_LOOP_CEILING_MAX, "LOOP: ceiling not limited");
+    CHECK(stim_loop_start(STIM_CH_A, EMG_CH_A, LOOP_GAIN, LOOP_DEADBAND, LOOP_SLEW, LOOP_CEILING) == 0,
+          "LOOP f=%u pw=%u: start", freq, pw);
+    CHECK(!stim_control[CH_B].stim_section, "LOOP f=%u pw=%u: channel B started", freq, pw);
+
+    // inside the deadband: no output
+    loop_run_ms(500, LOOP_DEADBAND - 10, &lo, &hi);
+    CHECK(hi == 0, "LOOP f=%u pw=%u: output %u inside deadband", freq, pw, hi);
+
+    // proportional, slew limited, reaches the target in 20mA / 0.5mA = 40 updates
+    t_on = sim_now();
+    step = loop_run_ms(500, LOOP_DEADBAND + 20, &lo, &hi);
+    CHECK(step <= 1, "LOOP f=%u pw=%u: step %d", freq, pw, step);
+    CHECK(stim_control[CH_A].intensity_dac == 20, "LOOP f=%u pw=%u: output %u, expect 20",
+          freq, pw, stim_control[CH_A].intensity_dac);
+    collect_pulses();
+    for (i = 0; i < pulse[CH_A].num && !pulse[CH_A].p[i].width; i++)
+        ;
+    CHECK(i < pulse[CH_A].num, "LOOP f=%u pw=%u: no pulse", freq, pw);
+    CHECK(pulse[CH_A].p[i].rise - t_on <= 5000 + 1000000 / freq,
+          "LOOP f=%u pw=%u: first pulse %lluus after envelope", freq, pw,
+          (unsigned long long)(pulse[CH_A].p[i].rise - t_on));
+
+    // above the ceiling
+    loop_run_ms(500, 1000, &lo, &hi);
+    CHECK(hi == LOOP_CEILING, "LOOP f=%u pw=%u: max %u, expect ceiling", freq, pw, hi);
+
+    // envelope lost: back to 0 at the slew rate per 50ms
+    loop_run_ms(4000, -1, &lo, &hi);
+    CHECK(lo == 0 && stim_control[CH_A].stim_section == STIMTIME,
+          "LOOP f=%u pw=%u: timeout output %u", freq, pw, lo);
+
+    // stop: falls to 0 and ends
+    loop_run_ms(200, LOOP_DEADBAND + 20, &lo, &hi);
+    stim_loop_stop();
+    loop_run_ms(2000, LOOP_DEADBAND + 20, &lo, &hi);
+    CHECK(!sim_tim0.running, "LOOP f=%u pw=%u: stim never ended", freq, pw);
+    CHECK(!stim_loop_active(), "LOOP f=%u pw=%u: still active", freq, pw);
+}
+
+static void usage(void)
+{
+    printf("usage: a.out [-f freq -w pulse_width [-b] [-c out.csv] [-v out.vcd]] [-d dac_write_us]\n");
+    printf("  no -f: run the FREQUENCY_MIN..MAX x PULSE_WIDTH_MIN..MAX regression\n");
+}
+
+int main(int argc, char **argv)
+{
+    int opt, all = 0;
+    uint16_t freq = 0, pw = PULSE_WIDTH_MIN;
+    const char *csv = NULL, *vcd = NULL;
+    uint32_t case_num = 0;
+
+    sim_dac_write_us = STIM_DAC_WR_CNT * 50;
+
+    while ((opt = getopt(argc, argv, "f:w:bc:v:d:h")) != -1) {
+        switch (opt) {
+            case 'f': freq = atoi(optarg); break;
+            case 'w': pw = atoi(optarg); break;
+            case 'b': all = 1; break;
+            case 'c': csv = optarg; break;
+            case 'v': vcd = optarg; break;
+            case 'd': sim_dac_write_us = atoi(optarg); break;
+            default: usage(); return 1;
+        }
+    }
+
+    printf("STIM_CH_NUM:%d, STIM_DAC_WR_CNT:%d, DAC write:%uus\n", STIM_CH_NUM, STIM_DAC_WR_CNT, sim_dac_write_us);
+
+    if (freq) {
+        FILE *fp;
+        run_stim(freq, pw, all ? STIM_CH_ALL : STIM_CH_A);
+        if (csv && (fp = fopen(csv, "w")) != NULL) { sim_trace_dump_csv(fp); fclose(fp); }
+        if (vcd && (fp = fopen(vcd, "w")) != NULL) { sim_trace_dump_vcd(fp); fclose(fp); }
+        if (all) test_channel_all(freq, pw);
+        else test_channel_a(freq, pw);
+    } else {
+        for (freq = FREQUENCY_MIN; freq <= FREQUENCY_MAX; freq++) {
+            for (pw = PULSE_WIDTH_MIN; pw <= PULSE_WIDTH_MAX; pw += 50) {
+                test_channel_a(freq, pw);
+                test_channel_all(freq, pw);
+                case_num += 2;
+            }
+        }
+        for (freq = FREQUENCY_MIN; freq <= FREQUENCY_MAX; freq += 10) {
+            for (pw = PULSE_WIDTH_MIN; pw <= PULSE_WIDTH_MAX; pw += 100) {
+                test_monitor_normal(freq, pw);
+                test_monitor_alarm(freq, pw);
+                test_monitor_open(freq, pw);
+                case_num += 3;
+            }
+        }
+        for (freq = 10; freq <= FREQUENCY_MAX; freq += 10) {
+            for (pw = PULSE_WIDTH_MIN; pw <= PULSE_WIDTH_MAX; pw += 100) {
+                test_loop(freq, pw);
+                case_num++;
+            }
+        }
+    }
+
+    test_monitor_adc_busy();
+    test_monitor_cal();
+    case_num += 2;
+
+    fail_num += test_protocol(&case_num);
+    fail_num += test_crc8(&case_num);
+    fail_num += test_crc(&case_num);
+    fail_num += test_bulk(&case_num);
+    fail_num += test_session_log(&case_num);
+
+    printf("%u cases, %u failures\n", case_num ? case_num : 1, fail_num);
+    return fail_num ? 1 : 0;
+}
@@ -0,0 +1,336 @@
+/*
+ * Frame parser (app/protocol.c) fed the way gattc_write_req_ind_handler does:
+ * whole GATT write buffers, several frames per write or frames split anywhere.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "protocol.h"
+#include "crc8.h"
+#include "bsp_systick.h"
+#include "bulk.h"
+#include "unittest.h"
+
+#define MAX_FRAMES  64
+
+static PACKET_Typedef got[MAX_FRAMES];
+static int16_t got_seq[MAX_FRAMES];
+static int16_t got_link[MAX_FRAMES];
+static uint32_t got_num;
+static uint8_t ext_data[PROTOCOL_EXT_FRAME_MAX];
+static uint16_t ext_len;
+static uint8_t ext_type;
+static uint32_t ext_num;
+
+void execute_handler(PACKET_Typedef *packet)
+{
+    if (got_num < MAX_FRAMES) {
+        got[got_num] = *packet;
+        got_seq[got_num] = protocol_seq();
+        got_link[got_num] = protocol_link();
+    }
+    got_num++;
+}
+
+// as handler.c: bulk segments go to bulk.c, everything is recorded
+void execute_ext_handler(uint8_t token, uint8_t type, const uint8_t *data, uint16_t len)
+{
+    ext_type = type;
+    ext_len = len;
+    memcpy(ext_data, data, len);
+    ext_num++;
+    if (token == AM300_TOKEN && type == CMD_BULK_DATA && protocol_link() >= 0)
+        bulk_segment_handler(protocol_link(), data, len);
+}
+
+// AA 5A token lenH lenL type data... crc, returns the frame length
+uint16_t ext_frame_build(uint8_t *p, uint8_t token, uint8_t type, const uint8_t *data, uint16_t data_len)
+{
+    p[0] = HEAD_1;
+    p[1] = HEAD_2_EXT;
+    p[2] = token;
+    p[3] = (data_len + 2) >> 8;
+    p[4] = (data_len + 2) & 0xFF;
+    p[5] = type;
+    memcpy(p + 6, data, data_len);
+    p[6 + data_len] = CRC_8(p, 6 + data_len);
+    return 7 + data_len;
+}
+
+// AA 55 token len type data... crc, returns the frame length
+static uint16_t frame_build(uint8_t *p, uint8_t token, uint8_t type, const uint8_t *data, uint8_t data_len)
+{
+    p[0] = HEAD_1;
+    p[1] = HEAD_2;
+    p[2] = token;
+    p[3] = data_len + 2;
+    p[4] = type;
+    memcpy(p + 5, data, data_len);
+    p[5 + data_len] = CRC_8(p, 5 + data_len);
+    return 6 + data_len;
+}
+
+static int frame_equal(const PACKET_Typedef *pk, const uint8_t *p, uint16_t len)
+{
+    return memcmp(pk->buf, p, len) == 0;
+}
+
+static void test_multi_frame_write(void)
+{
+    uint8_t buf[200], data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint16_t len = 0, l0, l1, l2;
+
+    got_num = 0;
+    l0 = frame_build(buf, AM300_TOKEN, 0x92, data, 1);
+    l1 = frame_build(buf + l0, GERNARL_TOKEN, 0x81, data, 0);
+    l2 = frame_build(buf + l0 + l1, AM300_TOKEN, 0x91, data, 8);
+    len = l0 + l1 + l2;
+    protocol_rx_write(0, buf, len);
+    CHECK(got_num == 3, "%u frames", got_num);
+    CHECK(frame_equal(&got[0], buf, l0) && frame_equal(&got[1], buf + l0, l1)
+          && frame_equal(&got[2], buf + l0 + l1, l2), "frame content");
+}
+
+static void test_split_frames(void)
+{
+    uint8_t buf[200], data[20];
+    uint16_t len, l0, cut, cut2;
+
+    for (cut = 0; cut < sizeof(data); cut++)
+        data[cut] = cut * 7;
+    l0 = frame_build(buf, AM300_TOKEN, 0x91, data, sizeof(data));
+    len = l0 + frame_build(buf + l0, AM300_TOKEN, 0x93, data, 1);
+
+    // every split point of two writes
+    for (cut = 1; cut < len; cut++) {
+        got_num = 0;
+        protocol_rx_write(0, buf, cut);
+        protocol_rx_write(0, buf + cut, len - cut);
+        CHECK(got_num == 2, "cut %u: %u frames", cut, got_num);
+        CHECK(frame_equal(&got[0], buf, l0), "cut %u: frame 0", cut);
+        CHECK(frame_equal(&got[1], buf + l0, len - l0), "cut %u: frame 1", cut);
+    }
+
+    // three writes
+    for (cut = 1; cut < len - 1; cut++) {
+        for (cut2 = cut + 1; cut2 < len; cut2++) {
+            got_num = 0;
+            protocol_rx_write(0, buf, cut);
+            protocol_rx_write(0, buf + cut, cut2 - cut);
+            protocol_rx_write(0, buf + cut2, len - cut2);
+            CHECK(got_num == 2, "cut %u/%u: %u frames", cut, cut2, got_num);
+        }
+    }
+
+    // byte by byte
+    got_num = 0;
+    for (cut = 0; cut < len; cut++)
+        protocol_rx_write(0, buf + cut, 1);
+    CHECK(got_num == 2, "byte by byte: %u frames", got_num);
+}
+
+static void test_resync(void)
+{
+    uint8_t buf[200], data[4] = {9, 8, 7, 6};
+    uint16_t len = 0, l;
+
+    got_num = 0;
+    buf[len++] = 0x00;
+    buf[len++] = HEAD_1;                                    // lone head
+    buf[len++] = HEAD_1;
+    buf[len++] = HEAD_2;
+    buf[len++] = 0x12;                                      // bad token
+    l = frame_build(buf + len, AM300_TOKEN, 0x92, data, 4);
+    buf[len + l - 1] ^= 0x5A;                               // bad crc
+    len += l;
+    l = frame_build(buf + len, AM300_TOKEN, 0x92, data, 4);
+    buf[len + 3] = 61;                                      // longer than PACKET_Typedef
+    len += l;
+    l = frame_build(buf + len, AM300_TOKEN, 0x9E, data, 0);
+    len += l;
+    protocol_rx_write(0, buf, len);
+    CHECK(got_num == 1, "%u frames", got_num);
+    CHECK(frame_equal(&got[0], buf + len - l, l), "frame content");
+
+    // same stream, split through the reassembly buffer
+    got_num = 0;
+    protocol_rx_write(0, buf, 10);
+    protocol_rx_write(0, buf + 10, len - 10);
+    CHECK(got_num == 1, "split: %u frames", got_num);
+}
+
+// bad frame completed by a write that also holds shorter frames, found again by resync
+static void test_resync_split(void)
+{
+    uint8_t buf[64], data[4] = {5, 6, 7, 8};
+    uint16_t len = 0, l0, l1;
+
+    buf[len++] = HEAD_1;
+    buf[len++] = HEAD_2;
+    buf[len++] = AM300_TOKEN;
+    buf[len++] = 0x0A;                                      // longer than the bytes before the next head
+    buf[len++] = 0x10;
+    buf[len++] = 0x00;
+    l0 = frame_build(buf + len, AM300_TOKEN, 0x9E, data, 0);
+    len += l0;
+    l1 = frame_build(buf + len, AM300_TOKEN, 0x92, data, 4);
+    len += l1;
+
+    got_num = 0;
+    protocol_rx_write(0, buf, 4);
+    protocol_rx_write(0, buf + 4, len - 4);
+    CHECK(got_num == 2, "%u frames", got_num);
+    CHECK(frame_equal(&got[0], buf + 6, l0), "short frame");
+    CHECK(frame_equal(&got[1], buf + len - l1, l1), "frame after it");
+
+    // short frame with a bad crc is dropped as well
+    buf[6 + l0 - 1] ^= 0x5A;
+    got_num = 0;
+    protocol_rx_write(0, buf, 4);
+    protocol_rx_write(0, buf + 4, len - 4);
+    CHECK(got_num == 1 && frame_equal(&got[0], buf + len - l1, l1), "bad crc: %u frames", got_num);
+}
+
+static void test_ext_frames(void)
+{
+    uint8_t buf[600], data[240];
+    uint16_t len = 0, l0, l1, cut;
+
+    for (cut = 0; cut < sizeof(data); cut++)
+        data[cut] = cut ^ 0xA5;
+
+    // extended frame longer than PACKET_Typedef between two normal frames
+    l0 = frame_build(buf, AM300_TOKEN, 0x92, data, 1);
+    l1 = ext_frame_build(buf + l0, AM300_TOKEN, 0xB0, data, 200);
+    len = l0 + l1 + frame_build(buf + l0 + l1, AM300_TOKEN, 0x93, data, 0);
+    got_num = ext_num = 0;
+    protocol_rx_write(0, buf, len);
+    CHECK(got_num == 2 && ext_num == 1, "%u/%u frames", got_num, ext_num);
+    CHECK(ext_type == 0xB0 && ext_len == 200 && memcmp(ext_data, data, 200) == 0, "ext content");
+
+    // every split point, through the reassembly buffer
+    for (cut = 1; cut < len; cut++) {
+        got_num = ext_num = ext_len = 0;
+        protocol_rx_write(0, buf, cut);
+        protocol_rx_write(0, buf + cut, len - cut);
+        CHECK(got_num == 2 && ext_num == 1, "cut %u: %u/%u frames", cut, got_num, ext_num);
+        CHECK(ext_len == 200 && memcmp(ext_data, data, 200) == 0, "cut %u: ext content", cut);
+    }
+
+    // 20-byte writes, as without MTU exchange
+    got_num = ext_num = 0;
+    for (cut = 0; cut < len; cut += 20)
+        protocol_rx_write(0, buf + cut, len - cut < 20 ? len - cut : 20);
+    CHECK(got_num == 2 && ext_num == 1, "20-byte writes: %u/%u frames", got_num, ext_num);
+
+    // longer than PROTOCOL_EXT_FRAME_MAX, bad crc: skipped, next frame found
+    len = ext_frame_build(buf, AM300_TOKEN, 0xB0, data, 10);
+    buf[3] = 0x01;
+    l0 = ext_frame_build(buf + len, AM300_TOKEN, 0xB0, data, 10);
+    buf[len + l0 - 1] ^= 0xFF;
+    len += l0;
+    len += ext_frame_build(buf + len, AM300_TOKEN, 0xB1, data, 3);
+    ext_num = 0;
+    protocol_rx_write(0, buf, len);
+    CHECK(ext_num == 1 && ext_type == 0xB1 && ext_len == 3, "resync: %u frames", ext_num);
+}
+
+static void test_timeout(void)
+{
+    uint8_t buf[64], data[4] = {1, 2, 3, 4};
+    uint16_t len;
+
+    got_num = 0;
+    len = frame_build(buf, AM300_TOKEN, 0x92, data, 4);
+    protocol_rx_write(0, buf, 5);
+    systick_cnt += TICK_X10MS(20) + 1;
+    protocol_handler();
+    protocol_rx_write(0, buf + 5, len - 5);
+    CHECK(got_num == 0, "stale fragment completed");
+    protocol_rx_write(0, buf, len);
+    CHECK(got_num == 1, "%u frames after timeout", got_num);
+}
+
+// Write Without Response path: seq byte then frames, handlers see the seq while they run
+static void test_seq(void)
+{
+    uint8_t buf[200], data[4] = {1, 2, 3, 4};
+    uint16_t len = 1, l0;
+
+    got_num = 0;
+    buf[0] = 0x7E;
+    l0 = frame_build(buf + len, AM300_TOKEN, 0x92, data, 1);
+    len += l0;
+    len += frame_build(buf + len, AM300_TOKEN, 0x9E, data, 0);
+    protocol_rx_write_seq(0, buf, len);
+    CHECK(got_num == 2, "%u frames", got_num);
+    CHECK(got_seq[0] == 0x7E && got_seq[1] == 0x7E, "seq %d %d", got_seq[0], got_seq[1]);
+    CHECK(frame_equal(&got[0], buf + 1, l0), "frame content");
+    CHECK(protocol_seq() == -1, "seq left set");
+
+    // plain write after it has no seq
+    protocol_rx_write(0, buf + 1, l0);
+    CHECK(got_num == 3 && got_seq[2] == -1, "plain write seq %d", got_seq[2]);
+
+    // frame split over two sequenced writes takes the seq of the completing write
+    got_num = 0;
+    buf[0] = 1;
+    protocol_rx_write_seq(0, buf, 4);
+    buf[3] = 2;
+    protocol_rx_write_seq(0, buf + 3, l0 - 2);
+    CHECK(got_num == 1 && got_seq[0] == 2, "split: %u frames seq %d", got_num, got_seq[0]);
+
+    protocol_rx_write_seq(0, buf, 0);
+    CHECK(got_num == 1, "empty write");
+}
+
+// patient phone and clinician tablet: fragments of two connections interleaved
+static void test_links(void)
+{
+    uint8_t a[64], b[64], data[20];
+    uint16_t la, lb, cut;
+
+    for (cut = 0; cut < sizeof(data); cut++)
+        data[cut] = cut * 3;
+    la = frame_build(a, AM300_TOKEN, 0x91, data, sizeof(data));
+    lb = frame_build(b, AM300_TOKEN, 0x9E, data, 2);
+
+    for (cut = 1; cut < lb; cut++) {
+        got_num = 0;
+        protocol_rx_write(0, a, cut);
+        protocol_rx_write(1, b, cut);
+        protocol_rx_write(0, a + cut, la - cut);
+        protocol_rx_write(1, b + cut, lb - cut);
+        CHECK(got_num == 2, "cut %u: %u frames", cut, got_num);
+        CHECK(frame_equal(&got[0], a, la) && got_link[0] == 0, "cut %u: link 0 frame", cut);
+        CHECK(frame_equal(&got[1], b, lb) && got_link[1] == 1, "cut %u: link 1 frame", cut);
+    }
+    CHECK(protocol_link() == -1, "link left set");
+
+    // dropping one link's fragment leaves the other alone
+    got_num = 0;
+    protocol_rx_write(0, a, 7);
+    protocol_rx_write(1, b, 3);
+    protocol_link_reset(0);
+    protocol_rx_write(0, a + 7, la - 7);
+    protocol_rx_write(1, b + 3, lb - 3);
+    CHECK(got_num == 1 && got_link[0] == 1, "reset: %u frames", got_num);
+
+    // out of range link is ignored
+    protocol_rx_write(PROTOCOL_LINK_MAX, a, la);
+    CHECK(got_num == 1, "link %u accepted", PROTOCOL_LINK_MAX);
+}
+
+uint32_t test_protocol(uint32_t *case_num)
+{
+    fail_num = 0;
+    test_multi_frame_write();
+    test_split_frames();
+    test_resync();
+    test_resync_split();
+    test_timeout();
+    test_seq();
+    test_ext_frames();
+    test_links();
+    *case_num += 8;
+    return fail_num;
+}
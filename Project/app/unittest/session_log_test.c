@@ -0,0 +1,311 @@
+/*
+ * Session log (app/session_log.c) on a RAM backed NOR flash: programming only
+ * clears bits, erase sets a whole sector to 0xFF, and a power cut can stop a
+ * write after any byte.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "stim_control.h"
+#include "session_log.h"
+#include "bsp_flash.h"
+#include "unittest.h"
+
+#define SIM_BASE        0x6D000
+#define SIM_SECTORS     8
+
+static uint8_t sim_flash[SIM_SECTORS * FLASH_SECTOR_SIZE];
+static uint32_t sim_erase[SIM_SECTORS];
+static uint32_t sim_write_ops;
+static uint32_t sim_write_max;
+static uint32_t sim_read_bytes;
+static int32_t sim_cut;         // bytes still programmed before the power cut, <0: no cut
+
+uint8_t flash_store_region(uint32_t *addr, uint32_t *len)
+{
+    *addr = SIM_BASE;
+    *len = sizeof(sim_flash);
+    return 1;
+}
+
+void flash_read(uint32_t addr, void *buf, uint32_t len)
+{
+    memcpy(buf, &sim_flash[addr - SIM_BASE], len);
+    sim_read_bytes += len;
+}
+
+void flash_write(uint32_t addr, const void *buf, uint32_t len)
+{
+    const uint8_t *p = buf;
+    uint32_t i;
+
+    sim_write_ops++;
+    if (len > sim_write_max)
+        sim_write_max = len;
+    for (i = 0; i < len && sim_cut != 0; i++) {
+        sim_flash[addr - SIM_BASE + i] &= p[i];
+        if (sim_cut > 0)
+            sim_cut--;
+    }
+}
+
+void flash_erase_sector(uint32_t addr)
+{
+    sim_write_ops++;
+    if (sim_cut == 0)
+        return;
+    memset(&sim_flash[addr - SIM_BASE], 0xFF, FLASH_SECTOR_SIZE);
+    sim_erase[(addr - SIM_BASE) / FLASH_SECTOR_SIZE]++;
+}
+
+static void flash_blank(void)
+{
+    memset(sim_flash, 0xFF, sizeof(sim_flash));
+    memset(sim_erase, 0, sizeof(sim_erase));
+    sim_write_ops = 0;
+    sim_write_max = 0;
+    sim_cut = -1;
+    stim_init();
+    session_log_init();
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+// stimulation on channel 0 for a number of seconds, pps pulses every second
+static void stim_on(uint16_t seconds, uint8_t intensity, uint32_t pps)
+{
+    uint16_t s;
+
+    stim_control[0].stim_section = 1;
+    stim_control[0].intensity = intensity;
+    for (s = 0; s < seconds; s++) {
+        session_log_tick_1s();
+        session_log_handler();
+        stim_control[0].pulse_cnt += pps;
+    }
+}
+
+static void stim_off(void)
+{
+    stim_control[0].stim_section = 0;
+    session_log_tick_1s();
+}
+
+static void flush(void)
+{
+    int n;
+
+    for (n = 0; n < 1000 && session_log_busy(); n++)
+        session_log_handler();
+}
+
+static uint32_t session_run(uint16_t seconds)
+{
+    stim_on(seconds, 10, 10);
+    stim_off();
+    flush();
+    return session_store.next_id - 1;
+}
+
+static uint32_t newest_id(uint8_t n)
+{
+    static uint8_t rec[SESSION_RECORD_MAX];
+
+    if (!session_log_read(n, rec, sizeof(rec)))
+        return 0;
+    return get32(rec + 4);
+}
+
+static void test_append(void)
+{
+    static uint8_t rec[SESSION_RECORD_MAX];
+    const uint8_t *p;
+    uint16_t len;
+
+    flash_blank();
+    CHECK(session_log_count() == 0 && session_log_read(0, rec, sizeof(rec)) == 0, "empty store");
+
+    stim_parameter.frequency = 50;
+    stim_parameter.pulse_width = 200;
+    stim_on(4, 20, 50);
+    session_log_emg(0, 100);
+    session_log_emg(0, 300);
+    session_log_emg(0, 200);
+    stim_control[0].probe_status = LEAD_OFF;
+    stim_on(6, 20, 50);
+    CHECK(sim_write_ops == 0, "flash written during stimulation");
+    stim_off();
+    flush();
+    CHECK(sim_write_ops > 0 && sim_write_max <= FLASH_PAGE_SIZE, "write steps %u, longest %u", sim_write_ops, sim_write_max);
+
+    len = session_log_read(0, rec, sizeof(rec));
+    CHECK(session_log_count() == 1 && len, "count %u len %u", session_log_count(), len);
+    CHECK(get16(rec) == SESSION_RECORD_MAGIC && get16(rec + 2) == len && get32(rec + 4) == 1, "record head");
+    CHECK(get16(rec + 8) == 10 && get16(rec + 10) == 50 && get16(rec + 12) == 200, "duration/parameters");
+    CHECK(rec[18] == CH_NUM && rec[19] == SESSION_EMG_CH && rec[20] == 1 && rec[21] == 1 && get16(rec + 22) == 10, "counts");
+    p = rec + SESSION_REC_HEAD_LEN;
+    CHECK(get32(p) == 500 && p[4] == 20 && p[5] == 1, "channel 0 pulses %u max %u off %u", get32(p), p[4], p[5]);
+    CHECK(get32(p + SESSION_REC_CH_LEN) == 0 && p[SESSION_REC_CH_LEN + 4] == 0, "channel 1 idle");
+    p += SESSION_REC_CH_LEN * CH_NUM;
+    CHECK(get16(p) == 100 && get16(p + 2) == 300 && get16(p + 4) == 200, "EMG min/max/mean");
+    CHECK(get16(p + SESSION_REC_EMG_LEN) == 0, "EMG channel without data");
+    p += SESSION_REC_EMG_LEN * SESSION_EMG_CH;
+    CHECK(get16(p) == 5 && p[2] == 0 && p[3] == LEAD_OFF, "electrode-off event t=%u", get16(p));
+    p += SESSION_REC_OFF_LEN;
+    CHECK(p[0] == 20 && p[9 * CH_NUM] == 20 && p + 10 * CH_NUM + 2 == rec + len, "trace");
+
+    // stimulation restarted with the electrode still off is not a new event
+    stim_on(3, 20, 50);
+    stim_off();
+    flush();
+    len = session_log_read(0, rec, sizeof(rec));
+    CHECK(session_log_count() == 2 && get32(rec + 4) == 2 && rec[21] == 0, "second record");
+    stim_control[0].probe_status = 0;
+}
+
+static void test_recover(void)
+{
+    uint32_t reads;
+
+    flash_blank();
+    session_run(3);
+    session_run(5);
+    session_run(7);
+
+    sim_read_bytes = 0;
+    session_log_init();
+    reads = sim_read_bytes;
+    CHECK(session_log_count() == 3 && newest_id(0) == 3 && newest_id(2) == 1, "recovered index");
+    // 2 reads of every header and directory, the blank check and the newest record id
+    CHECK(reads <= 2 * SIM_SECTORS * SESSION_DATA_START + 32, "recovery read %u bytes", reads);
+    CHECK(session_run(2) == 4 && session_log_count() == 4 && newest_id(0) == 4, "append after recovery");
+}
+
+static void test_rotation(void)
+{
+    uint32_t i, lo = 0xFFFFFFFF, hi = 0;
+
+    flash_blank();
+    for (i = 1; i <= 1000; i++) {
+        if (session_run(i % 7 ? 2 : 600) != i) {
+            CHECK(0, "session %u lost", i);
+        }
+    }
+    for (i = 0; i < SIM_SECTORS; i++) {
+        if (sim_erase[i] < lo) lo = sim_erase[i];
+        if (sim_erase[i] > hi) hi = sim_erase[i];
+    }
+    CHECK(lo > 1 && hi - lo <= 1, "erase counts %u..%u", lo, hi);
+    CHECK(session_log_count() == SESSION_INDEX_NUM, "index full");
+    for (i = 0; i < SESSION_INDEX_NUM; i++) {
+        if (newest_id(i) != 1000 - i) {
+            CHECK(0, "newest %u is id %u", i, newest_id(i));
+        }
+    }
+
+    session_log_init();
+    CHECK(session_log_count() == SESSION_INDEX_NUM && newest_id(0) == 1000 && newest_id(SESSION_INDEX_NUM - 1) == 1000 - SESSION_INDEX_NUM + 1,
+          "index across wrapped sectors");
+    CHECK(session_run(2) == 1001, "id after wrap");
+}
+
+static void test_trace_decimate(void)
+{
+    static uint8_t rec[SESSION_RECORD_MAX];
+    uint16_t s, len;
+
+    flash_blank();
+    stim_control[0].stim_section = 1;
+    for (s = 0; s < SESSION_TRACE_NUM + 10; s++) {
+        stim_control[0].intensity = s % 50;
+        session_log_tick_1s();
+    }
+    stim_off();
+    flush();
+    len = session_log_read(0, rec, sizeof(rec));
+    CHECK(len && get16(rec + 8) == SESSION_TRACE_NUM + 10 && rec[20] == 2, "interval %u", rec[20]);
+    CHECK(get16(rec + 22) == SESSION_TRACE_NUM / 2 + 5, "points %u", get16(rec + 22));
+    CHECK(rec[len - 2 - get16(rec + 22) * CH_NUM] == 1, "max of a pair");
+}
+
+static void test_power_loss(void)
+{
+    uint8_t rec[8];
+
+    flash_blank();
+    session_run(3);
+    session_run(3);
+
+    // cut while the record body is programmed
+    stim_on(3, 10, 10);
+    stim_off();
+    sim_cut = 20;
+    flush();
+    sim_cut = -1;
+    session_log_init();
+    CHECK(session_log_count() == 2 && newest_id(0) == 2, "torn record dropped");
+    CHECK(session_store.dir_used == SESSION_DIR_NUM, "torn sector closed");
+    CHECK(session_run(3) == 3 && session_store.head == 1 && newest_id(0) == 3 && newest_id(1) == 2, "next record in a fresh sector");
+
+    // cut in the middle of the directory slot
+    stim_on(3, 10, 10);
+    stim_off();
+    sim_cut = session_store.pend_len + 2;
+    flush();
+    sim_cut = -1;
+    session_log_init();
+    CHECK(session_log_count() == 3 && newest_id(0) == 3, "half written slot dropped");
+    CHECK(session_run(3) == 4 && session_log_count() == 4, "append after torn slot");
+
+    // cut during the sector erase, the header is never written
+    session_store.dir_used = SESSION_DIR_NUM;
+    stim_on(3, 10, 10);
+    stim_off();
+    sim_cut = 0;
+    flush();
+    sim_cut = -1;
+    session_log_init();
+    CHECK(session_log_count() == 4 && newest_id(0) == 4, "erase cut");
+    CHECK(session_run(3) == 5 && session_log_count() == 5, "append after erase cut");
+
+    // bit rot in a stored record
+    sim_flash[session_store.index[(session_store.index_head + SESSION_INDEX_NUM - 1) % SESSION_INDEX_NUM].addr - SIM_BASE + 9] ^= 0x01;
+    CHECK(session_log_read(0, (uint8_t *)rec, 0) == 0 && newest_id(0) == 0 && newest_id(1) == 4, "CRC error");
+}
+
+static void test_busy(void)
+{
+    flash_blank();
+
+    // the next stimulation starts before the previous record is written
+    stim_on(2, 10, 10);
+    stim_off();
+    stim_on(2, 10, 10);
+    stim_off();
+    stim_on(2, 10, 10);
+    CHECK(sim_write_ops == 0 && session_store.lost == 1, "lost %u", session_store.lost);
+    stim_off();
+    flush();
+    CHECK(session_log_count() == 2 && newest_id(0) == 2 && session_store.lost == 1, "two records kept");
+}
+
+uint32_t test_session_log(uint32_t *case_num)
+{
+    fail_num = 0;
+    test_append();
+    test_recover();
+    test_rotation();
+    test_trace_decimate();
+    test_power_loss();
+    test_busy();
+    *case_num += 6;
+    stim_init();
+    return fail_num;
+}
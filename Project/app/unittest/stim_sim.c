@@ -0,0 +1,289 @@
+/*
+ * Host model of the hardware used by app/stim_control.c
+ *
+ * TIM0 is a free running reload timer, its ISR calls stim_50us_server().
+ * A blocking call inside the ISR (the bit-banged DAC60501 write) delays the
+ * following ISR: every timer edge that falls inside the busy window collapses
+ * into one pending interrupt, exactly like the NVIC pending bit does.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "stim_sim.h"
+#include "bsp_gpio.h"
+#include "bsp_timer.h"
+#include "bsp_iic.h"
+#include "bsp_adc.h"
+#include "stim_control.h"
+#include "stim_monitor.h"
+#include "emg_wave.h"
+
+HS_TIM_Type sim_tim0, sim_tim1;
+volatile uint32_t systick_cnt;
+
+static uint16_t emg_a_raw_buf[EMG_BUF_LEN];
+static uint16_t emg_b_raw_buf[EMG_BUF_LEN];
+QUEUE_U16 emg_a_raw_fifo;
+QUEUE_U16 emg_b_raw_fifo;
+EMG_Typedef emg_wave;
+
+sim_trace_t sim_trace;
+uint32_t sim_dac_write_us = 0;
+uint32_t sim_pin_input = 0;
+uint8_t sim_adc_busy = 0;
+uint32_t sim_load_ohm[CH_NUM];
+const uint8_t sim_gate_pin[CH_NUM] = {
+    PIN_STIM_OUT_A, PIN_STIM_OUT_B,
+#if (STIM_CH_NUM > 2)
+    PIN_STIM_OUT_C, PIN_STIM_OUT_D,
+#endif
+};
+
+static uint64_t sim_isr_start;      // time the running ISR was entered
+static uint64_t sim_busy_us;        // time consumed so far in the running ISR
+static uint64_t sim_grid;           // next timer reload edge
+static uint32_t sim_isr_num;
+static uint32_t sim_pins;
+static uint16_t sim_dac;
+static adc_callback_t sim_adc_cb;   // conversion in flight, completes after the ISR
+
+static void sim_record(uint8_t sig, uint16_t value)
+{
+    if (sim_trace.num == sim_trace.size) {
+        sim_trace.size = sim_trace.size ? sim_trace.size * 2 : 4096;
+        sim_trace.ev = realloc(sim_trace.ev, sim_trace.size * sizeof(sim_event_t));
+    }
+    sim_trace.ev[sim_trace.num].t_us = sim_now();
+    sim_trace.ev[sim_trace.num].sig = sig;
+    sim_trace.ev[sim_trace.num].value = value;
+    sim_trace.num++;
+}
+
+void gpio_write(uint32_t pin_mask, gpio_level_t level)
+{
+    uint8_t pin;
+
+    for (pin = 0; pin < 32; pin++) {
+        if (!(pin_mask & (1u << pin)))
+            continue;
+        if (((sim_pins >> pin) & 1u) == (uint32_t)level)
+            continue;
+        sim_pins ^= 1u << pin;
+        sim_record(pin, level);
+    }
+}
+
+uint32_t gpio_read(uint32_t pin_mask)
+{
+    return sim_pin_input & pin_mask;
+}
+
+void tim_start(HS_TIM_Type *TIMx)
+{
+    if (TIMx == HS_TIM0 && !TIMx->running)
+        sim_grid = sim_now() + TIMx->ARR;
+    TIMx->running = 1;
+}
+
+void tim_stop(HS_TIM_Type *TIMx)
+{
+    TIMx->running = 0;
+}
+
+// The simulation calls stim_control_handler() itself after every tick
+void app_event_set(uint8_t event)
+{
+}
+
+void tim_arr_set(HS_TIM_Type *TIMx, uint16_t value)
+{
+    TIMx->ARR = value;
+}
+
+void dac_out_value_set(uint16_t value)
+{
+    // The DAC latches at the end of the I2C frame
+    sim_busy_us += sim_dac_write_us;
+    if (value != sim_dac) {
+        sim_dac = value;
+        sim_record(SIM_SIG_DAC, value);
+    }
+}
+
+uint8_t adc_del_channel(adc_channel_t inp_gp)
+{
+    (void)inp_gp;
+    return 0;
+}
+
+uint8_t adc_sample_one_channel_irq(adc_channel_t ch_p, adc_callback_t cb)
+{
+    (void)ch_p;
+    if (sim_adc_cb || sim_adc_busy)
+        return 0;
+    sim_adc_cb = cb;
+    return 1;
+}
+
+/*
+ * Voltage on PIN_CURRENT_ACQ while a gate is open: VH - I * Z of the gated
+ * channel, the current regulator cannot pull the node below 0.
+ */
+static void sim_adc_complete(void)
+{
+    adc_callback_t cb = sim_adc_cb;
+    int64_t vnode = 0;
+    uint32_t load = 0;
+    uint8_t ch;
+
+    if (!cb)
+        return;
+    sim_adc_cb = NULL;
+    for (ch = 0; ch < CH_NUM; ch++)
+        if (sim_pins & BITMASK(sim_gate_pin[ch]))
+            load = sim_load_ohm[ch];
+    if (load) {
+        vnode = STIM_MON_VH_MV - (int64_t)sim_dac * load;
+        if (vnode < 0)
+            vnode = 0;
+    }
+    cb(ADC_CHANNEL_EXTERN_CH5, (uint32_t)(vnode / STIM_MON_DIV * 2048 / 800));
+}
+
+void sim_reset(void)
+{
+    uint8_t ch;
+
+    sim_trace.num = 0;
+    sim_isr_start = 0;
+    sim_busy_us = 0;
+    sim_grid = 0;
+    sim_isr_num = 0;
+    sim_pins = 0;
+    sim_dac = 0;
+    sim_pin_input = 0;
+    sim_adc_cb = NULL;
+    sim_adc_busy = 0;
+    for (ch = 0; ch < CH_NUM; ch++)
+        sim_load_ohm[ch] = SIM_LOAD_DEFAULT;
+    memset(&sim_tim0, 0, sizeof(sim_tim0));
+    memset(&sim_tim1, 0, sizeof(sim_tim1));
+    sim_tim0.ARR = 50;
+    sim_tim1.ARR = 250;
+    memset(&emg_wave, 0, sizeof(emg_wave));
+    QUEUE_INIT(emg_a_raw_fifo, emg_a_raw_buf, EMG_BUF_LEN);
+    QUEUE_INIT(emg_b_raw_fifo, emg_b_raw_buf, EMG_BUF_LEN);
+}
+
+uint64_t sim_now(void)
+{
+    return sim_isr_start + sim_busy_us;
+}
+
+uint32_t sim_isr_count(void)
+{
+    return sim_isr_num;
+}
+
+void sim_run_us(uint64_t duration_us)
+{
+    uint64_t end = sim_now() + duration_us;
+    uint64_t start;
+
+    while (sim_tim0.running && sim_grid < end) {
+        if (sim_grid <= sim_now()) {
+            // edges latched while the previous ISR was busy: one pending interrupt
+            start = sim_now();
+            while (sim_grid <= start)
+                sim_grid += sim_tim0.ARR;
+        } else {
+            start = sim_grid;
+            sim_grid += sim_tim0.ARR;
+        }
+        sim_isr_start = start;
+        sim_busy_us = 0;
+        sim_isr_num++;
+        stim_50us_server();
+        sim_adc_complete();
+    }
+    if (sim_now() < end) {
+        sim_isr_start = end;
+        sim_busy_us = 0;
+    }
+}
+
+static const char *sim_sig_name(uint8_t sig)
+{
+    static char name[8];
+
+    switch (sig) {
+        case PIN_STIM_OUT_A:        return "out_a";
+        case PIN_STIM_OUT_B:        return "out_b";
+#if (STIM_CH_NUM > 2)
+        case PIN_STIM_OUT_C:        return "out_c";
+        case PIN_STIM_OUT_D:        return "out_d";
+        case PIN_STIM_DAC_SEL_C:    return "dac_sel_c";
+        case PIN_STIM_DAC_SEL_D:    return "dac_sel_d";
+#endif
+        case PIN_STIM_PWM_L:        return "pwm_l";
+        case PIN_STIM_PWM_H:        return "pwm_h";
+        case PIN_OFF_EN_OR_RELEASE: return "release";
+        case PIN_EMG_OR_STIM_SW:    return "emg_sw";
+        case PIN_LED0:              return "led0";
+        case PIN_LED1:              return "led1";
+        case PIN_LED2:              return "led2";
+        case PIN_LED3:              return "led3";
+        case SIM_SIG_DAC:           return "dac";
+        default:
+            sprintf(name, "p%u", sig);
+            return name;
+    }
+}
+
+void sim_trace_dump_csv(FILE *fp)
+{
+    uint32_t i;
+
+    fprintf(fp, "t_us,signal,value\n");
+    for (i = 0; i < sim_trace.num; i++) {
+        sim_event_t *e = &sim_trace.ev[i];
+        fprintf(fp, "%llu,%s,%u\n", (unsigned long long)e->t_us, sim_sig_name(e->sig), e->value);
+    }
+}
+
+void sim_trace_dump_vcd(FILE *fp)
+{
+    uint32_t i, used = 0;
+    uint64_t last = (uint64_t)-1;
+    int b;
+
+    for (i = 0; i < sim_trace.num; i++)
+        if (sim_trace.ev[i].sig < 32)
+            used |= 1u << sim_trace.ev[i].sig;
+
+    fprintf(fp, "$timescale 1us $end\n$scope module am300 $end\n");
+    for (i = 0; i < 32; i++)
+        if (used & (1u << i))
+            fprintf(fp, "$var wire 1 %c %s $end\n", (char)('!' + i), sim_sig_name(i));
+    fprintf(fp, "$var wire 16 %c dac $end\n", (char)('!' + SIM_SIG_DAC));
+    fprintf(fp, "$upscope $end\n$enddefinitions $end\n#0\n");
+    for (i = 0; i < 32; i++)
+        if (used & (1u << i))
+            fprintf(fp, "0%c\n", (char)('!' + i));
+    fprintf(fp, "b0 %c\n", (char)('!' + SIM_SIG_DAC));
+
+    for (i = 0; i < sim_trace.num; i++) {
+        sim_event_t *e = &sim_trace.ev[i];
+        if (e->t_us != last) {
+            fprintf(fp, "#%llu\n", (unsigned long long)e->t_us);
+            last = e->t_us;
+        }
+        if (e->sig < 32) {
+            fprintf(fp, "%u%c\n", e->value, (char)('!' + e->sig));
+        } else {
+            fprintf(fp, "b");
+            for (b = 15; b >= 0; b--)
+                fputc('0' + ((e->value >> b) & 1), fp);
+            fprintf(fp, " %c\n", (char)('!' + SIM_SIG_DAC));
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef __STIM_SIM_H__
+#define __STIM_SIM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_SIG_DAC     32      // signal id of the DAC, 0~31 are pin numbers
+
+typedef struct {
+    uint64_t t_us;              // simulated time of the transition
+    uint8_t  sig;               // pin number or SIM_SIG_DAC
+    uint16_t value;             // new level / new DAC value
+} sim_event_t;
+
+typedef struct {
+    sim_event_t *ev;
+    uint32_t num;
+    uint32_t size;
+} sim_trace_t;
+
+extern sim_trace_t sim_trace;
+
+// Time consumed by one blocking dac_out_value_set() (bit-banged I2C), 0 is ideal
+extern uint32_t sim_dac_write_us;
+// Level returned by gpio_read(PIN_STIM_OFF)
+extern uint32_t sim_pin_input;
+// GPADC held by a main loop conversion (battery), pulse samples are refused
+extern uint8_t sim_adc_busy;
+// Electrode load of each channel in ohm, 0 is an open circuit
+#define SIM_LOAD_DEFAULT 1000
+extern uint32_t sim_load_ohm[];
+// Output gate pin of each channel, same order as the firmware channel table
+extern const uint8_t sim_gate_pin[];
+
+void sim_reset(void);
+uint64_t sim_now(void);
+uint32_t sim_isr_count(void);
+void sim_run_us(uint64_t duration_us);
+
+void sim_trace_dump_csv(FILE *fp);
+void sim_trace_dump_vcd(FILE *fp);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __UNITTEST_H__
+#define __UNITTEST_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Every test file counts its own failures: CHECK() bumps the file's
+ * fail_num, prints where it failed and leaves the test function. The
+ * file's test_xxx() entry returns fail_num to main().
+ */
+static uint32_t fail_num;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fail_num++; printf("FAIL %s:%d: ", __func__, __LINE__); printf(__VA_ARGS__); printf("\n"); return; } } while (0)
+
+// Test files run from main() after the stimulation sweep
+uint32_t test_protocol(uint32_t *case_num);
+uint32_t test_crc8(uint32_t *case_num);
+uint32_t test_crc(uint32_t *case_num);
+uint32_t test_bulk(uint32_t *case_num);
+uint32_t test_session_log(uint32_t *case_num);
+
+#endif
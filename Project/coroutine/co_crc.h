@@ -0,0 +1,117 @@
+/*********************************************************************
+ * @file co_crc.h
+ * @brief CRC32 (IEEE 802.3), CRC16 (CCITT) and CRC8 (Dallas/Maxim)
+ * @version 1.0
+ * @date 2021/06/28
+ *
+ * @note Each CRC is built as one of the implementations below, selected
+ *       with CO_CRC32_IMPL, CO_CRC16_IMPL and CO_CRC8_IMPL:
+ *
+ *       CO_CRC_IMPL_BITWISE: no table, 8 shifts per byte
+ *       CO_CRC_IMPL_TABLE:   one 256-entry table, 1 lookup per byte
+ *       CO_CRC_IMPL_SLICE4:  4 tables, 4 bytes per step with independent lookups
+ *       CO_CRC_IMPL_SLICE8:  8 tables, 8 bytes per step
+ *
+ *       Table size in flash: 256 * entries * sizeof(crc), e.g. CRC32 slice-by-4 is 4KB.
+ *       All implementations give the same result, unaligned buffers are fine.
+ *
+ *       The default is one table each (1.75KB in all), host builds pass e.g.
+ *       -DCO_CRC32_IMPL=CO_CRC_IMPL_SLICE8 to measure the larger ones.
+ */
+
+#ifndef __CO_CRC_H__
+#define __CO_CRC_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdint.h>
+
+/*********************************************************************
+ * MACROS
+ */
+#define CO_CRC_IMPL_BITWISE     0
+#define CO_CRC_IMPL_TABLE       1
+#define CO_CRC_IMPL_SLICE4      4
+#define CO_CRC_IMPL_SLICE8      8
+
+#ifndef CO_CRC32_IMPL
+#define CO_CRC32_IMPL           CO_CRC_IMPL_TABLE
+#endif
+
+#ifndef CO_CRC16_IMPL
+#define CO_CRC16_IMPL           CO_CRC_IMPL_TABLE
+#endif
+
+#ifndef CO_CRC8_IMPL
+#define CO_CRC8_IMPL            CO_CRC_IMPL_TABLE
+#endif
+
+/* Build every implementation as co_crcXX_<impl>(), for host tests */
+#ifndef CO_CRC_ALL_IMPL
+#define CO_CRC_ALL_IMPL         0
+#endif
+
+/*********************************************************************
+ * EXTERN FUNCTIONS
+ */
+
+/**
+ * @brief co_crc32() IEEE 802.3 (zip, png, nordic DFU), reflected 0xEDB88320
+ *
+ * @param[in] crc  previous result, 0 for the first block
+ * @param[in] buf  data
+ * @param[in] len  data length
+ *
+ * @return crc of all blocks so far
+ **/
+uint32_t co_crc32(uint32_t crc, const void *buf, unsigned len);
+
+/**
+ * @brief co_crc16() CCITT 0x1021 MSB first, same result as co_crc16_ccitt() in ROM
+ *
+ * @param[in] crc  previous result or initial value
+ * @param[in] buf  data
+ * @param[in] len  data length
+ *
+ * @return crc of all blocks so far
+ **/
+uint16_t co_crc16(uint16_t crc, const void *buf, unsigned len);
+
+/**
+ * @brief co_crc8() Dallas/Maxim X^8+X^5+X^4+1, reflected 0x8C
+ *
+ * @param[in] crc  previous result, 0 for the first block
+ * @param[in] buf  data
+ * @param[in] len  data length
+ *
+ * @return crc of all blocks so far, 0 when the buffer ends with its own crc
+ **/
+uint8_t co_crc8(uint8_t crc, const void *buf, unsigned len);
+
+#if CO_CRC_ALL_IMPL
+uint32_t co_crc32_bitwise(uint32_t crc, const void *buf, unsigned len);
+uint32_t co_crc32_table(uint32_t crc, const void *buf, unsigned len);
+uint32_t co_crc32_slice4(uint32_t crc, const void *buf, unsigned len);
+uint32_t co_crc32_slice8(uint32_t crc, const void *buf, unsigned len);
+uint16_t co_crc16_bitwise(uint16_t crc, const void *buf, unsigned len);
+uint16_t co_crc16_table(uint16_t crc, const void *buf, unsigned len);
+uint16_t co_crc16_slice4(uint16_t crc, const void *buf, unsigned len);
+uint16_t co_crc16_slice8(uint16_t crc, const void *buf, unsigned len);
+uint8_t co_crc8_bitwise(uint8_t crc, const void *buf, unsigned len);
+uint8_t co_crc8_table(uint8_t crc, const void *buf, unsigned len);
+uint8_t co_crc8_slice4(uint8_t crc, const void *buf, unsigned len);
+uint8_t co_crc8_slice8(uint8_t crc, const void *buf, unsigned len);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -13,6 +13,10 @@
 
 #include "bsp_adc.h"
 
+// GPADCһֻһͨжϲءEMG缫ѭ̼迹50usʱж
+static volatile uint8_t adc_busy = 0;
+static adc_callback_t adc_user_cb = NULL;
+
 void bsp_adc_config(void)
 {
 	adc_init();
@@ -111,10 +115,41 @@ int16_t Get_sample_adc(adc_channel_t ch_p, adc_callback_t cb)
 }
 
 
-void adc_sample_one_channel_irq(adc_channel_t ch_p, adc_callback_t cb)
+/************************************************
+	@Function			: adc_sample_done
+	@Description	:	жϲɣ߻صͷGPADC
+	@parameter		: ch , ADCͨ
+									adc_data , ADCֵ
+	@Return				: None
+	@Remark				: ADCжִУصɾͨ
+*/
+static void adc_sample_done(uint32_t ch, uint32_t adc_data)
+{
+	if(adc_user_cb != NULL) adc_user_cb(ch, adc_data);
+	adc_busy = 0;
+}
+
+/************************************************
+	@Function			: adc_sample_one_channel_irq
+	@Description	:	ͨжϲ
+	@parameter		: ch_p , ADCͨ
+									cb , ɻصص adc_del_channel
+	@Return				: 1 , ; 0 , GPADCͨʹ
+	@Remark				: ѭжоɵãæʱGPADC
+*/
+uint8_t adc_sample_one_channel_irq(adc_channel_t ch_p, adc_callback_t cb)
 {
 	adc_channel_config_t channel_config;
 	adc_config_t config;
+	uint8_t busy;
+	
+	CO_DISABLE_IRQ();
+	busy = adc_busy;
+	adc_busy = 1;
+	CO_RESTORE_IRQ();
+	if(busy) return 0;
+	
+	adc_user_cb = cb;
 	adc_init_irq();
 	adc_start();
 	
@@ -124,7 +159,7 @@ void adc_sample_one_channel_irq(adc_channel_t ch_p, adc_callback_t cb)
 	config.hw_trigger_sel = ADC_HW_TIMER0_0;
 	adc_config(&config);
 
-	channel_config.callback = cb;
+	channel_config.callback = adc_sample_done;
 	channel_config.inp_gp   = ch_p;
 	channel_config.inn_gp   = ADC_CHANNEL_CHIP_VCM;
 	channel_config.clk_sel  = ADC_CLK_SEL_16MHZ;
@@ -134,6 +169,8 @@ void adc_sample_one_channel_irq(adc_channel_t ch_p, adc_callback_t cb)
 	channel_config.vcm_gp   = ADC_VCM_SEL_000mV;
 	adc_add_channel(&channel_config);
 	adc_start_convert();
+	
+	return 1;
 }
 
 
@@ -20,7 +20,7 @@
 void bsp_adc_config(void);
 int16_t Get_sample_adc(adc_channel_t ch_p, adc_callback_t cb);
 
-void adc_sample_one_channel_irq(adc_channel_t ch_p, adc_callback_t cb);
+uint8_t adc_sample_one_channel_irq(adc_channel_t ch_p, adc_callback_t cb);
 
 #endif
 
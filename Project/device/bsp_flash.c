@@ -0,0 +1,84 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: bsp_flash.c
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20211108
+		1. 20211108		First editon
+		2.
+*/
+
+#include "bsp_flash.h"
+#include "peripheral.h"
+#include "mbr.h"
+
+/************************************************
+	@Function			: flash_store_region
+	@Description	:	ȡӦݴ洢
+	@parameter		: addr , 洢ʼַ룩
+									len , 洢ȣ
+	@Return				: 1 , ɹ; 0 , 洢
+	@Remark				: None
+*/
+uint8_t flash_store_region(uint32_t *addr, uint32_t *len)
+{
+	uint32_t part_addr = 0, part_len = 0;
+	
+	sfs_enable();
+	
+	if(mbr_read_part(PART_TYPE_USR4, &part_addr, &part_len, NULL) < 0)
+	{
+		part_addr = FLASH_STORE_ADDR;
+		part_len = FLASH_STORE_LEN;
+	}
+	
+	// ܲģֻʹ
+	*addr = (part_addr + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+	if(part_addr + part_len < *addr + FLASH_SECTOR_SIZE) return 0;
+	*len = (part_addr + part_len - *addr) & ~(FLASH_SECTOR_SIZE - 1);
+	
+	// δ֪0ʱ
+	return (sfs_capacity() == 0) || (*addr + *len <= sfs_capacity());
+}
+
+/************************************************
+	@Function			: flash_read
+	@Description	:	Flash
+	@parameter		: addr , Flashַ
+									buf , ݻ
+									len , 
+	@Return				: None
+	@Remark				: None
+*/
+void flash_read(uint32_t addr, void *buf, uint32_t len)
+{
+	sfs_read(addr, buf, len);
+}
+
+/************************************************
+	@Function			: flash_write
+	@Description	:	дFlashֻܰ1д0дǰѲ
+	@parameter		: addr , Flashַ
+									buf , 
+									len , ȣҳʱԼ1ms
+	@Return				: None
+	@Remark				: None
+*/
+void flash_write(uint32_t addr, const void *buf, uint32_t len)
+{
+	sfs_write(addr, buf, len);
+}
+
+/************************************************
+	@Function			: flash_erase_sector
+	@Description	:	һ4K
+	@parameter		: addr , ַ
+	@Return				: None
+	@Remark				: Լ50ms
+*/
+void flash_erase_sector(uint32_t addr)
+{
+	sfs_erase(addr & ~(FLASH_SECTOR_SIZE - 1), FLASH_SECTOR_SIZE);
+}
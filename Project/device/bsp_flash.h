@@ -0,0 +1,35 @@
+/**
+	@Company		: Shenzhen Creative Industry Co., Ltd.
+	@Department	: Embedded Software Group
+	@Project		: AM300
+	@File				: bsp_flash.h
+	@Author			: cms
+	@Version		: V0.0.0.1
+	@History		: 20211108
+		1. 20211108		First editon
+		2.
+*/
+
+#ifndef __BSP_FLASH_H__
+#define __BSP_FLASH_H__
+
+#include <stdint.h>
+
+/*
+	Ӧݴ洢ϵͳFlash4KΪλ
+	ʹMBRе PART_TYPE_USR4 MBRûʱʹù̶
+	0x6D000 ~ 0x75000λ0x030000x35000  0x32000ֹ 0x67000֮󡢲0x75000֮ǰ
+	ַ onmicro_dfu_config.h  dfu_image_types޸ľ񲼾ʱͬ鱾
+	д/ڼȼжϱرգsf.c SF_WRITE_BEGINֻѭСֹ̼ͣʱ
+*/
+#define FLASH_SECTOR_SIZE			4096
+#define FLASH_PAGE_SIZE				256
+#define FLASH_STORE_ADDR			0x6D000		// MBRûзʱĬϴ洢
+#define FLASH_STORE_LEN				0x8000		// 8
+
+uint8_t flash_store_region(uint32_t *addr, uint32_t *len);
+void flash_read(uint32_t addr, void *buf, uint32_t len);
+void flash_write(uint32_t addr, const void *buf, uint32_t len);
+void flash_erase_sector(uint32_t addr);
+
+#endif
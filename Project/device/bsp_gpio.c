@@ -51,7 +51,7 @@ void gpio_config(void)
 	
 	// ADC
 	pinmux_config(PIN_EMG_OFF_AD, PINMUX_ANALOG_CH7_PIN7_CFG);
-	pinmux_config(PIN_CURRENT_ACQ, PINMUX_ANALOG_CH1_PIN9_CFG);
+	pinmux_config(PIN_CURRENT_ACQ, PINMUX_ANALOG_CH4_PIN10_CFG);
 	pinmux_config(PIN_BAT_AD, PINMUX_ANALOG_CH1_PIN9_CFG);
 	
 	// STIM OFF
@@ -75,6 +75,12 @@ void gpio_config(void)
 	gpio_pin_config(PIN_EMG_OR_STIM_SW, GPIO_OUTPUT, PMU_PIN_MODE_PP);	
 	gpio_pin_config(PIN_STIM_OUT_B, GPIO_OUTPUT, PMU_PIN_MODE_PP);
 	gpio_pin_config(PIN_STIM_OUT_A, GPIO_OUTPUT, PMU_PIN_MODE_PP);	
+#ifdef PIN_STIM_OUT_C  // 4ͨӲ
+	gpio_pin_config(PIN_STIM_OUT_C, GPIO_OUTPUT, PMU_PIN_MODE_PP);
+	gpio_pin_config(PIN_STIM_OUT_D, GPIO_OUTPUT, PMU_PIN_MODE_PP);
+	gpio_pin_config(PIN_STIM_DAC_SEL_C, GPIO_OUTPUT, PMU_PIN_MODE_PP);
+	gpio_pin_config(PIN_STIM_DAC_SEL_D, GPIO_OUTPUT, PMU_PIN_MODE_PP);
+#endif
 	gpio_pin_config(PIN_OFF_EN_OR_RELEASE, GPIO_OUTPUT, PMU_PIN_MODE_PP);	
 
 #ifndef CONFIG_LOG_OUTPUT
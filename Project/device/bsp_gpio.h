@@ -42,7 +42,7 @@
 // STIM Lead off Pin
 #define PIN_STIM_OFF						9 //10
 
-// STIM Current check ADC_CH5
+// STIM Current check ADC_CH4
 #define PIN_CURRENT_ACQ					10 //11
 
 // Battery Voltage check ADC_CH6
@@ -61,6 +61,8 @@
 #define PIN_EMG_OR_STIM_SW			30 //20
 #define PIN_STIM_OUT_B					17 //21
 #define PIN_STIM_OUT_A					15 //25
+// 4ͨӲSTIM_CH_NUM=4ڴ˶ PIN_STIM_OUT_C/D  DAC л PIN_STIM_DAC_SEL_C/D
+// ǰӲֻA/B·δʱ STIM_CH_NUM>2 뱨
 
 // Battery Charging Status Pin					
 #define PIN_CHG_ON							31 //22
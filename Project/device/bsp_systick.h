@@ -20,6 +20,7 @@ extern volatile uint32_t systick_cnt;
 #define TICK_OUT			(1000* 60 * 30)   // max count 30min
 #define TICK_NOW			(systick_cnt)
 #define TICK_INC			(systick_cnt > TICK_OUT ? systick_cnt = 0 : systick_cnt++)
+#define TICK_ADD(_ms)		(systick_cnt = (systick_cnt + (uint32_t)(_ms)) % TICK_OUT)   // ˯ڼSysTickֹͣѺ󲹳
 
 #define TICK_X10MS(_x10ms)		(((uint32_t)_x10ms) * 100)
 #define TICK_nS(_ns)					((uint32_t)_ns * 1000)
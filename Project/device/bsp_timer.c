@@ -13,6 +13,7 @@
 
 #include "bsp_timer.h"
 #include "bsp_spi.h"
+#include "main.h"
 #include "emg_wave.h"
 #include "stim_control.h"
 
@@ -44,11 +45,12 @@ void tim_timer_handler(void)
 	@Description	:	ʱ1жϴ
 	@parameter		: None
 	@Return				: None
-	@Remark				: None
+	@Remark				: ֪ͨѭEMG
 */
 void tim_timer_handler1(void)
 {
 	get_emg_raw_adc_value();
+	app_event_set(APP_EVENT_EMG);
 	
 //	GLOBAL_INT_STOP();
 //	stim_50us_server();
@@ -34,6 +34,7 @@
 #include "nordic_dfu_task.h"
 #include "prf_utils.h"
 #include "co_utils.h"
+#include "co_crc.h"
 #include "mbr.h"
 #include "sha256.h"
 #include "pb_common.h"
@@ -153,7 +154,6 @@ static uint32_t          m_dfu_cache_crc;
  ****************************************************************************************
  */
 static  uint16_t calc_dfu_crc16(uint32_t in_addr, uint32_t in_len);
-static  uint32_t calc_dfu_crc32(uint8_t const * p_data, uint32_t size, uint32_t const * p_crc);
 static uint8_t dfu_update_cmd_init(uint32_t data_obj_size)
 {
     if(data_obj_size <= DFU_COMMAND_OBJ_MAX_SIZE)
@@ -344,7 +344,7 @@ static void dfu_update_app_data(uint8_t *data, uint16_t len, uint32_t offset)
                 sfs_enable();
                 sfs_write(write_addr, m_dfu_cache, m_dfu_cache_len); //update config in flash
                 m_dfu_cache_offset += m_dfu_cache_len;
-                m_dfu_cache_crc = calc_dfu_crc32(m_dfu_cache, m_dfu_cache_len, &m_dfu_cache_crc);
+                m_dfu_cache_crc = co_crc32(m_dfu_cache_crc, m_dfu_cache, m_dfu_cache_len);
                 sha256_update(&m_dfu_data_hash_ctx, m_dfu_cache, m_dfu_cache_len);
                 m_dfu_cache_len = 0;
             }
@@ -361,7 +361,7 @@ static void dfu_update_app_data(uint8_t *data, uint16_t len, uint32_t offset)
                     sfs_enable();
                     sfs_write(write_addr, m_dfu_cache, m_dfu_cache_len); //update app in flash
                     m_dfu_cache_offset += m_dfu_cache_len;
-                    m_dfu_cache_crc = calc_dfu_crc32(m_dfu_cache, m_dfu_cache_len, &m_dfu_cache_crc);
+                    m_dfu_cache_crc = co_crc32(m_dfu_cache_crc, m_dfu_cache, m_dfu_cache_len);
                     sha256_update(&m_dfu_data_hash_ctx, m_dfu_cache, m_dfu_cache_len);
                     m_dfu_cache_len = 0;
                 }
@@ -376,7 +376,7 @@ static void dfu_update_app_data(uint8_t *data, uint16_t len, uint32_t offset)
                     sfs_enable();
                     sfs_write(write_addr, m_dfu_cache, m_dfu_cache_len); //update patch in flash
                     m_dfu_cache_offset += m_dfu_cache_len;
-                    m_dfu_cache_crc = calc_dfu_crc32(m_dfu_cache, m_dfu_cache_len, &m_dfu_cache_crc);
+                    m_dfu_cache_crc = co_crc32(m_dfu_cache_crc, m_dfu_cache, m_dfu_cache_len);
                     sha256_update(&m_dfu_data_hash_ctx, m_dfu_cache, m_dfu_cache_len);
                     m_dfu_cache_len = 0;
                 }
@@ -397,7 +397,7 @@ static uint8_t dfu_update_app_finish(void)
             memset(m_dfu_cache, 0x5F, len);
             sfs_enable();
             sfs_read((m_new_cfg_base_addr+i), (void *)m_dfu_cache, len);
-            m_dfu_cache_crc = calc_dfu_crc32(m_dfu_cache, len, &m_dfu_cache_crc);
+            m_dfu_cache_crc = co_crc32(m_dfu_cache_crc, m_dfu_cache, len);
         }
     }
     else
@@ -410,7 +410,7 @@ static uint8_t dfu_update_app_finish(void)
                 memset(m_dfu_cache, 0x5F, len);
                 sfs_enable();
                 sfs_read((m_new_app_base_addr+i), (void *)m_dfu_cache, len);
-                m_dfu_cache_crc = calc_dfu_crc32(m_dfu_cache, len, &m_dfu_cache_crc);
+                m_dfu_cache_crc = co_crc32(m_dfu_cache_crc, m_dfu_cache, len);
             }
         }
         if(m_new_patch_size > 0)   // update app data
@@ -421,7 +421,7 @@ static uint8_t dfu_update_app_finish(void)
                 memset(m_dfu_cache, 0x5F, len);
                 sfs_enable();
                 sfs_read((m_new_patch_base_addr+i), (void *)m_dfu_cache, len);
-                m_dfu_cache_crc = calc_dfu_crc32(m_dfu_cache, len, &m_dfu_cache_crc);
+                m_dfu_cache_crc = co_crc32(m_dfu_cache_crc, m_dfu_cache, len);
             }
         }
     }
@@ -484,18 +484,6 @@ static uint8_t dfu_update_app_finish(void)
 }
 
 
-static  uint32_t calc_dfu_crc32(uint8_t const * p_data, uint32_t size, uint32_t const * p_crc)
-{
-    uint32_t crc;
-    crc = (p_crc == NULL) ? 0xFFFFFFFF : ~(*p_crc);
-    for (uint32_t i = 0; i < size; i++)
-    {
-        crc = crc ^ p_data[i];
-        for (uint32_t j = 8; j > 0; j--) crc = (crc >> 1) ^ (0xEDB88320U & ((crc & 1) ? 0xFFFFFFFF : 0));
-    }
-    return ~crc;
-}
-
 static  uint16_t calc_dfu_crc16(uint32_t in_addr, uint32_t in_len)
 {
     uint32_t buffer[256/4];
@@ -511,7 +499,7 @@ static  uint16_t calc_dfu_crc16(uint32_t in_addr, uint32_t in_len)
         if(read_size > in_len - len)
             read_size = in_len - len;
         sfs_read( addr, (void *)buffer, read_size); //alignment for dual/quad read
-        crc16 = co_crc16_ccitt(crc16, buffer, read_size);
+        crc16 = co_crc16(crc16, buffer, read_size);
     }
 
     return crc16;
@@ -823,7 +811,7 @@ __STATIC int gattc_write_req_ind_handler(ke_msg_id_t const msgid, struct gattc_w
                 {
                     break;
                 }
-                (*crc32) = calc_dfu_crc32(data, len, crc32);
+                (*crc32) = co_crc32(*crc32, data, len);
                 (*offset) += len;
                 m_recv_pkg_cnt++;
                 //dfu_debug("PKG:%d\n", *offset);
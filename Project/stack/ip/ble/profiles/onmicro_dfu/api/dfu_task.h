@@ -56,6 +56,10 @@ enum onmicro_dfu_msg_id
     ONMICRO_DFU_ENABLE_REQ = TASK_FIRST_MSG(TASK_ID_ONMICRO_DFU),//!< ONMICRO_DFU_ENABLE_REQ
     /// Delay Timer
     ONMICRO_DFU_END_TIMER,//!< ONMICRO_DFU_END_TIMER
+    /// Erase/write received data in the background
+    ONMICRO_DFU_FLASH_IND,//!< ONMICRO_DFU_FLASH_IND
+    /// Verify the command object signature in the background
+    ONMICRO_DFU_SIGN_IND, //!< ONMICRO_DFU_SIGN_IND
 };
 
 /// @} ONMICRO_DFUSTASK
@@ -116,6 +116,50 @@ __STATIC int gattc_att_info_req_ind_handler(ke_msg_id_t const msgid,
  * @return If the message was consumed or not.
  ****************************************************************************************
  */
+static bool flash_ind_pending;
+/// Erase/write the received data from the task queue, one step per message
+static void dfu_flash_schedule(ke_task_id_t const task)
+{
+    if(!flash_ind_pending && dfu_flash_pending()){
+        flash_ind_pending = true;
+        ke_msg_send_basic(ONMICRO_DFU_FLASH_IND, task, task);
+    }
+}
+
+__STATIC int onmicro_dfu_flash_ind_handler(ke_msg_id_t const msgid, void const *param,
+                                           ke_task_id_t const dest_id, ke_task_id_t const src_id)
+{
+    flash_ind_pending = false;
+    if(dfu_flash_process()){
+        dfu_flash_schedule(dest_id);
+    }
+    return (KE_MSG_CONSUMED);
+}
+
+static bool sign_ind_pending;
+/// Verify the signature from the task queue, one step per message so the link keeps running.
+/// The message comes from the GATT task of the connection, the EXECUTE response goes back to it.
+static void dfu_sign_schedule(ke_task_id_t const task, ke_task_id_t const gattc)
+{
+    if(!sign_ind_pending && dfu_sign_pending()){
+        sign_ind_pending = true;
+        ke_msg_send_basic(ONMICRO_DFU_SIGN_IND, task, gattc);
+    }
+}
+
+__STATIC int onmicro_dfu_sign_ind_handler(ke_msg_id_t const msgid, void const *param,
+                                          ke_task_id_t const dest_id, ke_task_id_t const src_id)
+{
+    dfu_response_t dfu_rsp_data = {0};
+    sign_ind_pending = false;
+    if(dfu_sign_process(&dfu_rsp_data)){
+        dfu_response(&dfu_rsp_data, dest_id, src_id);
+    }else{
+        dfu_sign_schedule(dest_id, src_id);
+    }
+    return (KE_MSG_CONSUMED);
+}
+
 __STATIC int gattc_write_req_ind_handler(ke_msg_id_t const msgid, struct gattc_write_req_ind const *param,
         ke_task_id_t const dest_id, ke_task_id_t const src_id)
 {
@@ -141,7 +185,10 @@ __STATIC int gattc_write_req_ind_handler(ke_msg_id_t const msgid, struct gattc_w
         dfu_response_t dfu_rsp_data = {0};
         if(att_idx == ONMICRO_DFU_IDX_CTRL_VAL){
             dfu_write_cmd(data, len, &dfu_rsp_data);
-            dfu_response(&dfu_rsp_data, dest_id, src_id);
+            if(dfu_rsp_data.length != DFU_RESP_SIZE_NO_DATA){
+                dfu_response(&dfu_rsp_data, dest_id, src_id);
+            }
+            dfu_sign_schedule(dest_id, src_id);
         }else if(att_idx == ONMICRO_DFU_IDX_PKG_VAL){
             dfu_write_data(data, len, &dfu_rsp_data);
             if(dfu_rsp_data.length != DFU_RESP_SIZE_NO_DATA){
@@ -158,6 +205,7 @@ __STATIC int gattc_write_req_ind_handler(ke_msg_id_t const msgid, struct gattc_w
             dfu_write_version_char(cmd, &version);
             dfu_response_version(&version, dest_id, src_id);
         }
+        dfu_flash_schedule(dest_id);
     }
     return KE_MSG_CONSUMED;
 }
@@ -261,6 +309,8 @@ KE_MSG_HANDLER_TAB(onmicro_dfu)
     {GATTC_CMP_EVT,                 (ke_msg_func_t) gattc_cmp_evt_handler},
     {GATTC_MTU_CHANGED_IND,         (ke_msg_func_t) gattc_mtu_changed_handler},
     {ONMICRO_DFU_END_TIMER,         (ke_msg_func_t) onmicro_dfu_end_timer_handler},
+    {ONMICRO_DFU_FLASH_IND,         (ke_msg_func_t) onmicro_dfu_flash_ind_handler},
+    {ONMICRO_DFU_SIGN_IND,          (ke_msg_func_t) onmicro_dfu_sign_ind_handler},
 };
 
 void onmicro_dfu_task_init(struct ke_task_desc *task_desc)
@@ -11,12 +11,15 @@
 #include "onmicro_dfu.h"
 #include "onmicro_dfu_config.h"
 #include "onmicro_dfu_nvds.h"
+#include "onmicro_dfu_decode.h"
+#include "co_crc.h"
 #if (DFU_CTRL_SIGN_EN)
 #include "uECC.h"
 #include "sha256.h"
 #define ECC_TYPE uECC_secp192r1()
 #define PRIV_KEY_SIZE 24
 extern uint8_t dfu_public_key[];
+extern uint8_t dfu_public_key_sum[];
 #elif  DFU_FORCE_CHECK_SHA256_EN
 #include "sha256.h"
 #define PRIV_KEY_SIZE 24
@@ -33,6 +36,10 @@ extern uint8_t dfu_public_key[];
 #define dfu_debug_array_ex(...)
 #endif
 
+#ifndef MIN
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#endif
+
 #define DFU_PKG_ACTIVED_NONE 0
 #define DFU_PKG_ACTIVED_CMD  1
 #define DFU_PKG_ACTIVED_DATA 2
@@ -59,6 +66,16 @@ typedef struct {
     uint32_t size;
 }dfu_cmd_raw_t;
 
+// Follows the image list when DFU_CTRL_BIT_ENCODED is set, one per image
+typedef struct {
+    uint32_t encoding:8;       // @ref DFU_IMG_ENC_NONE
+    uint32_t window_sz2:4;     // LZ
+    uint32_t lookahead_sz2:4;  // LZ
+    uint32_t base_crc16:16;    // DELTA: CRC16 of the installed image in MBR
+    uint32_t data_size;        // size in the data object, dfu_cmd_img_t.size is the decoded size
+    uint32_t base_size;        // DELTA: size of the installed image in MBR
+}dfu_cmd_enc_t;
+
 typedef struct {
     uint8_t     *cmd_obj_buffer;
     uint32_t     obj_size;
@@ -70,6 +87,7 @@ typedef struct {
     int8_t       cmd_img_idx;
     uint32_t     cmd_img_size;
     uint32_t     cmd_img_recv_len;
+    uint32_t     cmd_img_out_len; // decoded
     uint32_t     cmd_img_new_addr;
     const dfu_image_t *cmd_img_info;
     const dfu_nvds_itf_t *image_ops_itf;
@@ -78,10 +96,43 @@ typedef struct {
     uint16_t     cache_recv_len;
 }dfu_env_t;
 
+// Digests of the data object, updated as each cache block is written to flash
+typedef struct {
+    uint16_t     crc16[IMAGE_TYPE_MBR_MAX]; // system images, stored in MBR
+#if (DFU_CTRL_SIGN_EN | DFU_FORCE_CHECK_SHA256_EN)
+    SHA256_CTX   sha256;                    // all images
+#endif
+}dfu_digest_t;
+
 static dfu_env_t *p_env, env;
 static uint32_t m_data_crc;
 static uint32_t m_data_offset;
-__ALIGNED(16) static uint8_t m_cache[DFU_CACHE_BUF_SIZE];
+static dfu_digest_t m_digest;
+
+// Cache blocks waiting for flash, written by dfu_flash_process()
+typedef struct {
+    uint32_t     addr;
+    uint16_t     len;
+    uint8_t      type;
+    int8_t       img_idx;
+    const dfu_nvds_itf_t *itf;
+}dfu_cache_blk_t;
+
+__ALIGNED(16) static uint8_t m_cache[DFU_CACHE_BUF_NUM][DFU_CACHE_BUF_SIZE];
+static dfu_cache_blk_t m_cache_blk[DFU_CACHE_BUF_NUM];
+static uint8_t m_cache_in, m_cache_out; // free running, in - out: blocks waiting for flash
+
+// Images are erased ahead of the data, one DFU_ERASE_STEP_SIZE per step
+static int8_t   m_erase_img;
+static uint32_t m_erase_addr;
+static uint32_t m_erase_end;
+static const dfu_nvds_itf_t *m_erase_itf;
+
+static dfu_decoder_t m_decoder;
+static bool m_decode_err;
+// Encoded data is decoded by dfu_flash_process(), not in the write handler
+static uint8_t m_dec_in[DFU_DECODE_IN_SIZE];
+static uint16_t m_dec_in_len, m_dec_in_pos;
 __ALIGNED(4) static uint8_t m_cmd_buf[DFU_COMMAND_OBJ_MAX_SIZE];
 
 
@@ -109,15 +160,69 @@ static dfu_env_t* dfu_env_init(void)
     return p_env;
 }
 
-static  uint32_t dfu_crc32(uint8_t const * p_data, uint32_t size, uint32_t const * p_crc)
+static void dfu_digest_reset(void)
 {
-    uint32_t crc;
-    crc = (p_crc == NULL) ? 0xFFFFFFFF : ~(*p_crc);
-    for (uint32_t i = 0; i < size; i++){
-        crc = crc ^ p_data[i];
-        for (uint32_t j = 8; j > 0; j--) crc = (crc >> 1) ^ (0xEDB88320U & ((crc & 1) ? 0xFFFFFFFF : 0));
+    m_data_crc = 0;
+    memset(m_digest.crc16, 0, sizeof(m_digest.crc16));
+#if (DFU_CTRL_SIGN_EN | DFU_FORCE_CHECK_SHA256_EN)
+    sha256_init(&m_digest.sha256);
+#endif
+}
+
+static void dfu_digest_update(uint8_t type, uint8_t const *data, uint32_t len)
+{
+    m_data_crc = co_crc32(m_data_crc, data, len);
+    if(type < IMAGE_TYPE_MBR_MAX){
+        m_digest.crc16[type] = co_crc16(m_digest.crc16[type], data, len);
     }
-    return ~crc;
+#if (DFU_CTRL_SIGN_EN | DFU_FORCE_CHECK_SHA256_EN)
+    sha256_update(&m_digest.sha256, data, len);
+#endif
+}
+
+// Encoding of image idx, NULL if the image is sent as is
+static dfu_cmd_enc_t *get_img_enc(uint8_t *cmd, int idx)
+{
+    uint16_t ctrl_flag = *(uint16_t*)&cmd[DFU_CMDPKG_OFFSET_CTRL];
+    uint16_t img_cnt = *(uint16_t*)&cmd[DFU_CMDPKG_OFFSET_IMGCNT];
+    if(!(ctrl_flag & DFU_CTRL_BIT_ENCODED)){
+        return NULL;
+    }
+    dfu_cmd_enc_t *encs = (dfu_cmd_enc_t*)&cmd[DFU_CMDPKG_OFFSET_PKG + sizeof(dfu_cmd_img_t) * img_cnt];
+    return encs[idx].encoding == DFU_IMG_ENC_NONE ? NULL : &encs[idx];
+}
+
+static bool is_cmd_encoded(uint8_t *cmd)
+{
+    uint16_t i, img_cnt = *(uint16_t*)&cmd[DFU_CMDPKG_OFFSET_IMGCNT];
+    for(i=0;i<img_cnt;i++){
+        if(get_img_enc(cmd, i)){
+            return true;
+        }
+    }
+    return false;
+}
+
+// Size of image idx in the data object
+static uint32_t get_img_data_size(uint8_t *cmd, int idx)
+{
+    dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&cmd[DFU_CMDPKG_OFFSET_PKG];
+    dfu_cmd_enc_t *enc = get_img_enc(cmd, idx);
+    return enc ? enc->data_size : imgs[idx].size;
+}
+
+// The installed system image a delta applies to
+static bool get_installed_img_info(dfu_cmd_img_t *img, dfu_image_mbr_info *info)
+{
+    if(img->type >= IMAGE_TYPE_MBR_MAX){
+        return false;
+    }
+    const dfu_nvds_itf_t *mbr_itf = &dfu_nvds_itf[DFU_NVDS_ITF_TYPE_MBR];
+    uint32_t len = sizeof(dfu_image_mbr_info);
+    mbr_itf->enable();
+    uint8_t res = mbr_itf->get(img->type, &len, info);
+    mbr_itf->disable();
+    return res == ONMICRO_DFU_NVDS_ST_SUCCESS;
 }
 
 static uint32_t get_new_img_address(dfu_cmd_img_t *img, const dfu_image_t *cmd_img_info)
@@ -162,13 +267,16 @@ static uint32_t get_new_img_address(dfu_cmd_img_t *img, const dfu_image_t *cmd_i
     return new_addr;
 }
 
+static void write_image_out(const uint8_t *data, uint32_t len);
+
 static void update_env_img_info_by_idx(void)
 {
     uint8_t *cmd = p_env->cmd_obj_buffer;
     dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&cmd[DFU_CMDPKG_OFFSET_PKG];
     dfu_cmd_img_t *img = &imgs[p_env->cmd_img_idx];
-    p_env->cmd_img_size = img->size;
+    p_env->cmd_img_size = get_img_data_size(cmd, p_env->cmd_img_idx);
     p_env->cmd_img_recv_len = 0;
+    p_env->cmd_img_out_len = 0;
     int j;
     if(img->type == IMAGE_TYPE_RAW){
         p_env->cmd_img_info = NULL;
@@ -194,12 +302,218 @@ static void update_env_img_info_by_idx(void)
     }
     dfu_debug("Flashing new_addr:0x%08X, size: %d (%s)\n",
                 p_env->cmd_img_new_addr, img->size, img->type==IMAGE_TYPE_RAW?"Raw Data":p_env->cmd_img_info->describe);
+    dfu_cmd_enc_t *enc = get_img_enc(cmd, p_env->cmd_img_idx);
+    m_dec_in_len = m_dec_in_pos = 0;
+    if(enc){
+        if(dfu_decode_init(&m_decoder, enc->encoding, enc->window_sz2, enc->lookahead_sz2, write_image_out) != DFU_DECODE_OK){
+            m_decode_err = true;
+        }
+        if(enc->encoding & DFU_IMG_ENC_DELTA){
+            dfu_image_mbr_info info;
+            if(get_installed_img_info(img, &info)){
+                dfu_decode_set_base(&m_decoder, p_env->image_ops_itf, info.address, info.length);
+            }else{
+                m_decode_err = true;
+            }
+        }
+        dfu_debug("Decoding %d bytes, encoding: 0x%02X\n", enc->data_size, enc->encoding);
+    }
+}
+
+static uint32_t get_img_address_itf(dfu_cmd_img_t *img, const dfu_nvds_itf_t **itf)
+{
+    int j;
+    *itf = NULL;
+    if(img->type == IMAGE_TYPE_RAW){
+        dfu_image_t raw_img_info = {
+            IMAGE_TYPE_RAW,
+            ((dfu_cmd_raw_t*)img)->new_address,
+            ((dfu_cmd_raw_t*)img)->new_address,
+        };
+        if(((dfu_cmd_raw_t*)img)->nvds_itf_type < DFU_NVDS_ITF_TYPE_MAX){
+            *itf = &dfu_nvds_itf[((dfu_cmd_raw_t*)img)->nvds_itf_type];
+        }
+        return get_new_img_address(img, &raw_img_info);
+    }
+    for(j=0;j<dfu_image_types_num;j++){
+        if(img->type == dfu_image_types[j].type){
+            *itf = dfu_image_types[j].image_ops_itf;
+            return get_new_img_address(img, &dfu_image_types[j]);
+        }
+    }
+    return 0;
+}
+
+static void dfu_erase_reset(void)
+{
+    m_erase_img = -1;
+    m_erase_addr = m_erase_end = 0;
+    m_erase_itf = NULL;
+}
+
+// Erase the next DFU_ERASE_STEP_SIZE (or up to its boundary), false when all images are erased
+static bool dfu_erase_step(void)
+{
+    uint16_t img_cnt = *(uint16_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_IMGCNT];
+    dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_PKG];
+    while(m_erase_addr >= m_erase_end){ // Current image erased, go on with the next one
+        if(m_erase_img + 1 >= img_cnt){
+            return false;
+        }
+        m_erase_img++;
+        m_erase_addr = get_img_address_itf(&imgs[m_erase_img], &m_erase_itf);
+        m_erase_end = m_erase_addr + imgs[m_erase_img].size;
+        dfu_debug("Erasing 0x%08X-0x%08X\n", m_erase_addr, m_erase_end);
+    }
+    uint32_t len = MIN(DFU_ERASE_STEP_SIZE - (m_erase_addr & (DFU_ERASE_STEP_SIZE - 1)), m_erase_end - m_erase_addr);
+    if(m_erase_itf){
+        m_erase_itf->enable();
+        m_erase_itf->del(m_erase_addr, len);
+        m_erase_itf->disable();
+    }
+    m_erase_addr += len;
+    return true;
+}
+
+// Encoded data of the current image not decoded yet
+static bool dfu_decode_busy(void)
+{
+    return !m_decode_err && (m_dec_in_pos < m_dec_in_len || dfu_decode_pending(&m_decoder));
+}
+
+// Decode up to DFU_DECODE_STEP_SIZE bytes, false when there is nothing to decode
+static bool dfu_decode_step(void)
+{
+    if(!dfu_decode_busy()){
+        return false;
+    }
+    int32_t n = dfu_decode_feed(&m_decoder, &m_dec_in[m_dec_in_pos], m_dec_in_len - m_dec_in_pos, DFU_DECODE_STEP_SIZE);
+    if(n < 0){
+        dfu_debug("Decoding failed at 0x%08X\n", p_env->cmd_img_out_len);
+        m_decode_err = true;
+        n = m_dec_in_len - m_dec_in_pos;
+    }
+    m_dec_in_pos += n;
+    if(m_dec_in_pos == m_dec_in_len){
+        m_dec_in_len = m_dec_in_pos = 0;
+    }
+    return true;
+}
+
+// Queue encoded data for dfu_flash_process(), decoded here only when the decoder falls a full queue behind
+static void dfu_decode_queue(const uint8_t *data, uint32_t len)
+{
+    while(len && !m_decode_err){
+        if(m_dec_in_len == sizeof(m_dec_in) && m_dec_in_pos){
+            m_dec_in_len -= m_dec_in_pos;
+            memmove(m_dec_in, &m_dec_in[m_dec_in_pos], m_dec_in_len);
+            m_dec_in_pos = 0;
+        }
+        if(m_dec_in_len == sizeof(m_dec_in)){
+            dfu_decode_step();
+            continue;
+        }
+        uint32_t n = MIN(len, sizeof(m_dec_in) - m_dec_in_len);
+        memcpy(&m_dec_in[m_dec_in_len], data, n);
+        m_dec_in_len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+bool dfu_flash_pending(void)
+{
+    if(!p_env || !p_env->cmd_obj_buffer || p_env->obj_actived != DFU_PKG_ACTIVED_DATA){
+        return false;
+    }
+    uint16_t img_cnt = *(uint16_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_IMGCNT];
+    return m_cache_in != m_cache_out || dfu_decode_busy() || m_erase_addr < m_erase_end || m_erase_img + 1 < img_cnt;
+}
+
+bool dfu_flash_process(void)
+{
+    if(!dfu_flash_pending()){
+        return false;
+    }
+    if(m_cache_in != m_cache_out){
+        uint8_t idx = m_cache_out % DFU_CACHE_BUF_NUM;
+        dfu_cache_blk_t *blk = &m_cache_blk[idx];
+        // The block's sectors must be erased first
+        while(m_erase_img < blk->img_idx || (m_erase_img == blk->img_idx && m_erase_addr < blk->addr + blk->len)){
+            if(!dfu_erase_step()){
+                break;
+            }
+        }
+        blk->itf->enable();
+        blk->itf->put(blk->addr, blk->len, m_cache[idx]);
+        blk->itf->disable();
+        dfu_digest_update(blk->type, m_cache[idx], blk->len);
+        m_data_offset += blk->len;
+        m_cache_out++;
+    }else if(!dfu_decode_step()){ // Decoded only with all cache blocks free, never nested in write_image_out()
+        dfu_erase_step(); // Link idle, erase ahead
+    }
+    return dfu_flash_pending();
+}
+
+// Decode and write all queued data, the erase ahead goes on in dfu_flash_process()
+static void dfu_flash_flush(void)
+{
+    while((m_cache_in != m_cache_out || dfu_decode_busy()) && dfu_flash_process());
+}
+
+// Decoded data of the current image to the cache blocks
+static void write_image_out(const uint8_t *data, uint32_t len)
+{
+    dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_PKG];
+    uint32_t img_size = imgs[p_env->cmd_img_idx].size;
+    while(len){
+        if(p_env->cmd_img_out_len == img_size){ // Decoded data exceeds the image
+            m_decode_err = true;
+            break;
+        }
+        if(p_env->cache_recv_len == 0){ // Need a free cache block
+            while((uint8_t)(m_cache_in - m_cache_out) >= DFU_CACHE_BUF_NUM){
+                dfu_flash_process();
+            }
+        }
+        // Copy data to m_cache
+        uint8_t *cache = m_cache[m_cache_in % DFU_CACHE_BUF_NUM];
+        uint32_t remain_cache = DFU_CACHE_BUF_SIZE - p_env->cache_recv_len;
+        uint32_t remain_image = img_size - p_env->cmd_img_out_len;
+        uint32_t copy2cache_len = MIN(MIN(len, remain_cache), remain_image);
+        memcpy(&cache[p_env->cache_recv_len], data, copy2cache_len);
+        data += copy2cache_len;
+        len -= copy2cache_len;
+        p_env->cache_recv_len += copy2cache_len;
+        p_env->cmd_img_out_len += copy2cache_len;
+
+        // Queue m_cache for flash
+        if(p_env->cache_recv_len == DFU_CACHE_BUF_SIZE || p_env->cmd_img_out_len == img_size){
+            dfu_cache_blk_t *blk = &m_cache_blk[m_cache_in % DFU_CACHE_BUF_NUM];
+            blk->addr = p_env->cmd_img_new_addr+p_env->cmd_img_out_len-p_env->cache_recv_len;
+            blk->len = p_env->cache_recv_len;
+            blk->type = imgs[p_env->cmd_img_idx].type;
+            blk->img_idx = p_env->cmd_img_idx;
+            blk->itf = p_env->image_ops_itf;
+            m_cache_in++;
+            p_env->cache_recv_len = 0;
+        }
+    }
+}
+
+// Current image decoded completely
+static bool is_img_out_done(void)
+{
+    dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_PKG];
+    if(m_decode_err || p_env->cmd_img_out_len != imgs[p_env->cmd_img_idx].size){
+        return false;
+    }
+    return !get_img_enc(p_env->cmd_obj_buffer, p_env->cmd_img_idx) || dfu_decode_done(&m_decoder);
 }
+
 static void write_image_data(uint8_t *data, uint32_t len)
 {
-#ifndef MIN
-#define MIN(a,b) ((a)<(b)?(a):(b))
-#endif
     uint32_t pos = 0;
     while(pos < len){
         if(p_env->cmd_img_size == p_env->cmd_img_recv_len){ // Current image received done.
@@ -207,38 +521,24 @@ static void write_image_data(uint8_t *data, uint32_t len)
             if(img_cnt == p_env->cmd_img_idx + 1){ // All images received done.
                 break;
             }
+            while(dfu_decode_step()); // The next image has its own decoder
+            if(p_env->cmd_img_idx >= 0 && !is_img_out_done()){
+                m_decode_err = true;
+            }
             p_env->cmd_img_idx++;
             update_env_img_info_by_idx();
             p_env->cache_recv_len = 0;
         }
-        // Copy data to m_cache
         uint32_t remain_data = len - pos;
-        uint32_t remain_cache = DFU_CACHE_BUF_SIZE - p_env->cache_recv_len;
         uint32_t remain_image = p_env->cmd_img_size - p_env->cmd_img_recv_len;
-        uint32_t copy2cache_len = MIN(MIN(remain_data, remain_cache), remain_image);
-        memcpy(&m_cache[p_env->cache_recv_len], &data[pos], copy2cache_len);
-        pos += copy2cache_len;
-        p_env->cache_recv_len += copy2cache_len;
-        p_env->cmd_img_recv_len += copy2cache_len;
-
-        // Write m_cache to flash
-        if(p_env->cache_recv_len == DFU_CACHE_BUF_SIZE || p_env->cmd_img_recv_len == p_env->cmd_img_size){
-            const dfu_nvds_itf_t *write_itf = p_env->image_ops_itf;
-            write_itf->enable();
-            uint32_t write_addr = p_env->cmd_img_new_addr+p_env->cmd_img_recv_len-p_env->cache_recv_len;
-#if FLASH_ERASE_SIZE
-            uint32_t erase_addr = (write_addr + FLASH_ERASE_SIZE - 1) & ~(FLASH_ERASE_SIZE - 1);
-            for(;erase_addr < write_addr + p_env->cache_recv_len;erase_addr += FLASH_ERASE_SIZE){
-                dfu_debug("Erasing 0x%08X-0x%08X (%s)\n", erase_addr, erase_addr+FLASH_ERASE_SIZE, p_env->cmd_img_info->describe);
-                write_itf->del(erase_addr, FLASH_ERASE_SIZE);
-            }
-#endif
-            write_itf->put(write_addr, p_env->cache_recv_len, m_cache);
-            write_itf->disable();
-            m_data_crc = dfu_crc32(m_cache, p_env->cache_recv_len, &m_data_crc);
-            m_data_offset += p_env->cache_recv_len;
-            p_env->cache_recv_len = 0;
+        uint32_t recv_len = MIN(remain_data, remain_image);
+        if(get_img_enc(p_env->cmd_obj_buffer, p_env->cmd_img_idx)){
+            dfu_decode_queue(&data[pos], recv_len);
+        }else{
+            write_image_out(&data[pos], recv_len);
         }
+        pos += recv_len;
+        p_env->cmd_img_recv_len += recv_len;
     }
 }
 static void update_env_img_info_by_cache(void)
@@ -256,6 +556,7 @@ static void update_env_img_info_by_cache(void)
             p_env->cmd_img_idx = i;
             p_env->cmd_img_size = img->size;
             p_env->cmd_img_recv_len = m_data_offset - (p_env->obj_size - img->size);
+            p_env->cmd_img_out_len = p_env->cmd_img_recv_len; // Only images sent as is are resumed
         }
     }
     dfu_cmd_img_t *img = &imgs[p_env->cmd_img_idx];
@@ -286,17 +587,168 @@ static uint32_t cal_cmd_obj_size(uint8_t *cmd)
 //    dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&cmd[DFU_CMDPKG_OFFSET_PKG];
     // Check package length
     uint32_t res = sizeof(dfu_cmd_img_t) * img_cnt + DFU_CMDPKG_OFFSET_PKG;
+    if(*(uint16_t*)&cmd[DFU_CMDPKG_OFFSET_CTRL] & DFU_CTRL_BIT_ENCODED){
+        res += sizeof(dfu_cmd_enc_t) * img_cnt;
+    }
 #if (DFU_CTRL_SIGN_EN)
     res += PRIV_KEY_SIZE*2 + SHA256_BLOCK_SIZE;
 #endif
     return res;
 }
 
+static uint8_t check_img_enc(uint8_t *cmd, int idx, const dfu_image_t *cmd_img_info)
+{
+    dfu_cmd_img_t *img = &((dfu_cmd_img_t*)&cmd[DFU_CMDPKG_OFFSET_PKG])[idx];
+    dfu_cmd_enc_t *enc = get_img_enc(cmd, idx);
+    if(enc == NULL){
+        return DFU_SUCCESS;
+    }
+    if(enc->encoding & ~(DFU_IMG_ENC_LZ | DFU_IMG_ENC_DELTA)){
+        return DFU_UNSUPPORTED_TYPE;
+    }
+    if(enc->encoding & DFU_IMG_ENC_LZ){
+        if(enc->window_sz2 > DFU_LZ_WINDOW_SZ2_MAX){
+            dfu_debug("LZ window 2^%d exceeds the buffer\n", enc->window_sz2);
+            return DFU_INSUFFICIENT_RESOURCES;
+        }
+        if(enc->window_sz2 < DFU_LZ_WINDOW_SZ2_MIN ||
+                enc->lookahead_sz2 < DFU_LZ_LOOKAHEAD_SZ2_MIN || enc->lookahead_sz2 >= enc->window_sz2){
+            return DFU_INVALID_PARAMETER;
+        }
+    }
+    if(enc->encoding & DFU_IMG_ENC_DELTA){
+        dfu_image_mbr_info info;
+        if(img->type >= IMAGE_TYPE_MBR_MAX || cmd_img_info == NULL){
+            return DFU_UNSUPPORTED_TYPE;
+        }
+        if(!get_installed_img_info(img, &info) || info.length != enc->base_size || info.crc16 != enc->base_crc16){
+            dfu_debug("Delta base does NOT match the installed image(%d)\n", img->type);
+            return DFU_VERSION_NOT_MATCH;
+        }
+        if(get_new_img_address(img, cmd_img_info) == info.address){ // Would overwrite its own base
+            return DFU_OPERATION_NOT_PERMITTED;
+        }
+    }
+    return DFU_SUCCESS;
+}
+
+// Check the images of a received command object, the signature is verified already
+static void execute_cmd_obj(uint8_t *cmd, dfu_response_t *response)
+{
+    uint32_t exp_length = cal_cmd_obj_size(cmd);
+    if(exp_length > p_env->obj_recv_len){
+        dfu_debug("Error length of data received: 0x%08X(0x%08X expected)",
+                    p_env->obj_recv_len, exp_length);
+        response->result = DFU_INVALID_PARAMETER;
+        return;
+    }
+
+    // Check Images type & size
+    uint16_t img_cnt = *(uint16_t*)&cmd[DFU_CMDPKG_OFFSET_IMGCNT];
+    dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&cmd[DFU_CMDPKG_OFFSET_PKG];
+    int i, j;
+    for(i=0;i<img_cnt&&sizeof(dfu_cmd_img_t)*i+DFU_CMDPKG_OFFSET_PKG<p_env->obj_recv_len;i++){
+        response->result = DFU_UNSUPPORTED_TYPE;
+        for(j=0;j<dfu_image_types_num;j++){
+            if(imgs[i].type == dfu_image_types[j].type){ // Is type available
+                if(imgs[i].size <= dfu_image_types[j].max_length){ // Is size available
+                    response->result = check_img_enc(cmd, i, &dfu_image_types[j]);
+                }else{
+                    dfu_debug("The image '%s' execeeds the size limit.(%d>%d)\n",
+                        dfu_image_types[j].describe, imgs[i].size, dfu_image_types[j].max_length);
+                    response->result = DFU_INSUFFICIENT_RESOURCES;
+                }
+                break;
+            }else if(imgs[i].type == IMAGE_TYPE_RAW){
+                response->result = check_img_enc(cmd, i, NULL);
+                break;
+            }
+        }
+#if CONFIG_HS6621C_VROM
+        uint16_t ctrl_flag = *(uint16_t*)&cmd[DFU_CMDPKG_OFFSET_CTRL];
+        if(imgs[i].type == IMAGE_TYPE_DUMMY && (ctrl_flag & DFU_CTRL_BIT_MORE_IMG)){
+            uint32_t version = imgs[i].version;
+            extern int VROM_ID;
+            if(version != 0 && version != 0xFFFFFFFF && version != (size_t)&VROM_ID){
+                response->result = DFU_VERSION_NOT_MATCH;
+                dfu_debug("ROM ID(0x%02X) does NOT match:  image(0x%02X)\n", (size_t)&VROM_ID, version);
+                break;
+            }
+        }else if(imgs[i].type == IMAGE_TYPE_VROM){
+            uint32_t version = imgs[i].version;
+            extern int VROM_ID;
+            if(version != (size_t)&VROM_ID){
+                response->result = DFU_VERSION_NOT_MATCH;
+                dfu_debug("ROM ID(0x%02X) does NOT match:  image(0x%02X)\n", (size_t)&VROM_ID, version);
+                break;
+            }
+        }
+#endif
+        if(response->result != DFU_SUCCESS){
+            dfu_debug("Not supported image type: 0x%02X\n", imgs[i].type);
+            break;
+        }
+    }
+    if(response->result == DFU_SUCCESS){
+        p_env->cmd_obj_buffer_valid = true;
+    }
+}
+
+#if (DFU_CTRL_SIGN_EN)
+// Signature of the command object being verified, see dfu_sign_process()
+static uECC_VerifyCtx m_sign_ctx;
+static bool m_sign_busy;
+#endif
+
+bool dfu_sign_pending(void)
+{
+#if (DFU_CTRL_SIGN_EN)
+    return m_sign_busy;
+#else
+    return false;
+#endif
+}
+
+bool dfu_sign_process(dfu_response_t *response)
+{
+#if (DFU_CTRL_SIGN_EN)
+    int res;
+    if(!m_sign_busy){
+        return false;
+    }
+    res = uECC_verify_step(&m_sign_ctx, DFU_SIGN_STEP_BITS);
+    if(res == uECC_VERIFY_PENDING){
+        return false;
+    }
+    m_sign_busy = false;
+    response->rsp_code = DFU_CTRL_RESPONSE;
+    response->opcode = DFU_CTRL_EXECTUE;
+    response->result = DFU_SUCCESS;
+    response->length = DFU_RESP_SIZE_NO_EXT_DATA;
+    if(!res){
+        dfu_debug("Error signature\n");
+        response->result = DFU_OPERATION_NOT_PERMITTED;
+    }else{
+        execute_cmd_obj(p_env->cmd_obj_buffer, response);
+    }
+    if(response->result != DFU_SUCCESS){
+        dfu_reset(DFU_UPDATE_ST_FAILED);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 void dfu_reset(uint8_t state)
 {
+#if (DFU_CTRL_SIGN_EN)
+    m_sign_busy = false;
+#endif
     if(p_env != NULL){
         uint16_t ctrl_flag = 0xFFFF;
         if(p_env->cmd_obj_buffer != NULL){
+            dfu_flash_flush(); // Keep the received blocks, the transfer may be resumed
             ctrl_flag = *(uint16_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_CTRL];
             dfu_free(p_env->cmd_obj_buffer);
         }
@@ -320,6 +772,12 @@ void dfu_write_cmd(uint8_t *data, uint32_t len, dfu_response_t *response)
         response->result = DFU_OPCODE_NOT_SUPPORT;
         return;
     }
+    if(dfu_sign_pending()){ // Nothing is expected before the EXECUTE response
+        dfu_debug("Signature verification busy.\n");
+        response->result = DFU_OPERATION_NOT_PERMITTED;
+        dfu_reset(DFU_UPDATE_ST_FAILED);
+        return;
+    }
     switch(opcode){
         case DFU_CTRL_CREATE:{
             // PKG: 01 TYPE LL LL LL LL (LL: size)
@@ -347,42 +805,25 @@ void dfu_write_cmd(uint8_t *data, uint32_t len, dfu_response_t *response)
                 }
             }else if(type == DFU_PKG_ACTIVED_DATA){
                 uint32_t sum_img_len = 0;
-                int i,j;
+                int i;
                 uint16_t img_cnt = *(uint16_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_IMGCNT];
                 dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_PKG];
                 for(i=0;i<img_cnt;i++){
-                    dfu_image_t raw_img_info = { IMAGE_TYPE_RAW };
-                    dfu_cmd_img_t *img = &imgs[i];
-                    const dfu_image_t *cmd_img_info = NULL;
-                    sum_img_len += img->size;
-                    for(j=0;j<dfu_image_types_num;j++){
-                        if(img->type == dfu_image_types[j].type){
-                            cmd_img_info = &dfu_image_types[j];
-                            break;
-                        }else if(img->type == IMAGE_TYPE_RAW){
-                            cmd_img_info = &raw_img_info;
-                            raw_img_info.base_address1 = ((dfu_cmd_raw_t*)img)->new_address;
-                            raw_img_info.base_address2 = ((dfu_cmd_raw_t*)img)->new_address;
-                            raw_img_info.image_ops_itf = &dfu_nvds_itf[((dfu_cmd_raw_t*)img)->nvds_itf_type];
-                            raw_img_info.describe = "Raw data";
-                        }
-                    }
-                    dfu_assert(cmd_img_info);
-#if !FLASH_ERASE_SIZE
-                    // Get address for new image
-                    uint32_t new_address = get_new_img_address(img, cmd_img_info);
-                    // Erase flash for new image
-                    const dfu_nvds_itf_t *nvds_itf = cmd_img_info->image_ops_itf;
-                    dfu_debug("Erasing 0x%08X-0x%08X (%s)\n", new_address, new_address+img->size, cmd_img_info->describe);
-                    nvds_itf->enable();
-                    nvds_itf->del(new_address, img->size);
-                    nvds_itf->disable();
-#endif
+                    const dfu_nvds_itf_t *nvds_itf;
+                    get_img_address_itf(&imgs[i], &nvds_itf);
+                    dfu_assert(nvds_itf);
+                    sum_img_len += get_img_data_size(p_env->cmd_obj_buffer, i);
                 }
 
+                // Images are erased ahead of the data by dfu_flash_process()
                 p_env->cmd_img_idx = -1;
-                p_env->cmd_img_size = p_env->cmd_img_recv_len = p_env->cache_recv_len = 0;
-                m_data_offset = m_data_crc = 0;
+                p_env->cmd_img_size = p_env->cmd_img_recv_len = p_env->cmd_img_out_len = p_env->cache_recv_len = 0;
+                m_data_offset = 0;
+                m_decode_err = false;
+                m_dec_in_len = m_dec_in_pos = 0;
+                m_cache_in = m_cache_out = 0;
+                dfu_erase_reset();
+                dfu_digest_reset();
                 if(sum_img_len != length){
                     dfu_debug("Created size NOT match to images\n");
                     response->result = DFU_INVALID_OBJECT;
@@ -431,95 +872,53 @@ void dfu_write_cmd(uint8_t *data, uint32_t len, dfu_response_t *response)
                         response->result = DFU_INVALID_PARAMETER;
                         break;
                     }
+                    if(p_env->obj_size < DFU_CMDPKG_OFFSET_PKG + PRIV_KEY_SIZE*2){
+                        response->result = DFU_INVALID_PARAMETER;
+                        break;
+                    }
                     uint8_t hash[SHA256_BLOCK_SIZE];
                     SHA256_CTX ctx;
                     sha256_init(&ctx);
                     sha256_update(&ctx, cmd, p_env->obj_size - PRIV_KEY_SIZE*2);
                     sha256_final(&ctx, hash);
-                    int res = uECC_verify(dfu_public_key, hash, SHA256_BLOCK_SIZE, cmd + p_env->obj_size - PRIV_KEY_SIZE*2, ECC_TYPE);
-                    if(!res){
+                    if(!uECC_verify_start(&m_sign_ctx, dfu_public_key, dfu_public_key_sum, hash, SHA256_BLOCK_SIZE,
+                                          cmd + p_env->obj_size - PRIV_KEY_SIZE*2, ECC_TYPE)){
                         dfu_debug("Error signature\n");
                         response->result = DFU_OPERATION_NOT_PERMITTED;
                         break;
                     }
+                    // Verified in steps by dfu_sign_process(), which also gives the response
+                    m_sign_busy = true;
+                    response->length = DFU_RESP_SIZE_NO_DATA;
+#else
+                    execute_cmd_obj(cmd, response);
 #endif
-                    uint32_t exp_length = cal_cmd_obj_size(cmd);
-                    if(exp_length > p_env->obj_recv_len){
-                        dfu_debug("Error length of data received: 0x%08X(0x%08X expected)",
-                                    p_env->obj_recv_len, exp_length);
-                        response->result = DFU_INVALID_PARAMETER;
-                        break;
-                    }
-
-                    // Check Images type & size
-                    uint16_t img_cnt = *(uint16_t*)&cmd[DFU_CMDPKG_OFFSET_IMGCNT];
-                    dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&cmd[DFU_CMDPKG_OFFSET_PKG];
-                    int i, j;
-                    for(i=0;i<img_cnt&&sizeof(dfu_cmd_img_t)*i+DFU_CMDPKG_OFFSET_PKG<p_env->obj_recv_len;i++){
-                        response->result = DFU_UNSUPPORTED_TYPE;
-                        for(j=0;j<dfu_image_types_num;j++){
-                            if(imgs[i].type == dfu_image_types[j].type){ // Is type available
-                                if(imgs[i].size <= dfu_image_types[j].max_length){ // Is size available
-                                    response->result = DFU_SUCCESS;
-                                }else{
-                                    dfu_debug("The image '%s' execeeds the size limit.(%d>%d)\n",
-                                        dfu_image_types[j].describe, imgs[i].size, dfu_image_types[j].max_length);
-                                    response->result = DFU_INSUFFICIENT_RESOURCES;
-                                }
-                                break;
-                            }else if(imgs[i].type == IMAGE_TYPE_RAW){
-                                response->result = DFU_SUCCESS;
-                                break;
-                            }
-                        }
-#if CONFIG_HS6621C_VROM
-                        uint16_t ctrl_flag = *(uint16_t*)&cmd[DFU_CMDPKG_OFFSET_CTRL];
-                        if(imgs[i].type == IMAGE_TYPE_DUMMY && (ctrl_flag & DFU_CTRL_BIT_MORE_IMG)){
-                            uint32_t version = imgs[i].version;
-                            extern int VROM_ID;
-                            if(version != 0 && version != 0xFFFFFFFF && version != (size_t)&VROM_ID){
-                                response->result = DFU_VERSION_NOT_MATCH;
-                                dfu_debug("ROM ID(0x%02X) does NOT match:  image(0x%02X)\n", (size_t)&VROM_ID, version);
-                                break;
-                            }
-                        }else if(imgs[i].type == IMAGE_TYPE_VROM){
-                            uint32_t version = imgs[i].version;
-                            extern int VROM_ID;
-                            if(version != (size_t)&VROM_ID){
-                                response->result = DFU_VERSION_NOT_MATCH;
-                                dfu_debug("ROM ID(0x%02X) does NOT match:  image(0x%02X)\n", (size_t)&VROM_ID, version);
-                                break;
-                            }
-                        }
-#endif
-                        if(response->result != DFU_SUCCESS){
-                            dfu_debug("Not supported image type: 0x%02X\n", imgs[i].type);
-                            break;
-                        }
-                    }
-                    if(response->result == DFU_SUCCESS){
-                        p_env->cmd_obj_buffer_valid = true;
-                    }
                 }else if(p_env->obj_actived == DFU_PKG_ACTIVED_DATA){
-                    m_data_offset = 0; // m_cache used for cal crc32, so reset offest.
+                    dfu_flash_flush();
+                    m_data_offset = 0; // Reception restarts from 0 after execute.
                     if(p_env->cmd_obj_buffer_valid){
                         uint16_t img_cnt = *(uint16_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_IMGCNT];
                         dfu_cmd_img_t *imgs = (dfu_cmd_img_t*)&p_env->cmd_obj_buffer[DFU_CMDPKG_OFFSET_PKG];
                         dfu_assert(img_cnt <= DFU_MAX_IMG_NUM);
-                        uint32_t cmd_img_new_addr[DFU_MAX_IMG_NUM], obj_crc32 = 0;
+                        bool encoded = is_cmd_encoded(p_env->cmd_obj_buffer);
+                        if(encoded && (p_env->cmd_img_idx != img_cnt - 1 || !is_img_out_done())){
+                            dfu_debug("Images NOT decoded completely.\n");
+                            response->result = DFU_INVALID_OBJECT;
+                            break;
+                        }
+                        uint32_t cmd_img_new_addr[DFU_MAX_IMG_NUM];
 #if (DFU_CTRL_SIGN_EN | DFU_FORCE_CHECK_SHA256_EN)
                         uint8_t imgs_hash[SHA256_BLOCK_SIZE];
-                        SHA256_CTX imgs_ctx;
-                        sha256_init(&imgs_ctx);
+#endif
+#if DFU_VERIFY_READBACK_EN
+                        uint32_t obj_crc32 = 0;
 #endif
 
                         const dfu_nvds_itf_t *info_ops_itf[DFU_MAX_IMG_NUM];// used for nvds info update
                         uint8_t info_id[DFU_MAX_IMG_NUM];
 
-                        uint16_t sys_crc16[IMAGE_TYPE_MBR_MAX] = {0}; // used for mbr update
-
-                        uint32_t i, j;  static uint32_t TEST_LEN = 0;
-                        for(i=0;i<img_cnt;i++){ // Cal all CRC32
+                        uint32_t i, j;
+                        for(i=0;i<img_cnt;i++){ // Get all image addresses
                             dfu_cmd_img_t *img = &imgs[i];
                             dfu_image_t raw_img_info = { IMAGE_TYPE_RAW };
                             const dfu_image_t *cmd_img_info = NULL;
@@ -544,33 +943,34 @@ void dfu_write_cmd(uint8_t *data, uint32_t len, dfu_response_t *response)
                                 }
                             }
                             dfu_assert(j != dfu_image_types_num);
-
+#if DFU_VERIFY_READBACK_EN
                             cmd_img_info->image_ops_itf->enable();
                             for(j=cmd_img_new_addr[i];j<cmd_img_new_addr[i]+img->size;){
                                 // TODO: If it takes too long to calculate the CRC, you need to add an action here to restart the watchdog timer
                                 uint32_t len = MIN(DFU_CACHE_BUF_SIZE, cmd_img_new_addr[i]+img->size-j);
-                                cmd_img_info->image_ops_itf->get(j, &len, m_cache);
-                                obj_crc32 = dfu_crc32(m_cache, len, &obj_crc32); //Cal all images'CRC
-#if (DFU_CTRL_SIGN_EN | DFU_FORCE_CHECK_SHA256_EN)
-                                sha256_update(&imgs_ctx, m_cache, len);
-#endif
-                                TEST_LEN += len;
-                                if(img->type < IMAGE_TYPE_MBR_MAX){
-                                    sys_crc16[img->type] = co_crc16_ccitt(sys_crc16[img->type], m_cache, len);
-                                }
+                                cmd_img_info->image_ops_itf->get(j, &len, m_cache[0]);
+                                obj_crc32 = co_crc32(obj_crc32, m_cache[0], len); //Cal all images'CRC from flash
                                 j += len;
                             }
                             cmd_img_info->image_ops_itf->disable();
+#endif
                             //mbr_validate_app(new_base_addr, ew_size);
                         }
-                        //All crc cal done.
-                        if(obj_crc32 != p_env->obj_crc32){
+                        //All digests were calculated while receiving, only compare here.
+                        if(!encoded && m_data_crc != p_env->obj_crc32){
                             dfu_debug("Data object CRC NOT matched.\n");
                             response->result = DFU_INSUFFICIENT_RESOURCES;
                             break;
                         }
+#if DFU_VERIFY_READBACK_EN
+                        if(obj_crc32 != m_data_crc){
+                            dfu_debug("Flash read back CRC NOT matched.\n");
+                            response->result = DFU_INSUFFICIENT_RESOURCES;
+                            break;
+                        }
+#endif
 #if (DFU_CTRL_SIGN_EN | DFU_FORCE_CHECK_SHA256_EN)
-                        sha256_final(&imgs_ctx, imgs_hash);
+                        sha256_final(&m_digest.sha256, imgs_hash);
                         //All hash cal done.
                         int sha256_result;
 #if (DFU_CTRL_SIGN_EN)
@@ -594,7 +994,7 @@ void dfu_write_cmd(uint8_t *data, uint32_t len, dfu_response_t *response)
                                 dfu_image_mbr_info info = {
                                     cmd_img_new_addr[i],
                                     img->size,
-                                    sys_crc16[img->type],
+                                    m_digest.crc16[img->type],
                                 };
                                 dfu_debug("Update MBR(%d) Addr: 0x%08X CRC: 0x%08X Size: %d.\n", img->type,
                                             info.address, info.crc16, info.length);
@@ -654,12 +1054,15 @@ void dfu_write_cmd(uint8_t *data, uint32_t len, dfu_response_t *response)
                 response->data.select_data.crc32 = 0;
             }else if(type == DFU_PKG_ACTIVED_DATA){
                 p_env->obj_actived = DFU_PKG_ACTIVED_DATA;
-                if(m_data_offset > 0 && p_env->cmd_obj_buffer_valid){ // Cal current image info
+                dfu_flash_flush();
+                // Decoder state is not kept, encoded images are received again from 0
+                if(m_data_offset > 0 && p_env->cmd_obj_buffer_valid && !is_cmd_encoded(p_env->cmd_obj_buffer)){ // Cal current image info
                     update_env_img_info_by_cache();
                     p_env->cache_recv_len = 0;
                 }else{
                     p_env->cmd_img_idx = -1;
                     m_data_offset = 0;
+                    dfu_digest_reset();
                 }
                 response->data.select_data.offset = m_data_offset;
                 response->data.select_data.crc32 = m_data_crc;
@@ -705,11 +1108,12 @@ void dfu_write_data(uint8_t *data, uint32_t len, dfu_response_t *response)
         return;
     }
     // Cal CRC
-    p_env->obj_crc32 = dfu_crc32(data, len, &p_env->obj_crc32);
+    p_env->obj_crc32 = co_crc32(p_env->obj_crc32, data, len);
     p_env->obj_recv_len += len;
     p_env->prn_cnt++;
     if(p_env->prn && p_env->prn <= p_env->prn_cnt){
         p_env->prn_cnt = 0;
+        dfu_flash_flush(); // The next PRN window starts with all cache blocks free
         response->length = DFU_RESP_SIZE_CHECKSUM;
         response->rsp_code = DFU_CTRL_RESPONSE;
         response->opcode = DFU_CTRL_CAL_CHECKSUM;
@@ -12,6 +12,7 @@
 #include "co.h"
 /*
     0x01BFDF55 | Protocol Version(2 Bytes) | RFU(2Bytes) | Ctrl bitmap | Image Num | N × 『|Type|RFU|Version|SIZE|』| Reserved |
+    DFU_CTRL_BIT_ENCODED: N × 『|Encoding|Window|Base CRC16|Data size|Base size|』 follows the images, @ref onmicro_dfu_decode.h
 */
 
 enum{
@@ -30,13 +31,20 @@ enum{
 enum{
     DFU_CTRL_BIT_SIGN     = 1<<0,
     DFU_CTRL_BIT_MORE_IMG = 1<<1,
+    DFU_CTRL_BIT_ENCODED  = 1<<2,
 };
 
 #define DFU_DATE_VERSION             0x20210310
 #define DFU_TYPE_VERSION             0x0000000F
 #define DFU_PROTOCOL_VERSION         0x00000003
+#ifndef DFU_CTRL_SIGN_EN
 #define DFU_CTRL_SIGN_EN             0  // digital signature support
+#endif
+#define DFU_SIGN_STEP_BITS           16 // signature verification bits per dfu_sign_process() call
 #define DFU_FORCE_CHECK_SHA256_EN    0  // check hash even sign not support, use @ref dfu_sha256_cmp to check
+#ifndef DFU_VERIFY_READBACK_EN
+#define DFU_VERIFY_READBACK_EN       0  // read images back from flash at execute and check CRC32 again
+#endif
 typedef void(*dfu_indicate_cb_t)(uint8_t status, void *p);
 
 typedef struct {
@@ -49,8 +57,12 @@ extern const dfu_cb_itf_t dfu_cb_itf;
 
 #define DFU_DATA_MAX_SIZE            0x10000000
 
-#define DFU_COMMAND_OBJ_MAX_SIZE     128
+#define DFU_COMMAND_OBJ_MAX_SIZE     256
 #define DFU_CACHE_BUF_SIZE           128 // 作为写入flash的cache buffer，需要16字节对齐
+#define DFU_CACHE_BUF_NUM            4   // cache blocks queued while flash is busy
+#define DFU_ERASE_STEP_SIZE          0x1000 // erase ahead granularity, one sector per step
+#define DFU_DECODE_IN_SIZE           1024 // encoded data waiting for the decoder
+#define DFU_DECODE_STEP_SIZE         (DFU_CACHE_BUF_SIZE * 2) // decoded bytes per dfu_flash_process() step
 
 #define DFU_CTRL_CREATE              0x01
 #define DFU_CTRL_SET_PRN             0x02
@@ -131,6 +143,10 @@ void dfu_write_data(uint8_t *data, uint32_t len, dfu_response_t *response);
 void dfu_read_version_char(dfu_version_t *version);
 void dfu_write_version_char(uint32_t cmd, dfu_version_t *version);
 int dfu_set_enable(bool enabled); // default: DFU_STATUS_ENABLED
+bool dfu_flash_process(void); // one erase/write step, return true if more flash work is pending
+bool dfu_flash_pending(void);
+bool dfu_sign_pending(void);
+bool dfu_sign_process(dfu_response_t *response); // one verification step, return true if the EXECUTE response is ready
 #if DFU_FORCE_CHECK_SHA256_EN
 extern int dfu_sha256_cmp(uint8_t *sha256_resule, uint8_t sha256_len);
 #endif
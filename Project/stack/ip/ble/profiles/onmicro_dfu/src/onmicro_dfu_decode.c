@@ -0,0 +1,293 @@
+/*********************************************************************
+ * @file onmicro_dfu_decode.c
+ * @version V20210310.1.0
+ */
+
+#include "string.h"
+#include "onmicro_dfu_decode.h"
+
+#if BLE_APP_ONMICRO_DFU
+
+#ifndef MIN
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#endif
+
+#define DFU_DECODE_BUF_SIZE 32
+
+enum{
+    LZ_STATE_TAG,
+    LZ_STATE_LITERAL,
+    LZ_STATE_INDEX,
+    LZ_STATE_COUNT,
+};
+
+enum{
+    DELTA_STATE_OP,
+    DELTA_STATE_LEN,
+    DELTA_STATE_OFFSET,
+    DELTA_STATE_DATA,
+};
+
+// Only one image is decoded at a time
+static uint8_t m_window[1<<DFU_LZ_WINDOW_SZ2_MAX];
+static uint8_t m_lz_out[DFU_DECODE_BUF_SIZE];
+static uint8_t m_lz_out_len;
+static uint8_t m_lz_out_pos;    // m_lz_out before it is passed on
+static uint32_t m_out_left;     // output budget of the current dfu_decode_feed()
+
+int dfu_decode_init(dfu_decoder_t *d, uint8_t encoding, uint8_t window_sz2, uint8_t lookahead_sz2, dfu_decode_out_t out)
+{
+    memset(d, 0, sizeof(dfu_decoder_t));
+    d->encoding = encoding;
+    d->out = out;
+    if(encoding & ~(DFU_IMG_ENC_LZ | DFU_IMG_ENC_DELTA)){
+        return DFU_DECODE_ERR;
+    }
+    if(encoding & DFU_IMG_ENC_LZ){
+        if(window_sz2 < DFU_LZ_WINDOW_SZ2_MIN || window_sz2 > DFU_LZ_WINDOW_SZ2_MAX ||
+                lookahead_sz2 < DFU_LZ_LOOKAHEAD_SZ2_MIN || lookahead_sz2 >= window_sz2){
+            return DFU_DECODE_ERR;
+        }
+        d->window_sz2 = window_sz2;
+        d->lookahead_sz2 = lookahead_sz2;
+        memset(m_window, 0, sizeof(m_window));
+        m_lz_out_len = m_lz_out_pos = 0;
+    }
+    return DFU_DECODE_OK;
+}
+
+void dfu_decode_set_base(dfu_decoder_t *d, const dfu_nvds_itf_t *itf, uint32_t addr, uint32_t size)
+{
+    d->base_itf = itf;
+    d->base_addr = addr;
+    d->base_size = size;
+    d->base_pos = 0;
+}
+
+static void read_base(dfu_decoder_t *d, uint32_t pos, uint32_t len, uint8_t *buf)
+{
+    d->base_itf->enable();
+    d->base_itf->get(d->base_addr + pos, &len, buf);
+    d->base_itf->disable();
+}
+
+static void decode_out(dfu_decoder_t *d, const uint8_t *data, uint32_t len)
+{
+    d->out(data, len);
+    m_out_left -= len;
+}
+
+// LEB128, false until the last byte
+static bool delta_varint(dfu_decoder_t *d, uint8_t c)
+{
+    d->var |= (uint32_t)(c & 0x7F) << d->var_shift;
+    d->var_shift += 7;
+    if(d->var_shift > 28 && (c & 0x80)){
+        d->error = true;
+    }
+    return !(c & 0x80);
+}
+
+// Returns the bytes of data used, stops when the output budget is used up
+static uint32_t delta_feed(dfu_decoder_t *d, const uint8_t *data, uint32_t len)
+{
+    uint8_t buf[DFU_DECODE_BUF_SIZE];
+    const uint8_t *start = data;
+    while(!d->error){
+        if(d->delta_state == DELTA_STATE_DATA && d->delta_op == DFU_DELTA_OP_COPY){
+            // No input needed, a long COPY goes on in the next calls
+            uint32_t n = MIN(MIN(d->delta_len, sizeof(buf)), m_out_left);
+            if(n == 0){
+                break;
+            }
+            read_base(d, d->base_pos, n, buf);
+            decode_out(d, buf, n);
+            d->base_pos += n;
+            d->delta_len -= n;
+            if(d->delta_len == 0){
+                d->delta_state = DELTA_STATE_OP;
+            }
+            continue;
+        }
+        if(len == 0 || (d->delta_state == DELTA_STATE_DATA && m_out_left == 0)){
+            break;
+        }
+        switch(d->delta_state){
+            case DELTA_STATE_OP:
+                d->delta_op = *data++;
+                len--;
+                if(d->delta_op > DFU_DELTA_OP_INSERT){
+                    d->error = true;
+                    break;
+                }
+                d->var = d->var_shift = 0;
+                d->delta_state = DELTA_STATE_LEN;
+                break;
+            case DELTA_STATE_LEN:
+                len--;
+                if(!delta_varint(d, *data++)){
+                    break;
+                }
+                d->delta_len = d->var;
+                d->var = d->var_shift = 0;
+                d->delta_state = d->delta_op == DFU_DELTA_OP_INSERT ? DELTA_STATE_DATA : DELTA_STATE_OFFSET;
+                if(d->delta_len == 0){
+                    d->delta_state = d->delta_op == DFU_DELTA_OP_INSERT ? DELTA_STATE_OP : DELTA_STATE_OFFSET;
+                }
+                break;
+            case DELTA_STATE_OFFSET:
+                len--;
+                if(!delta_varint(d, *data++)){
+                    break;
+                }
+                d->base_pos += (int32_t)(d->var >> 1) ^ -(int32_t)(d->var & 1); // zigzag
+                if(d->base_pos > d->base_size || d->delta_len > d->base_size - d->base_pos){
+                    d->error = true;
+                    break;
+                }
+                d->delta_state = DELTA_STATE_DATA;
+                if(d->delta_len == 0){
+                    d->delta_state = DELTA_STATE_OP;
+                }
+                break;
+            case DELTA_STATE_DATA:{
+                uint32_t n = MIN(MIN(MIN(d->delta_len, len), sizeof(buf)), m_out_left);
+                if(d->delta_op == DFU_DELTA_OP_ADD){
+                    uint32_t i;
+                    read_base(d, d->base_pos, n, buf);
+                    for(i=0;i<n;i++){
+                        buf[i] += data[i];
+                    }
+                    decode_out(d, buf, n);
+                    d->base_pos += n;
+                }else{
+                    decode_out(d, data, n);
+                }
+                data += n;
+                len -= n;
+                d->delta_len -= n;
+                if(d->delta_len == 0){
+                    d->delta_state = DELTA_STATE_OP;
+                }
+            }   break;
+        }
+    }
+    return data - start;
+}
+
+// Pass m_lz_out on, false while some of it is held back by the output budget
+static bool lz_flush(dfu_decoder_t *d)
+{
+    uint32_t n = m_lz_out_len - m_lz_out_pos;
+    if(d->encoding & DFU_IMG_ENC_DELTA){
+        n = delta_feed(d, &m_lz_out[m_lz_out_pos], n); // Also goes on with a pending COPY
+    }else if(n){
+        n = MIN(n, m_out_left);
+        decode_out(d, &m_lz_out[m_lz_out_pos], n);
+    }
+    m_lz_out_pos += n;
+    if(m_lz_out_pos < m_lz_out_len){
+        return false;
+    }
+    m_lz_out_len = m_lz_out_pos = 0;
+    return true;
+}
+
+static void lz_emit(dfu_decoder_t *d, uint8_t c)
+{
+    m_window[d->lz_head++ & ((1<<d->window_sz2) - 1)] = c;
+    m_lz_out[m_lz_out_len++] = c;
+}
+
+static uint16_t lz_take(dfu_decoder_t *d, uint8_t n)
+{
+    d->bit_cnt -= n;
+    return (d->bits >> d->bit_cnt) & ((1<<n) - 1);
+}
+
+// Bits of the current state are all there
+static bool lz_ready(const dfu_decoder_t *d)
+{
+    switch(d->lz_state){
+        case LZ_STATE_TAG:     return d->bit_cnt >= 1;
+        case LZ_STATE_LITERAL: return d->bit_cnt >= 8;
+        case LZ_STATE_INDEX:   return d->bit_cnt >= d->window_sz2;
+        default:               return d->bit_cnt >= d->lookahead_sz2;
+    }
+}
+
+// Returns the bytes of data used, stops when m_lz_out is full and held back by the output budget
+static uint32_t lz_feed(dfu_decoder_t *d, const uint8_t *data, uint32_t len)
+{
+    uint16_t mask = (1<<d->window_sz2) - 1;
+    uint32_t used = 0;
+    while(!d->error){
+        if(m_lz_out_len == sizeof(m_lz_out) && !lz_flush(d)){
+            break;
+        }
+        if(d->lz_count){ // A back reference may span several flushes
+            lz_emit(d, m_window[(uint16_t)(d->lz_head - d->lz_index) & mask]);
+            d->lz_count--;
+        }else if(lz_ready(d)){
+            if(d->lz_state == LZ_STATE_TAG){
+                d->lz_state = lz_take(d, 1) ? LZ_STATE_LITERAL : LZ_STATE_INDEX;
+            }else if(d->lz_state == LZ_STATE_LITERAL){
+                lz_emit(d, lz_take(d, 8));
+                d->lz_state = LZ_STATE_TAG;
+            }else if(d->lz_state == LZ_STATE_INDEX){
+                d->lz_index = lz_take(d, d->window_sz2) + 1;
+                d->lz_state = LZ_STATE_COUNT;
+            }else{
+                d->lz_count = lz_take(d, d->lookahead_sz2) + 1;
+                d->lz_state = LZ_STATE_TAG;
+            }
+        }else if(used < len){ // More bits needed
+            d->bits = (d->bits << 8) | data[used++];
+            d->bit_cnt += 8;
+        }else{
+            break;
+        }
+    }
+    if(!d->error){
+        lz_flush(d);
+    }
+    return used;
+}
+
+int32_t dfu_decode_feed(dfu_decoder_t *d, const uint8_t *data, uint32_t len, uint32_t out_max)
+{
+    uint32_t used = len;
+    m_out_left = out_max;
+    if(d->encoding & DFU_IMG_ENC_LZ){
+        used = lz_feed(d, data, len);
+    }else if(d->encoding & DFU_IMG_ENC_DELTA){
+        used = delta_feed(d, data, len);
+    }else{
+        d->out(data, len);
+    }
+    return d->error ? DFU_DECODE_ERR : (int32_t)used;
+}
+
+bool dfu_decode_pending(const dfu_decoder_t *d)
+{
+    if(d->error){
+        return false;
+    }
+    if((d->encoding & DFU_IMG_ENC_LZ) && (m_lz_out_len || d->lz_count || lz_ready(d))){
+        return true;
+    }
+    return (d->encoding & DFU_IMG_ENC_DELTA) && d->delta_state == DELTA_STATE_DATA && d->delta_op == DFU_DELTA_OP_COPY;
+}
+
+bool dfu_decode_done(const dfu_decoder_t *d)
+{
+    if(d->error || dfu_decode_pending(d)){
+        return false;
+    }
+    if((d->encoding & DFU_IMG_ENC_LZ) && d->lz_state != LZ_STATE_TAG && d->lz_state != LZ_STATE_INDEX){
+        return false; // Only the zero padding of the last byte may be left
+    }
+    return !(d->encoding & DFU_IMG_ENC_DELTA) || d->delta_state == DELTA_STATE_OP;
+}
+
+#endif //BLE_APP_ONMICRO_DFU
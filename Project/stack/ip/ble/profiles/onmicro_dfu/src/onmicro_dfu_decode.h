@@ -0,0 +1,76 @@
+/*********************************************************************
+ * @file onmicro_dfu_decode.h
+ * @version V20210310.1.0
+ */
+
+#ifndef __ONMICRO_DFU_DECODE_H__
+#define __ONMICRO_DFU_DECODE_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "onmicro_dfu_nvds.h"
+
+/*
+    Image encodings, may be combined: the LZ stream is decoded first, its output is the delta stream.
+
+    DFU_IMG_ENC_LZ:    heatshrink bit stream, window 2^window_sz2, back reference length 2^lookahead_sz2
+                       |1|8 bits literal| or |0|window_sz2 bits (index-1)|lookahead_sz2 bits (count-1)|
+    DFU_IMG_ENC_DELTA: records against the installed image, base cursor starts at 0
+                       |op|len(LEB128)|offset(zigzag LEB128, COPY/ADD only)|len bytes(ADD/INSERT only)|
+                       COPY: base[cursor+offset ...] ADD: base[cursor+offset ...] + bytes INSERT: bytes
+*/
+enum{
+    DFU_IMG_ENC_NONE  = 0,
+    DFU_IMG_ENC_LZ    = 1<<0,
+    DFU_IMG_ENC_DELTA = 1<<1,
+};
+
+enum{
+    DFU_DELTA_OP_COPY,
+    DFU_DELTA_OP_ADD,
+    DFU_DELTA_OP_INSERT,
+};
+
+#ifndef DFU_LZ_WINDOW_SZ2_MAX
+#define DFU_LZ_WINDOW_SZ2_MAX       10 // LZ window buffer in RAM: 1KB
+#endif
+#define DFU_LZ_WINDOW_SZ2_MIN       4
+#define DFU_LZ_LOOKAHEAD_SZ2_MIN    3
+
+#define DFU_DECODE_OK               0
+#define DFU_DECODE_ERR              (-1)
+
+typedef void(*dfu_decode_out_t)(const uint8_t *data, uint32_t len);
+
+typedef struct {
+    uint8_t      encoding;
+    uint8_t      error;
+    dfu_decode_out_t out;
+    // LZ
+    uint8_t      window_sz2;
+    uint8_t      lookahead_sz2;
+    uint8_t      lz_state;
+    uint8_t      bit_cnt;
+    uint32_t     bits;
+    uint16_t     lz_index;
+    uint16_t     lz_count;     // back reference bytes not output yet
+    uint16_t     lz_head;
+    // DELTA
+    uint8_t      delta_state;
+    uint8_t      delta_op;
+    uint8_t      var_shift;
+    uint32_t     var;
+    uint32_t     delta_len;
+    const dfu_nvds_itf_t *base_itf;
+    uint32_t     base_addr;
+    uint32_t     base_size;
+    uint32_t     base_pos;
+}dfu_decoder_t;
+
+int dfu_decode_init(dfu_decoder_t *d, uint8_t encoding, uint8_t window_sz2, uint8_t lookahead_sz2, dfu_decode_out_t out);
+void dfu_decode_set_base(dfu_decoder_t *d, const dfu_nvds_itf_t *itf, uint32_t addr, uint32_t size);
+// Decodes at most out_max bytes, returns the bytes of data used (the rest is fed again) or DFU_DECODE_ERR
+int32_t dfu_decode_feed(dfu_decoder_t *d, const uint8_t *data, uint32_t len, uint32_t out_max);
+bool dfu_decode_pending(const dfu_decoder_t *d); // output held back by out_max, fed again with no data
+bool dfu_decode_done(const dfu_decoder_t *d); // stream ended on a record boundary
+
+#endif /* __ONMICRO_DFU_DECODE_H__ */
@@ -5,3 +5,9 @@ uint8_t dfu_public_key[] = {
     0xBC, 0x4F, 0x55, 0x3F, 0x50, 0x29, 0xBA, 0x9D, 0x7E, 0xD4, 0x60, 0x8F, 0x32, 0x61, 0x22, 0x90,
     0x31, 0x00, 0xEF, 0xAE, 0x41, 0x32, 0x5F, 0xDB, 0xF2, 0x8A, 0x23, 0xBC, 0x75, 0x2C, 0x95, 0x7D,
 };
+// G + dfu_public_key, uECC_verify_precompute(dfu_public_key, dfu_public_key_sum, uECC_secp192r1())
+uint8_t dfu_public_key_sum[] = {
+    0x47, 0x41, 0xA0, 0x8D, 0x5C, 0x7D, 0x56, 0xE5, 0x16, 0xB0, 0x41, 0xEA, 0x57, 0x36, 0x08, 0x75,
+    0x1C, 0xFB, 0x22, 0xEC, 0x5C, 0xF1, 0xBB, 0xDB, 0x87, 0x93, 0xB0, 0xD5, 0x4C, 0x15, 0xE4, 0xA2,
+    0xDC, 0xF1, 0x6A, 0x0E, 0x29, 0x92, 0x5B, 0x7D, 0x64, 0xA8, 0xBD, 0x69, 0x03, 0x35, 0xA2, 0xB7,
+};
@@ -35,6 +35,16 @@
     #endif
 #endif
 
+/* Cortex-M4 (ARMv7E-M) has UMAAL: multiply and square operand-scanned in C, one
+   a * b + c + d per word product, which the compiler emits as a single UMAAL. */
+#ifndef uECC_MULT_UMAAL
+    #if defined(__ARM_ARCH_7EM__) || defined(__TARGET_ARCH_7E_M)
+        #define uECC_MULT_UMAAL 1
+    #else
+        #define uECC_MULT_UMAAL 0
+    #endif
+#endif
+
 #ifndef uECC_WORD_SIZE
     #if uECC_PLATFORM == uECC_avr
         #define uECC_WORD_SIZE 1
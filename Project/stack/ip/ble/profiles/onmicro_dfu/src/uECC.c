@@ -180,6 +180,12 @@ static cmpresult_t uECC_vli_cmp_unsafe(const uECC_word_t *left,
     #include "asm_avr.inc"
 #endif
 
+#if uECC_MULT_UMAAL
+    #include "mult_umaal.inc"
+#endif
+
+typedef char uECC_verify_ctx_size_check[(uECC_MAX_WORDS <= uECC_VERIFY_MAX_WORDS) ? 1 : -1];
+
 #if default_RNG_defined
 static uECC_RNG_Function g_rng_function = &default_RNG;
 #else
@@ -1452,116 +1458,218 @@ static bitcount_t smax(bitcount_t a, bitcount_t b) {
     return (a > b ? a : b);
 }
 
-int uECC_verify(const uint8_t *public_key,
-                const uint8_t *message_hash,
-                unsigned hash_size,
-                const uint8_t *signature,
-                uECC_Curve curve) {
-    uECC_word_t u1[uECC_MAX_WORDS], u2[uECC_MAX_WORDS];
-    uECC_word_t z[uECC_MAX_WORDS];
-    uECC_word_t sum[uECC_MAX_WORDS * 2];
-    uECC_word_t rx[uECC_MAX_WORDS];
-    uECC_word_t ry[uECC_MAX_WORDS];
+enum {
+    uECC_VERIFY_ST_INV_S,
+    uECC_VERIFY_ST_SUM,
+    uECC_VERIFY_ST_LOOP,
+    uECC_VERIFY_ST_FINAL,
+    uECC_VERIFY_ST_DONE,
+};
+
+/* sum = G + Q in affine coordinates, 0 if Q = +-G */
+static int verify_sum(uECC_word_t *sum, const uECC_word_t *_public, uECC_Curve curve) {
     uECC_word_t tx[uECC_MAX_WORDS];
     uECC_word_t ty[uECC_MAX_WORDS];
-    uECC_word_t tz[uECC_MAX_WORDS];
-    const uECC_word_t *points[4];
-    const uECC_word_t *point;
-    bitcount_t num_bits;
-    bitcount_t i;
-#if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    uECC_word_t *_public = (uECC_word_t *)public_key;
-#else
-    uECC_word_t _public[uECC_MAX_WORDS * 2];
-#endif    
-    uECC_word_t r[uECC_MAX_WORDS], s[uECC_MAX_WORDS];
+    uECC_word_t z[uECC_MAX_WORDS];
+    wordcount_t num_words = curve->num_words;
+
+    uECC_vli_modSub(z, _public, curve->G, curve->p, num_words); /* z = x2 - x1 */
+    if (uECC_vli_isZero(z, num_words)) {
+        return 0;
+    }
+    uECC_vli_set(sum, _public, num_words);
+    uECC_vli_set(sum + num_words, _public + num_words, num_words);
+    uECC_vli_set(tx, curve->G, num_words);
+    uECC_vli_set(ty, curve->G + num_words, num_words);
+    XYcZ_add(tx, ty, sum, sum + num_words, curve);
+    uECC_vli_modInv(z, z, curve->p, num_words); /* z = 1/z */
+    apply_z(sum, sum + num_words, z, curve);
+    return 1;
+}
+
+static const uECC_word_t *verify_point(const uECC_VerifyCtx *ctx, bitcount_t bit) {
+    uECC_word_t index = (!!uECC_vli_testBit(ctx->u1, bit)) | ((!!uECC_vli_testBit(ctx->u2, bit)) << 1);
+    return index == 0 ? 0 : index == 1 ? ctx->curve->G : index == 2 ? ctx->pub : ctx->sum;
+}
+
+/* Start of Shamir's trick: R = the point for the top bits */
+static void verify_loop_init(uECC_VerifyCtx *ctx) {
+    uECC_Curve curve = ctx->curve;
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+    bitcount_t num_bits = smax(uECC_vli_numBits(ctx->u1, num_n_words),
+                               uECC_vli_numBits(ctx->u2, num_n_words));
+    const uECC_word_t *point = verify_point(ctx, num_bits - 1);
+
+    uECC_vli_set(ctx->rx, point, num_words);
+    uECC_vli_set(ctx->ry, point + num_words, num_words);
+    uECC_vli_clear(ctx->z, num_words);
+    ctx->z[0] = 1;
+    ctx->bit = num_bits - 2;
+    ctx->state = uECC_VERIFY_ST_LOOP;
+}
+
+int uECC_verify_start(uECC_VerifyCtx *ctx,
+                      const uint8_t *public_key,
+                      const uint8_t *public_sum,
+                      const uint8_t *message_hash,
+                      unsigned hash_size,
+                      const uint8_t *signature,
+                      uECC_Curve curve) {
     wordcount_t num_words = curve->num_words;
     wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
 
-    rx[num_n_words - 1] = 0;
-    r[num_n_words - 1] = 0;
-    s[num_n_words - 1] = 0;
+    ctx->curve = curve;
+    ctx->state = uECC_VERIFY_ST_DONE;
+    ctx->rx[num_n_words - 1] = 0;
+    ctx->r[num_n_words - 1] = 0;
+    ctx->z[num_n_words - 1] = 0;
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    __bocpy((uint8_t *) r, signature, curve->num_bytes);
-    __bocpy((uint8_t *) s, signature + curve->num_bytes, curve->num_bytes);
+    __bocpy((uint8_t *) ctx->pub, public_key, curve->num_bytes * 2);
+    __bocpy((uint8_t *) ctx->r, signature, curve->num_bytes);
+    __bocpy((uint8_t *) ctx->z, signature + curve->num_bytes, curve->num_bytes); /* s */
+    if (public_sum) {
+        __bocpy((uint8_t *) ctx->sum, public_sum, curve->num_bytes * 2);
+    }
 #else
-    uECC_vli_bytesToNative(_public, public_key, curve->num_bytes);
+    uECC_vli_bytesToNative(ctx->pub, public_key, curve->num_bytes);
     uECC_vli_bytesToNative(
-        _public + num_words, public_key + curve->num_bytes, curve->num_bytes);
-    uECC_vli_bytesToNative(r, signature, curve->num_bytes);
-    uECC_vli_bytesToNative(s, signature + curve->num_bytes, curve->num_bytes);
+        ctx->pub + num_words, public_key + curve->num_bytes, curve->num_bytes);
+    uECC_vli_bytesToNative(ctx->r, signature, curve->num_bytes);
+    uECC_vli_bytesToNative(ctx->z, signature + curve->num_bytes, curve->num_bytes);
+    if (public_sum) {
+        uECC_vli_bytesToNative(ctx->sum, public_sum, curve->num_bytes);
+        uECC_vli_bytesToNative(
+            ctx->sum + num_words, public_sum + curve->num_bytes, curve->num_bytes);
+    }
 #endif
 
     /* r, s must not be 0. */
-    if (uECC_vli_isZero(r, num_words) || uECC_vli_isZero(s, num_words)) {
+    if (uECC_vli_isZero(ctx->r, num_words) || uECC_vli_isZero(ctx->z, num_words)) {
         return 0;
     }
 
     /* r, s must be < n. */
-    if (uECC_vli_cmp_unsafe(curve->n, r, num_n_words) != 1 ||
-            uECC_vli_cmp_unsafe(curve->n, s, num_n_words) != 1) {
+    if (uECC_vli_cmp_unsafe(curve->n, ctx->r, num_n_words) != 1 ||
+            uECC_vli_cmp_unsafe(curve->n, ctx->z, num_n_words) != 1) {
         return 0;
     }
 
-    /* Calculate u1 and u2. */
-    uECC_vli_modInv(z, s, curve->n, num_n_words); /* z = 1/s */
-    u1[num_n_words - 1] = 0;
-    bits2int(u1, message_hash, hash_size, curve);
-    uECC_vli_modMult(u1, u1, z, curve->n, num_n_words); /* u1 = e/s */
-    uECC_vli_modMult(u2, r, z, curve->n, num_n_words); /* u2 = r/s */
+    ctx->u1[num_n_words - 1] = 0;
+    bits2int(ctx->u1, message_hash, hash_size, curve); /* e */
+    ctx->state = public_sum ? uECC_VERIFY_ST_INV_S | 0x80 : uECC_VERIFY_ST_INV_S;
+    return 1;
+}
 
-    /* Calculate sum = G + Q. */
-    uECC_vli_set(sum, _public, num_words);
-    uECC_vli_set(sum + num_words, _public + num_words, num_words);
-    uECC_vli_set(tx, curve->G, num_words);
-    uECC_vli_set(ty, curve->G + num_words, num_words);
-    uECC_vli_modSub(z, sum, tx, curve->p, num_words); /* z = x2 - x1 */
-    XYcZ_add(tx, ty, sum, sum + num_words, curve);
-    uECC_vli_modInv(z, z, curve->p, num_words); /* z = 1/z */
-    apply_z(sum, sum + num_words, z, curve);
+int uECC_verify_step(uECC_VerifyCtx *ctx, unsigned max_bits) {
+    uECC_Curve curve = ctx->curve;
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
+    uECC_word_t tx[uECC_MAX_WORDS];
+    uECC_word_t ty[uECC_MAX_WORDS];
+    uECC_word_t tz[uECC_MAX_WORDS];
+    const uECC_word_t *point;
+    uint8_t have_sum = ctx->state & 0x80;
+
+    switch (ctx->state & 0x7F) {
+    case uECC_VERIFY_ST_INV_S:
+        /* Calculate u1 and u2. */
+        uECC_vli_modInv(ctx->z, ctx->z, curve->n, num_n_words); /* z = 1/s */
+        uECC_vli_modMult(ctx->u1, ctx->u1, ctx->z, curve->n, num_n_words); /* u1 = e/s */
+        uECC_vli_modMult(ctx->u2, ctx->r, ctx->z, curve->n, num_n_words); /* u2 = r/s */
+        if (have_sum) {
+            verify_loop_init(ctx);
+        } else {
+            ctx->state = uECC_VERIFY_ST_SUM;
+        }
+        return uECC_VERIFY_PENDING;
+
+    case uECC_VERIFY_ST_SUM:
+        /* Calculate sum = G + Q. */
+        if (!verify_sum(ctx->sum, ctx->pub, curve)) {
+            ctx->state = uECC_VERIFY_ST_DONE;
+            return 0;
+        }
+        verify_loop_init(ctx);
+        return uECC_VERIFY_PENDING;
+
+    case uECC_VERIFY_ST_LOOP:
+        /* Use Shamir's trick to calculate u1*G + u2*Q */
+        for (; ctx->bit >= 0 && max_bits; --ctx->bit, --max_bits) {
+            curve->double_jacobian(ctx->rx, ctx->ry, ctx->z, curve);
+
+            point = verify_point(ctx, ctx->bit);
+            if (point) {
+                uECC_vli_set(tx, point, num_words);
+                uECC_vli_set(ty, point + num_words, num_words);
+                apply_z(tx, ty, ctx->z, curve);
+                uECC_vli_modSub(tz, ctx->rx, tx, curve->p, num_words); /* Z = x2 - x1 */
+                XYcZ_add(tx, ty, ctx->rx, ctx->ry, curve);
+                uECC_vli_modMult_fast(ctx->z, ctx->z, tz, curve);
+            }
+        }
+        if (ctx->bit < 0) {
+            ctx->state = uECC_VERIFY_ST_FINAL;
+        }
+        return uECC_VERIFY_PENDING;
+
+    case uECC_VERIFY_ST_FINAL:
+        uECC_vli_modInv(ctx->z, ctx->z, curve->p, num_words); /* Z = 1/Z */
+        apply_z(ctx->rx, ctx->ry, ctx->z, curve);
 
-    /* Use Shamir's trick to calculate u1*G + u2*Q */
-    points[0] = 0;
-    points[1] = curve->G;
-    points[2] = _public;
-    points[3] = sum;
-    num_bits = smax(uECC_vli_numBits(u1, num_n_words),
-                    uECC_vli_numBits(u2, num_n_words));
-
-    point = points[(!!uECC_vli_testBit(u1, num_bits - 1)) |
-                   ((!!uECC_vli_testBit(u2, num_bits - 1)) << 1)];
-    uECC_vli_set(rx, point, num_words);
-    uECC_vli_set(ry, point + num_words, num_words);
-    uECC_vli_clear(z, num_words);
-    z[0] = 1;
-
-    for (i = num_bits - 2; i >= 0; --i) {
-        uECC_word_t index;
-        curve->double_jacobian(rx, ry, z, curve);
-
-        index = (!!uECC_vli_testBit(u1, i)) | ((!!uECC_vli_testBit(u2, i)) << 1);
-        point = points[index];
-        if (point) {
-            uECC_vli_set(tx, point, num_words);
-            uECC_vli_set(ty, point + num_words, num_words);
-            apply_z(tx, ty, z, curve);
-            uECC_vli_modSub(tz, rx, tx, curve->p, num_words); /* Z = x2 - x1 */
-            XYcZ_add(tx, ty, rx, ry, curve);
-            uECC_vli_modMult_fast(z, z, tz, curve);
+        /* v = x1 (mod n) */
+        if (uECC_vli_cmp_unsafe(curve->n, ctx->rx, num_n_words) != 1) {
+            uECC_vli_sub(ctx->rx, ctx->rx, curve->n, num_n_words);
         }
+        ctx->state = uECC_VERIFY_ST_DONE;
+
+        /* Accept only if v == r. */
+        return (int)(uECC_vli_equal(ctx->rx, ctx->r, num_words));
+
+    default:
+        return 0;
     }
+}
 
-    uECC_vli_modInv(z, z, curve->p, num_words); /* Z = 1/Z */
-    apply_z(rx, ry, z, curve);
+int uECC_verify_precompute(const uint8_t *public_key, uint8_t *public_sum, uECC_Curve curve) {
+    uECC_word_t _public[uECC_MAX_WORDS * 2];
+    uECC_word_t sum[uECC_MAX_WORDS * 2];
 
-    /* v = x1 (mod n) */
-    if (uECC_vli_cmp_unsafe(curve->n, rx, num_n_words) != 1) {
-        uECC_vli_sub(rx, rx, curve->n, num_n_words);
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    __bocpy((uint8_t *) _public, public_key, curve->num_bytes * 2);
+#else
+    uECC_vli_bytesToNative(_public, public_key, curve->num_bytes);
+    uECC_vli_bytesToNative(
+        _public + curve->num_words, public_key + curve->num_bytes, curve->num_bytes);
+#endif
+    if (!verify_sum(sum, _public, curve)) {
+        return 0;
     }
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    __bocpy(public_sum, (uint8_t *) sum, curve->num_bytes * 2);
+#else
+    uECC_vli_nativeToBytes(public_sum, curve->num_bytes, sum);
+    uECC_vli_nativeToBytes(
+        public_sum + curve->num_bytes, curve->num_bytes, sum + curve->num_words);
+#endif
+    return 1;
+}
+
+int uECC_verify(const uint8_t *public_key,
+                const uint8_t *message_hash,
+                unsigned hash_size,
+                const uint8_t *signature,
+                uECC_Curve curve) {
+    uECC_VerifyCtx ctx;
+    int res;
 
-    /* Accept only if v == r. */
-    return (int)(uECC_vli_equal(rx, r, num_words));
+    if (!uECC_verify_start(&ctx, public_key, 0, message_hash, hash_size, signature, curve)) {
+        return 0;
+    }
+    while ((res = uECC_verify_step(&ctx, uECC_VERIFY_STEP_ALL)) == uECC_VERIFY_PENDING) {
+    }
+    return res;
 }
 
 #if uECC_ENABLE_VLI_API
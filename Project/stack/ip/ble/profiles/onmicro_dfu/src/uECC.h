@@ -34,7 +34,7 @@ platform. */
 used for (scalar) squaring instead of the generic multiplication function. This can make things
 faster somewhat faster, but increases the code size. */
 #ifndef uECC_SQUARE_FUNC
-    #define uECC_SQUARE_FUNC 0
+    #define uECC_SQUARE_FUNC 1
 #endif
 
 /* uECC_VLI_NATIVE_LITTLE_ENDIAN - If enabled (defined as nonzero), this will switch to native
@@ -75,9 +75,33 @@ the same endianness. */
     #define uECC_SUPPORT_COMPRESSED_POINT 0
 #endif
 
+#include "types.h"
+
 struct uECC_Curve_t;
 typedef const struct uECC_Curve_t * uECC_Curve;
 
+/* Words of the largest supported curve, sizes uECC_VerifyCtx. */
+#define uECC_VERIFY_MAX_WORDS (32 / uECC_WORD_SIZE)
+
+/* uECC_verify_step() results */
+#define uECC_VERIFY_PENDING (-1)
+#define uECC_VERIFY_STEP_ALL 0xFFFF
+
+/* State of a verification split with uECC_verify_start() / uECC_verify_step(). */
+typedef struct uECC_VerifyCtx {
+    uECC_Curve curve;
+    uint8_t state;
+    bitcount_t bit;
+    uECC_word_t u1[uECC_VERIFY_MAX_WORDS];
+    uECC_word_t u2[uECC_VERIFY_MAX_WORDS];
+    uECC_word_t r[uECC_VERIFY_MAX_WORDS];
+    uECC_word_t z[uECC_VERIFY_MAX_WORDS];
+    uECC_word_t rx[uECC_VERIFY_MAX_WORDS];
+    uECC_word_t ry[uECC_VERIFY_MAX_WORDS];
+    uECC_word_t pub[uECC_VERIFY_MAX_WORDS * 2];
+    uECC_word_t sum[uECC_VERIFY_MAX_WORDS * 2];
+} uECC_VerifyCtx;
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -358,6 +382,49 @@ int uECC_verify(const uint8_t *public_key,
                 const uint8_t *signature,
                 uECC_Curve curve);
 
+/* uECC_verify_start() function.
+Same as uECC_verify(), but the work is done later by uECC_verify_step() in bounded chunks,
+so a caller running from an event loop can give other events a turn in between.
+
+Inputs:
+    public_key   - The signer's public key.
+    public_sum   - G + public_key from uECC_verify_precompute(), or NULL to compute it here.
+    message_hash - The hash of the signed data.
+    hash_size    - The size of message_hash in bytes.
+    signature    - The signature value.
+
+Outputs:
+    ctx - Verification state, public_key and public_sum are copied into it.
+
+Returns 1 if the verification started, 0 if the signature is invalid already (r or s out of range).
+*/
+int uECC_verify_start(uECC_VerifyCtx *ctx,
+                      const uint8_t *public_key,
+                      const uint8_t *public_sum,
+                      const uint8_t *message_hash,
+                      unsigned hash_size,
+                      const uint8_t *signature,
+                      uECC_Curve curve);
+
+/* uECC_verify_step() function.
+Continue a verification started by uECC_verify_start(). A step is one modular inversion
+or up to max_bits bits of the double-and-add loop (one doubling and at most one addition each).
+
+Returns uECC_VERIFY_PENDING until done, then 1 if the signature is valid, 0 if it is invalid.
+*/
+int uECC_verify_step(uECC_VerifyCtx *ctx, unsigned max_bits);
+
+/* uECC_verify_precompute() function.
+Compute G + public_key, the point added when both scalar bits are set, so a fixed public key
+can ship it and save uECC_verify_start() one modular inversion per verification.
+
+Outputs:
+    public_sum - Will be filled in with G + public_key, in the public key format.
+
+Returns 1 if the point was computed, 0 if public_key is G or -G.
+*/
+int uECC_verify_precompute(const uint8_t *public_key, uint8_t *public_sum, uECC_Curve curve);
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
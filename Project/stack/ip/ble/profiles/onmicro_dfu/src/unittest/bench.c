@@ -0,0 +1,289 @@
+/*
+ * DFU throughput benchmark: sweeps MTU and PRN over a synthetic multi-image package
+ * against the simulated flash timing of onmicro_dfu_nvds_test.c.
+ *
+ *   ./a.out --bench [mtu=23,185,247,517] [prn=0,1,10,30] [size=131072] [phy=2000000]
+ *                   [ci_us=15000] [prog_ns=2700] [erase_us=40000] [cpu_scale=1]
+ *
+ * One CSV row per run on stdout, the DFU log of each run goes to /dev/null.
+ * est_ms models the link as back to back LL PDUs (251 bytes, T_IFS and an empty
+ * ack each), one connection interval per control request and PRN notification,
+ * and the CPU stalled while flash is busy (XIP): a packet takes the longer of its
+ * air time and the handler + flash time. cpu_scale converts host to target CPU time.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "onmicro_dfu.h"
+#include "onmicro_dfu_decode.h"
+
+#define BENCH_LIST_MAX      16
+#define BENCH_STACK_PROBE   (32 * 1024)
+#define BENCH_IMG_NUM       3
+
+typedef struct {
+    uint32_t mtu[BENCH_LIST_MAX], mtu_num;
+    uint32_t prn[BENCH_LIST_MAX], prn_num;
+    uint32_t size;
+    uint32_t phy_bps;
+    uint32_t ci_us;
+    uint32_t prog_ns;
+    uint32_t erase_us;
+    double   cpu_scale;
+} bench_cfg_t;
+
+typedef struct {
+    uint8_t  result;
+    uint32_t bytes;
+    uint32_t packets;
+    uint64_t est_ns;
+    uint64_t link_ns;
+    uint64_t flash_ns;
+    uint64_t cpu_ns;
+    uint64_t cpu_max_ns;
+    uint32_t stack_peak;
+} bench_result_t;
+
+extern void nvds_init(void);
+extern uint32_t nvds_flash_prog_ns_per_byte;
+extern uint32_t nvds_flash_erase_ns_per_sector;
+extern uint64_t nvds_flash_busy_ns;
+
+static const bench_cfg_t *cfg;
+static bench_result_t *res;
+static uint8_t *stack_lo;
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+// The handlers run on the stack painted here, the untouched part is left 0xA5
+__attribute__((noinline)) static void stack_paint(void)
+{
+    uint8_t buf[BENCH_STACK_PROBE], *p = buf;
+    memset(buf, 0xA5, sizeof(buf));
+    __asm__ volatile("" : "+r"(p) : : "memory"); // Keep the memset, hide the local address
+    stack_lo = p;
+}
+
+__attribute__((noinline)) static uint32_t stack_used(void)
+{
+    volatile uint8_t *p = stack_lo;
+    uint32_t i = 0;
+    while(i < BENCH_STACK_PROBE && p[i] == 0xA5){
+        i++;
+    }
+    return BENCH_STACK_PROBE - i;
+}
+
+// Air time of one ATT write of len bytes
+static uint64_t link_ns(uint32_t len)
+{
+    uint32_t sdu = len + 3 + 4; // ATT + L2CAP headers
+    uint32_t pre = cfg->phy_bps > 1000000 ? 2 : 1;
+    uint64_t t = 0;
+    while(sdu){
+        uint32_t n = sdu > 251 ? 251 : sdu;
+        t += (uint64_t)(pre + 4 + 2 + n + 3) * 8 * 1000000000u / cfg->phy_bps + 150000; // PDU + T_IFS
+        t += (uint64_t)(pre + 4 + 2 + 3) * 8 * 1000000000u / cfg->phy_bps + 150000;     // empty ack + T_IFS
+        sdu -= n;
+    }
+    return t;
+}
+
+// CPU and flash time of one call, returns the response length
+static uint8_t bench_call(bool ctrl, uint8_t *data, uint32_t len, dfu_response_t *rsp)
+{
+    uint64_t busy = nvds_flash_busy_ns, t;
+    uint32_t stack;
+    memset(rsp, 0, sizeof(*rsp));
+    stack_paint();
+    t = now_ns();
+    if(ctrl){
+        dfu_write_cmd(data, len, rsp);
+    }else{
+        dfu_write_data(data, len, rsp);
+        dfu_flash_process(); // ONMICRO_DFU_FLASH_IND before the next packet
+    }
+    t = now_ns() - t;
+    stack = stack_used();
+    busy = nvds_flash_busy_ns - busy;
+    if(stack > res->stack_peak){
+        res->stack_peak = stack;
+    }
+    res->cpu_ns += t;
+    if(t > res->cpu_max_ns){
+        res->cpu_max_ns = t;
+    }
+    res->flash_ns += busy;
+    if(ctrl){
+        res->est_ns += (uint64_t)cfg->ci_us * 1000 + busy + (uint64_t)(t * cfg->cpu_scale);
+    }else{
+        uint64_t air = link_ns(len), work = busy + (uint64_t)(t * cfg->cpu_scale);
+        res->link_ns += air;
+        res->est_ns += air > work ? air : work;
+        if(rsp->length){ // PRN notification, the phone waits for it
+            res->est_ns += (uint64_t)cfg->ci_us * 1000;
+        }
+    }
+    return rsp->length;
+}
+
+static void bench_ctrl(uint8_t *cmd, uint32_t len)
+{
+    dfu_response_t rsp;
+    bench_call(true, cmd, len, &rsp);
+    if(rsp.result != DFU_SUCCESS && res->result == DFU_SUCCESS){
+        res->result = rsp.result;
+    }
+}
+
+static void bench_create(uint8_t type, uint32_t size)
+{
+    uint8_t create[6] = { DFU_CTRL_CREATE, type, size, size >> 8, size >> 16, size >> 24 };
+    bench_ctrl(create, sizeof(create));
+}
+
+// APP + PATCH + CONFIG, the sizes the data object is split into
+static uint32_t bench_cmd_build(uint8_t *cmd, uint32_t app_size)
+{
+    uint32_t pkg[3 + BENCH_IMG_NUM * 3] = {
+        0x01BFDF55, DFU_PROTOCOL_VERSION, BENCH_IMG_NUM << 16,
+        IMAGE_TYPE_APP,    1, app_size,
+        IMAGE_TYPE_PATCH,  1, 0x1800,
+        IMAGE_TYPE_CONFIG, 1, 0x4000,
+    };
+    memcpy(cmd, pkg, sizeof(pkg));
+    return sizeof(pkg);
+}
+
+static void bench_run(uint32_t mtu, uint32_t prn)
+{
+    static uint8_t cmd[DFU_COMMAND_OBJ_MAX_SIZE];
+    uint32_t cmd_size = bench_cmd_build(cmd, cfg->size);
+    uint32_t i, n, size = cfg->size + 0x1800 + 0x4000;
+    uint8_t *data = malloc(size);
+    uint8_t set_prn[3] = { DFU_CTRL_SET_PRN, prn, prn >> 8 };
+    dfu_response_t rsp;
+
+    for(i=0;i<size;i++){
+        data[i] = rand();
+    }
+    nvds_init();
+    nvds_flash_prog_ns_per_byte = cfg->prog_ns;
+    nvds_flash_erase_ns_per_sector = cfg->erase_us * 1000;
+    nvds_flash_busy_ns = 0;
+    res->result = DFU_SUCCESS;
+    res->bytes = size;
+
+    bench_ctrl((uint8_t*)"\x06\x01", 2);
+    bench_create(0x01, cmd_size); // command object
+    bench_call(false, cmd, cmd_size, &rsp);
+    bench_ctrl((uint8_t*)"\x04", 1);
+    bench_ctrl((uint8_t*)"\x06\x02", 2);
+    bench_ctrl(set_prn, sizeof(set_prn));
+    bench_create(0x02, size);     // data object
+    for(i=0;i<size;i+=n){
+        n = size - i < mtu - 3 ? size - i : mtu - 3;
+        bench_call(false, &data[i], n, &rsp);
+        res->packets++;
+    }
+    bench_ctrl((uint8_t*)"\x03", 1);
+    bench_ctrl((uint8_t*)"\x04", 1);
+    free(data);
+}
+
+static uint32_t parse_list(const char *s, uint32_t *list)
+{
+    uint32_t n = 0;
+    while(*s && n < BENCH_LIST_MAX){
+        list[n++] = strtoul(s, (char**)&s, 0);
+        if(*s == ','){
+            s++;
+        }
+    }
+    return n;
+}
+
+int dfu_bench(int argc, char *argv[])
+{
+    static const uint32_t mtus[] = { 23, 65, 131, 185, 247, 251, 512, 517 };
+    static const uint32_t prns[] = { 0, 1, 5, 10, 30 };
+    bench_cfg_t c = {
+        .size = 0x20000, .phy_bps = 2000000, .ci_us = 15000,
+        .prog_ns = 2700, .erase_us = 40000, .cpu_scale = 1,
+    };
+    int i, m, p;
+    memcpy(c.mtu, mtus, sizeof(mtus));
+    c.mtu_num = sizeof(mtus) / sizeof(mtus[0]);
+    memcpy(c.prn, prns, sizeof(prns));
+    c.prn_num = sizeof(prns) / sizeof(prns[0]);
+    for(i=0;i<argc;i++){
+        char *v = strchr(argv[i], '=');
+        if(!v){
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return -1;
+        }
+        *v++ = '\0';
+        if(!strcmp(argv[i], "mtu"))            c.mtu_num = parse_list(v, c.mtu);
+        else if(!strcmp(argv[i], "prn"))       c.prn_num = parse_list(v, c.prn);
+        else if(!strcmp(argv[i], "size"))      c.size = strtoul(v, NULL, 0);
+        else if(!strcmp(argv[i], "phy"))       c.phy_bps = strtoul(v, NULL, 0);
+        else if(!strcmp(argv[i], "ci_us"))     c.ci_us = strtoul(v, NULL, 0);
+        else if(!strcmp(argv[i], "prog_ns"))   c.prog_ns = strtoul(v, NULL, 0);
+        else if(!strcmp(argv[i], "erase_us"))  c.erase_us = strtoul(v, NULL, 0);
+        else if(!strcmp(argv[i], "cpu_scale")) c.cpu_scale = strtod(v, NULL);
+        else{
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return -1;
+        }
+    }
+    cfg = &c;
+
+    printf("mtu,prn,images,bytes,packets,est_ms,bytes_per_s,link_ms,flash_ms,cpu_us_per_pkt,cpu_us_max,stack_peak,buf_ram,result\n");
+    for(m=0;m<c.mtu_num;m++){
+        for(p=0;p<c.prn_num;p++){
+            bench_result_t r = {0};
+            int fd[2], status;
+            if(c.mtu[m] < 23 || c.mtu[m] > 517 || pipe(fd)){
+                continue;
+            }
+            fflush(stdout);
+            pid_t pid = fork();
+            if(pid == 0){ // A successful update locks DFU, one process per run
+                close(fd[0]);
+                if(!freopen("/dev/null", "w", stdout)){
+                    _exit(1);
+                }
+                res = &r;
+                bench_run(c.mtu[m], c.prn[p]);
+                if(write(fd[1], &r, sizeof(r)) != sizeof(r)){
+                    _exit(1);
+                }
+                _exit(0);
+            }
+            close(fd[1]);
+            if(read(fd[0], &r, sizeof(r)) != sizeof(r)){
+                r.result = 0xFF;
+            }
+            close(fd[0]);
+            waitpid(pid, &status, 0);
+            printf("%u,%u,%u,%u,%u,%.1f,%.0f,%.1f,%.1f,%.2f,%.2f,%u,%u,0x%02X\n",
+                    c.mtu[m], c.prn[p], BENCH_IMG_NUM, r.bytes, r.packets,
+                    r.est_ns / 1e6, r.est_ns ? r.bytes * 1e9 / r.est_ns : 0,
+                    r.link_ns / 1e6, r.flash_ns / 1e6,
+                    r.packets ? r.cpu_ns / 1e3 / r.packets : 0, r.cpu_max_ns / 1e3,
+                    r.stack_peak,
+                    DFU_CACHE_BUF_NUM * DFU_CACHE_BUF_SIZE + DFU_COMMAND_OBJ_MAX_SIZE + (1 << DFU_LZ_WINDOW_SZ2_MAX),
+                    r.result);
+        }
+    }
+    return 0;
+}
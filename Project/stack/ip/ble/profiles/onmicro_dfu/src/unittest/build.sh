@@ -1,2 +1,11 @@
-rm -rf a.out a.exe
-gcc *.c ../onmicro_dfu.c ../sha256.c ../uecc.c ../public_key.c -I.. -I. -Wall -O3 --std=c99 -m32
+rm -rf a.out a.exe a_readback.out a_umaal.out a_sign.out a_slice8.out
+gcc *.c ../onmicro_dfu.c ../onmicro_dfu_decode.c ../sha256.c ../uECC.c ../public_key.c ../../../../../../../coroutine/co_crc.c -I.. -I. -I../../../../../../../coroutine -Wall -O3 --std=c99 -m32 -DBLE_APP_ONMICRO_DFU=1
+# Execute reads every image back from flash, for comparison
+gcc *.c ../onmicro_dfu.c ../onmicro_dfu_decode.c ../sha256.c ../uECC.c ../public_key.c ../../../../../../../coroutine/co_crc.c -I.. -I. -I../../../../../../../coroutine -Wall -O3 --std=c99 -m32 -DBLE_APP_ONMICRO_DFU=1 -DDFU_VERIFY_READBACK_EN=1 -o a_readback.out
+# Cortex-M4 multiply and square of mult_umaal.inc, built for the host
+gcc *.c ../onmicro_dfu.c ../onmicro_dfu_decode.c ../sha256.c ../uECC.c ../public_key.c ../../../../../../../coroutine/co_crc.c -I.. -I. -I../../../../../../../coroutine -Wall -O3 --std=c99 -m32 -DBLE_APP_ONMICRO_DFU=1 -DuECC_MULT_UMAAL=1 -o a_umaal.out
+# Signed packages with a test key, no x.dat needed: ./a_sign.out
+gcc *.c ../onmicro_dfu.c ../onmicro_dfu_decode.c ../sha256.c ../uECC.c ../../../../../../../coroutine/co_crc.c -I.. -I. -I../../../../../../../coroutine -Wall -O3 --std=c99 -m32 -DBLE_APP_ONMICRO_DFU=1 -DDFU_CTRL_SIGN_EN=1 -o a_sign.out
+# Slice-by-8 CRC32/CRC16 instead of the single-table firmware default, to compare with --bench
+gcc *.c ../onmicro_dfu.c ../onmicro_dfu_decode.c ../sha256.c ../uECC.c ../public_key.c ../../../../../../../coroutine/co_crc.c -I.. -I. -I../../../../../../../coroutine -Wall -O3 --std=c99 -m32 -DBLE_APP_ONMICRO_DFU=1 -DCO_CRC32_IMPL=CO_CRC_IMPL_SLICE8 -DCO_CRC16_IMPL=CO_CRC_IMPL_SLICE8 -o a_slice8.out
+# Throughput sweep, CSV on stdout: ./a.out --bench [mtu=23,247,517] [prn=0,10] [prog_ns=2700] [erase_us=40000] ...
@@ -0,0 +1,347 @@
+/*
+ * Signature verification of signed DFU packages (uECC, secp192r1):
+ * OpenSSL generated test vectors, invalid signatures, the resumable
+ * uECC_verify_start()/uECC_verify_step() path and the precomputed G + Q,
+ * then verify time and the longest step on the host.
+ * With DFU_CTRL_SIGN_EN a signed package is sent through the DFU, the
+ * EXECUTE response of the command object comes from dfu_sign_process().
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "onmicro_dfu.h"
+#include "uECC.h"
+#include "sha256.h"
+
+#define ECC_CURVE       uECC_secp192r1()
+#define ECC_SIZE        24
+#define ECC_BENCH_LOOPS 200
+
+typedef struct {
+    uint8_t pub[ECC_SIZE * 2];  // x | y, little endian
+    uint8_t e[ECC_SIZE];        // leftmost 192 bits of the sha256, little endian
+    uint8_t sig[ECC_SIZE * 2];  // r | s, little endian
+} ecc_vector_t;
+
+// openssl ecparam -name prime192v1 -genkey; openssl dgst -sha256 -sign, converted to uECC byte order
+static const ecc_vector_t ecc_vectors[] = {
+    { // sha256("")
+        {
+            0x7A, 0xC0, 0x21, 0xB6, 0xF9, 0xA5, 0x81, 0x44, 0xB1, 0x20, 0x76, 0x62, 0xBB, 0xCF, 0xED, 0xA5,
+            0xDF, 0xB2, 0x34, 0x07, 0x38, 0x9F, 0x5B, 0x7D, 0x57, 0x0C, 0xA9, 0xEE, 0x1B, 0xF3, 0x63, 0xDD,
+            0x71, 0xAE, 0xF5, 0x25, 0x85, 0xF6, 0x9B, 0x59, 0x2A, 0x5E, 0x31, 0x3D, 0x9C, 0x7E, 0x9A, 0x2C,
+        },
+        {
+            0x4C, 0x93, 0x9B, 0x64, 0xE4, 0x41, 0xAE, 0x27, 0x24, 0xB9, 0x6F, 0x99, 0xC8, 0xF4, 0xFB, 0x9A,
+            0x14, 0x1C, 0xFC, 0x98, 0x42, 0xC4, 0xB0, 0xE3,
+        },
+        {
+            0xBE, 0xC4, 0xDE, 0x5A, 0x8B, 0x6C, 0x99, 0x14, 0xA2, 0x62, 0xCD, 0x62, 0xAB, 0x0F, 0x13, 0x21,
+            0x3C, 0x2C, 0xB4, 0x1F, 0x1D, 0xA6, 0x53, 0x61, 0x99, 0x67, 0x60, 0xF9, 0x25, 0x4E, 0x40, 0x37,
+            0x1F, 0xD8, 0x37, 0x0B, 0x20, 0xBC, 0xAC, 0x3B, 0xBF, 0xCB, 0x6A, 0x96, 0xF5, 0xC1, 0xA9, 0xAD,
+        },
+    },
+    { // sha256("abc")
+        {
+            0x7A, 0xC0, 0x21, 0xB6, 0xF9, 0xA5, 0x81, 0x44, 0xB1, 0x20, 0x76, 0x62, 0xBB, 0xCF, 0xED, 0xA5,
+            0xDF, 0xB2, 0x34, 0x07, 0x38, 0x9F, 0x5B, 0x7D, 0x57, 0x0C, 0xA9, 0xEE, 0x1B, 0xF3, 0x63, 0xDD,
+            0x71, 0xAE, 0xF5, 0x25, 0x85, 0xF6, 0x9B, 0x59, 0x2A, 0x5E, 0x31, 0x3D, 0x9C, 0x7E, 0x9A, 0x2C,
+        },
+        {
+            0x9C, 0x7A, 0x17, 0x96, 0xA3, 0x61, 0x03, 0xB0, 0x23, 0x22, 0xAE, 0x5D, 0xDE, 0x40, 0x41, 0x41,
+            0xEA, 0xCF, 0x01, 0x8F, 0xBF, 0x16, 0x78, 0xBA,
+        },
+        {
+            0x51, 0x0D, 0x9F, 0xA8, 0x0A, 0x94, 0xF2, 0x6E, 0xF3, 0xBF, 0xFD, 0x17, 0x2D, 0x16, 0x86, 0xDB,
+            0x2F, 0x27, 0x49, 0x71, 0x75, 0xE4, 0x03, 0x1A, 0x2A, 0x4F, 0x86, 0xB1, 0x16, 0x7C, 0xFD, 0xB3,
+            0xC8, 0x7D, 0x56, 0x32, 0x76, 0xA8, 0x12, 0xE2, 0xDC, 0x96, 0x1E, 0x30, 0x2A, 0x7E, 0x65, 0x5F,
+        },
+    },
+    { // sha256("onmicro dfu")
+        {
+            0x7A, 0xC0, 0x21, 0xB6, 0xF9, 0xA5, 0x81, 0x44, 0xB1, 0x20, 0x76, 0x62, 0xBB, 0xCF, 0xED, 0xA5,
+            0xDF, 0xB2, 0x34, 0x07, 0x38, 0x9F, 0x5B, 0x7D, 0x57, 0x0C, 0xA9, 0xEE, 0x1B, 0xF3, 0x63, 0xDD,
+            0x71, 0xAE, 0xF5, 0x25, 0x85, 0xF6, 0x9B, 0x59, 0x2A, 0x5E, 0x31, 0x3D, 0x9C, 0x7E, 0x9A, 0x2C,
+        },
+        {
+            0xA5, 0x51, 0xE9, 0x59, 0x1F, 0x87, 0x21, 0x65, 0x78, 0x50, 0xEB, 0xFD, 0x5B, 0xB2, 0xF8, 0xB3,
+            0xA8, 0x1D, 0xD3, 0xE7, 0xDB, 0x30, 0x34, 0x04,
+        },
+        {
+            0x6C, 0xDD, 0x20, 0x93, 0xA7, 0x5F, 0x90, 0xF8, 0xC6, 0xCD, 0xD7, 0x63, 0x5E, 0x1E, 0x89, 0xA6,
+            0x26, 0xF6, 0x22, 0x32, 0xF1, 0xCF, 0x18, 0xE4, 0x10, 0x55, 0x78, 0xDC, 0x0F, 0x1F, 0x5B, 0x7A,
+            0x38, 0x26, 0xC9, 0xB3, 0x29, 0xD6, 0xB0, 0x61, 0xC6, 0xCF, 0xFC, 0x4A, 0xB3, 0xFA, 0x3E, 0xFF,
+        },
+    },
+    { // sha256("123456789")
+        {
+            0x7A, 0xC0, 0x21, 0xB6, 0xF9, 0xA5, 0x81, 0x44, 0xB1, 0x20, 0x76, 0x62, 0xBB, 0xCF, 0xED, 0xA5,
+            0xDF, 0xB2, 0x34, 0x07, 0x38, 0x9F, 0x5B, 0x7D, 0x57, 0x0C, 0xA9, 0xEE, 0x1B, 0xF3, 0x63, 0xDD,
+            0x71, 0xAE, 0xF5, 0x25, 0x85, 0xF6, 0x9B, 0x59, 0x2A, 0x5E, 0x31, 0x3D, 0x9C, 0x7E, 0x9A, 0x2C,
+        },
+        {
+            0x5F, 0xC6, 0x94, 0xCE, 0x20, 0xE3, 0x20, 0x0C, 0x42, 0x19, 0xC4, 0x9E, 0x60, 0xEF, 0xF1, 0xB0,
+            0xEB, 0x91, 0x38, 0xC3, 0xD3, 0xB0, 0xE2, 0x15,
+        },
+        {
+            0x93, 0x4B, 0x3A, 0xE5, 0xBD, 0xF5, 0xA9, 0x38, 0xA2, 0xE2, 0xE0, 0xEE, 0x56, 0xB9, 0x93, 0xF7,
+            0x73, 0xFA, 0x76, 0x0E, 0x03, 0x66, 0xB0, 0x9A, 0xD9, 0x3A, 0x19, 0xD2, 0x37, 0x77, 0xA6, 0xEA,
+            0xB2, 0xD0, 0x39, 0x6A, 0x6A, 0xE2, 0x94, 0x00, 0xA9, 0x86, 0xAF, 0x8A, 0xF7, 0xCA, 0x05, 0x04,
+        },
+    },
+    { // sha256(00 01 .. 3F)
+        {
+            0x59, 0x15, 0x15, 0x09, 0xC9, 0xFB, 0x18, 0x1B, 0xB5, 0xE6, 0xEE, 0x0D, 0x98, 0xF2, 0x2D, 0xCB,
+            0x2F, 0xFF, 0x51, 0x13, 0xF7, 0xAD, 0xC4, 0x5A, 0x39, 0xCC, 0xC9, 0xFB, 0x77, 0xED, 0xB1, 0xDC,
+            0x28, 0xD7, 0xC0, 0x48, 0x1F, 0xAF, 0x2D, 0x07, 0xBA, 0x97, 0x8E, 0x48, 0xC7, 0x8C, 0x6A, 0xA3,
+        },
+        {
+            0x3A, 0x60, 0x11, 0x98, 0xCF, 0x7F, 0x75, 0x9C, 0x8F, 0x9E, 0xA2, 0xC9, 0xCD, 0x58, 0x26, 0xBD,
+            0x62, 0x03, 0x71, 0xF3, 0xAC, 0xB9, 0xEA, 0xFD,
+        },
+        {
+            0xA2, 0xD5, 0xA2, 0x9F, 0xD4, 0x70, 0x65, 0x60, 0x5B, 0x40, 0x2D, 0x0A, 0xD9, 0xD6, 0x5A, 0xEB,
+            0xE4, 0x3A, 0xF5, 0x9E, 0x17, 0x20, 0xDF, 0x6C, 0x70, 0xE1, 0x0C, 0x20, 0xCB, 0x99, 0xC4, 0xBD,
+            0x7C, 0xAF, 0x4F, 0x58, 0xB0, 0x7D, 0xD3, 0x3A, 0x61, 0xDE, 0x0D, 0x57, 0x61, 0x6C, 0x66, 0x92,
+        },
+    },
+    { // sha256(100 x FF)
+        {
+            0x59, 0x15, 0x15, 0x09, 0xC9, 0xFB, 0x18, 0x1B, 0xB5, 0xE6, 0xEE, 0x0D, 0x98, 0xF2, 0x2D, 0xCB,
+            0x2F, 0xFF, 0x51, 0x13, 0xF7, 0xAD, 0xC4, 0x5A, 0x39, 0xCC, 0xC9, 0xFB, 0x77, 0xED, 0xB1, 0xDC,
+            0x28, 0xD7, 0xC0, 0x48, 0x1F, 0xAF, 0x2D, 0x07, 0xBA, 0x97, 0x8E, 0x48, 0xC7, 0x8C, 0x6A, 0xA3,
+        },
+        {
+            0x28, 0xF3, 0xF8, 0xFB, 0x63, 0xEB, 0x52, 0x26, 0x8B, 0x9D, 0x1E, 0x29, 0x40, 0xB3, 0xA5, 0x01,
+            0xCE, 0x56, 0xE3, 0x0C, 0x97, 0x14, 0x6F, 0xDA,
+        },
+        {
+            0x6C, 0xBE, 0x57, 0xDC, 0x6E, 0x32, 0xE0, 0x0F, 0x64, 0xC0, 0x1D, 0xAB, 0x29, 0xFC, 0xEF, 0x6F,
+            0xCA, 0x93, 0x0B, 0xAA, 0x9F, 0x4B, 0x4C, 0xE5, 0x4E, 0x00, 0xF2, 0x0C, 0x10, 0xAD, 0xED, 0x55,
+            0xC5, 0xA3, 0x0A, 0xDC, 0xD3, 0x8D, 0xCB, 0x2C, 0xD4, 0xB0, 0xE0, 0xBA, 0x5A, 0xAB, 0x83, 0x80,
+        },
+    },
+    { // sha256("AM300A init packet")
+        {
+            0x59, 0x15, 0x15, 0x09, 0xC9, 0xFB, 0x18, 0x1B, 0xB5, 0xE6, 0xEE, 0x0D, 0x98, 0xF2, 0x2D, 0xCB,
+            0x2F, 0xFF, 0x51, 0x13, 0xF7, 0xAD, 0xC4, 0x5A, 0x39, 0xCC, 0xC9, 0xFB, 0x77, 0xED, 0xB1, 0xDC,
+            0x28, 0xD7, 0xC0, 0x48, 0x1F, 0xAF, 0x2D, 0x07, 0xBA, 0x97, 0x8E, 0x48, 0xC7, 0x8C, 0x6A, 0xA3,
+        },
+        {
+            0xE1, 0x7B, 0x88, 0xDA, 0x5B, 0x3F, 0x2A, 0xEA, 0x8F, 0x6F, 0x3C, 0xEC, 0xAE, 0x33, 0x09, 0xA3,
+            0xA4, 0x3E, 0x60, 0x4D, 0x4F, 0x78, 0x0A, 0x93,
+        },
+        {
+            0x11, 0x86, 0x7F, 0xAB, 0xB8, 0x6D, 0x41, 0x59, 0x3F, 0xD2, 0xEF, 0x12, 0x36, 0xF3, 0x1D, 0xD0,
+            0xF4, 0x55, 0x51, 0xFB, 0x95, 0xDB, 0x74, 0x95, 0x2F, 0x33, 0x07, 0xD8, 0x6A, 0x64, 0x15, 0x6C,
+            0xC2, 0x31, 0x52, 0x97, 0x6C, 0x58, 0x3E, 0x17, 0x9D, 0x4D, 0xDF, 0xED, 0x17, 0xE6, 0x57, 0xB7,
+        },
+    },
+    { // sha256(1000 x "x")
+        {
+            0x59, 0x15, 0x15, 0x09, 0xC9, 0xFB, 0x18, 0x1B, 0xB5, 0xE6, 0xEE, 0x0D, 0x98, 0xF2, 0x2D, 0xCB,
+            0x2F, 0xFF, 0x51, 0x13, 0xF7, 0xAD, 0xC4, 0x5A, 0x39, 0xCC, 0xC9, 0xFB, 0x77, 0xED, 0xB1, 0xDC,
+            0x28, 0xD7, 0xC0, 0x48, 0x1F, 0xAF, 0x2D, 0x07, 0xBA, 0x97, 0x8E, 0x48, 0xC7, 0x8C, 0x6A, 0xA3,
+        },
+        {
+            0x7A, 0xDE, 0x0F, 0x98, 0x81, 0x91, 0x7A, 0xC4, 0x34, 0xC5, 0xE9, 0xD3, 0xA8, 0x92, 0x17, 0xBA,
+            0x03, 0xBA, 0xA5, 0x94, 0x44, 0x35, 0xF8, 0x44,
+        },
+        {
+            0xDC, 0x06, 0x41, 0xBD, 0xEC, 0xD1, 0xB4, 0x6C, 0x88, 0x47, 0x94, 0xEA, 0xB1, 0xE5, 0x46, 0x58,
+            0xC1, 0x68, 0x01, 0x18, 0xE3, 0x89, 0x6F, 0xA8, 0x89, 0x72, 0x05, 0xB5, 0x17, 0x26, 0x69, 0x9B,
+            0xD0, 0x9C, 0x02, 0x4D, 0x94, 0x36, 0xED, 0x75, 0x39, 0x4A, 0xC9, 0xD8, 0xC6, 0x5B, 0xB3, 0xBD,
+        },
+    },
+};
+#define ECC_VECTOR_NUM (sizeof(ecc_vectors) / sizeof(ecc_vectors[0]))
+
+#if DFU_CTRL_SIGN_EN
+// Test key of the signed packages, public_key.c is not linked in this build
+uint8_t dfu_public_key[ECC_SIZE * 2];
+uint8_t dfu_public_key_sum[ECC_SIZE * 2];
+static uint8_t dfu_private_key[ECC_SIZE];
+#else
+extern uint8_t dfu_public_key[];
+extern uint8_t dfu_public_key_sum[];
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+static int test_rng(uint8_t *dest, unsigned size)
+{
+    while(size--){
+        *dest++ = rand();
+    }
+    return 1;
+}
+
+// Step through a verification, returns the result and the number of steps
+static int verify_steps(const ecc_vector_t *v, const uint8_t *sum, unsigned max_bits, uint32_t *steps)
+{
+    uECC_VerifyCtx ctx;
+    int res;
+    *steps = 0;
+    if(!uECC_verify_start(&ctx, v->pub, sum, v->e, ECC_SIZE, v->sig, ECC_CURVE)){
+        return 0;
+    }
+    do{
+        res = uECC_verify_step(&ctx, max_bits);
+        (*steps)++;
+    }while(res == uECC_VERIFY_PENDING);
+    return res;
+}
+
+static void test_vectors(void)
+{
+    static const unsigned max_bits[] = { 1, 7, DFU_SIGN_STEP_BITS, 64, uECC_VERIFY_STEP_ALL };
+    uint8_t sum[ECC_SIZE * 2];
+    uint32_t i, j, steps;
+    for(i=0;i<ECC_VECTOR_NUM;i++){
+        const ecc_vector_t *v = &ecc_vectors[i];
+        assert(uECC_valid_public_key(v->pub, ECC_CURVE));
+        assert(uECC_verify(v->pub, v->e, ECC_SIZE, v->sig, ECC_CURVE) == 1);
+        assert(uECC_verify_precompute(v->pub, sum, ECC_CURVE));
+        for(j=0;j<sizeof(max_bits)/sizeof(max_bits[0]);j++){
+            assert(verify_steps(v, NULL, max_bits[j], &steps) == 1);
+            assert(verify_steps(v, sum, max_bits[j], &steps) == 1);
+            // inverse of s, the bits in chunks of max_bits, inverse of Z
+            assert(steps <= 1 + (ECC_SIZE * 8 + max_bits[j] - 1) / max_bits[j] + 1);
+        }
+    }
+}
+
+// Any change of key, hash or signature fails, out of range r or s fails at the start
+static void test_invalid(void)
+{
+    uint32_t i, k, steps;
+    for(i=0;i<ECC_VECTOR_NUM;i++){
+        ecc_vector_t v = ecc_vectors[i];
+        for(k=0;k<ECC_SIZE*8;k+=23){
+            v.sig[k/8] ^= 1 << (k % 8);                     // r
+            assert(uECC_verify(v.pub, v.e, ECC_SIZE, v.sig, ECC_CURVE) == 0);
+            v.sig[k/8] ^= 1 << (k % 8);
+            v.sig[ECC_SIZE + k/8] ^= 1 << (k % 8);          // s
+            assert(verify_steps(&v, NULL, DFU_SIGN_STEP_BITS, &steps) == 0);
+            v.sig[ECC_SIZE + k/8] ^= 1 << (k % 8);
+            v.e[k/8] ^= 1 << (k % 8);                       // hash
+            assert(verify_steps(&v, NULL, 7, &steps) == 0);
+            v.e[k/8] ^= 1 << (k % 8);
+        }
+        memcpy(v.pub, ecc_vectors[(i + 1) % ECC_VECTOR_NUM].pub, sizeof(v.pub));
+        if(memcmp(v.pub, ecc_vectors[i].pub, sizeof(v.pub))){  // other key
+            assert(uECC_verify(v.pub, v.e, ECC_SIZE, v.sig, ECC_CURVE) == 0);
+        }
+        v = ecc_vectors[i];
+        memset(v.sig, 0, ECC_SIZE);                         // r = 0
+        assert(verify_steps(&v, NULL, DFU_SIGN_STEP_BITS, &steps) == 0 && steps == 0);
+        v = ecc_vectors[i];
+        memset(&v.sig[ECC_SIZE], 0xFF, ECC_SIZE);           // s >= n
+        assert(verify_steps(&v, NULL, DFU_SIGN_STEP_BITS, &steps) == 0 && steps == 0);
+    }
+}
+
+// Sign and verify with random keys, the multiply and square of this build against each other
+static void test_sign_verify(void)
+{
+    uint8_t pub[ECC_SIZE * 2], priv[ECC_SIZE], sum[ECC_SIZE * 2], hash[SHA256_BLOCK_SIZE];
+    uECC_VerifyCtx ctx;
+    uint32_t i, j;
+    int res;
+    uECC_set_rng(test_rng);
+    for(i=0;i<64;i++){
+        assert(uECC_make_key(pub, priv, ECC_CURVE));
+        for(j=0;j<sizeof(hash);j++){
+            hash[j] = rand();
+        }
+        ecc_vector_t v;
+        memcpy(v.pub, pub, sizeof(pub));
+        memcpy(v.e, hash, ECC_SIZE);
+        assert(uECC_sign(priv, hash, sizeof(hash), v.sig, ECC_CURVE));
+        assert(uECC_verify(pub, hash, sizeof(hash), v.sig, ECC_CURVE) == 1);
+        assert(uECC_verify_precompute(pub, sum, ECC_CURVE));
+        assert(uECC_verify_start(&ctx, pub, sum, hash, sizeof(hash), v.sig, ECC_CURVE));
+        while((res = uECC_verify_step(&ctx, 1 + i)) == uECC_VERIFY_PENDING);
+        assert(res == 1);
+    }
+}
+
+#if DFU_CTRL_SIGN_EN
+// Signature of a command object, as the package tool makes it
+void ecc_test_sign(const uint8_t *data, uint32_t len, uint8_t *sig)
+{
+    uint8_t hash[SHA256_BLOCK_SIZE];
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, hash);
+    assert(uECC_sign(dfu_private_key, hash, sizeof(hash), sig, ECC_CURVE));
+}
+#endif
+
+// The DFU key ships with its G + Q
+static void test_dfu_key(void)
+{
+    uint8_t sum[ECC_SIZE * 2];
+    assert(uECC_valid_public_key(dfu_public_key, ECC_CURVE));
+    assert(uECC_verify_precompute(dfu_public_key, sum, ECC_CURVE));
+    assert(memcmp(sum, dfu_public_key_sum, sizeof(sum)) == 0);
+}
+
+static void bench(void)
+{
+    const ecc_vector_t *v = &ecc_vectors[0];
+    uint8_t sum[ECC_SIZE * 2];
+    uint64_t t, t_full, t_sum, t_step, t_max = 0;
+    uint32_t i, steps = 0;
+    uECC_VerifyCtx ctx;
+    int res;
+
+    uECC_verify_precompute(v->pub, sum, ECC_CURVE);
+    t = now_ns();
+    for(i=0;i<ECC_BENCH_LOOPS;i++){
+        assert(uECC_verify(v->pub, v->e, ECC_SIZE, v->sig, ECC_CURVE) == 1);
+    }
+    t_full = (now_ns() - t) / ECC_BENCH_LOOPS;
+    t = now_ns();
+    for(i=0;i<ECC_BENCH_LOOPS;i++){
+        assert(verify_steps(v, sum, uECC_VERIFY_STEP_ALL, &steps) == 1);
+    }
+    t_sum = (now_ns() - t) / ECC_BENCH_LOOPS;
+    for(i=0;i<ECC_BENCH_LOOPS;i++){
+        steps = 0;
+        uECC_verify_start(&ctx, v->pub, sum, v->e, ECC_SIZE, v->sig, ECC_CURVE);
+        do{
+            t = now_ns();
+            res = uECC_verify_step(&ctx, DFU_SIGN_STEP_BITS);
+            t_step = now_ns() - t;
+            t_max = t_step > t_max ? t_step : t_max;
+            steps++;
+        }while(res == uECC_VERIFY_PENDING);
+    }
+    log_debug("ECC secp192r1 verify: %.1f us, with G+Q %.1f us, %d steps of %d bits, longest %.1f us (MULT_UMAAL:%d SQUARE_FUNC:%d)\n",
+            t_full / 1e3, t_sum / 1e3, steps, DFU_SIGN_STEP_BITS, t_max / 1e3, uECC_MULT_UMAAL, uECC_SQUARE_FUNC);
+}
+
+void test_ecc(void)
+{
+#if DFU_CTRL_SIGN_EN
+    uECC_set_rng(test_rng);
+    assert(uECC_make_key(dfu_public_key, dfu_private_key, ECC_CURVE));
+    assert(uECC_verify_precompute(dfu_public_key, dfu_public_key_sum, ECC_CURVE));
+#endif
+    test_vectors();
+    test_invalid();
+    test_sign_verify();
+    test_dfu_key();
+    bench();
+    log_debug("ECC: PASS\n");
+}
@@ -0,0 +1,94 @@
+#include <string.h>
+#include "encode.h"
+#include "onmicro_dfu_decode.h"
+
+typedef struct {
+    uint8_t *out;
+    uint32_t len;
+    uint8_t bits;
+    uint8_t bit_cnt;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *w, uint32_t v, uint8_t n)
+{
+    while(n--){
+        w->bits = (w->bits << 1) | ((v >> n) & 1);
+        if(++w->bit_cnt == 8){
+            w->out[w->len++] = w->bits;
+            w->bits = w->bit_cnt = 0;
+        }
+    }
+}
+
+// Greedy heatshrink encoder, brute force match search
+uint32_t lz_encode(const uint8_t *in, uint32_t len, uint8_t *out, uint8_t window_sz2, uint8_t lookahead_sz2)
+{
+    bit_writer_t w = { out };
+    uint32_t i = 0, window = 1 << window_sz2, lookahead = 1 << lookahead_sz2;
+    while(i < len){
+        uint32_t best_len = 0, best_dist = 0, dist;
+        for(dist = 1; dist <= window && dist <= i; dist++){
+            uint32_t n = 0;
+            while(n < lookahead && i + n < len && in[i + n] == in[i + n - dist]){
+                n++;
+            }
+            if(n > best_len){
+                best_len = n;
+                best_dist = dist;
+            }
+        }
+        if(best_len * 9 > 1 + window_sz2 + lookahead_sz2){
+            put_bits(&w, 0, 1);
+            put_bits(&w, best_dist - 1, window_sz2);
+            put_bits(&w, best_len - 1, lookahead_sz2);
+            i += best_len;
+        }else{
+            put_bits(&w, 1, 1);
+            put_bits(&w, in[i++], 8);
+        }
+    }
+    if(w.bit_cnt){
+        put_bits(&w, 0, 8 - w.bit_cnt);
+    }
+    return w.len;
+}
+
+static void put_varint(delta_writer_t *w, uint32_t v)
+{
+    while(v >= 0x80){
+        w->out[w->len++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    w->out[w->len++] = v;
+}
+
+static void put_record(delta_writer_t *w, uint8_t op, uint32_t base_pos, uint32_t len)
+{
+    int32_t offset = base_pos - w->base_pos;
+    w->out[w->len++] = op;
+    put_varint(w, len);
+    put_varint(w, ((uint32_t)offset << 1) ^ (uint32_t)(offset >> 31));
+    w->base_pos = base_pos + len;
+}
+
+void delta_copy(delta_writer_t *w, uint32_t base_pos, uint32_t len)
+{
+    put_record(w, DFU_DELTA_OP_COPY, base_pos, len);
+}
+
+void delta_add(delta_writer_t *w, const uint8_t *base, uint32_t base_pos, const uint8_t *data, uint32_t len)
+{
+    uint32_t i;
+    put_record(w, DFU_DELTA_OP_ADD, base_pos, len);
+    for(i = 0; i < len; i++){
+        w->out[w->len++] = data[i] - base[base_pos + i];
+    }
+}
+
+void delta_insert(delta_writer_t *w, const uint8_t *data, uint32_t len)
+{
+    w->out[w->len++] = DFU_DELTA_OP_INSERT;
+    put_varint(w, len);
+    memcpy(&w->out[w->len], data, len);
+    w->len += len;
+}
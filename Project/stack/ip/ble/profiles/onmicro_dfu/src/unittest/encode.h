@@ -0,0 +1,19 @@
+#ifndef __ENCODE_H__
+#define __ENCODE_H__
+#include <stdint.h>
+
+// Reference encoders for the image encodings in onmicro_dfu_decode.h
+
+uint32_t lz_encode(const uint8_t *in, uint32_t len, uint8_t *out, uint8_t window_sz2, uint8_t lookahead_sz2);
+
+typedef struct {
+    uint8_t *out;
+    uint32_t len;
+    uint32_t base_pos;
+} delta_writer_t;
+
+void delta_copy(delta_writer_t *w, uint32_t base_pos, uint32_t len);
+void delta_add(delta_writer_t *w, const uint8_t *base, uint32_t base_pos, const uint8_t *data, uint32_t len);
+void delta_insert(delta_writer_t *w, const uint8_t *data, uint32_t len);
+
+#endif
@@ -1,7 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
 #include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "onmicro_dfu.h"
 #include "onmicro_dfu_nvds.h"
+#include "onmicro_dfu_decode.h"
 #include "utils.h"
+#include "encode.h"
+#if DFU_CTRL_SIGN_EN
+#include "sha256.h"
+#endif
 
 
 typedef struct {
@@ -44,6 +52,7 @@ void test(char *filename_data, char *filename_bin)
     for(i=0;i<data_size;i+=dfu_env.mtu-3){
         dfu_response_t rsp = test_write_data(&bin_data[i], data_size-i<dfu_env.mtu-3?data_size-i:dfu_env.mtu-3);
         crc = dfu_crc32(&bin_data[i], data_size-i<dfu_env.mtu-3?data_size-i:dfu_env.mtu-3, &crc);
+        dfu_flash_process(); // ONMICRO_DFU_FLASH_IND between two writes
         if(rsp.length){
             assert(crc == rsp.data.checksum.crc32);
         }
@@ -54,17 +63,291 @@ void test(char *filename_data, char *filename_bin)
             data_size, crc, rsp.data.checksum.offset, rsp.data.checksum.crc32);
     assert(data_size == rsp.data.checksum.offset);
     assert(crc == rsp.data.checksum.crc32);
+    // Execute validates the data object, digests are calculated while receiving
+    clock_t t = clock();
     test_write_cmd((uint8_t*)"\x04", 1);
+    t = clock() - t;
+    log_debug("Execute %d bytes: %.3f ms (DFU_VERIFY_READBACK_EN:%d)\n",
+            data_size, t * 1000.0 / CLOCKS_PER_SEC, DFU_VERIFY_READBACK_EN);
     free(bin_data);
 }
 
+// Encoded images: command packet with the encoding table, data object of encoded images
+#define ENC_IMG_ADDR   0x00035000 // new APP address while the installed one is at 0x3000
+#define ENC_IMG_SIZE   0x10000
+
+extern void nvds_install_image(uint8_t type, uint32_t addr, const uint8_t *data, uint32_t len);
+extern const uint8_t *nvds_flash(uint32_t addr);
+extern uint32_t nvds_read_bytes;
+
+// Delta base read by the write handlers and by the longest ONMICRO_DFU_FLASH_IND step
+static uint32_t enc_write_read, enc_step_read_max;
+
+static uint32_t enc_cmd_build(uint8_t *cmd, uint32_t img_size, uint8_t encoding, uint8_t window_sz2, uint8_t lookahead_sz2,
+                              uint32_t data_size, const uint8_t *base, uint32_t base_size)
+{
+    uint32_t hdr[3] = { 0x01BFDF55, DFU_PROTOCOL_VERSION, 1 << 16 | DFU_CTRL_BIT_ENCODED }; // mark, version, img_cnt|ctrl
+    uint32_t img[3] = { IMAGE_TYPE_APP, 1, img_size };
+    uint32_t enc[3] = { encoding | window_sz2 << 8 | lookahead_sz2 << 12, data_size, base_size };
+    if(base){
+        enc[0] |= (uint32_t)co_crc16_ccitt(0, base, base_size) << 16;
+    }
+    memcpy(cmd, hdr, sizeof(hdr));
+    memcpy(cmd + 12, img, sizeof(img));
+    memcpy(cmd + 24, enc, sizeof(enc));
+    return 36;
+}
+
+// Returns the execute result of the data object, or of the command object if that failed
+static uint8_t enc_transfer(uint8_t *cmd, uint32_t cmd_size, uint8_t *data, uint32_t data_size)
+{
+    uint32_t i, n;
+    uint8_t create[6] = { 0x01, 0x01, cmd_size, cmd_size >> 8 };
+    test_write_cmd((uint8_t*)"\x06\x01", 2);
+    test_write_cmd(create, sizeof(create));
+    test_write_data(cmd, cmd_size);
+    dfu_response_t rsp = test_write_cmd((uint8_t*)"\x04", 1);
+    if(rsp.result != DFU_SUCCESS){
+        return rsp.result;
+    }
+    test_write_cmd((uint8_t*)"\x06\x02", 2);
+    create[1] = 0x02; create[2] = data_size; create[3] = data_size >> 8; create[4] = data_size >> 16;
+    test_write_cmd(create, sizeof(create));
+    enc_write_read = enc_step_read_max = 0;
+    for(i=0;i<data_size;i+=n){
+        n = data_size-i<dfu_env.mtu-3?data_size-i:dfu_env.mtu-3;
+        uint32_t rd = nvds_read_bytes;
+        test_write_data(&data[i], n);
+        enc_write_read += nvds_read_bytes - rd;
+        do{ // ONMICRO_DFU_FLASH_IND is sent again while work is left, before the next packet
+            rd = nvds_read_bytes;
+            dfu_flash_process();
+            if(nvds_read_bytes - rd > enc_step_read_max){
+                enc_step_read_max = nvds_read_bytes - rd;
+            }
+        }while(dfu_flash_pending() && rand() % 4);
+    }
+    rsp = test_write_cmd((uint8_t*)"\x04", 1);
+    return rsp.result;
+}
+
+// Firmware-like: short repeats of recent code between literal bytes
+static void enc_img_fill(uint8_t *p, uint32_t len, uint32_t seed)
+{
+    uint32_t i = 0;
+    srand(seed);
+    while(i < len){
+        if(i > 64 && rand() % 3 == 0){
+            uint32_t n = 4 + rand() % 24, dist = 1 + rand() % (i < 900 ? i : 900);
+            while(n-- && i < len){ p[i] = p[i - dist]; i++; }
+        }else{
+            p[i++] = rand() % 32;
+        }
+    }
+}
+
+// The new image: the old one with code inserted, removed and addresses shifted
+static uint32_t enc_delta_build(delta_writer_t *w, const uint8_t *base, uint8_t *img)
+{
+    static uint8_t ins[300];
+    uint32_t i;
+    enc_img_fill(ins, sizeof(ins), 7);
+    w->len = w->base_pos = 0;
+    memcpy(img, base, 0x2000);                            delta_copy(w, 0, 0x2000);
+    memcpy(img + 0x2000, ins, sizeof(ins));               delta_insert(w, ins, sizeof(ins));
+    for(i=0;i<0x1000;i++){ img[0x2000+sizeof(ins)+i] = base[0x2000+i] + (i % 16 == 0 ? 4 : 0); }
+    delta_add(w, base, 0x2000, img + 0x2000 + sizeof(ins), 0x1000);
+    memcpy(img + 0x3000 + sizeof(ins), base + 0x3200, ENC_IMG_SIZE - 0x3200); // 0x200 removed
+    delta_copy(w, 0x3200, ENC_IMG_SIZE - 0x3200);
+    return ENC_IMG_SIZE - 0x3200 + 0x3000 + sizeof(ins);
+}
+
+static void enc_check_flash(const uint8_t *img, uint32_t size)
+{
+    dfu_image_mbr_info info;
+    uint32_t len = sizeof(info);
+    assert(memcmp(nvds_flash(ENC_IMG_ADDR), img, size) == 0);
+    dfu_nvds_itf[DFU_NVDS_ITF_TYPE_MBR].get(IMAGE_TYPE_APP, &len, &info);
+    assert(info.address == ENC_IMG_ADDR && info.length == size && info.crc16 == co_crc16_ccitt(0, img, size));
+}
+
+static void test_enc_case(int n)
+{
+    static uint8_t base[ENC_IMG_SIZE], img[ENC_IMG_SIZE], lz[ENC_IMG_SIZE * 2], delta[ENC_IMG_SIZE * 2];
+    uint8_t cmd[64];
+    uint32_t cmd_size, img_size, lz_size;
+    delta_writer_t w = { delta };
+    extern void nvds_init(void);
+    nvds_init();
+    dfu_env.mtu = (rand() % 500) + 23;
+    enc_img_fill(base, sizeof(base), 1);
+    switch(n){
+        case 0: // LZ
+            enc_img_fill(img, sizeof(img), 2);
+            lz_size = lz_encode(img, sizeof(img), lz, 10, 4);
+            cmd_size = enc_cmd_build(cmd, sizeof(img), DFU_IMG_ENC_LZ, 10, 4, lz_size, NULL, 0);
+            assert(enc_transfer(cmd, cmd_size, lz, lz_size) == DFU_SUCCESS);
+            enc_check_flash(img, sizeof(img));
+            log_debug("ENC LZ: %d -> %d bytes\n", (int)sizeof(img), lz_size);
+            break;
+        case 1: // DELTA
+            nvds_install_image(IMAGE_TYPE_APP, 0x3000, base, sizeof(base));
+            img_size = enc_delta_build(&w, base, img);
+            cmd_size = enc_cmd_build(cmd, img_size, DFU_IMG_ENC_DELTA, 0, 0, w.len, base, sizeof(base));
+            assert(enc_transfer(cmd, cmd_size, delta, w.len) == DFU_SUCCESS);
+            enc_check_flash(img, img_size);
+            // A COPY of 0xCE00 bytes is decoded in steps, not in the write handler
+            assert(enc_step_read_max <= DFU_DECODE_STEP_SIZE && enc_write_read < img_size / 4);
+            log_debug("ENC DELTA: %d -> %d bytes, base read in writes %d, per step %d\n", img_size, w.len, enc_write_read, enc_step_read_max);
+            break;
+        case 2: // LZ + DELTA
+            nvds_install_image(IMAGE_TYPE_APP, 0x3000, base, sizeof(base));
+            img_size = enc_delta_build(&w, base, img);
+            lz_size = lz_encode(delta, w.len, lz, 8, 4);
+            cmd_size = enc_cmd_build(cmd, img_size, DFU_IMG_ENC_LZ | DFU_IMG_ENC_DELTA, 8, 4, lz_size, base, sizeof(base));
+            assert(enc_transfer(cmd, cmd_size, lz, lz_size) == DFU_SUCCESS);
+            enc_check_flash(img, img_size);
+            log_debug("ENC LZ+DELTA: %d -> %d bytes\n", img_size, lz_size);
+            break;
+        case 3: // Delta against another image
+            nvds_install_image(IMAGE_TYPE_APP, 0x3000, base, sizeof(base));
+            img_size = enc_delta_build(&w, base, img);
+            base[0] ^= 1;
+            cmd_size = enc_cmd_build(cmd, img_size, DFU_IMG_ENC_DELTA, 0, 0, w.len, base, sizeof(base));
+            dfu_end_status = DFU_UPDATE_ST_FAILED;
+            assert(enc_transfer(cmd, cmd_size, delta, w.len) == DFU_VERSION_NOT_MATCH);
+            break;
+        case 4: // LZ window larger than the decoder buffer
+            cmd_size = enc_cmd_build(cmd, sizeof(img), DFU_IMG_ENC_LZ, DFU_LZ_WINDOW_SZ2_MAX + 1, 4, 100, NULL, 0);
+            dfu_end_status = DFU_UPDATE_ST_FAILED;
+            assert(enc_transfer(cmd, cmd_size, lz, 100) == DFU_INSUFFICIENT_RESOURCES);
+            break;
+        case 5: // Truncated LZ stream
+            enc_img_fill(img, sizeof(img), 3);
+            lz_size = lz_encode(img, sizeof(img), lz, 10, 4) - 16;
+            cmd_size = enc_cmd_build(cmd, sizeof(img), DFU_IMG_ENC_LZ, 10, 4, lz_size, NULL, 0);
+            dfu_end_status = DFU_UPDATE_ST_FAILED;
+            assert(enc_transfer(cmd, cmd_size, lz, lz_size) == DFU_INVALID_OBJECT);
+            break;
+    }
+}
+
+// A successful update locks DFU until reboot, run each case in its own process
+void test_encoded(void)
+{
+    int n, status;
+    for(n=0;n<6;n++){
+        pid_t pid = fork();
+        if(pid == 0){
+            test_enc_case(n);
+            exit(0);
+        }
+        waitpid(pid, &status, 0);
+        log_debug("ENC case %d: %s\n", n, WIFEXITED(status) && WEXITSTATUS(status) == 0 ? "PASS" : "FAIL");
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+}
+
+#if DFU_CTRL_SIGN_EN
+#define SIGN_IMG_SIZE  0x8000
+#define SIGN_CMD_SIZE  (24 + SHA256_BLOCK_SIZE + 48)
+
+extern void ecc_test_sign(const uint8_t *data, uint32_t len, uint8_t *sig);
+
+// One APP image, the sha256 of the image, then the signature of all before it
+static uint32_t sign_cmd_build(uint8_t *cmd, const uint8_t *img, uint32_t img_size)
+{
+    uint32_t hdr[3] = { 0x01BFDF55, DFU_PROTOCOL_VERSION, 1 << 16 | DFU_CTRL_BIT_SIGN }; // mark, version, img_cnt|ctrl
+    uint32_t info[3] = { IMAGE_TYPE_APP, 1, img_size };
+    SHA256_CTX ctx;
+    memcpy(cmd, hdr, sizeof(hdr));
+    memcpy(cmd + 12, info, sizeof(info));
+    sha256_init(&ctx);
+    sha256_update(&ctx, img, img_size);
+    sha256_final(&ctx, cmd + 24);
+    ecc_test_sign(cmd, 24 + SHA256_BLOCK_SIZE, cmd + 24 + SHA256_BLOCK_SIZE);
+    return SIGN_CMD_SIZE;
+}
+
+static void test_sign_case(int n)
+{
+    static uint8_t img[SIGN_IMG_SIZE];
+    uint8_t cmd[SIGN_CMD_SIZE];
+    dfu_response_t rsp = {0};
+    extern void nvds_init(void);
+    nvds_init();
+    dfu_env.mtu = (rand() % 500) + 23;
+    enc_img_fill(img, sizeof(img), 8);
+    sign_cmd_build(cmd, img, sizeof(img));
+    switch(n){
+        case 0: // Signed package
+            assert(enc_transfer(cmd, sizeof(cmd), img, sizeof(img)) == DFU_SUCCESS);
+            enc_check_flash(img, sizeof(img));
+            break;
+        case 1: // Command object changed after signing
+            cmd[16] ^= 1; // image version
+            dfu_end_status = DFU_UPDATE_ST_FAILED;
+            assert(enc_transfer(cmd, sizeof(cmd), img, sizeof(img)) == DFU_OPERATION_NOT_PERMITTED);
+            break;
+        case 2: // Bad signature
+            cmd[sizeof(cmd) - 1] ^= 0x80;
+            dfu_end_status = DFU_UPDATE_ST_FAILED;
+            assert(enc_transfer(cmd, sizeof(cmd), img, sizeof(img)) == DFU_OPERATION_NOT_PERMITTED);
+            break;
+        case 3: // Image changed, the signed hash does not match
+            img[sizeof(img) / 2] ^= 1;
+            dfu_end_status = DFU_UPDATE_ST_FAILED;
+            assert(enc_transfer(cmd, sizeof(cmd), img, sizeof(img)) == DFU_OPERATION_NOT_PERMITTED);
+            break;
+        case 4: // Control write while the signature is verified
+            dfu_write_cmd((uint8_t*)"\x06\x01", 2, &rsp);
+            dfu_write_cmd((uint8_t*)"\x01\x01\x68\x00\x00\x00", 6, &rsp);
+            test_write_data(cmd, sizeof(cmd));
+            dfu_write_cmd((uint8_t*)"\x04", 1, &rsp);
+            assert(rsp.length == DFU_RESP_SIZE_NO_DATA && dfu_sign_pending());
+            assert(!dfu_sign_process(&rsp));
+            dfu_end_status = DFU_UPDATE_ST_FAILED;
+            dfu_write_cmd((uint8_t*)"\x06\x01", 2, &rsp);
+            assert(rsp.result == DFU_OPERATION_NOT_PERMITTED && !dfu_sign_pending());
+            break;
+    }
+}
+
+// A successful update locks DFU until reboot, run each case in its own process
+void test_signed(void)
+{
+    int n, status;
+    for(n=0;n<5;n++){
+        pid_t pid = fork();
+        if(pid == 0){
+            test_sign_case(n);
+            exit(0);
+        }
+        waitpid(pid, &status, 0);
+        log_debug("SIGN case %d: %s\n", n, WIFEXITED(status) && WEXITSTATUS(status) == 0 ? "PASS" : "FAIL");
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+}
+#endif
+
 int main(int argc, char *argv[])
 {
+    extern int dfu_bench(int argc, char *argv[]);
+    if(argc > 1 && !strcmp(argv[1], "--bench")){
+        return dfu_bench(argc - 2, argv + 2);
+    }
+    extern void test_ecc(void);
+    srand(time(0));
+    test_ecc();
+#if DFU_CTRL_SIGN_EN
+    test_signed();
+    return 0; // x.dat and the packages below are not signed
+#endif
     if(argc <= 2){ log_debug("Usage: Exec x.dat x.bin\n"); return -1; }
     char *filename_data = argv[1];
     char *filename_bin = argv[2];
     int i, j;
-    srand(time(0));
+    test_encoded();
     for(i=0;i<100;i++){
         for(j=0;j<=30;j+=10){
             dfu_env.mtu = (rand() % 500) + 23;
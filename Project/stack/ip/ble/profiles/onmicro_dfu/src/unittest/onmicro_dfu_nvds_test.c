@@ -12,6 +12,11 @@
 #define CFG_SIZE_BYTE       (1 << 20)
 static uint8_t flash[FLASH_SIZE_BYTE];
 static uint8_t ext_flash[EXT_FLASH_SIZE_BYTE];
+static dfu_image_mbr_info mbr_parts[0x100];
+// Simulated flash timing, 0 for the tests. Programming and erasing add to nvds_flash_busy_ns.
+uint32_t nvds_flash_prog_ns_per_byte;
+uint32_t nvds_flash_erase_ns_per_sector;
+uint64_t nvds_flash_busy_ns;
 //static uint8_t mbr[MBR_SIZE_BYTE];
 //static uint8_t cfg[CFG_SIZE_BYTE];
 
@@ -37,27 +42,35 @@ void nvds_init(void)
 {
     memset(flash, 0xFF, FLASH_SIZE_BYTE);
     memset(ext_flash, 0xFF, FLASH_SIZE_BYTE);
+    memset(mbr_parts, 0, sizeof(mbr_parts));
 }
 
 static uint8_t onmicro_dfu_nvds_enable(void)
 {
     return ONMICRO_DFU_NVDS_ST_SUCCESS;
 }
+uint32_t nvds_read_bytes; // flash reads, e.g. the delta base
 static uint8_t onmicro_dfu_nvds_get_flash(uint32_t addr, uint32_t *lengthPtr, void *buf)
 {
     assert(addr+*lengthPtr<FLASH_SIZE_BYTE);
     memcpy(buf, &flash[addr], *lengthPtr);
+    nvds_read_bytes += *lengthPtr;
     return ONMICRO_DFU_NVDS_ST_SUCCESS;
 }
 static uint8_t onmicro_dfu_nvds_put_flash(uint32_t addr, uint32_t length, void *buf)
 {
     assert(addr+length<FLASH_SIZE_BYTE);
-    memcpy(&flash[addr], buf, length);
+    uint32_t i;
+    nvds_flash_busy_ns += (uint64_t)length * nvds_flash_prog_ns_per_byte;
+    for(i=0;i<length;i++){ // Like NOR flash, programming only clears bits: catches writes before erase
+        flash[addr+i] &= ((uint8_t*)buf)[i];
+    }
     return ONMICRO_DFU_NVDS_ST_SUCCESS;
 }
 static uint8_t onmicro_dfu_nvds_erase_flash(uint32_t addr, uint32_t length)
 {
     assert(addr+length<FLASH_SIZE_BYTE);
+    nvds_flash_busy_ns += (uint64_t)((addr + length + 0xFFF) / 0x1000 - addr / 0x1000) * nvds_flash_erase_ns_per_sector;
     memset(&flash[addr], 0xFF, length);
     return ONMICRO_DFU_NVDS_ST_SUCCESS;
 }
@@ -65,8 +78,30 @@ static uint8_t onmicro_dfu_nvds_disable(void)
 {
     return ONMICRO_DFU_NVDS_ST_SUCCESS;
 }
-int mbr_read_part(uint8_t id, uint32_t *addr, uint32_t *length, uint16_t *crc16){ *addr = 0x3000; return 0; }
-int mbr_write_part(uint8_t id, uint32_t addr, uint32_t length, uint16_t crc16){ return 0; }
+int mbr_read_part(uint8_t id, uint32_t *addr, uint32_t *length, uint16_t *crc16)
+{
+    *addr = mbr_parts[id].address ? mbr_parts[id].address : 0x3000;
+    *length = mbr_parts[id].length;
+    *crc16 = mbr_parts[id].crc16;
+    return 0;
+}
+int mbr_write_part(uint8_t id, uint32_t addr, uint32_t length, uint16_t crc16)
+{
+    mbr_parts[id].address = addr;
+    mbr_parts[id].length = length;
+    mbr_parts[id].crc16 = crc16;
+    return 0;
+}
+// Pretend an image is installed, as the base of a delta update
+void nvds_install_image(uint8_t type, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    memcpy(&flash[addr], data, len);
+    mbr_write_part(mbr_types[type], addr, len, co_crc16_ccitt(0, data, len));
+}
+const uint8_t *nvds_flash(uint32_t addr)
+{
+    return &flash[addr];
+}
 static uint8_t onmicro_dfu_nvds_get_mbr(uint32_t id, uint32_t *lengthPtr, void *buf)
 {
     dfu_image_mbr_info *info = (dfu_image_mbr_info*)buf;
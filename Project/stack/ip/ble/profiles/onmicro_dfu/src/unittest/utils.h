@@ -77,9 +77,10 @@ static void dfu_prog_cb(uint8_t status, void *p)
 {
     //log_debug("%s@%d\n", __func__, __LINE__);
 }
+static uint8_t dfu_end_status = DFU_UPDATE_ST_SUCCESS; // expected
 static void dfu_end_cb(uint8_t status, void *p)
 {
-    assert(status == DFU_UPDATE_ST_SUCCESS);
+    assert(status == dfu_end_status);
     log_debug("%s status:%d\n", __func__, status);
 }
 
@@ -88,6 +89,7 @@ static dfu_response_t test_write_cmd(uint8_t *cmd, int len)
     dfu_response_t dfu_rsp_data = {0};
     log_debug("<<< "); hexdump(cmd, len);
     dfu_write_cmd(cmd, len, &dfu_rsp_data);
+    while(dfu_sign_pending() && !dfu_sign_process(&dfu_rsp_data)); // ONMICRO_DFU_SIGN_IND until the response
     log_debug(">>> "); hexdump(&dfu_rsp_data.rsp_code, dfu_rsp_data.length);
     return dfu_rsp_data;
 }
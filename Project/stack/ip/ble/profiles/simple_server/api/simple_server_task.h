@@ -45,7 +45,8 @@
 ///Maximal number of SIMPLE_SERVER that can be added in the DB
 #define SIMPLE_SERVER_NB_INSTANCES_MAX         (1)
 
-#define SIMPLE_SERVER_MAX_CHAC_LEN    20
+/// Characteristic value length, one notification at MTU 247
+#define SIMPLE_SERVER_MAX_CHAC_LEN    244
 
 
 /*
@@ -118,7 +119,8 @@ struct simple_server_send_ntf_cmd
 };
 
 
-void enable_notification(uint8_t enable);
+/// Force the notification configuration of one link, the APP is told with SIMPLE_SERVER_NTF_CFG_IND
+void enable_notification(uint8_t conidx, uint8_t enable);
 
 /// @} SIMPLE_SERVERSTASK
 
@@ -52,6 +52,11 @@ const struct attm_desc_128 simple_server_att_db[SIMPLE_SERVER_IDX_NB] =
     [SIMPLE_SERVER_IDX_DEMO_CHAR2]        =   {ATT_16_TO_128_ARRAY(ATT_DECL_CHARACTERISTIC),   PERM(RD, ENABLE), 0, 0},
     // Characteristic Value
     [SIMPLE_SERVER_IDX_DEMO_VAL2]         =   {ATT_SVC_SIMPLE_SERVER_CHAC2,    PERM(RD, ENABLE) | PERM(WRITE_REQ, ENABLE), PERM(UUID_LEN, UUID_128), SIMPLE_SERVER_MAX_CHAC_LEN},
+
+    // Characteristic Declaration
+    [SIMPLE_SERVER_IDX_CMD_CHAR]          =   {ATT_16_TO_128_ARRAY(ATT_DECL_CHARACTERISTIC),   PERM(RD, ENABLE), 0, 0},
+    // Characteristic Value
+    [SIMPLE_SERVER_IDX_CMD_VAL]           =   {ATT_SVC_SIMPLE_SERVER_CHAC3,    PERM(WRITE_COMMAND, ENABLE), PERM(UUID_LEN, UUID_128), SIMPLE_SERVER_MAX_CHAC_LEN},
 };
 
 /*
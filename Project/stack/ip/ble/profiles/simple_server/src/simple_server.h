@@ -40,6 +40,8 @@
 #define ATT_SVC_SIMPLE_SERVER_SERVICE {0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0xB0, 0xFF, 0x00, 0x00}
 #define ATT_SVC_SIMPLE_SERVER_CHAC1   {0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0xB2, 0xFF, 0x00, 0x00}
 #define ATT_SVC_SIMPLE_SERVER_CHAC2   {0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0xB1, 0xFF, 0x00, 0x00}
+/// Command characteristic, Write Without Response, first byte of each write is a sequence number
+#define ATT_SVC_SIMPLE_SERVER_CHAC3   {0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0xB3, 0xFF, 0x00, 0x00}
 
 
 ///Maximum number of Server task instances
@@ -74,6 +76,9 @@ enum
     SIMPLE_SERVER_IDX_DEMO_CHAR2,
     SIMPLE_SERVER_IDX_DEMO_VAL2,
 
+    SIMPLE_SERVER_IDX_CMD_CHAR,
+    SIMPLE_SERVER_IDX_CMD_VAL,
+
     SIMPLE_SERVER_IDX_NB,
 };
 
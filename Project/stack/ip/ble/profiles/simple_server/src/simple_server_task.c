@@ -120,7 +120,8 @@ __STATIC int gattc_att_info_req_ind_handler(ke_msg_id_t const msgid,
             // CCC attribute length = 2
             cfm->length = sizeof(uint16_t);
         }
-        else if(att_idx == SIMPLE_SERVER_IDX_DEMO_VAL1 || att_idx == SIMPLE_SERVER_IDX_DEMO_VAL2)
+        else if(att_idx == SIMPLE_SERVER_IDX_DEMO_VAL1 || att_idx == SIMPLE_SERVER_IDX_DEMO_VAL2
+                || att_idx == SIMPLE_SERVER_IDX_CMD_VAL)
         {
             cfm->length = SIMPLE_SERVER_MAX_CHAC_LEN;
         }
@@ -149,6 +150,8 @@ __STATIC int gattc_att_info_req_ind_handler(ke_msg_id_t const msgid,
  * @return If the message was consumed or not.
  ****************************************************************************************
  */
+#include "protocol.h"
+#include "app_simple_server.h"
 #include "main.h"
 __STATIC int gattc_write_req_ind_handler(ke_msg_id_t const msgid, struct gattc_write_req_ind const *param,
                                       ke_task_id_t const dest_id, ke_task_id_t const src_id)
@@ -192,7 +195,14 @@ __STATIC int gattc_write_req_ind_handler(ke_msg_id_t const msgid, struct gattc_w
             log_debug("Offset:%2d. ", param->offset);   
             log_debug_array_ex("write data", param->value, param->length); 
 					
-						for(int i = 0; i < param->length; i++) QUEUE_WRITE(BLE_Rx, param->value[i]);  // 20210525
+            protocol_rx_write(conidx, param->value, param->length);  // parse and execute in place, replies go back to conidx
+            app_event_set(APP_EVENT_STIM);
+        }
+        else if (att_idx == SIMPLE_SERVER_IDX_CMD_VAL)
+        {
+            // Write Without Response: seq + frames, the ACK packets carry the seq back
+            protocol_rx_write_seq(conidx, param->value, param->length);
+            app_event_set(APP_EVENT_STIM);
         }
         else
         {
@@ -293,17 +303,21 @@ __STATIC int gattc_cmp_evt_handler(ke_msg_id_t const msgid,  struct gattc_cmp_ev
                                  ke_task_id_t const dest_id, ke_task_id_t const src_id)
 {
     log_debug("%s msgid=0x%04x, operation=%d, status=%d\n", __func__, msgid, param->operation, param->status);
+    if(param->operation == GATTC_NOTIFY || param->operation == GATTC_INDICATE)
+        app_simple_server_tx_cmp(KE_IDX_GET(src_id));  // credit back to the TX scheduler of that link
     return (KE_MSG_CONSUMED);
 }
 
 __STATIC int simple_server_send_ntf_cmd_handler(ke_msg_id_t const msgid,  struct simple_server_send_ntf_cmd const *param,
                                  ke_task_id_t const dest_id, ke_task_id_t const src_id)
 {
-    uint8_t conidx = KE_IDX_GET(src_id);
+    // Sent by the APP task, the target link is in the message
+    uint8_t conidx = param->conidx;
     struct simple_server_env_tag* simple_server_env = PRF_ENV_GET(SIMPLE_SERVER, simple_server);
    
 //		printf("8888888\r\n");
-		if(!(simple_server_env->ntf_cfg[conidx] == PRF_CLI_START_NTF || simple_server_env->ntf_cfg[conidx] == PRF_CLI_START_IND)){
+		if(conidx >= BLE_CONNECTION_MAX || !(simple_server_env->ntf_cfg[conidx] == PRF_CLI_START_NTF || simple_server_env->ntf_cfg[conidx] == PRF_CLI_START_IND)){
+        app_simple_server_tx_cmp(conidx);  // not sent, no GATTC_CMP_EVT will come
         return (KE_MSG_CONSUMED);
     }
 	
@@ -311,7 +325,7 @@ __STATIC int simple_server_send_ntf_cmd_handler(ke_msg_id_t const msgid,  struct
     uint16_t att_handle = simple_server_get_att_handle(SIMPLE_SERVER_IDX_DEMO_VAL1);
     // Send the indication
     struct gattc_send_evt_cmd *req = KE_MSG_ALLOC_DYN(GATTC_SEND_EVT_CMD,
-            TASK_GATTC, dest_id, gattc_send_evt_cmd, param->length);
+            KE_BUILD_ID(TASK_GATTC, conidx), dest_id, gattc_send_evt_cmd, param->length);
     // Fill in the parameter structure
     if(simple_server_env->ntf_cfg[conidx] == PRF_CLI_START_NTF){
         req->operation = GATTC_NOTIFY;
@@ -363,11 +377,8 @@ void simple_server_task_init(struct ke_task_desc *task_desc)
 }
 
 
-void enable_notification(uint8_t enable)
+void enable_notification(uint8_t conidx, uint8_t enable)
 {
-
-	uint8_t conidx = 0; 
-
 	struct simple_server_env_tag* simple_server_env = PRF_ENV_GET(SIMPLE_SERVER, simple_server);
 
 //	uint16_t ntf_cfg = PRF_CLI_START_NTF; 